@@ -106,6 +106,8 @@ template <class T> T_Status C_DDI_Crawler<T>::Download_Index(T_Filename folder,
     T_Glyph_Ptr             values[] = { "", "", "", "", "", "", "", "", "", "",  };
     T_Glyph                 buffer[1000], url[1000];
 
+    x_Profile_Timer(Get_Term(), "download_index", Get_Pool());
+
     /* Get the number of retrievals we need to make for this type and go through
         them one by one
     */
@@ -118,9 +120,14 @@ template <class T> T_Status C_DDI_Crawler<T>::Download_Index(T_Filename folder,
             }
         Log_Message(buffer, true);
 
-        /* Get the filename of the index we'll be using
+        /* Get the filename of the index we'll be using - if we already got
+            it before we were interrupted last time, we can use that
         */
         sprintf(buffer, INDEX_FILENAME, folder, m_tab_name, i);
+        if (Journal_Is_Index_Current(buffer)) {
+            Log_Message("done (already downloaded).\n", true);
+            continue;
+            }
 
         /* Get the URL and post parameters to use for the retrieval
         */
@@ -144,6 +151,7 @@ template <class T> T_Status C_DDI_Crawler<T>::Download_Index(T_Filename folder,
             Log_Message("Couldn't write index file.");
             x_Status_Return(status);
             }
+        Journal_Record_Index(buffer);
         Log_Message("done.\n", true);
         }
 
@@ -161,6 +169,8 @@ template <class T> T_Status C_DDI_Crawler<T>::Read_Index(T_Filename folder)
     T_XML_Node              root;
     T_Glyph                 buffer[1000], message[1000];
 
+    x_Profile_Timer(Get_Term(), "read_index", Get_Pool());
+
     sprintf(buffer, "Processing %s index... ", Get_Term());
     Log_Message(buffer, true);
 
@@ -532,11 +542,14 @@ static void Get_Page_URL(T_Glyph_Ptr buffer, T_Filename filename, T_Filename fol
 template <class T> T_Status C_DDI_Crawler<T>::Download_Content(T_Filename folder, T_WWW internet)
 {
     T_Int32U        i, count, retries;
+    bool            is_ok;
     T *             info;
     T_Filename      filename;
     T_Glyph         url[500], buffer[500];
     T_Failed        failed;
 
+    x_Profile_Timer(Get_Term(), "download_content", Get_Pool());
+
     sprintf(buffer, "Downloading approx. %lu %s entries...\n", Get_List()->size(), Get_Term());
     Log_Message(buffer, true);
 
@@ -571,8 +584,15 @@ template <class T> T_Status C_DDI_Crawler<T>::Download_Content(T_Filename folder
             continue;
             }
 
+        /* If we already got this page before we were interrupted last time,
+            there's no need to get it again
+        */
+        if (Journal_Is_Downloaded(filename))
+            continue;
+
         /* Try to download the page several times, in case the first time fails
         */
+        is_ok = false;
         for (retries = 0; retries < MAX_RETRIES; retries++) {
             if (retries > 0)
                 Log_Message("Retry...\n");
@@ -583,12 +603,17 @@ template <class T> T_Status C_DDI_Crawler<T>::Download_Content(T_Filename folder
                 because there was some serious problem that indicates it can't
                 be downloaded at all.
             */
-            if (Download_Page(internet, info, url, filename))
+            is_ok = Download_Page(internet, info, url, filename);
+            if (is_ok)
                 break;
             if (info->is_partial)
                 break;
             Pause_Execution(10000); // 10s
             }
+        if (is_ok)
+            l_crawl_stats.fetched++;
+        if (is_ok || (retries >= MAX_RETRIES))
+            Journal_Record_Download(filename, is_ok);
 
         /* If we failed because of too many retries, add this page to a list to
             try and grab later, once we've finished
@@ -617,6 +642,8 @@ template <class T> T_Status C_DDI_Crawler<T>::Read_Content(T_Filename folder)
     vector<T>       extras;
     T_Glyph         url[500], buffer[500];
 
+    x_Profile_Timer(Get_Term(), "read_content", Get_Pool());
+
     sprintf(buffer, "Reading %s entries... ", Get_Term());
     Log_Message(buffer, true);
 
@@ -670,11 +697,13 @@ template <class T> T_Status C_DDI_Crawler<T>::Read_Content(T_Filename folder)
             often invalid XML). Just parse it as text.
         */
         extras.clear();
-        status = Parse_Entry_Details(contents, info, detail, checkpoint, &extras);
+        x_Profile_Trace(Get_Term(), "Parse_Entry_Details", info->name,
+                        status = Parse_Entry_Details(contents, info, detail, checkpoint, &extras));
         if (x_Trap_Opt(!x_Is_Success(status))) {
             info->is_partial = true;
             goto next_power;
             }
+        l_crawl_stats.parsed++;
 
         /* If any extra info entries need to be added, do so and adjust our
             position and count - we assume they're already processed here, but
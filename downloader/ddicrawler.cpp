@@ -50,11 +50,27 @@
 vector<T_Mapping *> l_mappings;
 
 
+/* Index of the mappings by unique id
+*/
+static map<T_Unique, T_Mapping *>   l_mapping_index;
+
+
+/* Incremented whenever a mapping entry is added, so that anything caching the
+    results of mapping lookups knows when to discard them
+*/
+static T_Int32U     l_mapping_generation = 0;
+
+
 /* Vector that holds a list of URLs that weren't retrieved properly
 */
 vector<T_Failed>   l_failed_downloads;
 
 
+/* Counts of what happened during the crawl
+*/
+T_Crawl_Stats       l_crawl_stats;
+
+
 /* Typedef out horrible types to something a lot nicer
 */
 typedef vector<C_DDI_Common *>::iterator ddi_iter;
@@ -78,6 +94,51 @@ enum E_Query_Mode {
     e_mode_exit,
 };
 
+static T_Glyph_Ptr  l_mode_names[] = {
+    "download", "download_password", "process", "append", "delete", "restore", "none",
+};
+
+
+/* Define the phases of a crawl, which are timed separately so a batch run can
+    report where the time went
+*/
+enum E_Phase {
+    e_phase_prepare,
+    e_phase_login,
+    e_phase_download_index,
+    e_phase_read_index,
+    e_phase_download_content,
+    e_phase_read_content,
+    e_phase_process,
+    e_phase_post_process,
+    e_phase_extensions,
+    e_phase_write,
+    e_phase_count,
+    e_phase_none = e_phase_count,
+};
+
+static T_Glyph_Ptr  l_phase_names[e_phase_count] = {
+    "prepare", "login", "download_index", "read_index", "download_content",
+    "read_content", "process", "post_process", "extensions", "write",
+};
+
+
+/* Define the exit codes for a batch run, so whatever started us can tell what
+    happened without reading the log
+*/
+enum E_Exit_Code {
+    e_exit_success = 0,
+    e_exit_incomplete = 1,      // finished, but some entries couldn't be downloaded
+    e_exit_usage = 2,           // bad command line or missing credentials
+    e_exit_login = 3,           // couldn't connect to the server or log in
+    e_exit_failed = 4,          // anything else
+};
+
+
+/* Define the length of the buffers used for the username and password
+*/
+#define MAX_CREDENTIAL      1000
+
 
 /* Define filenames for important files
 */
@@ -86,13 +147,27 @@ enum E_Query_Mode {
 #define SOURCE_FILENAME     "ddi_sources.aug"
 #define POWERS_FILENAME     "ddi_powers.dat"
 
-#define BACKUP_EXTENSION    ".saved"
-
 
 static bool                 l_is_password = false;
+static bool                 l_is_dump = false;
+static vector<T_Glyph_Ptr>  l_only;
+static bool                 l_is_batch = false;
+static T_Glyph              l_batch_mode = '\0';
+static T_Int32U             l_batch_retries = 0;
+static T_Int32U             l_batch_retry_wait = 600;
+static T_Glyph_Ptr          l_credentials = NULL;
+static T_Int32S             l_last_option = 0;
+static T_Filename           l_temp_root;
+static E_Phase              l_phase = e_phase_none;
+static E_Phase              l_failed_phase = e_phase_none;
+static T_Int32U             l_phase_start;
+static T_Int32U             l_phase_times[e_phase_count];
 static T_XML_Node           l_language_root = NULL;
 static T_XML_Node           l_wepprop_root = NULL;
 static T_XML_Node           l_source_root = NULL;
+static C_Tag_Registry       l_language_registry;
+static C_Tag_Registry       l_wepprop_registry;
+static C_Tag_Registry       l_source_registry;
 
 
 T_XML_Node      Get_Language_Root(void)
@@ -116,6 +191,27 @@ T_XML_Node      Get_Source_Root(void)
 }
 
 
+C_Tag_Registry *    Get_Language_Registry(void)
+{
+    x_Trap_Opt(l_language_registry.Get_Root() == NULL);
+    return(&l_language_registry);
+}
+
+
+C_Tag_Registry *    Get_WepProp_Registry(void)
+{
+    x_Trap_Opt(l_wepprop_registry.Get_Root() == NULL);
+    return(&l_wepprop_registry);
+}
+
+
+C_Tag_Registry *    Get_Source_Registry(void)
+{
+    x_Trap_Opt(l_source_registry.Get_Root() == NULL);
+    return(&l_source_registry);
+}
+
+
 bool            Is_Password(void)
 {
     return(l_is_password);
@@ -124,18 +220,17 @@ bool            Is_Password(void)
 
 static T_Mapping *  Get_Mapping(T_Glyph_Ptr mapping)
 {
-    T_Unique        id;
+    map<T_Unique, T_Mapping *>::iterator    it;
 
     if (x_Trap_Opt(!UniqueId_Is_Valid(mapping)))
         return(NULL);
-    id = UniqueId_From_Text(mapping);
 
     /* Find a mapping with the appropriate unique id
     */
-    for (map_iter it = l_mappings.begin(); it != l_mappings.end(); ++it)
-        if (id == (*it)->id)
-            return(*it);
-    return(NULL);
+    it = l_mapping_index.find(UniqueId_From_Text(mapping));
+    if (it == l_mapping_index.end())
+        return(NULL);
+    return(it->second);
 }
 
 
@@ -145,6 +240,8 @@ T_Tuple *       Mapping_Find_Tuple(T_Glyph_Ptr mapping, T_Glyph_Ptr search,
     T_Int32U        length;
     T_Mapping *     map = NULL;
 
+    x_Profile_Count(e_counter_mapping_lookups);
+
     /* Find a mapping with the appropriate unique id
     */
     map = Get_Mapping(mapping);
@@ -174,6 +271,25 @@ T_Tuple *       Mapping_Find_Tuple(T_Glyph_Ptr mapping, T_Glyph_Ptr search,
 }
 
 
+/* Find the entry in a mapping that maps something onto the given id - the
+    reverse of Mapping_Find_Tuple
+*/
+T_Tuple *       Mapping_Find_Id(T_Glyph_Ptr mapping, T_Glyph_CPtr id)
+{
+    T_Mapping *     map = NULL;
+
+    x_Profile_Count(e_counter_mapping_lookups);
+    map = Get_Mapping(mapping);
+    if (x_Trap_Opt(map == NULL))
+        return(NULL);
+    for (tuple_iter it = map->list.begin(); it != map->list.end(); ++it)
+        if ((it->b != NULL) && (stricmp(id, it->b) == 0))
+            return(&(*it));
+
+    return(NULL);
+}
+
+
 T_Glyph_Ptr     Mapping_Find(T_Glyph_Ptr mapping, T_Glyph_Ptr search,
                                 bool is_partial_mapping, bool is_partial_search)
 {
@@ -208,12 +324,20 @@ void        Mapping_Add(T_Glyph_Ptr mapping, T_Glyph_Ptr a, T_Glyph_Ptr b, T_Gly
             return;
         map->id = UniqueId_From_Text(mapping);
         l_mappings.push_back(map);
+        l_mapping_index[map->id] = map;
         }
 
     tuple.a = a;
     tuple.b = b;
     tuple.c = c;
     map->list.push_back(tuple);
+    l_mapping_generation++;
+}
+
+
+T_Int32U    Mapping_Get_Generation(void)
+{
+    return(l_mapping_generation);
 }
 
 
@@ -339,40 +463,63 @@ static void Trim_Eval_Whitespace(T_XML_Node node)
 #endif
 
 
-static void     Backup_Existing(T_Glyph_Ptr path)
+/* A finished document that needs to have any extensions appended to it,
+    along with anything logged while we were doing that. Documents handed over
+    after post-processing belong to whoever handed them over; documents read
+    back in from the temporary folder belong to the job.
+*/
+struct T_Extension_Job {
+    string          filename;
+    string          base_filename;
+    bool            is_partial;
+    bool            is_extended;
+    bool            is_owned;
+    bool            is_merged;      // extensions were merged in by an earlier run
+    T_XML_Document  document;
+    T_Log_Capture   log;
+};
+
+
+struct T_Extension_Queue {
+    vector<T_Extension_Job> jobs;
+    T_Glyph_Ptr             output_folder;
+    volatile T_Int32S       claimed;
+};
+
+
+static  vector<T_Extension_Job> l_extensions;
+
+
+void            Extension_Queue(T_XML_Document document, T_Glyph_CPtr filename, bool is_partial)
 {
-    T_Glyph                 backup[MAX_FILE_NAME+1];
+    T_Extension_Job     job;
 
-    /* Generate our backup filename and copy the file (fails silently if an
-        existing version of the file isn't present, which is fine)
-    */
-    strcpy(backup, path);
-    strcat(backup, BACKUP_EXTENSION);
-    FileSys_Copy_File(backup, path, FALSE);
+    if (x_Trap_Opt((document == NULL) || (filename == NULL)))
+        return;
+
+    job.base_filename = filename;
+    job.is_partial = is_partial;
+    job.is_extended = false;
+    job.is_owned = false;
+    job.is_merged = false;
+    job.document = document;
+    l_extensions.push_back(job);
 }
 
 
-static T_Status Append_Extension(T_Glyph_Ptr filename, T_File_Attribute attributes,
-                             T_Void_Ptr context)
+/* Queue a document left in the temporary folder by an earlier run - it's read
+    in when its extensions are appended. The context points to whether the
+    document is an output file, which has had extensions merged into it.
+*/
+static T_Status Queue_Dumped_Document(T_Glyph_Ptr filename, T_File_Attribute attributes,
+                                        T_Void_Ptr context)
 {
-    long            result;
-    bool            is_partial;
-    T_Glyph_Ptr     base_filename, output_folder = (T_Glyph_Ptr) context;
-    T_XML_Node      root;
-    T_XML_Document  document;
-    T_Filename      output_filename;
+    T_Glyph_Ptr         base_filename;
+    T_Extension_Job     job;
 
     if ((attributes & e_filetype_directory) != 0)
         x_Status_Return_Success();
 
-    /* Read the file in from the temporary folder as an XML document
-    */
-    result = XML_Read_Document(&document, &l_data, filename);
-    if (x_Trap_Opt(result != 0)) {
-        Log_Message("Could not read XML document.");
-        x_Status_Return_Success();
-        }
-
     /* Get the base filename to use for this file
     */
     base_filename = strrchr(filename, DIR[0]);
@@ -382,44 +529,37 @@ static T_Status Append_Extension(T_Glyph_Ptr filename, T_File_Attribute attribut
     if (x_Trap_Opt(*base_filename == '\0'))
         x_Status_Return(LWD_ERROR);
 
-    /* Query and unset the artificial "partial" flag we added, so it
-        doesn't confuse things by showing up in the real data file we're
-        about to output.
-    */
-    result = XML_Get_Document_Node(document, &root);
-    if (x_Trap_Opt(result != 0))
-        x_Status_Return_Success();
-    is_partial = XML_Read_Boolean_Attribute(root, "ispartial");
-    XML_Write_Boolean_Attribute(root, "ispartial", false);
-
-    /* Append any extensions to the document
-     */
-    Append_Extensions(document, output_folder, base_filename, is_partial);
-
-    /* Back up any existing file and write out the new one
-    */
-    sprintf(output_filename, "%s" DIR "%s", output_folder, base_filename);
-    Backup_Existing(output_filename);
-    result = XML_Write_Document(document, output_filename, false, true);
-    if (x_Trap_Opt(result != 0)) {
-        Log_Message("Could not write XML document.");
-        x_Status_Return_Success();
-        }
-
-    XML_Destroy_Document(document);
+    job.filename = filename;
+    job.base_filename = base_filename;
+    job.is_partial = false;
+    job.is_extended = false;
+    job.is_owned = true;
+    job.is_merged = *(bool *) context;
+    job.document = NULL;
+    l_extensions.push_back(job);
     x_Status_Return_Success();
 }
 
 
-static void Append_Extensions(T_Filename temp_folder, T_Filename output_folder)
+/* Queue the documents dumped by an earlier run with -dump. If there aren't
+    any, append to the files in the output folder instead - they already have
+    extensions merged into them, but anything that's already there isn't
+    merged again.
+*/
+static void     Queue_Dumped_Documents(T_Filename temp_folder, T_Filename output_folder)
 {
-    T_Status        status;
-    T_Filename      input_wildcard;
+    T_Status            status;
+    T_Filename          input_wildcard;
+    bool                is_merged = false;
 
-    /* Go through our data files and post-process them
-     */
     sprintf(input_wildcard, "%s" DIR "*.dat", temp_folder);
-    status = FileSys_Enumerate_Matching_Files(input_wildcard, Append_Extension, output_folder);
+    status = FileSys_Enumerate_Matching_Files(input_wildcard, Queue_Dumped_Document, &is_merged);
+    if (status == WARN_CORE_FILE_NOT_FOUND) {
+        Log_Message("No dumped documents found - appending to the output files.\n", true);
+        is_merged = true;
+        sprintf(input_wildcard, "%s" DIR "ddi_*.dat", output_folder);
+        status = FileSys_Enumerate_Matching_Files(input_wildcard, Queue_Dumped_Document, &is_merged);
+        }
     if (x_Trap_Opt(status == WARN_CORE_FILE_NOT_FOUND)) {
         printf("<No files to append to!>\n");
         return;
@@ -428,6 +568,147 @@ static void Append_Extensions(T_Filename temp_folder, T_Filename output_folder)
 }
 
 
+/* Write copies of the documents we've been handed to the temporary folder, as
+    they are before any extensions are appended. This is only done when asked
+    for, so the documents can be looked at or merged again later in append
+    mode. The "partial" flag goes into each copy, so it's not lost when the
+    copy is read back in.
+*/
+static void     Dump_Documents(T_Filename temp_folder)
+{
+    T_Int32U            i, count;
+    T_Status            status;
+    T_XML_Node          root;
+    T_Extension_Job *   job;
+    T_Filename          filename;
+
+    for (i = 0, count = l_extensions.size(); i < count; i++) {
+        job = &l_extensions[i];
+        if (job->is_partial && (XML_Get_Document_Node(job->document, &root) == 0))
+            XML_Write_Boolean_Attribute(root, "ispartial", true);
+        sprintf(filename, "%s" DIR "%s", temp_folder, job->base_filename.c_str());
+        Writer_Queue(job->document, filename, false, false);
+        }
+    status = Writer_Flush();
+    x_Trap_Opt(!x_Is_Success(status));
+
+    for (i = 0; i < count; i++) {
+        job = &l_extensions[i];
+        if (job->is_partial && (XML_Get_Document_Node(job->document, &root) == 0))
+            XML_Write_Boolean_Attribute(root, "ispartial", false);
+        }
+}
+
+
+static void     Append_Extension(T_Extension_Job * job, T_Glyph_Ptr output_folder)
+{
+    long            result;
+    T_XML_Node      root;
+    T_XML_Document  document;
+
+    /* If the document was handed over straight after post-processing, make
+        sure all its nodes are valid before we start adding to it
+    */
+    if (job->document != NULL)
+        Writer_Check_Nodes(job->document, job->base_filename.c_str());
+
+    /* Otherwise read the file in from the temporary folder as an XML
+        document, then query and unset the artificial "partial" flag, so it
+        doesn't confuse things by showing up in the real data file we're about
+        to output.
+    */
+    else {
+        result = XML_Read_Document(&document, &l_data, job->filename.c_str());
+        if (x_Trap_Opt(result != 0)) {
+            Log_Message("Could not read XML document.");
+            return;
+            }
+        result = XML_Get_Document_Node(document, &root);
+        if (x_Trap_Opt(result != 0)) {
+            XML_Destroy_Document(document);
+            return;
+            }
+        job->is_partial = XML_Read_Boolean_Attribute(root, "ispartial");
+        XML_Write_Boolean_Attribute(root, "ispartial", false);
+        job->document = document;
+        }
+
+    /* Append any extensions to the document
+     */
+    if (job->is_extended)
+        Append_Extensions(job->document, output_folder, (T_Glyph_Ptr) job->base_filename.c_str(),
+                            job->is_partial, job->is_merged);
+}
+
+
+/* Keep claiming documents until there are none left
+*/
+static void     Extension_Worker(T_Void_Ptr context)
+{
+    T_Int32S            index;
+    T_Extension_Queue * queue = (T_Extension_Queue *) context;
+
+    while (true) {
+        index = Thread_Atomic_Increment(&queue->claimed);
+        if (index >= (T_Int32S) queue->jobs.size())
+            break;
+        Log_Begin_Capture(&queue->jobs[index].log);
+        Append_Extension(&queue->jobs[index], queue->output_folder);
+        Log_End_Capture();
+        }
+}
+
+
+/* Append extensions to every document that's been queued, then queue them all
+    to be written out into the output folder
+*/
+static void Append_Extensions(T_Filename output_folder)
+{
+    T_Int32U            i, count;
+    T_Extension_Job *   job;
+    T_Extension_Queue   queue;
+    T_Filename          ext_filename, output_filename;
+
+    x_Profile_Timer("all", "extensions", NULL);
+
+    queue.jobs.swap(l_extensions);
+    queue.output_folder = output_folder;
+    queue.claimed = -1;
+
+    /* See which documents have a file in our ddidownloader directory with the
+        same name. We check now, rather than on a worker thread, so the
+        platform file functions are only called from here.
+    */
+    for (i = 0, count = queue.jobs.size(); i < count; i++) {
+        job = &queue.jobs[i];
+        sprintf(ext_filename, "%s" DIR "ddidownloader" DIR "%s", output_folder,
+                job->base_filename.c_str());
+        job->is_extended = FileSys_Does_File_Exist(ext_filename);
+        }
+
+    /* Each document is merged with its own extension file, so they can all be
+        merged at once, a thread per processor
+    */
+    count = Thread_Get_Worker_Count();
+    if (count > queue.jobs.size())
+        count = queue.jobs.size();
+    Thread_Run_Workers(count, Extension_Worker, &queue);
+
+    /* Log what happened to each document in order, then back up any existing
+        file and queue the new one to be written out - the writer destroys the
+        documents we own once it's done with them
+    */
+    for (i = 0, count = queue.jobs.size(); i < count; i++) {
+        job = &queue.jobs[i];
+        Log_Replay(&job->log);
+        if (job->document == NULL)
+            continue;
+        sprintf(output_filename, "%s" DIR "%s", output_folder, job->base_filename.c_str());
+        Writer_Queue(job->document, output_filename, true, job->is_owned, !job->is_owned);
+        }
+}
+
+
 static void     Fixup_Wizard_Powers(T_Glyph_Ptr folder)
 {
     T_Int32U            count;
@@ -437,7 +718,7 @@ static void     Fixup_Wizard_Powers(T_Glyph_Ptr folder)
     bool                is_match;
     T_XML_Iter          iter;
     T_Glyph             buffer[500];
-    T_Filename          file_old, file_new;
+    T_Filename          file_old, file_new, file_temp;
     T_XML_Vector        nodes;
 
     /* Open the previous version of the powers file - if we don't have one,
@@ -514,11 +795,17 @@ static void     Fixup_Wizard_Powers(T_Glyph_Ptr folder)
         count++;
         }
 
-    /* Write out the new contents of the new powers file.
+    /* Write out the new contents of the new powers file. We write them to a
+        temporary file first, so the file we have stays intact if we can't.
     */
     sprintf(buffer, " done (%lu powers restored).\n", count);
     Log_Message(buffer, true);
-    result = XML_Write_Document(doc_new, file_new, false, true);
+    sprintf(file_temp, "%s%s", file_new, WRITING_EXTENSION);
+    result = XML_Write_Document(doc_new, file_temp, false, true);
+    if ((result == 0) && !x_Is_Success(FileSys_Rename_File(file_new, file_temp))) {
+        FileSys_Delete_File(file_temp, FALSE);
+        result = -1;
+        }
     if (x_Trap_Opt(result != 0))
         Log_Message("Could not write XML document.", true);
 
@@ -532,38 +819,52 @@ cleanup_exit:
 }
 
 
-static T_Status Finish_Document(T_XML_Document document, T_Glyph_Ptr output_folder,
+static void     Finish_Document(T_XML_Document document, T_Glyph_Ptr output_folder,
                                 T_Glyph_Ptr filename)
 {
-    T_Int32S                result;
     T_Glyph                 buffer[MAX_FILE_NAME+1];
 
+    /* Back up any existing file and queue the document to be written into our
+        output folder
+    */
     sprintf(buffer, "%s" DIR "%s", output_folder, filename);
-    Backup_Existing(buffer);
+    Writer_Queue(document, buffer, true, false);
+}
 
-    /* Output the document into our output folder
-    */
-    result = XML_Write_Document(document, buffer, false, true);
-    if (x_Trap_Opt(result != 0)) {
-        sprintf(buffer, "Could not write %s XML document.", filename);
-        Log_Message(buffer);
-        x_Status_Return(LWD_ERROR);
-        }
 
-    x_Status_Return_Success();
+/* Get one of our folders inside the temporary folder - a different temporary
+    folder can be given on the command line, so several downloads can run at
+    once without treading on each other
+*/
+static void Get_Temporary_Folder(T_Filename folder, T_Glyph_CPtr name = "ddicrawler" DIR)
+{
+    if (l_temp_root[0] != '\0')
+        strcpy(folder, l_temp_root);
+    else
+        FileSys_Get_Temporary_Folder(folder);
+    strcat(folder, name);
 }
 
 
-static void Get_Temporary_Folder(T_Filename folder)
+/* Add the time spent in the current phase of the crawl to its total, then
+    start timing the next one
+*/
+static void Begin_Phase(E_Phase phase)
 {
-    FileSys_Get_Temporary_Folder(folder);
-    strcat(folder, "ddicrawler" DIR);
+    T_Int32U        now;
+
+    now = Get_Milliseconds();
+    if (l_phase != e_phase_none)
+        l_phase_times[l_phase] += now - l_phase_start;
+    l_phase = phase;
+    l_phase_start = now;
 }
 
 
 static void Retry_Failed_Downloads(T_WWW www)
 {
     bool                        is_ok;
+    T_Int32U                    rounds = 0;
     T_Glyph                     choice;
     vector<T_Failed>::iterator  iter;
     T_Glyph                     buffer[5000];
@@ -588,8 +889,11 @@ static void Retry_Failed_Downloads(T_WWW www)
                 back and try again later.
             */
             is_ok = Download_Page(www, iter->info, iter->url, iter->filename);
-            if (is_ok)
+            if (is_ok) {
+                l_crawl_stats.fetched++;
+                Journal_Record_Download(iter->filename, true);
                 iter = l_failed_downloads.erase(iter);
+                }
             else
                 iter++;
             }
@@ -603,9 +907,30 @@ static void Retry_Failed_Downloads(T_WWW www)
             }
 
         /* Otherwise, ask the user what to do next - if they want to continue,
-            we'll go round the loop again. Otherwise, skip out.
+            we'll go round the loop again. Otherwise, skip out. Make sure
+            everything we've downloaded so far is noted in the journal first,
+            since the user may well close the program while we wait.
+        */
+        Journal_Flush();
+
+        /* In batch mode there's nobody to ask, so wait a while and go round
+            again as many times as we were told to, then give up
         */
-        sprintf(buffer, "\n%lu records were not retrieved from the D&D Compendium,\ndue to server problems. This issue usually resolves itself\nwithin a few hours - we recommend you wait at least 30 minutes,\nthen press 'r' to retry the download.\n\n(Do not close this program if you wish to retry - if you do,\nall downloading progress will be lost!)\n\nPress 'r' to retry the download, or 's' to skip. ", l_failed_downloads.size());
+        if (l_is_batch) {
+            if (rounds >= l_batch_retries) {
+                sprintf(buffer, "%lu records were not retrieved from the D&D Compendium - giving up.\n", l_failed_downloads.size());
+                Log_Message(buffer, true);
+                return;
+                }
+            rounds++;
+            sprintf(buffer, "%lu records were not retrieved from the D&D Compendium - waiting %lu seconds to retry.\n", l_failed_downloads.size(), l_batch_retry_wait);
+            Log_Message(buffer, true);
+            Pause_Execution(l_batch_retry_wait * 1000);
+            Attempt_Login_Again(www);
+            continue;
+            }
+
+        sprintf(buffer, "\n%lu records were not retrieved from the D&D Compendium,\ndue to server problems. This issue usually resolves itself\nwithin a few hours - we recommend you wait at least 30 minutes,\nthen press 'r' to retry the download.\n\n(If you close this program, the download will carry on from\nwhere it left off the next time you run it.)\n\nPress 'r' to retry the download, or 's' to skip. ", l_failed_downloads.size());
         Log_Message(buffer, true);
         choice = Get_Character();
         Log_Message("\n\n", true);
@@ -622,12 +947,84 @@ static void Retry_Failed_Downloads(T_WWW www)
 }
 
 
+/* Move any crawlers we weren't asked to rebuild from the list into the
+    'others' list, complaining if we were asked for a category that doesn't
+    exist
+*/
+static T_Status Select_Crawlers(vector<C_DDI_Common *> * list, vector<C_DDI_Common *> * others)
+{
+    T_Int32U                i, count;
+    bool                    is_found;
+    vector<C_DDI_Common *>  selected;
+    T_Glyph                 buffer[1000];
+
+    for (ddi_iter it = list->begin(); it != list->end(); ++it) {
+        for (i = 0, count = l_only.size(); i < count; i++)
+            if (stricmp(l_only[i], (*it)->Get_Category()) == 0)
+                break;
+        if (i < count)
+            selected.push_back(*it);
+        else
+            others->push_back(*it);
+        }
+
+    for (i = 0, count = l_only.size(); i < count; i++) {
+        is_found = false;
+        for (ddi_iter it = selected.begin(); it != selected.end(); ++it)
+            if (stricmp(l_only[i], (*it)->Get_Category()) == 0)
+                is_found = true;
+        if (!is_found) {
+            sprintf(buffer, "Unknown category '%s' - use one of:", l_only[i]);
+            for (ddi_iter it = list->begin(); it != list->end(); ++it) {
+                strcat(buffer, " ");
+                strcat(buffer, (*it)->Get_Category());
+                }
+            strcat(buffer, "\n");
+            Log_Message(buffer, true);
+            x_Status_Return(LWD_ERROR);
+            }
+        }
+
+    list->swap(selected);
+    x_Status_Return_Success();
+}
+
+
+/* Create a document for entries the crawlers share. If we're only rebuilding
+    some categories, start from what we generated last time, so that entries
+    keep the same ids they had before.
+*/
+static T_Status Open_Document(T_XML_Document * document, T_XML_Node * root, T_Glyph_Ptr name,
+                                T_XML_Element * element, T_Glyph_Ptr output_folder,
+                                T_Glyph_Ptr filename)
+{
+    T_Int32S                result;
+    T_Filename              buffer;
+
+    if (!l_only.empty()) {
+        sprintf(buffer, "%s" DIR "%s", output_folder, filename);
+        if (FileSys_Does_File_Exist(buffer)) {
+            result = XML_Read_Document(document, element, buffer);
+            if ((result == 0) && (XML_Get_Document_Node(*document, root) == 0))
+                x_Status_Return_Success();
+            x_Trap_Opt(1);
+            if (*document != NULL) {
+                XML_Destroy_Document(*document);
+                *document = NULL;
+                }
+            }
+        }
+
+    x_Status_Return(Create_Document(document, root, name, element));
+}
+
+
 static T_Status Crawl_Data(bool use_cache, T_Glyph_Ptr email, T_Glyph_Ptr password,
                             T_Filename output_folder, bool is_clear)
 {
     T_Status                status;
     T_WWW                   internet = NULL;
-    bool                    is_exists;
+    bool                    is_exists, is_finished;
     T_Glyph_Ptr             path_ptr;
     T_Filename              folder;
     T_XML_Document          doc_languages = NULL;
@@ -646,7 +1043,7 @@ static T_Status Crawl_Data(bool use_cache, T_Glyph_Ptr email, T_Glyph_Ptr passwo
     C_DDI_Powers            powers(&pool);
     C_DDI_Monsters          monsters(&pool);
     C_DDI_Backgrounds       backgrounds(&pool);
-    vector<C_DDI_Common *>  list;
+    vector<C_DDI_Common *>  list, others;
     vector<C_DDI_Single_Common *>   singles;
 
     /* Add all of our downloader classes to the list
@@ -667,8 +1064,19 @@ static T_Status Crawl_Data(bool use_cache, T_Glyph_Ptr email, T_Glyph_Ptr passwo
 #endif
     list.push_back(&backgrounds);
 
+    /* If we've been told to rebuild only some categories, leave the rest out
+        of the list - what we generated for them last time is loaded instead,
+        so the categories we do rebuild can still look things up in it
+    */
+    if (!l_only.empty()) {
+        status = Select_Crawlers(&list, &others);
+        if (!x_Is_Success(status))
+            x_Status_Return(status);
+        }
+
     /* Find a temporary folder to use
     */
+    Begin_Phase(e_phase_prepare);
     Get_Temporary_Folder(folder);
     path_ptr = folder + strlen(folder);
 
@@ -678,7 +1086,7 @@ static T_Status Crawl_Data(bool use_cache, T_Glyph_Ptr email, T_Glyph_Ptr passwo
     if (!is_exists) {
         status = FileSys_Create_Directory(folder);
         if (x_Trap_Opt(!x_Is_Success(status))) {
-            Log_Message("Couldn't create temporary folder.");
+            Log_Message("Couldn't create temporary folder.", false, e_log_fatal);
             x_Status_Return(LWD_ERROR);
             }
         }
@@ -687,49 +1095,76 @@ static T_Status Crawl_Data(bool use_cache, T_Glyph_Ptr email, T_Glyph_Ptr passwo
         have a username and password, this just establishes the connection)
     */
     if (!use_cache) {
+        Begin_Phase(e_phase_login);
         Log_Message("Connecting to server...\n", true);
 
         /* Open a connection to the server first
         */
         status = WWW_HTTP_Open(&internet,LOGIN_URL,NULL,NULL,NULL);
         if (x_Trap_Opt(!x_Is_Success(status))) {
-            Log_Message("Couldn't open connection to login server!\n", true);
+            Log_Message("Couldn't open connection to login server!\n", true, e_log_fatal);
             goto cleanup_exit;
             }
 
         status = Login(internet, email, password, true);
         if (x_Trap_Opt(!x_Is_Success(status)))
             goto cleanup_exit;
+        Begin_Phase(e_phase_prepare);
         }
 
     /* If we're not using the cache, we want to make sure we have fresh copies
-        of everything, so delete the files in our temporary folder
+        of everything, so delete the files in our temporary folder - unless
+        there's a journal there from a download that was interrupted, in
+        which case we can carry on with it
     */
     if (!use_cache) {
-        strcpy(path_ptr,"*.*");
-        FileSys_Delete_Files(folder);
-        *path_ptr = '\0';
+        if (Journal_Open(folder))
+            Log_Message("Resuming the download that was interrupted last time...\n", true);
+        else {
+            strcpy(path_ptr,"*.*");
+            FileSys_Delete_Files(folder);
+            *path_ptr = '\0';
+            }
         }
 
     /* Create XML documents for deities languages - the crawlers can add their
         own entries for these during processing
     */
-    status = Create_Document(&doc_languages, &l_language_root, "language",
-                                DTD_Get_Data());
+    status = Open_Document(&doc_languages, &l_language_root, "language",
+                                DTD_Get_Data(), output_folder, LANGUAGE_FILENAME);
     if (!x_Is_Success(status))
         goto cleanup_exit;
-    status = Create_Document(&doc_wepprops, &l_wepprop_root, "weapon property",
-                                DTD_Get_Augmentation());
+    status = Open_Document(&doc_wepprops, &l_wepprop_root, "weapon property",
+                                DTD_Get_Augmentation(), output_folder, WEPPROP_FILENAME);
     if (!x_Is_Success(status))
         goto cleanup_exit;
-    status = Create_Document(&doc_sources, &l_source_root, "source",
-                                DTD_Get_Augmentation());
+    status = Open_Document(&doc_sources, &l_source_root, "source",
+                                DTD_Get_Augmentation(), output_folder, SOURCE_FILENAME);
     if (!x_Is_Success(status))
         goto cleanup_exit;
 
+    /* Set up registries of the entries in each of those documents, so the
+        crawlers can find existing tags and generate new ids cheaply. Language
+        names are matched regardless of case, the same as the language mappings.
+    */
+    l_language_registry.Initialize(l_language_root, "thing", "id", true);
+    l_wepprop_registry.Initialize(l_wepprop_root, "extgroup", "tag");
+    l_source_registry.Initialize(l_source_root, "source", "id");
+
+    /* Load up what we generated last time for any categories we're not
+        rebuilding - this has to be done before anything is read in, since
+        reading some categories adds entries to others
+    */
+    for (ddi_iter it = others.begin(); it != others.end(); ++it) {
+        status = (*it)->Load_Output(output_folder);
+        if (!x_Is_Success(status))
+            goto cleanup_exit;
+        }
+
     /* First, download all the index pages if we need to
     */
     if (!use_cache) {
+        Begin_Phase(e_phase_download_index);
         for (ddi_iter it = list.begin(); it != list.end(); ++it) {
             status = (*it)->Download_Index(folder, internet);
             if (x_Trap_Opt(!x_Is_Success(status)))
@@ -744,6 +1179,7 @@ static T_Status Crawl_Data(bool use_cache, T_Glyph_Ptr email, T_Glyph_Ptr passwo
 
     /* Read them in
     */
+    Begin_Phase(e_phase_read_index);
     for (ddi_iter it = list.begin(); it != list.end(); ++it) {
         status = (*it)->Read_Index(folder);
         if (x_Trap_Opt(!x_Is_Success(status)))
@@ -760,6 +1196,7 @@ static T_Status Crawl_Data(bool use_cache, T_Glyph_Ptr email, T_Glyph_Ptr passwo
             you have a password.
     */
     if (!use_cache && l_is_password) {
+        Begin_Phase(e_phase_download_content);
         for (ddi_iter it = list.begin(); it != list.end(); ++it) {
             status = (*it)->Download_Content(folder, internet);
             if (x_Trap_Opt(!x_Is_Success(status)))
@@ -771,23 +1208,33 @@ static T_Status Crawl_Data(bool use_cache, T_Glyph_Ptr email, T_Glyph_Ptr passwo
             so try them again
         */
         Retry_Failed_Downloads(internet);
+        Journal_Flush();
         }
 
     /* Read it in and process it
     */
+    Begin_Phase(e_phase_read_content);
     for (ddi_iter it = list.begin(); it != list.end(); ++it) {
         status = (*it)->Read_Content(folder);
         if (x_Trap_Opt(!x_Is_Success(status)))
             goto cleanup_exit;
         }
 
-    /* Process all our stuff
+    /* Process all our stuff. Categories we're not rebuilding still need to
+        output whatever the others added to them, so it can be referred to,
+        but it's never post-processed or written out.
     */
+    Begin_Phase(e_phase_process);
     for (ddi_iter it = list.begin(); it != list.end(); ++it) {
         status = (*it)->Process();
         if (x_Trap_Opt(!x_Is_Success(status)))
             goto cleanup_exit;
         }
+    for (ddi_iter it = others.begin(); it != others.end(); ++it) {
+        status = (*it)->Process();
+        if (x_Trap_Opt(!x_Is_Success(status)))
+            goto cleanup_exit;
+        }
     for (single_iter it = singles.begin(); it != singles.end(); ++it) {
         status = (*it)->Process();
         if (x_Trap_Opt(!x_Is_Success(status)))
@@ -797,28 +1244,33 @@ static T_Status Crawl_Data(bool use_cache, T_Glyph_Ptr email, T_Glyph_Ptr passwo
     /* Post-process all our stuff - this requires it to have been output first,
         and puts finishing touches on everything
     */
+    Begin_Phase(e_phase_post_process);
     for (ddi_iter it = list.begin(); it != list.end(); ++it) {
-        status = (*it)->Post_Process(folder);
+        status = (*it)->Post_Process();
         if (x_Trap_Opt(!x_Is_Success(status)))
             goto cleanup_exit;
         }
     for (single_iter it = singles.begin(); it != singles.end(); ++it) {
-        status = (*it)->Post_Process(folder);
+        status = (*it)->Post_Process();
         if (x_Trap_Opt(!x_Is_Success(status)))
             goto cleanup_exit;
         }
 
-    /* Output our languages to the temporary folder, so we can append
-        extensions to them later
+    /* Our languages need extensions appended too, unless they were loaded
+        from last time's output, where they've been appended already. If we've
+        been asked to, keep copies of everything in the temporary folder
+        before it's touched, so it can be merged again later in append mode.
     */
-    status = Finish_Document(doc_languages, folder, LANGUAGE_FILENAME);
-    if (!x_Is_Success(status))
-        goto cleanup_exit;
+    Begin_Phase(e_phase_extensions);
+    if (l_only.empty())
+        Extension_Queue(doc_languages, LANGUAGE_FILENAME, false);
+    if (l_is_dump)
+        Dump_Documents(folder);
 
     /* Now append any fixup extensions that are needed to compensate for the
         data being terrible
     */
-    Append_Extensions(folder, output_folder);
+    Append_Extensions(output_folder);
 
     /* Load the old "powers" XML document and try and copy any wizard powers
         out of it
@@ -830,16 +1282,28 @@ static T_Status Crawl_Data(bool use_cache, T_Glyph_Ptr email, T_Glyph_Ptr passwo
         directly into the output folder - plus they're augmentation files,
         which aren't messed with anyway
     */
-    status = Finish_Document(doc_sources, output_folder, SOURCE_FILENAME);
-    if (!x_Is_Success(status))
-        goto cleanup_exit;
-    status = Finish_Document(doc_wepprops, output_folder, WEPPROP_FILENAME);
+    Finish_Document(doc_sources, output_folder, SOURCE_FILENAME);
+    Finish_Document(doc_wepprops, output_folder, WEPPROP_FILENAME);
+
+    /* Write out all our finished documents together - each one is only
+        written this once
+    */
+    Begin_Phase(e_phase_write);
+    Log_Message("Writing documents...", true);
+    status = Writer_Flush();
+    Log_Message(" done.\n", true);
     if (!x_Is_Success(status))
         goto cleanup_exit;
 
     /* wrapup everything
     */
 cleanup_exit:
+    if (!x_Is_Success(status))
+        l_failed_phase = l_phase;
+    Begin_Phase(e_phase_none);
+    l_language_registry.Reset();
+    l_wepprop_registry.Reset();
+    l_source_registry.Reset();
     l_language_root = NULL;
     if (doc_languages != NULL)
         XML_Destroy_Document(doc_languages);
@@ -852,9 +1316,18 @@ cleanup_exit:
     if (internet != NULL)
         WWW_Close_Server(internet);
 
-    /* Delete everything in our folder if required
+    /* Once everything's been written out and nothing failed to download, the
+        download is finished and we don't need to resume it - otherwise keep
+        the journal so we can
     */
-    if (is_clear) {
+    is_finished = x_Is_Success(status) && l_failed_downloads.empty();
+    Journal_Close(is_finished);
+
+    /* Delete everything in our folder if required - but not if the download
+        didn't finish, since the journal and the pages we already have are
+        what let the next run pick up where this one left off
+    */
+    if (is_clear && is_finished) {
         strcpy(path_ptr,"*.*");
         FileSys_Delete_Files(folder);
         *path_ptr = '\0';
@@ -871,6 +1344,16 @@ static E_Query_Mode Query_Mode(int argc,char ** argv,bool * is_command_line)
 
     *is_command_line = false;
 
+    /* In batch mode, nobody's there to read the menu or choose from it, so
+        the mode has to be given with the -mode option - a trailing parameter
+        could just as easily be the value of some other option
+    */
+    if (l_is_batch) {
+        *is_command_line = true;
+        choice = l_batch_mode;
+        goto chosen;
+        }
+
     printf("**********************************************************\n");
     printf("Welcome to the 4e data downloader. Please choose an option\n");
     printf("by pressing 1, 2, r, or d, or press any other key to exit.\n\n");
@@ -890,10 +1373,16 @@ static E_Query_Mode Query_Mode(int argc,char ** argv,bool * is_command_line)
     printf("d. Delete existing data\n");
     printf("x. Exit\n\n");
 
-    /* If our last parameter was one character long, assume it's the option to
-        use - otherwise, ask the user to choose
+    /* If we were given a mode, or our last parameter was one character long
+        (and not the value of an option), assume it's the option to use -
+        otherwise, ask the user to choose
     */
-    if (argc <= 1)
+    if (l_batch_mode != '\0') {
+        choice = l_batch_mode;
+        printf("%c (from command-line parameter)\n\n", choice);
+        *is_command_line = true;
+        }
+    else if ((argc <= 1) || (argc - 1 <= l_last_option))
         choice = Get_Character();
     else {
         ptr = argv[argc - 1];
@@ -906,6 +1395,7 @@ static E_Query_Mode Query_Mode(int argc,char ** argv,bool * is_command_line)
             }
         }
 
+chosen:
     switch (choice) {
         case '1' :      return(e_mode_no_password);
         case '2' :      return(e_mode_password);
@@ -933,6 +1423,57 @@ static void Get_Credentials(T_Glyph_Ptr username, T_Glyph_Ptr password)
 }
 
 
+/* Find a username and password without asking for them - they can be read
+    from the first two lines of a file given on the command line, or from the
+    DDI_EMAIL and DDI_PASSWORD environment variables
+*/
+static bool Find_Credentials(T_Glyph_Ptr username, T_Glyph_Ptr password)
+{
+    T_Int32U        i, length;
+    T_Glyph_Ptr     text, ptr, end;
+    T_Glyph_Ptr     values[2];
+    T_Glyph         buffer[MAX_FILE_NAME+100];
+
+    values[0] = username;
+    values[1] = password;
+
+    if (l_credentials == NULL) {
+        text = getenv("DDI_EMAIL");
+        ptr = getenv("DDI_PASSWORD");
+        if ((text == NULL) || (text[0] == '\0') || (strlen(text) >= MAX_CREDENTIAL) ||
+            (ptr == NULL) || (ptr[0] == '\0') || (strlen(ptr) >= MAX_CREDENTIAL))
+            return(false);
+        strcpy(username, text);
+        strcpy(password, ptr);
+        return(true);
+        }
+
+    text = Quick_Read_Text(l_credentials);
+    if (text == NULL) {
+        sprintf(buffer, "Couldn't read login information from %s.\n", l_credentials);
+        Log_Message(buffer, true);
+        return(false);
+        }
+    ptr = text;
+    for (i = 0; i < 2; i++) {
+        end = ptr + strcspn(ptr, "\r\n");
+        length = end - ptr;
+        if ((length == 0) || (length >= MAX_CREDENTIAL))
+            break;
+        memcpy(values[i], ptr, length);
+        values[i][length] = '\0';
+        ptr = end + strspn(end, "\r\n");
+        }
+    delete [] text;
+    if (i < 2) {
+        sprintf(buffer, "%s must contain a username and password on separate lines.\n", l_credentials);
+        Log_Message(buffer, true);
+        return(false);
+        }
+    return(true);
+}
+
+
 static void Delete_Generated_Files(T_Glyph_Ptr output_folder)
 {
     T_Glyph         choice;
@@ -945,8 +1486,12 @@ static void Delete_Generated_Files(T_Glyph_Ptr output_folder)
     strcat(wildcard, DIR "ddi_*.*");
 
     FileSys_List_Files(wildcard);
-    printf("\nTo continue, press 'y', or 'n' to cancel.\n\n");
-    choice = Get_Character();
+    if (l_is_batch)
+        choice = 'y';
+    else {
+        printf("\nTo continue, press 'y', or 'n' to cancel.\n\n");
+        choice = Get_Character();
+        }
     if (tolower(choice) != 'y') {
         printf("Cancelled.\n\n");
         return;
@@ -958,25 +1503,33 @@ static void Delete_Generated_Files(T_Glyph_Ptr output_folder)
     Log_Message("All output files deleted.\n", true);
 }
 
-static T_Status Restore_Old_File(T_Glyph_Ptr filename, T_File_Attribute attributes,
-                             T_Void_Ptr context)
+static T_Status Find_Old_File(T_Glyph_Ptr filename, T_File_Attribute attributes,
+                                T_Void_Ptr context)
+{
+    vector<string> *    list = (vector<string> *) context;
+
+    if ((attributes & e_filetype_directory) == 0)
+        list->push_back(filename);
+    x_Status_Return_Success();
+}
+
+
+static void Restore_Old_File(T_Glyph_Ptr output_folder, T_Glyph_CPtr filename)
 {
     T_Status            status;
-    T_Glyph_Ptr         base_filename, output_folder = (T_Glyph_Ptr) context;
+    bool                is_moved;
+    T_Glyph_CPtr        base_filename;
     T_Filename          file_old, file_new, file_temp;
     T_Glyph             buffer[1000];
 
-    if ((attributes & e_filetype_directory) != 0)
-        x_Status_Return_Success();
-
     /* Get the base filename to use for this file
     */
     base_filename = strrchr(filename, DIR[0]);
     if (x_Trap_Opt(base_filename == NULL))
-        x_Status_Return(LWD_ERROR);
+        return;
     base_filename++;
     if (x_Trap_Opt(*base_filename == '\0'))
-        x_Status_Return(LWD_ERROR);
+        return;
 
     /* Get the temporary filename we'll use for stuff
     */
@@ -993,71 +1546,95 @@ static T_Status Restore_Old_File(T_Glyph_Ptr filename, T_File_Attribute attribut
     Log_Message(buffer, true);
 
     /* We want to swap the two files, so that the new is replaced by the
-        old.
+        old. They're all in the same folder, so we can just rename them. If
+        any step fails, put back what we've done so far and stop, so we never
+        lose either file.
     */
     FileSys_Delete_File(file_temp, FALSE);
+    is_moved = false;
     if (FileSys_Does_File_Exist(file_new)) {
-        status = FileSys_Copy_File(file_temp, file_new, FALSE);
+        status = FileSys_Rename_File(file_temp, file_new);
         if (!x_Is_Success(status)) {
             sprintf(buffer, "Couldn't make a backup of %s!\n", file_new);
             Log_Message(buffer, true);
+            return;
             }
+        is_moved = true;
         }
-    if (FileSys_Does_File_Exist(file_old)) {
-        status = FileSys_Copy_File(file_new, file_old, FALSE);
-        if (!x_Is_Success(status)) {
-            sprintf(buffer, "Couldn't restore old file %s!\n", file_old);
+    status = FileSys_Rename_File(file_new, file_old);
+    if (!x_Is_Success(status)) {
+        sprintf(buffer, "Couldn't restore old file %s!\n", file_old);
+        Log_Message(buffer, true);
+        if (is_moved && !x_Is_Success(FileSys_Rename_File(file_new, file_temp))) {
+            sprintf(buffer, "Couldn't put back new file %s - it was left as %s.\n", file_new, file_temp);
             Log_Message(buffer, true);
             }
+        return;
         }
-    if (FileSys_Does_File_Exist(file_temp)) {
-        status = FileSys_Copy_File(file_old, file_temp, FALSE);
+    if (is_moved) {
+        status = FileSys_Rename_File(file_old, file_temp);
         if (!x_Is_Success(status)) {
-            sprintf(buffer, "Couldn't restore backup of new file %s!\n", file_new);
+            sprintf(buffer, "Couldn't restore backup of new file %s - it was left as %s.\n", file_new, file_temp);
             Log_Message(buffer, true);
             }
         }
-    FileSys_Delete_File(file_temp, FALSE);
-    x_Status_Return_Success();
 }
 
 
 static void Restore_Old_Files(T_Glyph_Ptr output_folder)
 {
+    T_Int32U            i, count;
     T_Status            status;
     T_Filename          wildcard;
+    vector<string>      list;
 
-    /* Go through our data files and post-process them
+    /* Find all our backed up files first - the files are renamed as they're
+        restored, so we don't want to be enumerating the folder at the time
     */
     sprintf(wildcard, "%s" DIR "ddi_*" BACKUP_EXTENSION, output_folder);
-    status = FileSys_Enumerate_Matching_Files(wildcard, Restore_Old_File, output_folder);
+    status = FileSys_Enumerate_Matching_Files(wildcard, Find_Old_File, &list);
     if (x_Trap_Opt(status == WARN_CORE_FILE_NOT_FOUND)) {
         Log_Message("No old files found to restore!\n", true);
         return;
         }
     x_Trap_Opt(!x_Is_Success(status));
+
+    for (i = 0, count = list.size(); i < count; i++)
+        Restore_Old_File(output_folder, list[i].c_str());
+
+    /* The files we wrote aren't there any more, so what we know about them is
+        no use
+    */
+    Writer_Discard_Manifest();
 }
 
 
-static T_XML_Document   Load_Mappings(T_Glyph_Ptr folder)
+/* Parse the mapping file. Anything logged while we're at it is captured, so
+    it can be saved along with the mappings and logged again on later runs.
+*/
+static T_Glyph_Ptr  Parse_Mappings(T_Glyph_Ptr filename, T_Log_Capture * log)
 {
     long                result;
     T_XML_Document      document;
     T_XML_Node          root, map, tuple;
-    T_Glyph_Ptr         ptr;
+    T_Glyph_Ptr         ptr, strings;
     T_Mapping *         mapping;
     T_Tuple             t;
-    T_Filename          filename;
 
     /* Load the mappings XML file
     */
-    sprintf(filename, "%s" DIR "ddidownloader" DIR "mapping.xml", folder);
+    Log_Begin_Capture(log);
     result = XML_Read_Document(&document, &l_mapping, filename);
-    if (x_Trap_Opt(result != 0))
+    if (x_Trap_Opt(result != 0)) {
+        Log_End_Capture();
         return(NULL);
+        }
     result = XML_Get_Document_Node(document, &root);
-    if (x_Trap_Opt(result != 0))
+    if (x_Trap_Opt(result != 0)) {
+        Log_End_Capture();
+        XML_Destroy_Document(document);
         return(NULL);
+        }
 
     /* Go through all our mappings
     */
@@ -1107,23 +1684,208 @@ next_map:
         result = XML_Get_Next_Named_Child(root, &map);
         }
 
-    /* Return the completed XML document, since it's already storing all the
-        strings we're using - this way we don't have to allocate new space
-        for them, we just throw the document away before we exit
+    /* Save an image of the mappings for next time, and take our own copy of
+        the strings they use, so we don't have to hang on to the document
     */
-    return(document);
+    Log_End_Capture();
+    strings = Overlay_Save_Mappings(filename, &l_mappings, log);
+    XML_Destroy_Document(document);
+    return(strings);
+}
+
+
+/* Load our mappings, and return the storage for all the strings they use, to
+    be deleted before we exit. If the mapping file hasn't changed since we last
+    saw it, everything comes straight from our saved image of it - including
+    any problems found in it, so they're reported every time.
+*/
+static T_Glyph_Ptr  Load_Mappings(T_Glyph_Ptr folder)
+{
+    T_Glyph_Ptr         strings;
+    T_Filename          filename;
+    T_Log_Capture       log;
+    T_Glyph             buffer[500];
+
+    sprintf(filename, "%s" DIR "ddidownloader" DIR "mapping.xml", folder);
+    strings = Overlay_Load_Mappings(filename, &l_mappings, &log);
+    if (strings == NULL)
+        strings = Parse_Mappings(filename, &log);
+    Log_Replay(&log);
+    if (strings == NULL)
+        return(NULL);
+
+    /* Index the mappings by id - if an id appears more than once, the first
+        mapping with it is the one that gets used
+    */
+    for (map_iter it = l_mappings.begin(); it != l_mappings.end(); ++it) {
+        if (l_mapping_index.count((*it)->id) == 0)
+            l_mapping_index[(*it)->id] = *it;
+        else {
+            sprintf(buffer, "**** Duplicate mapping %s found - only the first one will be used!\n",
+                    As_Id((*it)->id));
+            Log_Message(buffer, true);
+            }
+        }
+    return(strings);
+}
+
+
+static bool Parse_Number(T_Glyph_CPtr text, T_Int32U * value)
+{
+    T_Glyph_Ptr     end;
+
+    if ((text == NULL) || !isdigit(text[0]))
+        return(false);
+    *value = strtoul(text, &end, 10);
+    return(*end == '\0');
+}
+
+
+/* Read the options that let us run without anybody at the keyboard, e.g.
+    from a scheduler:
+
+        -batch                  never wait for a key press
+        -brieflog               leave each page downloaded out of the log
+        -mode <choice>          the menu choice to use (1, 2, 7, 9, r or d)
+        -credentials <file>     file holding the username and password
+        -retries <count>        times to retry failed downloads (default 0)
+        -retrywait <seconds>    time to wait before each retry (default 600)
+        -threads <count>        worker threads to use (default one per processor)
+        -output <folder>        folder to read data files from and write to
+        -temp <folder>          folder to keep downloaded and cached files in
+        -trace <file>           write a Chrome trace of every entry processed
+                                (only if built with _PROFILE defined)
+        -only <category>        rebuild just this category (can be repeated)
+
+    All of these can be used when running interactively as well. We note the
+    last argument used by an option, so its value is never mistaken for a
+    menu choice given as the last parameter.
+*/
+static bool Parse_Options(int argc, char ** argv, T_Filename output_folder)
+{
+    T_Int32S        i;
+    T_Int32U        count;
+    T_Glyph_Ptr     option, value;
+    T_Glyph         buffer[500];
+
+    for (i = 1; i < argc; i++) {
+        option = argv[i];
+        value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (stricmp(option, "-batch") == 0) {
+            l_last_option = i;
+            continue;
+            }
+        if (stricmp(option, "-brieflog") == 0) {
+            Log_Set_Level(e_log_normal);
+            l_last_option = i;
+            continue;
+            }
+        if (stricmp(option, "-mode") == 0) {
+            if ((value == NULL) || (strlen(value) != 1))
+                goto bad_option;
+            l_batch_mode = value[0];
+            }
+        else if (stricmp(option, "-credentials") == 0) {
+            if (value == NULL)
+                goto bad_option;
+            l_credentials = value;
+            }
+        else if (stricmp(option, "-retries") == 0) {
+            if (!Parse_Number(value, &l_batch_retries))
+                goto bad_option;
+            }
+        else if (stricmp(option, "-retrywait") == 0) {
+            if (!Parse_Number(value, &l_batch_retry_wait))
+                goto bad_option;
+            }
+        else if (stricmp(option, "-threads") == 0) {
+            if (!Parse_Number(value, &count) || (count == 0))
+                goto bad_option;
+            Thread_Set_Worker_Count(count);
+            }
+        else if (stricmp(option, "-output") == 0) {
+            if ((value == NULL) || (strlen(value) >= MAX_FILE_NAME - 50))
+                goto bad_option;
+            strcpy(output_folder, value);
+            }
+        else if (stricmp(option, "-temp") == 0) {
+            if ((value == NULL) || (strlen(value) >= MAX_FILE_NAME - 50))
+                goto bad_option;
+            strcpy(l_temp_root, value);
+            if (l_temp_root[strlen(l_temp_root) - 1] != DIR[0])
+                strcat(l_temp_root, DIR);
+            }
+        else if (stricmp(option, "-trace") == 0) {
+            if (value == NULL)
+                goto bad_option;
+#ifdef _PROFILE
+            Profile_Enable_Trace(value);
+#else
+            Log_Message("Tracing is only available if the downloader is built with _PROFILE defined.\n", true);
+#endif
+            }
+        else if (stricmp(option, "-only") == 0) {
+            if (value == NULL)
+                goto bad_option;
+            l_only.push_back(value);
+            }
+        else
+            continue;
+
+        /* Skip over the value we just used
+        */
+        i++;
+        l_last_option = i;
+        }
+    return(true);
+
+bad_option:
+    sprintf(buffer, "Missing or invalid value for the %s option.\n", option);
+    Log_Message(buffer, true);
+    return(false);
+}
+
+
+/* Write out a summary of a batch run for whatever started us to read - it's
+    the last thing we output, as a single line of JSON
+*/
+static void Report_Summary(E_Query_Mode mode, T_Int32S result, T_Int32U elapsed)
+{
+    T_Int32U        i;
+    T_Glyph_Ptr     ptr;
+    T_Glyph         buffer[2000];
+
+    ptr = buffer;
+    ptr += sprintf(ptr, "{\"mode\":\"%s\",\"exit_code\":%ld,\"failed_phase\":",
+                    l_mode_names[mode], result);
+    if (l_failed_phase == e_phase_none)
+        ptr += sprintf(ptr, "null,");
+    else
+        ptr += sprintf(ptr, "\"%s\",", l_phase_names[l_failed_phase]);
+    ptr += sprintf(ptr, "\"entries\":{\"fetched\":%lu,\"parsed\":%lu,\"failed\":%lu},",
+                    l_crawl_stats.fetched, l_crawl_stats.parsed,
+                    (T_Int32U) l_failed_downloads.size());
+    ptr += sprintf(ptr, "\"phase_ms\":{");
+    for (i = 0; i < e_phase_count; i++)
+        ptr += sprintf(ptr, "%s\"%s\":%lu", (i > 0) ? "," : "", l_phase_names[i],
+                        l_phase_times[i]);
+    sprintf(ptr, "},\"total_ms\":%lu}\n", elapsed);
+    Log_Message(buffer, true);
 }
 
 
 int     main(int argc,char ** argv)
 {
-    T_Status                status;
-    T_Int32S                result = 0;
-    bool                    use_cache, is_command_line, is_clear = true;
-    E_Query_Mode            mode;
+    T_Status                status = SUCCESS;
+    T_Int32S                i, result = 0;
+    T_Int32U                start;
+    bool                    use_cache, is_command_line = false, is_clear = true;
+    E_Query_Mode            mode = e_mode_exit;
     T_Filename              output_folder, folder, logfile;
-    T_XML_Document          mappings = NULL;
-    T_Glyph                 xml_errors[1000], email[1000], password[1000];
+    T_Glyph_Ptr             mappings = NULL;
+    T_Glyph                 xml_errors[XML_ERROR_BUFFER_SIZE], email[MAX_CREDENTIAL], password[MAX_CREDENTIAL];
+
+    start = Get_Milliseconds();
 
     /* On windows, get the current directory to use as the output folder. On the
         mac, the current directory could well be the user's home directory, so
@@ -1131,7 +1893,7 @@ int     main(int argc,char ** argv)
     */
 #ifdef _WIN32
     FileSys_Get_Current_Directory(output_folder);
-#elif defined(_OSX)
+#elif defined(_OSX) || defined(_LINUX)
     strcpy(output_folder, argv[0]);
     T_Glyph_Ptr ptr;
     ptr = strrchr(output_folder, DIR[0]);
@@ -1144,6 +1906,16 @@ int     main(int argc,char ** argv)
 #error Unknown platform!
 #endif
 
+    /* Check whether we're running unattended, and pick up any options that
+        change where our files go - this needs to be done before the log file
+        is created
+    */
+    for (i = 1; i < argc; i++)
+        if (stricmp(argv[i], "-batch") == 0)
+            l_is_batch = true;
+    if (!Parse_Options(argc, argv, output_folder))
+        return(l_is_batch ? e_exit_usage : -1);
+
     /* Set up our static output stream for logging
     */
     sprintf(logfile, "%s" DIR "output.txt", output_folder);
@@ -1152,17 +1924,27 @@ int     main(int argc,char ** argv)
         Initialize_Helper(&output);
     else {
         Log_Message("Error opening output log file.", true);
+        status = LWD_ERROR;
         goto cleanup_exit;
         }
 
     /* Set up an error buffer for our XML library
     */
-    XML_Set_Error_Buffer(xml_errors);
+    XML_Set_Error_Buffer(xml_errors, sizeof(xml_errors));
+    x_Profile_Initialize();
 
     /* Initialize our unique id mechanisms
     */
     UniqueId_Initialize();
 
+    /* Precompiled copies of the extension files are kept in their own folder,
+        since the normal temporary folder is emptied on every run
+    */
+    Get_Temporary_Folder(folder, "ddicache" DIR);
+    if (FileSys_Does_Folder_Exist(folder) ||
+        x_Is_Success(FileSys_Create_Directory(folder)))
+        Overlay_Initialize(folder);
+
     /* Verify that we have write privileges in our output folder - if not, then
         downloading stuff would be a bit of a waste of time (this can happen if
         the downloader needs to be run with administrator rights).
@@ -1172,11 +1954,17 @@ int     main(int argc,char ** argv)
         goto cleanup_exit;
         }
 
+    /* Find out what we wrote into the output folder last time, so files that
+        haven't changed don't get written again
+    */
+    Writer_Open_Manifest(output_folder);
+
     /* Load up our mappings from the mapping XML file
     */
     mappings = Load_Mappings(output_folder);
     if (x_Trap_Opt(mappings == NULL)) {
-        Log_Message("Could not open mapping file.\n", true);
+        Log_Message("Could not open mapping file.\n", true, e_log_fatal);
+        status = LWD_ERROR;
         goto cleanup_exit;
         }
 
@@ -1192,12 +1980,28 @@ int     main(int argc,char ** argv)
     if ((argc > 1) && (stricmp(argv[1], "-nodelete") == 0))
         is_clear = false;
 
+    /* If we're asked to dump our documents, keep copies of them in the
+        temporary folder before extensions are appended, so they can be looked
+        at or appended to again later - which means the folder mustn't be
+        emptied at the end of the run
+    */
+    for (i = 1; i < argc; i++)
+        if (stricmp(argv[i], "-dump") == 0) {
+            l_is_dump = true;
+            is_clear = false;
+            }
+
     /* Ask the user how the program is going to run - if we're told to exit,
         just get out now
     */
     mode = Query_Mode(argc, argv, &is_command_line);
-    if (mode == e_mode_exit)
+    if (mode == e_mode_exit) {
+        if (l_is_batch) {
+            Log_Message("No mode given for batch run - use the -mode option.\n", true);
+            result = e_exit_usage;
+            }
         goto cleanup_exit;
+        }
 
     /* If we want to download with no password, do nothing - this is the
         normal way we'll work
@@ -1217,15 +2021,31 @@ int     main(int argc,char ** argv)
     */
     else if (mode == e_mode_append) {
         Get_Temporary_Folder(folder);
-        Append_Extensions(folder, output_folder);
-        status = SUCCESS;
+        Queue_Dumped_Documents(folder, output_folder);
+        Begin_Phase(e_phase_extensions);
+        Append_Extensions(output_folder);
+        Begin_Phase(e_phase_write);
+        Log_Message("Writing documents...", true);
+        status = Writer_Flush();
+        Log_Message(" done.\n", true);
+        if (!x_Is_Success(status))
+            l_failed_phase = e_phase_write;
+        Begin_Phase(e_phase_none);
         goto cleanup_exit;
         }
 
     /* If we want to download with no password, get the username and password
+        - if they weren't given to us some other way, we have to ask for them
     */
     else if (mode == e_mode_password) {
-        Get_Credentials(email, password);
+        if (!Find_Credentials(email, password)) {
+            if (l_is_batch) {
+                Log_Message("No username or password for batch run - use the -credentials option\nor the DDI_EMAIL and DDI_PASSWORD environment variables.\n", true);
+                result = e_exit_usage;
+                goto cleanup_exit;
+                }
+            Get_Credentials(email, password);
+            }
         if ((email[0] == '\0') || (password[0] == '\0')) {
             Log_Message("Empty username or password - cancelling download.\n", true);
             goto cleanup_exit;
@@ -1266,26 +2086,42 @@ int     main(int argc,char ** argv)
     else
         Log_Message("\n\nThere were one or more problems with the import. Please see the manual for more details.\n\n", true);
 
-    /* wrapup everything
+    /* wrapup everything - batch runs finish with an exit code and a summary
+        of what happened
     */
 cleanup_exit:
+    if (l_is_batch) {
+        if (result != 0)
+            /* already decided */;
+        else if (!x_Is_Success(status))
+            result = (l_failed_phase == e_phase_login) ? e_exit_login : e_exit_failed;
+        else if ((status != SUCCESS) || !l_failed_downloads.empty())
+            result = e_exit_incomplete;
+        Report_Summary(mode, result, Get_Milliseconds() - start);
+        }
+    x_Profile_Report();
+
     for (map_iter it = l_mappings.begin(); it != l_mappings.end(); ++it)
         delete *it;
+    l_mappings.clear();
+    l_mapping_index.clear();
     if (mappings != NULL)
-        XML_Destroy_Document(mappings);
+        delete [] mappings;
 
+    Symbol_Shutdown();
+    Regex_Shutdown();
     Shutdown_Helper();
 
     /* The window doesn't auto-close on OS X, so we don't need this
     */
 #ifndef _OSX
-    if (!is_command_line) {
+    if (!is_command_line && !l_is_batch) {
         printf("Press any key to quit.\n\n");
         Get_Character();
         }
 #endif
 
-    if (!x_Is_Success(status))
+    if (!l_is_batch && !x_Is_Success(status))
         result = -1;
     return(result);
 }
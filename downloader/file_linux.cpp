@@ -0,0 +1,529 @@
+/*  FILE:   FILE_LINUX.CPP
+
+    Copyright (c) 2012 by Lone Wolf Development.  All rights reserved.
+
+    This code is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation; either version 2 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place, Suite 330, Boston, MA 02111-1307 USA
+
+    You can find more information about this project here:
+
+    http://code.google.com/p/ddidownloader/
+
+    This file includes:
+
+    Implementation of file-related functions for Linux, using plain POSIX
+    calls.
+*/
+
+
+/* dirent.h defines a DIR type, which clashes with our DIR separator string,
+    so give it another name before we include our own headers
+*/
+#include    <dirent.h>
+
+typedef DIR                 T_Dir_Stream;
+
+#include    "private.h"
+
+#include    <errno.h>
+#include    <fcntl.h>
+#include    <stdio.h>
+#include    <stdlib.h>
+#include    <unistd.h>
+#include    <sys/stat.h>
+
+#include    <string>
+#include    <fstream>
+
+
+/*  define internal error codes
+*/
+#define WARN_CORE_CALLBACK_ABORTED_ENUMERATE    0x100
+#define WARN_CORE_FILE_ALREADY_EXISTS           0x101
+
+#define ERR_CORE_INVALID_INBOUND_PARAM          0x110
+#define ERR_CORE_INVALID_RETURN_PARAM           0x111
+
+#define ERR_CORE_FILE_COPY_FAILED               0x120
+#define ERR_CORE_FILE_DOES_NOT_EXIST            0x121
+#define ERR_CORE_FILE_CREATE_FAILED             0x122
+#define ERR_CORE_FILE_DELETE_FAILED             0x123
+#define ERR_CORE_FILE_RENAME_FAILED             0x126
+#define ERR_CORE_FILE_SYNC_FAILED               0x127
+#define ERR_CORE_FILE_LINK_FAILED               0x128
+
+
+/*  Write the specified text out to the given file using a simple ofstream
+*/
+T_Status    Quick_Write_Text(T_Glyph_Ptr filename,T_Glyph_Ptr text)
+{
+    ofstream    output(filename,ios::out);
+
+    /* if there was an error accessing the file, report an error
+    */
+    if (!output.good())
+        x_Status_Return(LWD_ERROR);
+
+    /* write the buffer out to the file
+    */
+    try {
+        output << text;
+        }
+    catch (...) {
+        x_Status_Return(LWD_ERROR);
+        }
+
+    x_Status_Return(output.good() ? SUCCESS : LWD_ERROR);
+}
+
+
+static T_Status FileSys_Does_File_Exist_Internal(T_Glyph_Ptr filename,
+                                                 T_File_Attribute attributes,
+                                                 T_Void_Ptr context)
+{
+    /* If we're called back, at least one file matched, so stop the enumeration
+    */
+    *((T_File_Attribute *) context) = attributes;
+    x_Status_Return(WARN_CORE_CALLBACK_ABORTED_ENUMERATE);
+}
+
+
+/* ***************************************************************************
+    FileSys_Does_File_Exist
+
+    Determine whether the specified filename actually points to a live, existing
+    file (or files if wildcards are used) on the system. If a file is found that
+    matches the given filename, TRUE is returned. The filename can include
+    wildcards, in which case ANY file that satisfies the criteria indicated will
+    result in a return of TRUE.
+
+    filename    --> filename to verify for a corresponding, existing file
+    return      <-- whether a matching file exists for the filename
+**************************************************************************** */
+
+bool        FileSys_Does_File_Exist(const T_Glyph_Ptr filename)
+{
+    T_Status            status;
+    T_File_Attribute    attributes;
+
+    /* validate the parameters
+    */
+    if (x_Trap_Opt(filename == NULL))
+        return(false);
+
+    /* To support wildcards, call the search function
+    */
+    status = FileSys_Enumerate_Matching_Files(filename, FileSys_Does_File_Exist_Internal,
+                                                &attributes);
+    if (status != WARN_CORE_CALLBACK_ABORTED_ENUMERATE)
+        return(false);
+    return((attributes & e_filetype_directory) == 0);
+}
+
+
+T_Status    FileSys_Copy_File(const T_Glyph_Ptr new_name,
+                                    const T_Glyph_Ptr old_name,T_Boolean is_force)
+{
+    FILE *          source;
+    FILE *          dest;
+    size_t          count;
+    bool            is_ok = true;
+    T_Glyph         buffer[65536];
+
+    /* validate the parameters
+    */
+    if (x_Trap_Opt((old_name == NULL) || (new_name == NULL))) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    /* find out if the source file exists
+    */
+    source = fopen(old_name, "rb");
+    if (source == NULL) {
+        x_Status_Return(ERR_CORE_FILE_DOES_NOT_EXIST);
+        }
+
+    /* If the 'force' flag has been specified, make sure we can write over any
+        existing target file
+    */
+    if (is_force)
+        chmod(new_name, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    /* copy the file, overwriting any existing file
+    */
+    dest = fopen(new_name, "wb");
+    if (dest == NULL) {
+        fclose(source);
+        x_Status_Return(ERR_CORE_FILE_COPY_FAILED);
+        }
+    while (is_ok && ((count = fread(buffer, 1, sizeof(buffer), source)) > 0))
+        is_ok = (fwrite(buffer, 1, count, dest) == count);
+    if (ferror(source))
+        is_ok = false;
+    fclose(source);
+    if (fclose(dest) != 0)
+        is_ok = false;
+    if (!is_ok) {
+        x_Status_Return(ERR_CORE_FILE_COPY_FAILED);
+        }
+    x_Status_Return_Success();
+}
+
+
+/* ***************************************************************************
+    FileSys_Enumerate_Matching_Files
+
+    This function will enumerate the list of files which match the specified
+    file specification, invoking the indicated callback function for each
+    matching file or sub-directory. The callback function is of type
+    T_Fn_File_Enum and receives two parameters - the matching filename and the
+    context provided by the caller. The return value from the callback function
+    must indicate SUCCESS to continue the enumeration. If a non-success value is
+    returned, the enumeration stops immediately and a user-abort warning is
+    returned by this function. To iterate down through a directory hierarchy,
+    this function may be called recursively from within the callback function.
+
+    filespec    --> filename defining the set of files to enumerate over
+    enum_func   --> callback function to invoke for each matching file
+    context     --> client parameter passed into enumeration function
+    return      <-- whether the enumeration was performed successfully
+**************************************************************************** */
+
+T_Status    FileSys_Enumerate_Matching_Files(T_Glyph_Ptr filespec,
+                                             T_Fn_File_Enum enum_func,
+                                             T_Void_Ptr context)
+{
+    T_Status            status = WARN_CORE_FILE_NOT_FOUND;
+    T_Dir_Stream *      stream;
+    struct dirent *     entry;
+    T_File_Attribute    attribs;
+    T_Glyph_Ptr         ptr, wildspec;
+    T_Glyph             name[MAX_FILE_NAME + 1];
+    T_Glyph             folder[MAX_FILE_NAME + 1];
+
+    /* validate the parameters
+    */
+    if (x_Trap_Opt((filespec == NULL) || (enum_func == NULL))) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    /* carve out the proper path portion of the search filespec
+    */
+    strcpy(name, filespec);
+    ptr = strrchr(name, DIR[0]);
+    if (ptr == NULL) {
+        strcpy(folder, ".");
+        ptr = name;
+        }
+    else {
+        ptr++;
+        strncpy(folder, name, ptr - name);
+        folder[ptr - name] = '\0';
+        }
+    wildspec = filespec + (ptr - name);
+
+    /* loop through every file in the folder, invoking the callback for every
+        file that matches the filespec
+    */
+    stream = opendir(folder);
+    if (stream == NULL) {
+        x_Status_Return(WARN_CORE_FILE_NOT_FOUND);
+        }
+    while ((entry = readdir(stream)) != NULL) {
+
+        /* skip the "." and ".." directory entries, and anything that doesn't
+            match
+        */
+        if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0))
+            continue;
+        if (!FileSys_Is_Wildcard_Match(entry->d_name, wildspec))
+            continue;
+
+        /* map the file attributes to the portable set
+        */
+        strcpy(ptr, entry->d_name);
+        if (!x_Is_Success(FileSys_Get_File_Attributes(name, &attribs)))
+            continue;
+
+        /* invoke the callback function for the file
+        */
+        status = enum_func(name, attribs, context);
+        if (!x_Is_Success(status)) {
+            status = WARN_CORE_CALLBACK_ABORTED_ENUMERATE;
+            break;
+            }
+        }
+    closedir(stream);
+    x_Status_Return(status);
+}
+
+
+void        FileSys_Get_Temporary_Folder(T_Glyph_Ptr buffer)
+{
+    T_Glyph_CPtr    ptr;
+
+    /* Make sure we end with a directory separator character
+    */
+    ptr = getenv("TMPDIR");
+    if ((ptr == NULL) || (*ptr == '\0') || (strlen(ptr) >= MAX_FILE_NAME - 1))
+        ptr = "/tmp";
+    strcpy(buffer, ptr);
+    if (buffer[strlen(buffer) - 1] != DIR[0])
+        strcat(buffer, DIR);
+}
+
+
+/* ***************************************************************************
+    FileSys_Create_Directory
+
+    Create the directory specified by the given explicit filename.
+
+    filename    --> filename indicating the new directory to create
+    return      <-- whether the directory was created successfully
+**************************************************************************** */
+
+T_Status        FileSys_Create_Directory(T_Glyph_CPtr filename)
+{
+    /* validate the parameters
+    */
+    if (x_Trap_Opt(filename == NULL)) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    /* find out if the directory exists
+    */
+    if (FileSys_Does_Folder_Exist(filename)) {
+        x_Status_Return(WARN_CORE_FILE_ALREADY_EXISTS);
+        }
+
+    /* create the directory
+    */
+    if (mkdir(filename, 0755) != 0) {
+        x_Status_Return(ERR_CORE_FILE_CREATE_FAILED);
+        }
+    x_Status_Return_Success();
+}
+
+
+/* ***************************************************************************
+    FileSys_Delete_File
+
+    Delete the file specified by the given filename. If the file does not exist,
+    cannot be deleted, or refers to multiple files, an error is returned. The
+    filename must specify a single, explicit file - wildcards cannot be used.
+
+    filename    --> filename indicating the file to be deleted
+    is_force    --> whether to delete the file if it's read-only, system or hidden
+    return      <-- whether the file was deleted successfully
+**************************************************************************** */
+
+T_Status        FileSys_Delete_File(T_Glyph_CPtr filename,T_Boolean is_force)
+{
+    /* validate the parameters
+    */
+    if (x_Trap_Opt(filename == NULL)) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    /* delete the file - whether the file itself is read-only doesn't matter
+        here, only whether we can write to its folder
+    */
+    if (unlink(filename) != 0) {
+        x_Status_Return((errno == ENOENT) ? ERR_CORE_FILE_DOES_NOT_EXIST : ERR_CORE_FILE_DELETE_FAILED);
+        }
+    x_Status_Return_Success();
+}
+
+
+bool            FileSys_Verify_Write_Privileges(T_Glyph_Ptr folder)
+{
+    /* As on OS X, everything should be under the user's home directory, so
+        there's nothing to check
+    */
+    return(true);
+}
+
+
+T_Glyph_Ptr     FileSys_Get_Current_Directory(T_Glyph_Ptr buffer)
+{
+    char *          ptr;
+
+    buffer[0] = '\0';
+    ptr = getcwd(buffer, MAX_FILE_NAME);
+    x_Trap_Opt(ptr == NULL);
+    return(buffer);
+}
+
+
+/* ***************************************************************************
+    FileSys_Get_File_Attributes
+
+    Retrieve the attributes of the file specified by the explicit filename.
+
+    filename    --> filename indicating the file to retrieve attributes for
+    attributes  <-- attributes of the file specified
+    return      <-- whether the attributes were retrieved successfully
+**************************************************************************** */
+
+T_Status    FileSys_Get_File_Attributes(T_Glyph_CPtr filename,
+                                            T_File_Attribute * attribute)
+{
+    T_Int32U        value;
+    T_Glyph_CPtr    ptr;
+    struct stat     info;
+
+    /* validate the parameters
+    */
+    if (x_Trap_Opt(filename == NULL)) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+    if (x_Trap_Opt(attribute == NULL)) {
+        x_Status_Return(ERR_CORE_INVALID_RETURN_PARAM);
+        }
+
+    /* make sure there are no wildcards in the filename
+    */
+    if (x_Trap_Opt((strchr(filename,'*') != NULL) || (strchr(filename,'?') != NULL))) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    /* retrieve the information for the file
+    */
+    if (stat(filename, &info) != 0) {
+        x_Status_Return(ERR_CORE_FILE_DOES_NOT_EXIST);
+        }
+
+    /* map the file information to the appropriate attributes
+    */
+    value = e_filetype_normal;
+    if (S_ISDIR(info.st_mode))
+        value |= e_filetype_directory;
+    if (access(filename, W_OK) != 0)
+        value |= e_filetype_read_only;
+    ptr = strrchr(filename, DIR[0]);
+    ptr = (ptr == NULL) ? filename : ptr + 1;
+    if (*ptr == '.')
+        value |= e_filetype_hidden;
+    *attribute = (T_File_Attribute) value;
+    x_Status_Return_Success();
+}
+
+
+/*  Make sure a change to the folder holding the file - e.g. a rename - has
+    reached the disk. If it can't be done, the change itself has still been
+    made, so there's nothing to report.
+*/
+static  void    Sync_Folder(T_Glyph_CPtr filename)
+{
+    int             fd;
+    std::string     folder;
+    size_t          pos;
+
+    folder = filename;
+    pos = folder.rfind('/');
+    folder = (pos == std::string::npos) ? "." : (pos == 0) ? "/" : folder.substr(0, pos);
+    fd = open(folder.c_str(), O_RDONLY);
+    if (x_Trap_Opt(fd < 0))
+        return;
+    x_Trap_Opt(fsync(fd) != 0);
+    close(fd);
+}
+
+
+/* ***************************************************************************
+    FileSys_Rename_File
+
+    Rename a file, replacing any existing file with the new name. The file
+    must stay in the same folder, so the rename is a single operation - there's
+    never a point where neither the old nor the new file is present. The
+    folder is synced afterwards, so the rename survives a crash.
+
+    new_name    --> name the file should have afterwards
+    old_name    --> name of the existing file
+    return      <-- whether the file was renamed successfully
+**************************************************************************** */
+
+T_Status    FileSys_Rename_File(T_Glyph_CPtr new_name,T_Glyph_CPtr old_name)
+{
+    /* validate the parameters
+    */
+    if (x_Trap_Opt((old_name == NULL) || (new_name == NULL))) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    if (rename(old_name, new_name) != 0) {
+        x_Status_Return((errno == ENOENT) ? ERR_CORE_FILE_DOES_NOT_EXIST : ERR_CORE_FILE_RENAME_FAILED);
+        }
+    Sync_Folder(new_name);
+    x_Status_Return_Success();
+}
+
+
+/* ***************************************************************************
+    FileSys_Link_File
+
+    Give an existing file a second name in the same folder, without copying
+    its contents. Any existing file with the new name must be deleted first.
+
+    new_name    --> the additional name the file should have
+    old_name    --> name of the existing file
+    return      <-- whether the link was created successfully
+**************************************************************************** */
+
+T_Status    FileSys_Link_File(T_Glyph_CPtr new_name,T_Glyph_CPtr old_name)
+{
+    /* validate the parameters
+    */
+    if (x_Trap_Opt((old_name == NULL) || (new_name == NULL))) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    if (link(old_name, new_name) != 0) {
+        x_Status_Return((errno == ENOENT) ? ERR_CORE_FILE_DOES_NOT_EXIST : ERR_CORE_FILE_LINK_FAILED);
+        }
+    x_Status_Return_Success();
+}
+
+
+/* ***************************************************************************
+    FileSys_Sync_File
+
+    Make sure everything written to the file has reached the disk, so that
+    it's safe to rename it into place.
+
+    filename    --> filename indicating the file to flush
+    return      <-- whether the file was flushed successfully
+**************************************************************************** */
+
+T_Status    FileSys_Sync_File(T_Glyph_CPtr filename)
+{
+    int             fd, result;
+
+    /* validate the parameters
+    */
+    if (x_Trap_Opt(filename == NULL)) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    fd = open(filename, O_RDWR);
+    if (fd < 0) {
+        x_Status_Return(ERR_CORE_FILE_DOES_NOT_EXIST);
+        }
+    result = fsync(fd);
+    close(fd);
+    if (result != 0) {
+        x_Status_Return(ERR_CORE_FILE_SYNC_FAILED);
+        }
+    x_Status_Return_Success();
+}
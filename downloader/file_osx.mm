@@ -32,6 +32,10 @@
 #include    <string>
 #include    <fstream>
 
+#include    <errno.h>
+#include    <fcntl.h>
+#include    <unistd.h>
+
 
 /*  define internal error codes
 */
@@ -49,6 +53,9 @@
 #define ERR_CORE_FILE_DELETE_FAILED             0x123
 #define ERR_CORE_FILE_ALREADY_EXISTS            0x124
 #define ERR_CORE_FILE_WRITE_FAILED              0x125
+#define ERR_CORE_FILE_RENAME_FAILED             0x126
+#define ERR_CORE_FILE_SYNC_FAILED               0x127
+#define ERR_CORE_FILE_LINK_FAILED               0x128
 
 
 /*  define private constants used by this file
@@ -653,3 +660,122 @@ T_Status    FileSys_Get_File_Attributes(T_Glyph_CPtr filename,
 
     x_Status_Return_Success();
 }
+
+
+/*  Make sure a change to the folder holding the file - e.g. a rename - has
+    reached the disk. If it can't be done, the change itself has still been
+    made, so there's nothing to report.
+*/
+static  void    Sync_Folder(T_Glyph_CPtr filename)
+{
+    int             fd;
+    std::string     folder;
+    size_t          pos;
+
+    folder = filename;
+    pos = folder.rfind('/');
+    folder = (pos == std::string::npos) ? "." : (pos == 0) ? "/" : folder.substr(0, pos);
+    fd = open(folder.c_str(), O_RDONLY);
+    if (x_Trap_Opt(fd < 0))
+        return;
+    x_Trap_Opt(fsync(fd) != 0);
+    close(fd);
+}
+
+
+/* ***************************************************************************
+    FileSys_Rename_File
+
+    Rename a file, replacing any existing file with the new name. The file
+    must stay in the same folder, so the rename is a single operation - there's
+    never a point where neither the old nor the new file is present. The
+    folder is synced afterwards, so the rename survives a crash.
+
+    new_name    --> name the file should have afterwards
+    old_name    --> name of the existing file
+    return      <-- whether the file was renamed successfully
+**************************************************************************** */
+
+T_Status    FileSys_Rename_File(T_Glyph_CPtr new_name,T_Glyph_CPtr old_name)
+{
+    /* validate the parameters
+    */
+    if (x_Trap_Opt((old_name == NULL) || (new_name == NULL))) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    /* NSFileManager won't move over an existing file, but rename() replaces
+        it in one step, which is what we want
+    */
+    if (rename(old_name, new_name) != 0) {
+        x_Status_Return((errno == ENOENT) ? ERR_CORE_FILE_DOES_NOT_EXIST : ERR_CORE_FILE_RENAME_FAILED);
+        }
+    Sync_Folder(new_name);
+    x_Status_Return_Success();
+}
+
+
+/* ***************************************************************************
+    FileSys_Link_File
+
+    Give an existing file a second name in the same folder, without copying
+    its contents. Any existing file with the new name must be deleted first.
+
+    new_name    --> the additional name the file should have
+    old_name    --> name of the existing file
+    return      <-- whether the link was created successfully
+**************************************************************************** */
+
+T_Status    FileSys_Link_File(T_Glyph_CPtr new_name,T_Glyph_CPtr old_name)
+{
+    /* validate the parameters
+    */
+    if (x_Trap_Opt((old_name == NULL) || (new_name == NULL))) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    if (link(old_name, new_name) != 0) {
+        x_Status_Return((errno == ENOENT) ? ERR_CORE_FILE_DOES_NOT_EXIST : ERR_CORE_FILE_LINK_FAILED);
+        }
+    x_Status_Return_Success();
+}
+
+
+/* ***************************************************************************
+    FileSys_Sync_File
+
+    Make sure everything written to the file has reached the disk, so that
+    it's safe to rename it into place. This doesn't use Cocoa, so it's safe to
+    call from a worker thread.
+
+    filename    --> filename indicating the file to flush
+    return      <-- whether the file was flushed successfully
+**************************************************************************** */
+
+T_Status    FileSys_Sync_File(T_Glyph_CPtr filename)
+{
+    int             fd, result;
+
+    /* validate the parameters
+    */
+    if (x_Trap_Opt(filename == NULL)) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    fd = open(filename, O_RDWR);
+    if (fd < 0) {
+        x_Status_Return(ERR_CORE_FILE_DOES_NOT_EXIST);
+        }
+
+    /* fsync only gets the data as far as the drive, so ask for a full sync
+        first, and fall back to fsync if the file system doesn't support it
+    */
+    result = fcntl(fd, F_FULLFSYNC);
+    if (result == -1)
+        result = fsync(fd);
+    close(fd);
+    if (result != 0) {
+        x_Status_Return(ERR_CORE_FILE_SYNC_FAILED);
+        }
+    x_Status_Return_Success();
+}
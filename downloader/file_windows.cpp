@@ -46,6 +46,9 @@
 #define ERR_CORE_FILE_DOES_NOT_EXIST            0x121
 #define ERR_CORE_FILE_CREATE_FAILED             0x122
 #define ERR_CORE_FILE_DELETE_FAILED             0x123
+#define ERR_CORE_FILE_RENAME_FAILED             0x126
+#define ERR_CORE_FILE_SYNC_FAILED               0x127
+#define ERR_CORE_FILE_LINK_FAILED               0x128
 
 
 /*  Write the specified text out to the given file using a simple ofstream. We
@@ -473,4 +476,96 @@ T_Status    FileSys_Get_File_Attributes(T_Glyph_CPtr filename,
     */
     *attribute = Translate_Attributes(attributes);
     x_Status_Return_Success();
-}
\ No newline at end of file
+}
+
+
+/* ***************************************************************************
+    FileSys_Rename_File
+
+    Rename a file, replacing any existing file with the new name. The file
+    must stay in the same folder, so the rename is a single operation - there's
+    never a point where neither the old nor the new file is present.
+
+    new_name    --> name the file should have afterwards
+    old_name    --> name of the existing file
+    return      <-- whether the file was renamed successfully
+**************************************************************************** */
+
+T_Status    FileSys_Rename_File(T_Glyph_CPtr new_name,T_Glyph_CPtr old_name)
+{
+    /* validate the parameters
+    */
+    if (x_Trap_Opt((old_name == NULL) || (new_name == NULL))) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    /* rename the file, overwriting any existing file
+    */
+    if (!MoveFileEx(old_name,new_name,MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        x_Status_Return(ERR_CORE_FILE_RENAME_FAILED);
+        }
+    x_Status_Return_Success();
+}
+
+
+/* ***************************************************************************
+    FileSys_Link_File
+
+    Give an existing file a second name in the same folder, without copying
+    its contents. Any existing file with the new name must be deleted first.
+
+    new_name    --> the additional name the file should have
+    old_name    --> name of the existing file
+    return      <-- whether the link was created successfully
+**************************************************************************** */
+
+T_Status    FileSys_Link_File(T_Glyph_CPtr new_name,T_Glyph_CPtr old_name)
+{
+    /* validate the parameters
+    */
+    if (x_Trap_Opt((old_name == NULL) || (new_name == NULL))) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    if (!CreateHardLink(new_name,old_name,NULL)) {
+        x_Status_Return(ERR_CORE_FILE_LINK_FAILED);
+        }
+    x_Status_Return_Success();
+}
+
+
+/* ***************************************************************************
+    FileSys_Sync_File
+
+    Make sure everything written to the file has reached the disk, so that
+    it's safe to rename it into place.
+
+    filename    --> filename indicating the file to flush
+    return      <-- whether the file was flushed successfully
+**************************************************************************** */
+
+T_Status    FileSys_Sync_File(T_Glyph_CPtr filename)
+{
+    HANDLE          handle;
+    BOOL            is_ok;
+
+    /* validate the parameters
+    */
+    if (x_Trap_Opt(filename == NULL)) {
+        x_Status_Return(ERR_CORE_INVALID_INBOUND_PARAM);
+        }
+
+    /* flushing needs write access to the file
+    */
+    handle = CreateFile(filename, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        x_Status_Return(ERR_CORE_FILE_DOES_NOT_EXIST);
+        }
+    is_ok = FlushFileBuffers(handle);
+    CloseHandle(handle);
+    if (!is_ok) {
+        x_Status_Return(ERR_CORE_FILE_SYNC_FAILED);
+        }
+    x_Status_Return_Success();
+}
@@ -52,7 +52,9 @@ struct  T_Memory_Info {
     };
 
 
-/* Define all the different types of nodes we might want to duplicate
+/* Define all the different types of nodes we might want to merge from an
+    extension, in the order we merge them. Fields and linkages replace any
+    existing value rather than being duplicated.
 */
 enum    E_Node_Type {
     e_node_tag = 0,
@@ -64,12 +66,23 @@ enum    E_Node_Type {
     e_node_exprreq,
     e_node_pickreq,
     e_node_containerreq,
+    e_node_fieldval,
+    e_node_link,
     };
 
+#define NODE_TYPE_COUNT     (e_node_link + 1)
+
+
+/* Things in a document, indexed by id. Only the first thing with each id is
+    indexed, since that's the one a search through the document would find.
+*/
+typedef map<string, T_XML_Node>     T_Thing_Index;
+
 
 /* Structure to support delayed copying of scripts
 */
 struct  T_Delayed_Copy {
+    T_XML_Node      parent;
     T_XML_Node      target;
     T_Glyph_CPtr    thing_id;
     T_Glyph_CPtr    index;
@@ -79,23 +92,55 @@ typedef vector<T_Delayed_Copy>  T_Copy_Vector;
 typedef T_Copy_Vector::iterator T_Copy_Iter;
 
 
+/* Prerequisite text repeats a great deal across feats, paths and destinies
+    (e.g. "Dwarf", "Wisdom 13", "Trained in Religion"), so we remember what
+    each prerequisite chunk resolved to and replay it the next time we see the
+    same chunk, rather than searching the mappings and class documents again.
+    While a chunk is being resolved, everything it outputs is recorded.
+*/
+enum    E_Prereq_Output {
+    e_prereq_tag = 0,
+    e_prereq_tier,
+    e_prereq_exprreq,
+    e_prereq_prereq,
+    e_prereq_field,
+    };
+
+struct  T_Prereq_Output {
+    E_Prereq_Output     type;
+    string              a;
+    string              b;
+    };
+
+struct  T_Prereq_Resolution {
+    vector<T_Prereq_Output> outputs;
+    T_Glyph_Ptr         last_class;
+    T_Glyph_Ptr         last_race;
+    T_Int32U            mapping_generation;
+    T_Int32U            symbol_count;
+    bool                is_logged;
+    };
+
+typedef map<string, T_Prereq_Resolution>    T_Prereq_Cache;
+
+
 /* Define static variables used below
 */
-static ofstream *       l_log = NULL;
+static T_Prereq_Cache   l_prereq_cache;
+static T_Prereq_Resolution *    l_prereq_record = NULL;
 
 
 void        Initialize_Helper(ofstream * stream)
 {
-    x_Trap_Opt(l_log != NULL);
-
-    if (Is_Log())
-        l_log = stream;
+    Log_Open(Is_Log() ? stream : NULL);
 }
 
 
 void        Shutdown_Helper(void)
 {
-    l_log = NULL;
+    Log_Close();
+    l_prereq_cache.clear();
+    Scratch_Shutdown_Thread();
 }
 
 
@@ -140,28 +185,64 @@ void        Mem_Release(T_Void_Ptr ptr)
 }
 
 
-void        Log_Message(T_Glyph_Ptr message, bool is_console)
+/* Stages that run on worker threads use a thread per processor, unless we've
+    been told to use fewer (e.g. so several downloads can run side by side)
+*/
+static  T_Int32U    l_worker_count = 0;
+
+void        Thread_Set_Worker_Count(T_Int32U count)
 {
-    /* Output the message to our log file and to the console if requested. Make
-        sure to flush appropriately so everything is updated immediately - we
-        want that more than we want to save a tiny amount of performance.
-    */
-    if (is_console) {
-        printf("%s", message);
-        fflush(stdout);
-        }
-    if (l_log != NULL) {
-        (*l_log) << message;
-        l_log->flush();
+    l_worker_count = count;
+}
+
+
+T_Int32U    Thread_Get_Worker_Count(void)
+{
+    if (l_worker_count > 0)
+        return(l_worker_count);
+    return(Thread_Get_Processor_Count());
+}
+
+
+/* A simple lock for protecting shared data that's only held briefly. The lock
+    is just a counter that starts at 0, so it needs no setting up - whoever
+    takes it from 0 to 1 holds it, and anyone else backs off and tries again.
+*/
+void        Thread_Lock(volatile T_Int32S * lock)
+{
+    while (Thread_Atomic_Add(lock, 1) != 1) {
+        Thread_Atomic_Add(lock, -1);
+        Pause_Execution(0);
         }
 }
 
 
+void        Thread_Unlock(volatile T_Int32S * lock)
+{
+    Thread_Atomic_Add(lock, -1);
+}
+
+
+/* Read a 64-bit hash written out in hex, as kept in the output manifest and
+    the download journal - strtoul can't hold one everywhere, so we read it
+    ourselves. The end is set to the first character after the hash.
+*/
+T_Int64U    Parse_Hash(T_Glyph_Ptr text, T_Glyph_Ptr * end)
+{
+    T_Int64U        hash;
+
+    for (hash = 0; isxdigit((T_Int8U) *text); text++)
+        hash = (hash << 4) | (isdigit((T_Int8U) *text) ? *text - '0' : (tolower(*text) - 'a' + 10));
+    *end = text;
+    return(hash);
+}
+
+
 bool        Check_Duplicate_Ids(T_Glyph_Ptr text, T_List_Ids * id_list)
 {
-    T_Int32U        i, count;
     T_Unique        power_id;
-    T_Unique        check_id;
+
+    x_Profile_Count(e_counter_thing_id_attempts);
 
     /* Make sure this is a valid unique id - if not, that's a problem
     */
@@ -170,14 +251,9 @@ bool        Check_Duplicate_Ids(T_Glyph_Ptr text, T_List_Ids * id_list)
     power_id = UniqueId_From_Text(text);
 
     /* Check to make sure we don't have a collision
-        FIX - this is doing a linear search, optimize it
     */
-    count = id_list->size();
-    for (i = 0; i < count; i++) {
-        check_id = (*id_list)[i];
-        if (check_id == power_id)
-            return(false);
-        }
+    if (id_list->count(power_id) != 0)
+        return(false);
 
     return(true);
 }
@@ -315,6 +391,8 @@ bool            Generate_Thing_Id(T_Glyph_Ptr buffer, T_Glyph_Ptr init, T_Glyph_
     T_Unique        thing_id;
     T_Glyph         name[1000];
 
+    x_Profile_Count(e_counter_thing_ids);
+
     /* Zero out the buffer (so we don't have to worry about null terminating)
         and then copy our initial length of stuff into it
     */
@@ -417,7 +495,7 @@ finish_id:
 
     /* Add this id to the list so other powers can check it
     */
-    id_list->push_back(thing_id);
+    id_list->insert(thing_id);
 
     /* Add the new id to our list of ids
     */
@@ -425,13 +503,126 @@ finish_id:
 }
 
 
-bool            Generate_Tag_Id(T_Glyph_Ptr buffer, T_Glyph_Ptr tag_name, T_XML_Node root)
+C_Tag_Registry::C_Tag_Registry(void)
+{
+    m_root = NULL;
+    m_is_any_case = false;
+}
+
+
+/* Index all the existing entries beneath the root - after this, new entries
+    should be registered with Add as they're created. If is_any_case is set,
+    names are matched regardless of case.
+*/
+void            C_Tag_Registry::Initialize(T_XML_Node root, T_Glyph_CPtr element, T_Glyph_CPtr id_attr,
+                                            bool is_any_case)
 {
     long            result;
-    T_Unique        id;
-    T_Glyph_Ptr     ptr;
     T_XML_Node      node;
-    T_List_Ids      id_list;
+
+    Reset();
+    m_root = root;
+    m_element = element;
+    m_id_attr = id_attr;
+    m_is_any_case = is_any_case;
+
+    result = XML_Get_First_Named_Child(m_root, m_element.c_str(), &node);
+    while (result == 0) {
+        Add(node);
+        result = XML_Get_Next_Named_Child(m_root, &node);
+        }
+}
+
+
+void            C_Tag_Registry::Reset(void)
+{
+    m_root = NULL;
+    m_ids.clear();
+    m_names.clear();
+    m_id_nodes.clear();
+}
+
+
+/* The key a name is stored under - folded to lower case if we're matching
+    names regardless of case
+*/
+string          C_Tag_Registry::Name_Key(T_Glyph_CPtr name)
+{
+    string          key;
+    size_t          i;
+
+    key = name;
+    if (m_is_any_case)
+        for (i = 0; i < key.size(); i++)
+            key[i] = tolower((unsigned char) key[i]);
+    return(key);
+}
+
+
+T_XML_Node      C_Tag_Registry::Find_Name(T_Glyph_CPtr name)
+{
+    map<string, T_XML_Node>::iterator   it;
+
+    it = m_names.find(Name_Key(name));
+    return((it == m_names.end()) ? NULL : it->second);
+}
+
+
+T_XML_Node      C_Tag_Registry::Find_Id(T_Glyph_CPtr id)
+{
+    map<string, T_XML_Node>::iterator   it;
+
+    it = m_id_nodes.find(id);
+    return((it == m_id_nodes.end()) ? NULL : it->second);
+}
+
+
+/* Return a pointer to the id attribute of the entry with the given name, or
+    NULL if there isn't one
+*/
+T_Glyph_CPtr    C_Tag_Registry::Find_Id_For_Name(T_Glyph_CPtr name)
+{
+    T_XML_Node      node;
+
+    node = Find_Name(name);
+    if (node == NULL)
+        return(NULL);
+    return(XML_Get_Attribute_Pointer(node, m_id_attr.c_str()));
+}
+
+
+/* Register a new entry. The first entry with a given name or id wins, which
+    matches what a search of the document from the start would find.
+*/
+void            C_Tag_Registry::Add(T_XML_Node node)
+{
+    T_Glyph_CPtr    id, name;
+
+    if (x_Trap_Opt(node == NULL))
+        return;
+
+    id = XML_Get_Attribute_Pointer(node, m_id_attr.c_str());
+    if ((id != NULL) && (id[0] != '\0')) {
+        m_id_nodes.insert(make_pair(string(id), node));
+        if (UniqueId_Is_Valid((T_Glyph_Ptr) id))
+            m_ids.insert(UniqueId_From_Text((T_Glyph_Ptr) id));
+        }
+    name = XML_Get_Attribute_Pointer(node, "name");
+    if ((name != NULL) && (name[0] != '\0'))
+        m_names.insert(make_pair(Name_Key(name), node));
+}
+
+
+bool            C_Tag_Registry::Generate_Id(T_Glyph_Ptr buffer, T_Glyph_Ptr init, T_Glyph_Ptr name,
+                                            T_Int32U second_length)
+{
+    return(Generate_Thing_Id(buffer, init, name, &m_ids, second_length));
+}
+
+
+bool            Generate_Tag_Id(T_Glyph_Ptr buffer, T_Glyph_Ptr tag_name, C_Tag_Registry * registry)
+{
+    T_Glyph_Ptr     ptr;
 
     /* Check for an explicit id in our list - if so, just use it
     */
@@ -441,22 +632,9 @@ bool            Generate_Tag_Id(T_Glyph_Ptr buffer, T_Glyph_Ptr tag_name, T_XML_
         return(true);
         }
 
-    /* Build a unique id list from our tag group - we should really cache this
-        for improved performance but that doesn't matter right now
+    /* Generate a new id that doesn't collide with any tag in the group
     */
-    result = XML_Get_First_Named_Child(root, "extgroup", &node);
-    while (result == 0) {
-        ptr = (T_Glyph_Ptr) XML_Get_Attribute_Pointer(node, "tag");
-        if (!UniqueId_Is_Valid(ptr))
-            x_Trap_Opt(1);
-        else {
-            id = UniqueId_From_Text(ptr);
-            id_list.push_back(id);
-            }
-        result = XML_Get_Next_Named_Child(root, &node);
-        }
-
-    return(Generate_Thing_Id(buffer, "", tag_name, &id_list, 5));
+    return(registry->Generate_Id(buffer, "", tag_name, 5));
 }
 
 
@@ -538,6 +716,10 @@ T_Int32S        Create_Thing_Node(T_XML_Node parent, T_Glyph_Ptr term, T_Glyph_P
     if (x_Trap_Opt(result != 0))
         return(result);
 
+    /* Record the thing in our symbol table, so that post-processing can find
+        it without searching the document
+    */
+    Symbol_Add_Thing(parent, *node, id, compset, name);
     return(0);
 }
 
@@ -645,15 +827,19 @@ void        Split_To_Tags(T_XML_Node node, T_Base_Info * info, T_Glyph_Ptr text,
                             T_Glyph_Ptr * split_words, T_Int32U split_word_count)
 {
     T_Int32U            i, chunk_count;
-    T_Glyph_Ptr         chunks[1000];
-    T_Glyph             buffer[100000];
+    T_Glyph_Ptr         buffer, chunks[1000];
+    T_Glyph             message[1000];
+    C_Scratch           scratch;
 
     if ((text == NULL) || (text[0] == '\0')) {
-        sprintf(buffer, "No tags found for group %s in thing %s\n", group, info->name);
-        Log_Message(buffer);
+        sprintf(message, "No tags found for group %s in thing %s\n", group, info->name);
+        Log_Message(message);
         return;
         }
 
+    buffer = scratch.Acquire(strlen(text) + 1);
+    if (x_Trap_Opt(buffer == NULL))
+        return;
     chunk_count = x_Array_Size(chunks);
     Split_To_Array(buffer, chunks, &chunk_count, text, splitchars, ignore_after,
                     split_words, split_word_count);
@@ -671,15 +857,19 @@ void        Split_To_Dynamic_Tags(T_XML_Node node, T_Base_Info * info, T_Glyph_P
                             bool is_dynamic_name, T_Glyph_Ptr ignore_after)
 {
     T_Int32U            i, chunk_count;
-    T_Glyph_Ptr         chunks[1000];
-    T_Glyph             buffer[100000];
+    T_Glyph_Ptr         buffer, chunks[1000];
+    T_Glyph             message[1000];
+    C_Scratch           scratch;
 
     if ((text == NULL) || (text[0] == '\0')) {
-        sprintf(buffer, "No tags found for group %s in thing %s\n", group, info->name);
-        Log_Message(buffer);
+        sprintf(message, "No tags found for group %s in thing %s\n", group, info->name);
+        Log_Message(message);
         return;
         }
 
+    buffer = scratch.Acquire(strlen(text) + 1);
+    if (x_Trap_Opt(buffer == NULL))
+        return;
     chunk_count = x_Array_Size(chunks);
     Split_To_Array(buffer, chunks, &chunk_count, text, splitchars, ignore_after);
 
@@ -780,8 +970,7 @@ T_Int32S        Output_Source(T_XML_Node node, T_Glyph_Ptr source)
     /* If there's no source by that id under our sources file, create a new
         node for it
     */
-    result = XML_Get_First_Named_Child_With_Attr(Get_Source_Root(), "source", "id", id_text, &child);
-    if (result == 0)
+    if (Get_Source_Registry()->Find_Id(id_text) != NULL)
         return(0);
     XML_Create_Child(Get_Source_Root(), "source", &child);
     XML_Write_Text_Attribute(child, "id", id_text);
@@ -790,21 +979,25 @@ T_Int32S        Output_Source(T_XML_Node node, T_Glyph_Ptr source)
     sprintf(buffer, "Enable rules from the '%s' supplement.", source);
     XML_Write_Text_Attribute(child, "description", buffer);
     XML_Write_Boolean_Attribute(child, "default", true);
+    Get_Source_Registry()->Add(child);
     return(0);
 }
 
 
 T_Int32S        Output_Language(T_XML_Node node, T_Glyph_Ptr name, T_Base_Info * info,
-                                T_List_Ids * id_list, C_Pool * pool, T_Glyph_Ptr boot_group,
+                                T_List_Ids * id_list, T_Glyph_Ptr boot_group,
                                 T_Glyph_Ptr boot_tag)
 {
     long                result;
     T_Glyph_Ptr         map;
     T_Glyph             lang_id[100], message[500];
 
-    /* If we already know this language, use the existing version
+    /* If this is one of the standard languages, or one we've already created,
+        use the existing version
     */
     map = Mapping_Find("language", name);
+    if (map == NULL)
+        map = (T_Glyph_Ptr) Get_Language_Registry()->Find_Id_For_Name(name);
     if (map != NULL) {
         result = Output_Bootstrap(info->node, map, info, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
                                     boot_group, boot_tag);
@@ -825,9 +1018,9 @@ T_Int32S        Output_Language(T_XML_Node node, T_Glyph_Ptr name, T_Base_Info *
                             name, lang_id, "", UNIQUENESS_UNIQUE, NULL, &node, true);
     if (x_Trap_Opt(result != 0))
         return(result);
+    Get_Language_Registry()->Add(node);
     Output_Bootstrap(info->node, lang_id, info, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
                                 boot_group, boot_tag);
-    Mapping_Add("language", pool->Acquire(name), pool->Acquire(lang_id));
     return(0);
 }
 
@@ -940,6 +1133,7 @@ T_Int32S        Output_Tag(T_XML_Node node, T_Glyph_Ptr group, T_Glyph_Ptr tag,
     XML_Write_Text_Attribute(child, "tag", id_text);
     if (is_dynamic_name && (strcmp(id_text, tag_name) != 0))
         XML_Write_Text_Attribute(child, "name", tag_name);
+    Symbol_Add_Tag(node, group, id_text);
     return(0);
 }
 
@@ -1264,6 +1458,99 @@ T_Int32S        Output_Eval_Rule(T_XML_Node node, T_Glyph_CPtr script, T_Glyph_P
 }
 
 
+static void     Prereq_Record(E_Prereq_Output type, T_Glyph_CPtr a, T_Glyph_CPtr b)
+{
+    T_Prereq_Output     output;
+
+    if (l_prereq_record == NULL)
+        return;
+    output.type = type;
+    output.a = a;
+    output.b = (b == NULL) ? "" : b;
+    l_prereq_record->outputs.push_back(output);
+}
+
+
+static void     Prereq_Tag(T_Base_Info * info, T_Glyph_Ptr group, T_Glyph_Ptr tag)
+{
+    Prereq_Record(e_prereq_tag, group, tag);
+    Output_Tag(info->node, group, tag, info);
+}
+
+
+/* Add a tier tag, unless the thing already has one
+*/
+static void     Prereq_Tier(T_Base_Info * info, T_Glyph_Ptr tier)
+{
+    Prereq_Record(e_prereq_tier, tier, NULL);
+    if (XML_Get_Named_Child_With_Attr_Count(info->node, "tag", "group", "Tier") == 0)
+        Output_Tag(info->node, "Tier", tier, info);
+}
+
+
+static void     Prereq_Exprreq(T_Base_Info * info, T_Glyph_Ptr message, T_Glyph_Ptr expr)
+{
+    Prereq_Record(e_prereq_exprreq, message, expr);
+    Output_Exprreq(info->node, message, expr, info);
+}
+
+
+static void     Prereq_Prereq(T_Base_Info * info, T_Glyph_Ptr message, T_Glyph_Ptr script)
+{
+    Prereq_Record(e_prereq_prereq, message, script);
+    Output_Prereq(info->node, message, script, info);
+}
+
+
+static void     Prereq_Field(T_Base_Info * info, T_Glyph_Ptr field, T_Glyph_Ptr value)
+{
+    Prereq_Record(e_prereq_field, field, value);
+    Output_Field(info->node, field, value, info);
+}
+
+
+/* Messages mention the thing being processed, so a chunk that logged anything
+    can't be replayed for another thing - just note that it can't be cached
+*/
+static void     Prereq_Log(T_Glyph_Ptr message)
+{
+    if (l_prereq_record != NULL)
+        l_prereq_record->is_logged = true;
+    Log_Message(message);
+}
+
+
+static void     Prereq_Replay(T_Prereq_Resolution * resolution, T_Base_Info * info)
+{
+    T_Int32U            i, count;
+    T_Glyph_Ptr         a, b;
+
+    count = resolution->outputs.size();
+    for (i = 0; i < count; i++) {
+        a = (T_Glyph_Ptr) resolution->outputs[i].a.c_str();
+        b = (T_Glyph_Ptr) resolution->outputs[i].b.c_str();
+        switch (resolution->outputs[i].type) {
+            case e_prereq_tag :
+                Output_Tag(info->node, a, b, info);
+                break;
+            case e_prereq_tier :
+                if (XML_Get_Named_Child_With_Attr_Count(info->node, "tag", "group", "Tier") == 0)
+                    Output_Tag(info->node, "Tier", a, info);
+                break;
+            case e_prereq_exprreq :
+                Output_Exprreq(info->node, a, b, info);
+                break;
+            case e_prereq_prereq :
+                Output_Prereq(info->node, a, b, info);
+                break;
+            case e_prereq_field :
+                Output_Field(info->node, a, b, info);
+                break;
+            }
+        }
+}
+
+
 static T_Glyph_Ptr Find_Deity(T_Glyph_Ptr deity_name)
 {
     T_Glyph_Ptr         ptr;
@@ -1292,12 +1579,11 @@ static T_Glyph_Ptr Find_Deity(T_Glyph_Ptr deity_name)
 
 static bool         Check_Thing_Name(T_XML_Node root, T_Glyph_Ptr id_text, T_Glyph_Ptr req_name)
 {
-    long                result;
     T_XML_Node          node;
     T_Glyph_Ptr         name;
 
-    result = XML_Get_First_Named_Child_With_Attr(root, "thing", "id", id_text, &node);
-    if (result != 0)
+    node = Symbol_Find_Id(root, id_text);
+    if (node == NULL)
         return(false);
     name = (T_Glyph_Ptr) XML_Get_Attribute_Pointer(node, "name");
     if (stricmp(req_name, name) == 0)
@@ -1330,8 +1616,8 @@ static T_Glyph_Ptr  Search_Classes(T_Glyph_Ptr name, T_Glyph_Ptr find_id, bool i
 
     /* Find the thing node with an appropriate id
     */
-    result = XML_Get_First_Named_Child_With_Attr(root, "thing", "id", find_id, &node);
-    if (x_Trap_Opt(result != 0))
+    node = Symbol_Find_Id(root, find_id);
+    if (x_Trap_Opt(node == NULL))
         return(NULL);
 
     /* Go through the bootstraps for the thing and record the unique ids
@@ -1387,7 +1673,7 @@ static bool Find_Feature(T_Glyph_Ptr text, T_Glyph_Ptr last_class, T_Base_Info *
     if (last_class == NULL) {
         if (!is_last_gasp) {
             sprintf(message, "No class / race requirement found for feature '%s' on thing %s\n", text, info->name);
-            Log_Message(message);
+            Prereq_Log(message);
             }
         return(false);
         }
@@ -1399,7 +1685,7 @@ static bool Find_Feature(T_Glyph_Ptr text, T_Glyph_Ptr last_class, T_Base_Info *
     if (ptr == NULL) {
         if (!is_last_gasp) {
             sprintf(message, "Class / race feature requirement '%s' on thing %s not found\n", text, info->name);
-            Log_Message(message);
+            Prereq_Log(message);
             }
         return(false);
         }
@@ -1409,7 +1695,7 @@ static bool Find_Feature(T_Glyph_Ptr text, T_Glyph_Ptr last_class, T_Base_Info *
         sprintf(expr, POWER_PREREQ, ptr);
     else
         sprintf(expr, CLASS_FEATURE_PREREQ, ptr);
-    Output_Prereq(info->node, message, expr, info);
+    Prereq_Prereq(info, message, expr);
 
     return(true);
 }
@@ -1427,7 +1713,7 @@ static bool Find_Feat(T_Glyph_Ptr text, T_Base_Info * info, bool is_last_gasp)
     if (stricmp(text, "Shield Proficiency (Light)") == 0) {
         sprintf(message, "'%s' required", text);
         strcpy(expr, "hero.tagis[ArmorProf.apShieldLg] <> 0");
-        Output_Exprreq(info->node, message, expr, info);
+        Prereq_Exprreq(info, message, expr);
         return(true);
         }
 
@@ -1439,14 +1725,14 @@ static bool Find_Feat(T_Glyph_Ptr text, T_Base_Info * info, bool is_last_gasp)
             ptr = (tuple->b == NULL) ? tuple->a : tuple->b;
             sprintf(message, "Feat '%s' required", tuple->a);
             sprintf(expr, "hero.tagis[Feat.%s] <> 0", ptr);
-            Output_Exprreq(info->node, message, expr, info);
+            Prereq_Exprreq(info, message, expr);
             return(true);
             }
         }
 
     if (!is_last_gasp) {
         sprintf(message, "Feat requirement '%s' on thing %s not found\n", text, info->name);
-        Log_Message(message);
+        Prereq_Log(message);
         }
     return(false);
 }
@@ -1505,12 +1791,12 @@ static bool Find_Alternates(T_Glyph_Ptr text, T_Base_Info * info, T_Glyph_Ptr *
         if (temp != NULL) {
             if (last != NULL)
                 *last = temp;
-            Output_Tag(info->node, group, temp, info);
+            Prereq_Tag(info, group, temp);
             is_found = true;
             }
         else if (!is_last_gasp) {
             sprintf(message, "No %s matched for '%s' on prereq for %s\n", mapping, text, info->name);
-            Log_Message(message);
+            Prereq_Log(message);
             }
 
         /* Find the place where we separate from the next item
@@ -1547,11 +1833,11 @@ static void Find_Background(T_Glyph_Ptr text, T_Base_Info * info)
 
     ptr = Mapping_Find("background", text);
     if (ptr != NULL) {
-        Output_Tag(info->node, "ReqBackgr", ptr, info);
+        Prereq_Tag(info, "ReqBackgr", ptr);
         }
     else {
         sprintf(message, "No background matched for '%s' on prereq for %s\n", text, info->name);
-        Log_Message(message);
+        Prereq_Log(message);
         }
 }
 
@@ -1592,7 +1878,7 @@ static void Output_Attr_Requirement(T_XML_Node node, T_Glyph_Ptr attr, T_Glyph_P
         requirement
     */
     if ((*ptr == '\0') || (strncmp(ptr, "or ", 3) != 0)) {
-        Output_Field(info->node, attr, As_Int(value), info);
+        Prereq_Field(info, attr, As_Int(value));
         return;
         }
 
@@ -1609,7 +1895,7 @@ static void Output_Attr_Requirement(T_XML_Node node, T_Glyph_Ptr attr, T_Glyph_P
     if (attr_id2 == NULL)
         attr_id2 = Mapping_Find("attrabbr", ptr, true);
     if (attr_id2 == NULL) {
-        Output_Field(info->node, attr, As_Int(value), info);
+        Prereq_Field(info, attr, As_Int(value));
         return;
         }
     name2 = ptr;
@@ -1625,316 +1911,371 @@ static void Output_Attr_Requirement(T_XML_Node node, T_Glyph_Ptr attr, T_Glyph_P
     sprintf(message, "Need %s %lu or %s %lu", name, value, name2, value2);
     sprintf(script, "validif (#trait[%s] >= %lu)\nvalidif (#trait[%s] >= %lu)",
             attr_id, value, attr_id2, value2);
-    Output_Prereq(node, message, script, info);
+    Prereq_Prereq(info, message, script);
 }
 
 
-void            Output_Prereqs(T_Base_Info * info, T_List_Ids * id_list)
+static void     Resolve_Prereq_Chunk(T_Glyph_Ptr chunk, T_Base_Info * info,
+                                        T_Glyph_Ptr * last_class, T_Glyph_Ptr * last_race)
 {
-    T_Int32U            i, chunk_count;
     T_Int32S            value;
-    T_Glyph_Ptr         deity_id, ptr, temp, last_class, last_race, chunks[1000];
-    T_Glyph             buffer[100000], buffer2[1000], message[1000];
+    T_Glyph_Ptr         deity_id, ptr, temp;
+    T_Glyph             buffer2[1000], message[1000];
 
-    if ((info->prerequisite == NULL) || (info->prerequisite[0] == '\0'))
+    /* "Any class specific multiclass feat" = requires multiclass tag
+    */
+    if (strcmp(chunk, "Any class-specific multiclass feat") == 0) {
+        Prereq_Exprreq(info, "Multiclass feat required", "hero.tagis[Multiclass.?] <> 0");
         return;
-    Output_Field(info->node, "reqText", info->prerequisite, info);
+        }
 
-    last_class = NULL;
-    last_race = NULL;
-    chunk_count = x_Array_Size(chunks);
-    Split_To_Array(buffer, chunks, &chunk_count, info->prerequisite, ",.;");
-    for (i = 0; i < chunk_count; i++) {
+    /* "Paragon multiclassing as a <x>" = requires multiclass tag for class
+        X, requires Paragon tier
+    */
+    if (strnicmp(chunk, "Paragon multiclassing as a", 26) == 0) {
+        ptr = chunk + 26;
 
-        /* If this starts with "or", skip that - it's a follow-on from a
-            previous thingy, so we have to parse it separately
+        /* Output the paragon tag if we don't already have a tier tag
         */
-        if (strnicmp(chunks[i], "or ", 3) == 0) {
-            chunks[i] += 3;
-            while (x_Is_Space(*chunks[i]))
-                chunks[i]++;
-            }
+        Prereq_Tier(info, "Paragon");
 
-        /* "Any class specific multiclass feat" = requires multiclass tag
+        /* Parse out the letter 'n' (for catching 'an') and any spaces,
+            then find the multiclass tag for that class
+            NOTE: also check the fake class list, to handle things like the
+            fighter/warlord that were converted to essentials classes)
         */
-        if (strcmp(chunks[i], "Any class-specific multiclass feat") == 0) {
-            Output_Exprreq(info->node, "Multiclass feat required", "hero.tagis[Multiclass.?] <> 0", info);
-            continue;
+        if (*ptr == 'n')
+            ptr++;
+        while (*ptr == ' ')
+            ptr++;
+        *ptr = toupper(*ptr);
+        temp = Mapping_Find("class", ptr);
+        if (temp == NULL)
+            temp = Mapping_Find("fakeclass", ptr);
+        if (temp == NULL) {
+            sprintf(message, "Couldn't find class '%s' on prereq for %s\n", ptr, info->name);
+            Prereq_Log(message);
+            }
+        else {
+            sprintf(buffer2, "Requires %s multiclass", ptr);
+            sprintf(message, "hero.tagis[Multiclass.%s] <> 0", temp);
+            Prereq_Exprreq(info, buffer2, message);
             }
+        return;
+        }
 
-        /* "Paragon multiclassing as a <x>" = requires multiclass tag for class
-            X, requires Paragon tier
-        */
-        if (strnicmp(chunks[i], "Paragon multiclassing as a", 26) == 0) {
-            ptr = chunks[i] + 26;
+    /* Channel Divinity
+    */
+    if (stricmp(chunk, "Channel Divinity class feature") == 0) {
+        Prereq_Tag(info, "User", "ReqChanDiv");
+        return;
+        }
 
-            /* Output the paragon tag if we don't already have a tier tag
-            */
-            if (XML_Get_Named_Child_With_Attr_Count(info->node, "tag", "group", "Tier") == 0)
-                Output_Tag(info->node, "Tier", "Paragon", info);
+    /* If this chunk has 'level' in it, treat it as a level requirement -
+        parse the first number out and assume that's the requirement.
+    */
+    if (strstr(chunk, "level") != NULL) {
+        value = atoi(chunk);
+        if (value != 0)
+            Prereq_Tag(info, "ReqLevel", As_Int(value));
+        return;
+        }
 
-            /* Parse out the letter 'n' (for catching 'an') and any spaces,
-                then find the multiclass tag for that class
-                NOTE: also check the fake class list, to handle things like the
-                fighter/warlord that were converted to essentials classes)
-            */
-            if (*ptr == 'n')
-                ptr++;
-            while (*ptr == ' ')
-                ptr++;
-            *ptr = toupper(*ptr);
-            temp = Mapping_Find("class", ptr);
-            if (temp == NULL)
-                temp = Mapping_Find("fakeclass", ptr);
-            if (temp == NULL) {
-                sprintf(message, "Couldn't find class '%s' on prereq for %s\n", ptr, info->name);
-                Log_Message(message);
-                }
-            else {
-                sprintf(buffer2, "Requires %s multiclass", ptr);
-                sprintf(message, "hero.tagis[Multiclass.%s] <> 0", temp);
-                Output_Exprreq(info->node, buffer2, message, info);
-                }
-            continue;
-            }
+    /* If this chunk starts with 'must worship' or 'worship', add it as a
+        deity (if not already present) and then add a requirement for it.
+        NOTE: If it just specifies "a deity of the X domain", skip it -
+            the user can validate it themself.
+    */
+    if (strnicmp(chunk, "must worship", 12) == 0) {
+        ptr = chunk + 12;
+        if (strnicmp(ptr, " a deity of the", 15) == 0)
+            return;
+        deity_id = Find_Deity(ptr);
+        if (deity_id != NULL)
+            Prereq_Tag(info, "ReqDeity", deity_id);
+        return;
+        }
+    if (strnicmp(chunk, "worship", 7) == 0) {
+        ptr = chunk + 7;
+        if (strnicmp(ptr, " a deity of the", 15) == 0)
+            return;
+        deity_id = Find_Deity(ptr);
+        if (deity_id != NULL)
+            Prereq_Tag(info, "ReqDeity", deity_id);
+        return;
+        }
 
-        /* Channel Divinity
-        */
-        if (stricmp(chunks[i], "Channel Divinity class feature") == 0) {
-            Output_Tag(info->node, "User", "ReqChanDiv", info);
-            continue;
+    /* If this chunk starts with 'trained in', search for an appropriate
+        skill
+    */
+    if (strnicmp(chunk, "trained in", 10) == 0) {
+        ptr = chunk + 10;
+        while (*ptr == ' ')
+            ptr++;
+        ptr = Mapping_Find("skill", ptr);
+        if (ptr != NULL)
+            Prereq_Tag(info, "ReqSkill", ptr);
+        else {
+            sprintf(message, "No skill matched for '%s' on prereq for %s\n", chunk, info->name);
+            Prereq_Log(message);
             }
-
-        /* If this chunk has 'level' in it, treat it as a level requirement -
-            parse the first number out and assume that's the requirement.
-        */
-        if (strstr(chunks[i], "level") != NULL) {
-            value = atoi(chunks[i]);
-            if (value != 0)
-                Output_Tag(info->node, "ReqLevel", As_Int(value), info);
-            continue;
+        return;
+        }
+    if (strnicmp(chunk, "training in", 11) == 0) {
+        ptr = chunk + 11;
+        while (*ptr == ' ')
+            ptr++;
+        ptr = Mapping_Find("skill", ptr);
+        if (ptr != NULL)
+            Prereq_Tag(info, "ReqSkill", ptr);
+        else {
+            sprintf(message, "No skill matched for '%s' on prereq for %s\n", chunk, info->name);
+            Prereq_Log(message);
             }
+        return;
+        }
 
-        /* If this chunk starts with 'must worship' or 'worship', add it as a
-            deity (if not already present) and then add a requirement for it.
-            NOTE: If it just specifies "a deity of the X domain", skip it -
-                the user can validate it themself.
-        */
-        if (strnicmp(chunks[i], "must worship", 12) == 0) {
-            ptr = chunks[i] + 12;
-            if (strnicmp(ptr, " a deity of the", 15) == 0)
-                continue;
-            deity_id = Find_Deity(ptr);
-            if (deity_id != NULL)
-                Output_Tag(info->node, "ReqDeity", deity_id, info);
-            continue;
-            }
-        if (strnicmp(chunks[i], "worship", 7) == 0) {
-            ptr = chunks[i] + 7;
-            if (strnicmp(ptr, " a deity of the", 15) == 0)
-                continue;
-            deity_id = Find_Deity(ptr);
-            if (deity_id != NULL)
-                Output_Tag(info->node, "ReqDeity", deity_id, info);
-            continue;
-            }
+    /* If this chunk starts with 'profiency with', search for an appropriate
+        weapon
+    */
+    if (strnicmp(chunk, "proficiency with", 16) == 0) {
+        ptr = chunk + 16;
+        Find_Weapons(ptr, info, false);
+        return;
+        }
 
-        /* If this chunk starts with 'trained in', search for an appropriate
-            skill
-        */
-        if (strnicmp(chunks[i], "trained in", 10) == 0) {
-            ptr = chunks[i] + 10;
-            while (*ptr == ' ')
-                ptr++;
-            ptr = Mapping_Find("skill", ptr);
-            if (ptr != NULL)
-                Output_Tag(info->node, "ReqSkill", ptr, info);
-            else {
-                sprintf(message, "No skill matched for '%s' on prereq for %s\n", chunks[i], info->name);
-                Log_Message(message);
-                }
-            continue;
+    /* If this chunk ends in "role", match a role name
+    */
+    ptr = " role";
+    value = strlen(ptr);
+    if (stricmp(chunk + strlen(chunk) - value, ptr) == 0) {
+        chunk[strlen(chunk)-value] = '\0';
+        ptr = Mapping_Find("role", chunk);
+        if (ptr != NULL) {
+            Prereq_Tag(info, "ReqRole", ptr);
             }
-        if (strnicmp(chunks[i], "training in", 11) == 0) {
-            ptr = chunks[i] + 11;
-            while (*ptr == ' ')
-                ptr++;
-            ptr = Mapping_Find("skill", ptr);
-            if (ptr != NULL)
-                Output_Tag(info->node, "ReqSkill", ptr, info);
-            else {
-                sprintf(message, "No skill matched for '%s' on prereq for %s\n", chunks[i], info->name);
-                Log_Message(message);
-                }
-            continue;
+        else {
+            sprintf(message, "No role matched for '%s' on prereq for %s\n", chunk, info->name);
+            Prereq_Log(message);
             }
+        return;
+        }
 
-        /* If this chunk starts with 'profiency with', search for an appropriate
-            weapon
-        */
-        if (strnicmp(chunks[i], "proficiency with", 16) == 0) {
-            ptr = chunks[i] + 16;
-            Find_Weapons(ptr, info, false);
-            continue;
-            }
+    /* If the chunk ends in "regional benefit" or "background", match it
+    */
+    ptr = " regional benefit";
+    value = strlen(ptr);
+    if (stricmp(chunk + strlen(chunk) - value, ptr) == 0) {
+        chunk[strlen(chunk)-value] = '\0';
+        Find_Background(chunk, info);
+        return;
+        }
+    ptr = " regional background";
+    value = strlen(ptr);
+    if (stricmp(chunk + strlen(chunk) - value, ptr) == 0) {
+        chunk[strlen(chunk)-value] = '\0';
+        Find_Background(chunk, info);
+        return;
+        }
+    ptr = " background";
+    value = strlen(ptr);
+    if (stricmp(chunk + strlen(chunk) - value, ptr) == 0) {
+        chunk[strlen(chunk)-value] = '\0';
+        Find_Background(chunk, info);
+        return;
+        }
 
-        /* If this chunk ends in "role", match a role name
-        */
-        ptr = " role";
+    /* If this chunk starts in "any" and ends in "class", match a power
+        source
+    */
+    ptr = "any ";
+    value = strlen(ptr);
+    if (strnicmp(chunk, ptr, value) == 0) {
+        ptr = " class";
         value = strlen(ptr);
-        if (stricmp(chunks[i] + strlen(chunks[i]) - value, ptr) == 0) {
-            chunks[i][strlen(chunks[i])-value] = '\0';
-            ptr = Mapping_Find("role", chunks[i]);
-            if (ptr != NULL) {
-                Output_Tag(info->node, "ReqRole", ptr, info);
-                }
+        if (stricmp(chunk + strlen(chunk) - value, ptr) == 0) {
+            chunk[strlen(chunk)-value] = '\0';
+            ptr = Mapping_Find("powersrc", chunk+4);
+            if (ptr != NULL)
+                Prereq_Tag(info, "ReqPwrSrc", ptr);
             else {
-                sprintf(message, "No role matched for '%s' on prereq for %s\n", chunks[i], info->name);
-                Log_Message(message);
+                sprintf(message, "No power source matched for '%s' on prereq for %s\n", chunk, info->name);
+                Prereq_Log(message);
                 }
-            continue;
+            return;
             }
+        }
 
-        /* If the chunk ends in "regional benefit" or "background", match it
-        */
-        ptr = " regional benefit";
-        value = strlen(ptr);
-        if (stricmp(chunks[i] + strlen(chunks[i]) - value, ptr) == 0) {
-            chunks[i][strlen(chunks[i])-value] = '\0';
-            Find_Background(chunks[i], info);
-            continue;
-            }
-        ptr = " regional background";
-        value = strlen(ptr);
-        if (stricmp(chunks[i] + strlen(chunks[i]) - value, ptr) == 0) {
-            chunks[i][strlen(chunks[i])-value] = '\0';
-            Find_Background(chunks[i], info);
-            continue;
-            }
-        ptr = " background";
-        value = strlen(ptr);
-        if (stricmp(chunks[i] + strlen(chunks[i]) - value, ptr) == 0) {
-            chunks[i][strlen(chunks[i])-value] = '\0';
-            Find_Background(chunks[i], info);
-            continue;
-            }
+    /* If this chunk matches a race name, add a 'required race' tag
+    */
+    temp = Mapping_Find("race", chunk);
+    if (temp != NULL) {
+        *last_race = temp;
+        Prereq_Tag(info, "ReqRace", *last_race);
+        return;
+        }
 
-        /* If this chunk starts in "any" and ends in "class", match a power
-            source
-        */
-        ptr = "any ";
-        value = strlen(ptr);
-        if (strnicmp(chunks[i], ptr, value) == 0) {
-            ptr = " class";
-            value = strlen(ptr);
-            if (stricmp(chunks[i] + strlen(chunks[i]) - value, ptr) == 0) {
-                chunks[i][strlen(chunks[i])-value] = '\0';
-                ptr = Mapping_Find("powersrc", chunks[i]+4);
-                if (ptr != NULL)
-                    Output_Tag(info->node, "ReqPwrSrc", ptr, info);
-                else {
-                    sprintf(message, "No power source matched for '%s' on prereq for %s\n", chunks[i], info->name);
-                    Log_Message(message);
-                    }
-                continue;
-                }
-            }
+    /* If this chunk matches a class name, add a 'required class' tag
+        (strip off any " class" at the end first)
+    */
+    ptr = " class";
+    if (stricmpright(chunk, ptr) == 0) {
+        chunk[strlen(chunk)-strlen(ptr)] = '\0';
+        Find_Classes(chunk, info, last_class, false);
+        return;
+        }
 
-        /* If this chunk matches a race name, add a 'required race' tag
-        */
-        temp = Mapping_Find("race", chunks[i]);
-        if (temp != NULL) {
-            last_race = temp;
-            Output_Tag(info->node, "ReqRace", last_race, info);
-            continue;
-            }
+    /* If this chunk starts with 'only a', search for an appropriate
+        class as the next word
+    */
+    if (strnicmp(chunk, "only a ", 7) == 0) {
+        ptr = chunk + 7;
+        temp = strchr(ptr, ' ');
+        if (temp != NULL)
+            *temp = '\0';
+        Find_Classes(ptr, info, last_class, false);
+        return;
+        }
 
-        /* If this chunk matches a class name, add a 'required class' tag
-            (strip off any " class" at the end first)
-        */
-        ptr = " class";
-        if (stricmpright(chunks[i], ptr) == 0) {
-            chunks[i][strlen(chunks[i])-strlen(ptr)] = '\0';
-            Find_Classes(chunks[i], info, &last_class, false);
-            continue;
-            }
+    /* If this chunk matches the first three letters of an ability score
+        name (or the full name), parse out the required ability total
+    */
+    ptr = Mapping_Find("reqattrnam", chunk, true);
+    if (ptr == NULL)
+        ptr = Mapping_Find("reqattr", chunk, true);
+    if (ptr != NULL) {
+        Output_Attr_Requirement(info->node, ptr, chunk, info);
+        return;
+        }
 
-        /* If this chunk starts with 'only a', search for an appropriate
-            class as the next word
-        */
-        if (strnicmp(chunks[i], "only a ", 7) == 0) {
-            ptr = chunks[i] + 7;
-            temp = strchr(ptr, ' ');
-            if (temp != NULL)
-                *temp = '\0';
-            Find_Classes(ptr, info, &last_class, false);
-            continue;
-            }
+    /* If this chunk is a class feature, try to match it for the last class
+        requirement we parsed
+    */
+    ptr = " class feature";
+    if (stricmpright(chunk, ptr) == 0) {
+        chunk[strlen(chunk)-strlen(ptr)] = '\0';
+        Find_Feature(chunk, *last_class, info, true, false);
+        return;
+        }
 
-        /* If this chunk matches the first three letters of an ability score
-            name (or the full name), parse out the required ability total
-        */
-        ptr = Mapping_Find("reqattrnam", chunks[i], true);
-        if (ptr == NULL)
-            ptr = Mapping_Find("reqattr", chunks[i], true);
-        if (ptr != NULL) {
-            Output_Attr_Requirement(info->node, ptr, chunks[i], info);
-            continue;
-            }
+    /* If this chunk is a racial feature or power, try to match it for the
+        last race requirement we parsed
+    */
+    ptr = " racial feature";
+    if (stricmpright(chunk, ptr) == 0) {
+        chunk[strlen(chunk)-strlen(ptr)] = '\0';
+        Find_Feature(chunk, *last_race, info, false, false);
+        return;
+        }
+    ptr = " racial power";
+    if (stricmpright(chunk, ptr) == 0) {
+        chunk[strlen(chunk)-strlen(ptr)] = '\0';
+        Find_Feature(chunk, *last_race, info, false, false);
+        return;
+        }
 
-        /* If this chunk is a class feature, try to match it for the last class
-            requirement we parsed
-        */
-        ptr = " class feature";
-        if (stricmpright(chunks[i], ptr) == 0) {
-            chunks[i][strlen(chunks[i])-strlen(ptr)] = '\0';
-            Find_Feature(chunks[i], last_class, info, true, false);
-            continue;
-            }
+    /* If this chunk matches a feat name, add a 'required feat' exprreq
+        element
+    */
+    ptr = " feat";
+    if (stricmpright(chunk, ptr) == 0) {
+        chunk[strlen(chunk)-strlen(ptr)] = '\0';
+        Find_Feat(chunk, info, false);
+        return;
+        }
+
+    /* Finally, as a last gasp look for a class, race, feat or class
+        feature with the exact text required, since it's probably one of
+        those
+    */
+    if (Find_Classes(chunk, info, last_class, true))
+        return;
+    if (Find_Races(chunk, info, last_class, true))
+        return;
+    if (Find_Weapons(chunk, info, true))
+        return;
+    if (Find_Feat(chunk, info, true))
+        return;
+    if (Find_Feature(chunk, *last_class, info, true, true))
+        return;
+
+    sprintf(message, "No prereq matched for '%s' on thing %s\n", chunk, info->name);
+    Prereq_Log(message);
+}
+
+
+void            Output_Prereqs(T_Base_Info * info, T_List_Ids * id_list)
+{
+    T_Int32U            i, chunk_count;
+    T_Glyph_Ptr         buffer, last_class, last_race, chunks[1000];
+    C_Scratch           scratch;
+    string              key;
+    T_Prereq_Resolution resolution;
+    T_Prereq_Cache::iterator    it;
+
+    if ((info->prerequisite == NULL) || (info->prerequisite[0] == '\0'))
+        return;
+    Output_Field(info->node, "reqText", info->prerequisite, info);
+
+    buffer = scratch.Acquire(strlen(info->prerequisite) + 1);
+    if (x_Trap_Opt(buffer == NULL))
+        return;
+    last_class = NULL;
+    last_race = NULL;
+    chunk_count = x_Array_Size(chunks);
+    Split_To_Array(buffer, chunks, &chunk_count, info->prerequisite, ",.;");
+    for (i = 0; i < chunk_count; i++) {
 
-        /* If this chunk is a racial feature or power, try to match it for the
-            last race requirement we parsed
+        /* If this starts with "or", skip that - it's a follow-on from a
+            previous thingy, so we have to parse it separately
         */
-        ptr = " racial feature";
-        if (stricmpright(chunks[i], ptr) == 0) {
-            chunks[i][strlen(chunks[i])-strlen(ptr)] = '\0';
-            Find_Feature(chunks[i], last_race, info, false, false);
-            continue;
-            }
-        ptr = " racial power";
-        if (stricmpright(chunks[i], ptr) == 0) {
-            chunks[i][strlen(chunks[i])-strlen(ptr)] = '\0';
-            Find_Feature(chunks[i], last_race, info, false, false);
-            continue;
+        if (strnicmp(chunks[i], "or ", 3) == 0) {
+            chunks[i] += 3;
+            while (x_Is_Space(*chunks[i]))
+                chunks[i]++;
             }
 
-        /* If this chunk matches a feat name, add a 'required feat' exprreq
-            element
+        /* Features are looked up for the last class or race we found, so
+            those are part of the key along with the chunk text. If we've
+            resolved this before, and no mappings or things have been added
+            since, we can just replay it.
         */
-        ptr = " feat";
-        if (stricmpright(chunks[i], ptr) == 0) {
-            chunks[i][strlen(chunks[i])-strlen(ptr)] = '\0';
-            Find_Feat(chunks[i], info, false);
+        key = chunks[i];
+        key += '|';
+        if (last_class != NULL)
+            key += last_class;
+        key += '|';
+        if (last_race != NULL)
+            key += last_race;
+        it = l_prereq_cache.find(key);
+        if ((it != l_prereq_cache.end()) &&
+            (it->second.mapping_generation == Mapping_Get_Generation()) &&
+            (it->second.symbol_count == Symbol_Get_Count())) {
+            Prereq_Replay(&it->second, info);
+            last_class = it->second.last_class;
+            last_race = it->second.last_race;
             continue;
             }
 
-        /* Finally, as a last gasp look for a class, race, feat or class
-            feature with the exact text required, since it's probably one of
-            those
+        /* Otherwise, resolve it from scratch, recording what we output
         */
-        if (Find_Classes(chunks[i], info, &last_class, true))
-            continue;
-        if (Find_Races(chunks[i], info, &last_class, true))
-            continue;
-        if (Find_Weapons(chunks[i], info, true))
-            continue;
-        if (Find_Feat(chunks[i], info, true))
-            continue;
-        if (Find_Feature(chunks[i], last_class, info, true, true))
-            continue;
-
-        sprintf(message, "No prereq matched for '%s' on thing %s\n", chunks[i], info->name);
-        Log_Message(message);
+        resolution.outputs.clear();
+        resolution.is_logged = false;
+        resolution.mapping_generation = Mapping_Get_Generation();
+        resolution.symbol_count = Symbol_Get_Count();
+        l_prereq_record = &resolution;
+        Resolve_Prereq_Chunk(chunks[i], info, &last_class, &last_race);
+        l_prereq_record = NULL;
+        resolution.last_class = last_class;
+        resolution.last_race = last_race;
+
+        /* Outputting tags can't add mappings or things, so if the tables are
+            the same as when we started, the result is safe to re-use
+        */
+        if (!resolution.is_logged &&
+            (resolution.mapping_generation == Mapping_Get_Generation()) &&
+            (resolution.symbol_count == Symbol_Get_Count()))
+            l_prereq_cache[key] = resolution;
         }
 }
 
@@ -2040,7 +2381,28 @@ static bool     Check_Delete_Eval(T_XML_Node node, T_Glyph_Ptr nodename, T_XML_N
 }
 
 
-static bool     Check_Delete_Fieldval(T_XML_Node node, T_XML_Node ext_child)
+/* Find the first child with the given name and attribute value that isn't
+    waiting to be deleted
+*/
+static T_Int32S Find_Live_Child(T_XML_Node node, T_Glyph_CPtr nodename, T_Glyph_CPtr attrname,
+                                T_Glyph_CPtr value, vector<T_XML_Node> * deleted,
+                                T_XML_Node * child)
+{
+    T_Int32S        result;
+
+    result = XML_Get_First_Named_Child_With_Attr(node, nodename, attrname, value, child);
+    while ((result == 0) && (find(deleted->begin(), deleted->end(), *child) != deleted->end()))
+        result = XML_Get_Next_Named_Child_With_Attr(node, child);
+    return(result);
+}
+
+
+/* Check for an instruction to delete a fieldval - the fieldval is added to
+    the list of nodes to delete, rather than being deleted straight away, so
+    they can all be deleted together
+*/
+static bool     Check_Delete_Fieldval(T_XML_Node node, T_XML_Node ext_child,
+                                        vector<T_XML_Node> * deleted)
 {
     T_Int32S        result;
     T_Glyph_CPtr    value, field;
@@ -2058,9 +2420,9 @@ static bool     Check_Delete_Fieldval(T_XML_Node node, T_XML_Node ext_child)
     /* Otherwise, find a fieldval with the same field id on the node, and delete
         it
     */
-    result = XML_Get_First_Named_Child_With_Attr(node, "fieldval", "field", field, &field_node);
+    result = Find_Live_Child(node, "fieldval", "field", field, deleted, &field_node);
     if (result == 0) {
-        XML_Delete_Node(field_node);
+        deleted->push_back(field_node);
         return(true);
         }
 
@@ -2087,10 +2449,54 @@ static void     Get_Node_Details(E_Node_Type type, T_Glyph_Ptr * nodename, T_Gly
         case e_node_exprreq :       *nodename = "exprreq"; *pcdata_child = ""; return;
         case e_node_pickreq :       *nodename = "pickreq"; return;
         case e_node_containerreq :  *nodename = "containerreq"; return;
+        case e_node_fieldval :      *nodename = "fieldval"; return;
+        case e_node_link :          *nodename = "link"; return;
         };
 }
 
 
+/* Sort the children of an extension thing into lists by type, so each thing
+    only needs to be walked once
+*/
+static void     Sort_Children(T_XML_Node ext_node, vector<T_XML_Node> children[NODE_TYPE_COUNT])
+{
+    T_Int32S        i, result;
+    T_Glyph_Ptr     nodename, pcdata_child;
+    T_XML_Node      child;
+    T_XML_Cursor    cursor;
+    T_Glyph         name[100];
+
+    result = XML_Cursor_First(&cursor, ext_node, &child);
+    while (result == 0) {
+        XML_Get_Name(child, name);
+        for (i = 0; i < NODE_TYPE_COUNT; i++) {
+            Get_Node_Details((E_Node_Type) i, &nodename, &pcdata_child);
+            if (strcmp(name, nodename) == 0) {
+                children[i].push_back(child);
+                break;
+                }
+            }
+        result = XML_Cursor_Next(&cursor, &child);
+        }
+}
+
+
+static void     Index_Things(T_XML_Node root, T_Thing_Index * index)
+{
+    T_Int32S        result;
+    T_Glyph_CPtr    id;
+    T_XML_Node      thing;
+    T_XML_Cursor    cursor;
+
+    result = XML_Cursor_First(&cursor, root, &thing, "thing");
+    while (result == 0) {
+        id = XML_Get_Attribute_Pointer(thing, "id");
+        index->insert(T_Thing_Index::value_type((id == NULL) ? "" : id, thing));
+        result = XML_Cursor_Next(&cursor, &thing);
+        }
+}
+
+
 static void     Fix_OSX_PCDATA(T_XML_Node node)
 {
 #ifdef _OSX
@@ -2112,32 +2518,136 @@ static void     Fix_OSX_PCDATA(T_XML_Node node)
 }
 
 
-static void     Duplicate_Nodes(T_XML_Node node, T_XML_Node ext_node, bool is_partial,
-                                E_Node_Type type, T_Copy_Vector * copies)
+/* Check whether every attribute of one node has the same value on another,
+    skipping the named attribute if there is one
+*/
+static bool     Is_Same_Attributes(T_XML_Node node, T_XML_Node other, T_Glyph_CPtr skip)
+{
+    T_Int32S        result;
+    T_Glyph         name[100];
+
+    result = XML_Get_First_Attribute(node, name);
+    while (result == 0) {
+        if (((skip == NULL) || (strcmp(name, skip) != 0)) &&
+            (strcmp(XML_Get_Attribute_Pointer(node, name),
+                    XML_Get_Attribute_Pointer(other, name)) != 0))
+            return(false);
+        result = XML_Get_Next_Attribute(node, name);
+        }
+    return(true);
+}
+
+
+/* Check whether two pieces of text are the same, ignoring whitespace - line
+    endings are changed in scripts on OS X, and scripts pick up indentation
+    each time they're written out and read back in
+*/
+static bool     Is_Same_Text(T_Glyph_CPtr text, T_Glyph_CPtr other)
+{
+    while (true) {
+        while (x_Is_Space(*text))
+            text++;
+        while (x_Is_Space(*other))
+            other++;
+        if (*text != *other)
+            return(false);
+        if (*text == '\0')
+            return(true);
+        text++;
+        other++;
+        }
+}
+
+
+/* Check whether two nodes have the same attributes, text and children
+*/
+static bool     Is_Same_Node(T_XML_Node node, T_XML_Node other, T_Glyph_CPtr skip = NULL)
+{
+    T_Int32S        result, other_result;
+    T_XML_Node      child, other_child;
+
+    if (!Is_Same_Attributes(node, other, skip) || !Is_Same_Attributes(other, node, skip))
+        return(false);
+    if (!Is_Same_Text(XML_Get_PCDATA_Pointer(node), XML_Get_PCDATA_Pointer(other)))
+        return(false);
+    if (XML_Get_Child_Count(node) != XML_Get_Child_Count(other))
+        return(false);
+
+    result = XML_Get_First_Child(node, &child);
+    other_result = XML_Get_First_Child(other, &other_child);
+    while ((result == 0) && (other_result == 0)) {
+        if (!Is_Same_Node(child, other_child))
+            return(false);
+        result = XML_Get_Next_Child(node, &child);
+        other_result = XML_Get_Next_Child(other, &other_child);
+        }
+    return(true);
+}
+
+
+/* Check whether an extension node has already been merged into the original
+    node, apart from the given node - this is only needed when we're appending
+    to output files that have had the extensions merged into them before, as
+    it compares against every child with the same name. The named attribute is
+    ignored, if there is one.
+*/
+static bool     Is_Already_Merged(T_XML_Node node, T_Glyph_CPtr nodename,
+                                    T_XML_Node ext_child, T_Glyph_CPtr skip,
+                                    T_XML_Node ignore = NULL)
+{
+    T_Int32S        result;
+    T_XML_Node      child;
+
+    result = XML_Get_First_Named_Child(node, nodename, &child);
+    while (result == 0) {
+        if ((child != ignore) && Is_Same_Node(ext_child, child, skip))
+            return(true);
+        result = XML_Get_Next_Named_Child(node, &child);
+        }
+    return(false);
+}
+
+
+static void     Duplicate_Nodes(T_XML_Node node, vector<T_XML_Node> * ext_children,
+                                bool is_partial, bool is_merged, E_Node_Type type,
+                                T_Copy_Vector * copies)
 {
     T_Int32S        result;
     T_XML_Node      child, ext_child, pcdata_node;
     T_Glyph_CPtr    cptr;
     T_Glyph_Ptr     nodename, pcdata_child;
     T_Delayed_Copy  copy;
+    bool            is_copy;
+    vector<T_XML_Node>::iterator    iter;
     T_Glyph         buffer[1000];
 
     Get_Node_Details(type, &nodename, &pcdata_child);
     if (x_Trap_Opt(nodename == NULL))
         return;
 
-    result = XML_Get_First_Named_Child(ext_node, nodename, &ext_child);
-    while (result == 0) {
+    for (iter = ext_children->begin(); iter != ext_children->end(); iter++) {
+        ext_child = *iter;
 
         /* Check to see if this is actually an instruction to delete a node
         */
         if ((type == e_node_tag) && Check_Delete_Tag(node, ext_child))
-            goto next_node;
+            continue;
         if ((type == e_node_bootstrap) && Check_Delete_Bootstrap(node, ext_child))
-            goto next_node;
+            continue;
         if (((type == e_node_eval) || (type == e_node_evalrule)) &&
             Check_Delete_Eval(node, nodename, ext_child))
-            goto next_node;
+            continue;
+
+        /* If the extensions were merged in before and we already have this
+            node, don't add it again. Bootstraps may have had their phase
+            changed when they were merged, so ignore it. Copied scripts are
+            checked once they've been found, below.
+        */
+        is_copy = ((type == e_node_eval) || (type == e_node_evalrule)) &&
+                (strcmp(XML_Get_Attribute_Pointer(ext_child, "phase"), COPY_SCRIPT) == 0);
+        if (is_merged && !is_copy && Is_Already_Merged(node, nodename, ext_child,
+                                    (type == e_node_bootstrap) ? "phase" : NULL))
+            continue;
 
         /* If we're a bootstrap, check for our 'ignore in partial mode'
             phase and skip it if so
@@ -2145,7 +2655,7 @@ static void     Duplicate_Nodes(T_XML_Node node, T_XML_Node ext_node, bool is_pa
         if ((type == e_node_bootstrap) && is_partial) {
             cptr = XML_Get_Attribute_Pointer(ext_child, "phase");
             if (strcmp(cptr, NO_PARTIAL_TEXT) == 0)
-                goto next_node;
+                continue;
             }
 
         /* If we have a pcdata child node, check it for our "ignore me in
@@ -2157,13 +2667,13 @@ static void     Duplicate_Nodes(T_XML_Node node, T_XML_Node ext_node, bool is_pa
             else {
                 result = XML_Get_First_Named_Child(ext_child, pcdata_child, &pcdata_node);
                 if (x_Trap_Opt(result != 0))
-                    goto next_node;
+                    continue;
                 }
             if (x_Trap_Opt(pcdata_node == NULL))
-                goto next_node;
+                continue;
             cptr = XML_Get_PCDATA_Pointer(pcdata_node);
             if (strstr(cptr, "~ignore if partial") != NULL)
-                goto next_node;
+                continue;
             }
 
         /* Create a new node in the original node to hold the copy
@@ -2178,14 +2688,13 @@ static void     Duplicate_Nodes(T_XML_Node node, T_XML_Node ext_node, bool is_pa
         /* If we're an eval script or eval rule, check for our "copy from this
             other script here" indicator.
         */
-        if (((type == e_node_eval) || (type == e_node_evalrule)) &&
-            (strcmp(XML_Get_Attribute_Pointer(ext_child, "phase"), COPY_SCRIPT) == 0)) {
+        if (is_copy) {
 
             /* The id to copy the script from is in the priority, and we copy
-                the script with the same index as this one. We need to save the
-                record to copy later, because we can't have two iterations
-                through the XML root node at once.
+                the script with the same index as this one. We save the record
+                and copy it once everything else has been merged.
             */
+            copy.parent = node;
             copy.target = child;
             copy.thing_id = XML_Get_Attribute_Pointer(ext_child, "priority");
             copy.index = XML_Get_Attribute_Pointer(ext_child, "index");
@@ -2214,98 +2723,106 @@ static void     Duplicate_Nodes(T_XML_Node node, T_XML_Node ext_node, bool is_pa
             */
             Fix_OSX_PCDATA(child);
             }
-
-next_node:
-        result = XML_Get_Next_Named_Child(ext_node, &ext_child);
         }
 }
 
 
-static void     Fixup_Nodes(T_XML_Node node, T_XML_Node ext_node, T_Glyph_Ptr nodename,
-                            T_Glyph_Ptr attrname)
+static void     Fixup_Nodes(T_XML_Node node, vector<T_XML_Node> * ext_children,
+                            T_Glyph_Ptr nodename, T_Glyph_Ptr attrname)
 {
     T_Int32S        result;
     T_Glyph_Ptr     ptr;
     T_XML_Node      child, ext_child;
     bool            is_fieldval;
+    vector<T_XML_Node>  deleted;
+    vector<T_XML_Node>::iterator    iter;
     T_Glyph         buffer[1000];
 
     is_fieldval = strcmp(nodename, "fieldval") == 0;
 
-    result = XML_Get_First_Named_Child(ext_node, nodename, &ext_child);
-    while (result == 0) {
-
+    for (iter = ext_children->begin(); iter != ext_children->end(); iter++) {
+        ext_child = *iter;
 
         /* Check to see if this is actually an instruction to delete a node
         */
-        if (is_fieldval && Check_Delete_Fieldval(node, ext_child))
-            goto next_node;
+        if (is_fieldval && Check_Delete_Fieldval(node, ext_child, &deleted))
+            continue;
 
         /* Create a new node in the original node to hold the copy, and
-            duplicate the extension node into it
+            duplicate the extension node into it - nodes we're about to delete
+            don't count
         */
         ptr = (T_Glyph_Ptr) XML_Get_Attribute_Pointer(ext_child, attrname);
-        result = XML_Get_First_Named_Child_With_Attr(node, nodename, attrname, ptr, &child);
+        result = Find_Live_Child(node, nodename, attrname, ptr, &deleted, &child);
         if (result != 0) {
             result = XML_Create_Child(node, nodename, &child);
             if (result != 0) {
                 sprintf(buffer, "Could not create new extension document %s node.", nodename);
                 Log_Message(buffer);
-                return;
+                break;
                 }
             }
         result = XML_Duplicate_Node(ext_child, &child);
         if (result != 0) {
             sprintf(buffer, "Could not duplicate %s node from extension document.", nodename);
             Log_Message(buffer);
-            return;
+            break;
             }
             
         /* On OS X, we need to convert \r\n to \n in scripts or it looks
             bad
         */
         Fix_OSX_PCDATA(child);
-
-next_node:
-        result = XML_Get_Next_Named_Child(ext_node, &ext_child);
         }
+
+    /* Delete everything we were asked to in one go
+    */
+    if (!deleted.empty())
+        XML_Delete_Children(node, &deleted[0], deleted.size());
 }
 
 
+/* Merge the extension file with the given name from our ddidownloader
+    directory into the document. The caller must make sure the extension file
+    exists. If the document is an output file that already had the extensions
+    merged into it, anything that's already there is skipped. This doesn't
+    touch anything but the document and the extension, so different documents
+    can be merged on different threads.
+*/
 void            Append_Extensions(T_XML_Document document, T_Glyph_Ptr output_folder,
-                                    T_Glyph_Ptr filename, bool is_partial)
+                                    T_Glyph_Ptr filename, bool is_partial, bool is_merged)
 {
-    T_Int32S            result;
+    T_Int32S            i, result;
     T_Glyph_Ptr         ptr;
     T_XML_Document      ext_document;
     T_XML_Node          root, node, ext_root, ext_node, bootstrap, thing_node, script_node;
-    T_Filename          full_name;
+    T_Glyph_Ptr         value;
+    T_Filename          full_name, name;
     vector<T_XML_Node>  list_nopartial;
     vector<T_XML_Node>::iterator    iter;
+    vector<T_XML_Node>  children[NODE_TYPE_COUNT];
+    T_Thing_Index       things, ext_things;
+    T_Thing_Index::iterator         thing_iter;
     T_Copy_Vector       script_copies;
     T_Copy_Iter         copy_iter;
-    T_Glyph             buffer[1000], contents[100000];
+    T_Glyph             buffer[1000];
 
-    /* See if we have a file in our ddidownloader directory with the appropriate
-        name - if not, there's nothing to do
-    */
     sprintf(full_name, "%s" DIR "ddidownloader" DIR "%s", output_folder, filename);
-    if (!FileSys_Does_File_Exist(full_name))
-        return;
 
-    strcpy(contents, filename+4);
-    ptr = strchr(contents, '.');
+    strcpy(name, filename+4);
+    ptr = strchr(name, '.');
     if (ptr != NULL)
         *ptr = '\0';
-    ptr = strchr(contents, '_');
+    ptr = strchr(name, '_');
     if (ptr != NULL)
         *ptr = ' ';
-    sprintf(buffer, "Finishing %s...", contents);
+    sprintf(buffer, "Finishing %s...", name);
     Log_Message(buffer, true);
 
-    /* Otherwise, read in the document
+    /* Otherwise, read in the document - this uses the precompiled copy if
+        the extension file hasn't changed since we last saw it
     */
-    result = XML_Read_Document(&ext_document,DTD_Get_Data(), full_name);
+    result = Overlay_Load(&ext_document, full_name);
     if (x_Trap_Opt(result != 0)) {
         sprintf(buffer, "Could not parse XML document %s.\n%ld - %s", full_name, XML_Get_Line(),
                 XML_Get_Error());
@@ -2325,6 +2842,12 @@ void            Append_Extensions(T_XML_Document document, T_Glyph_Ptr output_fo
         goto cleanup_exit;
         }
 
+    /* Index the things in both documents by id, so we don't have to search
+        through either of them for every thing we merge
+    */
+    Index_Things(root, &things);
+    Index_Things(ext_root, &ext_things);
+
     /* Go through the nodes in the document
     */
     result = XML_Get_First_Named_Child(ext_root, "thing", &ext_node);
@@ -2334,8 +2857,8 @@ void            Append_Extensions(T_XML_Document document, T_Glyph_Ptr output_fo
             don't find one, just copy the node to the master document
         */
         ptr = (T_Glyph_Ptr) XML_Get_Attribute_Pointer(ext_node, "id");
-        result = XML_Get_First_Named_Child_With_Attr(root, "thing", "id", ptr, &node);
-        if (result != 0) {
+        thing_iter = things.find(ptr);
+        if (thing_iter == things.end()) {
 
             /* If the node has no name or compset, skip it - we can't create a
                 new node without those, since that would make an invalid data
@@ -2362,6 +2885,7 @@ void            Append_Extensions(T_XML_Document document, T_Glyph_Ptr output_fo
                 Log_Message(buffer);
                 goto cleanup_exit;
                 }
+            things[ptr] = node;
                 
             /* On OS X, we need to convert \r\n to \n in scripts or it looks
                 bad
@@ -2394,36 +2918,33 @@ void            Append_Extensions(T_XML_Document document, T_Glyph_Ptr output_fo
 
         /* Otherwise, we need to fix up the 'real' node with anything in the
             extension - iterate through all the attributes, setting them if
-            they're non-empty
+            they're non-empty. We use the value in place, since it can be any
+            length.
         */
+        node = thing_iter->second;
         result = XML_Get_First_Attribute(ext_node, buffer);
         while (result == 0) {
-            XML_Get_Attribute(ext_node, buffer, contents, false);
-            if (contents[0] != '\0')
-                XML_Write_Text_Attribute(node, buffer, contents);
+            value = (T_Glyph_Ptr) XML_Get_Attribute_Pointer(ext_node, buffer, false);
+            if ((value != NULL) && (value[0] != '\0'))
+                XML_Write_Text_Attribute(node, buffer, value);
             result = XML_Get_Next_Attribute(ext_node, buffer);
             }
 
-        /* Now add any tags and bootstraps on the extension node to the real node
+        /* Now add any tags, bootstraps, eval scripts, eval rules and pre-reqs
+            on the extension node to the real node. We go through the extension
+            node's children once, and merge them a type at a time.
         */
-        Duplicate_Nodes(node, ext_node, is_partial, e_node_tag, &script_copies);
-        Duplicate_Nodes(node, ext_node, is_partial, e_node_bootstrap, &script_copies);
-        Duplicate_Nodes(node, ext_node, is_partial, e_node_arrayval, &script_copies);
-
-        /* Same with eval scripts, eval rules, and pre-reqs
-        */
-        Duplicate_Nodes(node, ext_node, is_partial, e_node_eval, &script_copies);
-        Duplicate_Nodes(node, ext_node, is_partial, e_node_evalrule, &script_copies);
-        Duplicate_Nodes(node, ext_node, is_partial, e_node_prereq, &script_copies);
-        Duplicate_Nodes(node, ext_node, is_partial, e_node_exprreq, &script_copies);
-        Duplicate_Nodes(node, ext_node, is_partial, e_node_pickreq, &script_copies);
-        Duplicate_Nodes(node, ext_node, is_partial, e_node_containerreq, &script_copies);
+        for (i = 0; i < NODE_TYPE_COUNT; i++)
+            children[i].clear();
+        Sort_Children(ext_node, children);
+        for (i = e_node_tag; i <= e_node_containerreq; i++)
+            Duplicate_Nodes(node, &children[i], is_partial, is_merged, (E_Node_Type) i, &script_copies);
 
         /* Do the same with fields and linkages, but replace any existing value
             for the field / linkage
         */
-        Fixup_Nodes(node, ext_node, "fieldval", "field");
-        Fixup_Nodes(node, ext_node, "link", "linkage");
+        Fixup_Nodes(node, &children[e_node_fieldval], "fieldval", "field");
+        Fixup_Nodes(node, &children[e_node_link], "link", "linkage");
 
         /* Onward and upward
         */
@@ -2434,12 +2955,13 @@ next_node:
     /* Now finalize any script copies
     */
     for (copy_iter = script_copies.begin(); copy_iter != script_copies.end(); copy_iter++) {
-        result = XML_Get_First_Named_Child_With_Attr(ext_root, "thing", "id", copy_iter->thing_id, &thing_node);
-        if (result != 0) {
+        thing_iter = ext_things.find(copy_iter->thing_id);
+        if (thing_iter == ext_things.end()) {
             sprintf(buffer, "Could not find thing '%s' in extension document.\n", copy_iter->thing_id);
             Log_Message(buffer);
             return;
             }
+        thing_node = thing_iter->second;
 
         /* Now just copy the script with the appropriate index
         */
@@ -2450,6 +2972,14 @@ next_node:
             return;
             }
 
+        /* If we already have the script, we don't need the copy after all
+        */
+        if (is_merged && Is_Already_Merged(copy_iter->parent, copy_iter->nodename,
+                                            script_node, NULL, copy_iter->target)) {
+            XML_Delete_Node(copy_iter->target);
+            continue;
+            }
+
         /* Now we have the right script, so duplicate it
         */
         result = XML_Duplicate_Node(script_node, &copy_iter->target);
@@ -2496,7 +3026,7 @@ bool    Download_Page(T_WWW www, T_Base_Info * info, T_Glyph_Ptr url, T_Glyph_Pt
 
     is_ok = false;
     sprintf(buffer, "Downloading %s\n", url);
-    Log_Message(buffer);
+    Log_Message(buffer, false, e_log_detail);
 
     /* Sleep for a while so we don't end up DDOSing the server - this
         means we don't go as fast as we could, but it's better for the
@@ -27,6 +27,8 @@
 
 
 #include <unistd.h>
+#include <pthread.h>
+#include <mach/mach_time.h>
 
 #include <iostream>
 
@@ -41,10 +43,37 @@ void     Pause_Execution(T_Int32U milliseconds)
 }
 
 
+/* Use the monotonic clock, so timings aren't thrown off if the system clock
+    is changed while we're running
+*/
+T_Int32U Get_Milliseconds(void)
+{
+    static mach_timebase_info_data_t    timebase;
+
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    return((T_Int32U) (mach_absolute_time() * timebase.numer / timebase.denom / 1000000));
+}
+
+
+T_Int64U Get_Microseconds(void)
+{
+    static mach_timebase_info_data_t    timebase;
+
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    return(mach_absolute_time() * timebase.numer / timebase.denom / 1000);
+}
+
+
 T_Glyph  Get_Character(void)
 {
     T_Glyph     buffer[500];
     
+    /* Make sure the user can see whatever they're answering
+    */
+    Log_Flush();
+
     /* This doesn't work as well as getch() on windows - it requires an enter
         key to be pressed after the keypress - but the only way to avoid that
         is apparently annoyingly complicated
@@ -71,3 +100,140 @@ bool    Is_Log(void)
     Gestalt(gestaltSystemVersionMinor, &minor);
     return !((major == 10) && (minor <= 5));
 }
+
+
+T_Int32U        Thread_Get_Processor_Count(void)
+{
+    long            count;
+
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+    return((count > 0) ? count : 1);
+}
+
+
+T_Int32U        Thread_Get_Id(void)
+{
+    return(pthread_mach_thread_np(pthread_self()));
+}
+
+
+T_Int32S        Thread_Atomic_Increment(volatile T_Int32S * value)
+{
+    return(__sync_add_and_fetch(value, 1));
+}
+
+
+T_Int32S        Thread_Atomic_Add(volatile T_Int32S * value, T_Int32S amount)
+{
+    return(__sync_add_and_fetch(value, amount));
+}
+
+
+static  pthread_key_t   l_local_keys[e_local_count];
+static  pthread_once_t  l_local_once = PTHREAD_ONCE_INIT;
+
+
+static void     Create_Local_Keys(void)
+{
+    T_Int32U        i;
+
+    for (i = 0; i < e_local_count; i++)
+        pthread_key_create(&l_local_keys[i], NULL);
+}
+
+
+T_Void_Ptr      Thread_Get_Local(E_Thread_Local slot)
+{
+    pthread_once(&l_local_once, Create_Local_Keys);
+    return(pthread_getspecific(l_local_keys[slot]));
+}
+
+
+void            Thread_Set_Local(E_Thread_Local slot, T_Void_Ptr value)
+{
+    pthread_once(&l_local_once, Create_Local_Keys);
+    pthread_setspecific(l_local_keys[slot], value);
+}
+
+
+/* Each worker thread needs to know the function to call and its context
+*/
+struct T_Worker_Start {
+    T_Fn_Worker     function;
+    T_Void_Ptr      context;
+};
+
+
+static void *   Worker_Thread(void * param)
+{
+    T_Worker_Start *    start = (T_Worker_Start *) param;
+
+    start->function(start->context);
+    Scratch_Shutdown_Thread();
+    return(NULL);
+}
+
+
+void            Thread_Run_Workers(T_Int32U count, T_Fn_Worker function, T_Void_Ptr context)
+{
+    T_Int32U            i;
+    T_Worker_Start      start;
+    pthread_attr_t      attr;
+    vector<pthread_t>   threads;
+    pthread_t           thread;
+
+    /* The calling thread does a share of the work too, so we only need to
+        start count - 1 threads. If we can't start a thread, the others just
+        pick up its share. Secondary threads get a small stack by default, so
+        ask for the same size we use on Windows.
+    */
+    start.function = function;
+    start.context = context;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+    for (i = 1; i < count; i++) {
+        if (x_Trap_Opt(pthread_create(&thread, &attr, Worker_Thread, &start) != 0))
+            break;
+        threads.push_back(thread);
+        }
+    pthread_attr_destroy(&attr);
+    function(context);
+
+    /* Wait for everyone else to finish
+    */
+    for (i = 0; i < threads.size(); i++)
+        pthread_join(threads[i], NULL);
+}
+
+
+/* A thread started on its own keeps its start information with it, since
+    the caller won't be waiting around
+*/
+struct T_Thread {
+    T_Worker_Start  start;
+    pthread_t       handle;
+};
+
+
+T_Void_Ptr      Thread_Start(T_Fn_Worker function, T_Void_Ptr context)
+{
+    T_Thread *      thread;
+
+    thread = new T_Thread;
+    thread->start.function = function;
+    thread->start.context = context;
+    if (x_Trap_Opt(pthread_create(&thread->handle, NULL, Worker_Thread, &thread->start) != 0)) {
+        delete thread;
+        return(NULL);
+        }
+    return(thread);
+}
+
+
+void            Thread_Wait(T_Void_Ptr param)
+{
+    T_Thread *      thread = (T_Thread *) param;
+
+    pthread_join(thread->handle, NULL);
+    delete thread;
+}
@@ -37,8 +37,30 @@ void     Pause_Execution(T_Int32U milliseconds)
 }
 
 
+T_Int32U Get_Milliseconds(void)
+{
+    return(GetTickCount());
+}
+
+
+T_Int64U Get_Microseconds(void)
+{
+    static LARGE_INTEGER    frequency;
+    LARGE_INTEGER           now;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    return((T_Int64U) (now.QuadPart / frequency.QuadPart * 1000000 +
+                        now.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart));
+}
+
+
 T_Glyph  Get_Character(void)
 {
+    /* Make sure the user can see whatever they're answering
+    */
+    Log_Flush();
     return(getch());
 }
 
@@ -49,3 +71,129 @@ bool    Is_Log(void)
     */
     return(true);
 }
+
+
+T_Int32U        Thread_Get_Processor_Count(void)
+{
+    SYSTEM_INFO     info;
+
+    GetSystemInfo(&info);
+    return((info.dwNumberOfProcessors > 0) ? info.dwNumberOfProcessors : 1);
+}
+
+
+T_Int32U        Thread_Get_Id(void)
+{
+    return(GetCurrentThreadId());
+}
+
+
+T_Int32S        Thread_Atomic_Increment(volatile T_Int32S * value)
+{
+    return(InterlockedIncrement(value));
+}
+
+
+T_Int32S        Thread_Atomic_Add(volatile T_Int32S * value, T_Int32S amount)
+{
+    return(InterlockedExchangeAdd(value, amount) + amount);
+}
+
+
+static  __declspec(thread)  T_Void_Ptr  l_local[e_local_count] = { NULL };
+
+
+T_Void_Ptr      Thread_Get_Local(E_Thread_Local slot)
+{
+    return(l_local[slot]);
+}
+
+
+void            Thread_Set_Local(E_Thread_Local slot, T_Void_Ptr value)
+{
+    l_local[slot] = value;
+}
+
+
+/* Each worker thread needs to know the function to call and its context
+*/
+struct T_Worker_Start {
+    T_Fn_Worker     function;
+    T_Void_Ptr      context;
+};
+
+
+static DWORD WINAPI Worker_Thread(LPVOID param)
+{
+    T_Worker_Start *    start = (T_Worker_Start *) param;
+
+    start->function(start->context);
+    Scratch_Shutdown_Thread();
+    return(0);
+}
+
+
+void            Thread_Run_Workers(T_Int32U count, T_Fn_Worker function, T_Void_Ptr context)
+{
+    T_Int32U            i, started;
+    T_Worker_Start      start;
+    HANDLE              threads[MAXIMUM_WAIT_OBJECTS];
+
+    /* The calling thread does a share of the work too, so we only need to
+        start count - 1 threads. If we can't start a thread, the others just
+        pick up its share.
+    */
+    start.function = function;
+    start.context = context;
+    if (count > MAXIMUM_WAIT_OBJECTS)
+        count = MAXIMUM_WAIT_OBJECTS;
+    for (i = 1, started = 0; i < count; i++) {
+        threads[started] = CreateThread(NULL, WORKER_STACK_SIZE, Worker_Thread, &start, 0, NULL);
+        if (x_Trap_Opt(threads[started] == NULL))
+            break;
+        started++;
+        }
+    function(context);
+
+    /* Wait for everyone else to finish
+    */
+    if (started > 0)
+        WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+    for (i = 0; i < started; i++)
+        CloseHandle(threads[i]);
+}
+
+
+/* A thread started on its own keeps its start information with it, since
+    the caller won't be waiting around
+*/
+struct T_Thread {
+    T_Worker_Start  start;
+    HANDLE          handle;
+};
+
+
+T_Void_Ptr      Thread_Start(T_Fn_Worker function, T_Void_Ptr context)
+{
+    T_Thread *      thread;
+
+    thread = new T_Thread;
+    thread->start.function = function;
+    thread->start.context = context;
+    thread->handle = CreateThread(NULL, WORKER_STACK_SIZE, Worker_Thread, &thread->start, 0, NULL);
+    if (x_Trap_Opt(thread->handle == NULL)) {
+        delete thread;
+        return(NULL);
+        }
+    return(thread);
+}
+
+
+void            Thread_Wait(T_Void_Ptr param)
+{
+    T_Thread *      thread = (T_Thread *) param;
+
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    delete thread;
+}
@@ -0,0 +1,334 @@
+/*  FILE:   HTML.CPP
+
+    Copyright (c) 2008-2012 by Lone Wolf Development, Inc.  All rights reserved.
+
+    This code is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation; either version 2 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place, Suite 330, Boston, MA 02111-1307 USA
+
+    You can find more information about this project here:
+
+    http://code.google.com/p/ddidownloader/
+
+    This file includes:
+
+    Single-pass tokenizer for the HTML detail blocks of compendium pages.
+*/
+
+
+#include "private.h"
+
+
+/* Make a trimmed copy of the text between start and end in the pool, in the
+    same way Extract_Text does.
+*/
+static T_Glyph_Ptr  Copy_Span(C_Pool * pool, T_Glyph_Ptr start, T_Glyph_Ptr end)
+{
+    T_Glyph_Ptr     final;
+    T_Glyph         backup;
+
+    backup = *end;
+    *end = '\0';
+    final = pool->Acquire(start);
+    Text_Trim_Leading_Space(final);
+    *end = backup;
+    return(final);
+}
+
+
+/* Return true if the tag name for the span is exactly the given name
+*/
+static bool     Is_Tag(T_HTML_Span * span, T_Glyph_CPtr tag)
+{
+    return((strncmp(span->tag, tag, span->tag_length) == 0) &&
+            (tag[span->tag_length] == '\0'));
+}
+
+
+C_HTML_Spans::C_HTML_Spans(T_Glyph_Ptr text, T_Glyph_Ptr checkpoint)
+{
+    T_HTML_Span     span;
+    T_HTML_Span *   previous;
+    T_Glyph_Ptr     ptr, end, label, label_end;
+    T_Glyph         quote;
+
+    /* If we aren't given a checkpoint, tokenize the whole of the text
+    */
+    if (checkpoint == NULL)
+        checkpoint = text + strlen(text);
+    m_checkpoint = checkpoint;
+
+    /* Walk through the text once, recording every tag we find
+    */
+    ptr = (T_Glyph_Ptr) memchr(text, '<', checkpoint - text);
+    while (ptr != NULL) {
+
+        /* The tag name runs until whitespace, the end of the tag, or a '/'
+            (unless the slash starts the name, as it does for end tags)
+        */
+        span.start = ptr;
+        span.tag = ptr + 1;
+        for (end = span.tag; end < checkpoint; end++)
+            if (x_Is_Space(*end) || (*end == '>') || ((*end == '/') && (end != span.tag)))
+                break;
+        span.tag_length = end - span.tag;
+
+        /* Find the end of the tag - if it runs off the end of our block, we're
+            done
+        */
+        end = (T_Glyph_Ptr) memchr(end, '>', checkpoint - end);
+        if (end == NULL)
+            break;
+
+        /* Look for a class attribute within the tag
+        */
+        span.cls = NULL;
+        span.cls_length = 0;
+        for (ptr = span.tag + span.tag_length; ptr + 8 < end; ptr++)
+            if (x_Is_Space(*ptr) && (strncmp(ptr + 1, "class=", 6) == 0)) {
+                quote = ptr[7];
+                if ((quote != '\"') && (quote != '\''))
+                    continue;
+                label = (T_Glyph_Ptr) memchr(ptr + 8, quote, end - (ptr + 8));
+                if (label == NULL)
+                    continue;
+                span.cls = ptr + 8;
+                span.cls_length = label - span.cls;
+                break;
+                }
+
+        /* The text for the span runs until the start of the next tag
+        */
+        span.text = end + 1;
+        span.text_end = (T_Glyph_Ptr) memchr(span.text, '<', checkpoint - span.text);
+        if (span.text_end == NULL)
+            span.text_end = checkpoint;
+        m_spans.push_back(span);
+
+        /* If this closes a bold tag that immediately followed an opening one,
+            the bold text is a label - index it by name, ignoring any trailing
+            colon and whitespace, so that "<b>Level</b>:", "<b>Level:</b>" and
+            "<b>Level: </b>" are all found under "Level".
+        */
+        if ((m_spans.size() >= 2) && Is_Tag(&m_spans.back(), "/b")) {
+            previous = &m_spans[m_spans.size() - 2];
+            if (Is_Tag(previous, "b")) {
+                label = previous->text;
+                label_end = previous->text_end;
+                while ((label < label_end) && x_Is_Space(*label))
+                    label++;
+                while ((label_end > label) && (x_Is_Space(label_end[-1]) || (label_end[-1] == ':')))
+                    label_end--;
+                if (label_end > label)
+                    m_labels[string(label, label_end - label)].push_back(m_spans.size() - 1);
+                }
+            }
+
+        /* Move on to the next tag
+        */
+        ptr = (span.text_end < checkpoint) ? span.text_end : NULL;
+        }
+}
+
+
+/* Find the index of the first span that starts at or after the given position
+    in the text - if there is none, we return the span count
+*/
+T_Int32S        C_HTML_Spans::Find_Span(T_Glyph_Ptr text)
+{
+    T_Int32S        low, high, mid;
+
+    low = 0;
+    high = m_spans.size();
+    while (low < high) {
+        mid = (low + high) / 2;
+        if (m_spans[mid].start < text)
+            low = mid + 1;
+        else
+            high = mid;
+        }
+    return(low);
+}
+
+
+/* Find the first tag with the given name (and class, if given) at or after
+    the text position; returns -1 if there isn't one
+*/
+T_Int32S        C_HTML_Spans::Find_Tag(T_Glyph_Ptr text, T_Glyph_CPtr tag, T_Glyph_CPtr cls)
+{
+    T_Int32S        i, count;
+    T_HTML_Span *   span;
+
+    for (i = Find_Span(text), count = m_spans.size(); i < count; i++) {
+        span = &m_spans[i];
+        if (!Is_Tag(span, tag))
+            continue;
+        if (cls == NULL)
+            return(i);
+        if ((span->cls != NULL) && (strncmp(span->cls, cls, span->cls_length) == 0) &&
+            (cls[span->cls_length] == '\0'))
+            return(i);
+        }
+    return(-1);
+}
+
+
+/* Find the first bold label with the given name at or after the text
+    position. We return the index of the span that closes the bold tag, since
+    its text is the value for the label; -1 if there isn't one.
+*/
+T_Int32S        C_HTML_Spans::Find_Label(T_Glyph_Ptr text, T_Glyph_CPtr label)
+{
+    T_Int32U        i, count;
+    map<string, vector<T_Int32U> >::iterator    it;
+
+    it = m_labels.find(label);
+    if (it == m_labels.end())
+        return(-1);
+
+    /* The label starts at the opening bold tag, just before the span we
+        recorded
+    */
+    for (i = 0, count = it->second.size(); i < count; i++)
+        if (m_spans[it->second[i] - 1].start >= text)
+            return(it->second[i]);
+    return(-1);
+}
+
+
+/* Copy the text from start until the earliest of the end options, returning
+    the position of that end (or the original text position if none is found)
+*/
+T_Glyph_Ptr     C_HTML_Spans::Extract_Until(T_Glyph_Ptr * final, C_Pool * pool, T_Glyph_Ptr text,
+                                            T_Glyph_Ptr start, T_Glyph_Ptr end_options[],
+                                            T_Int32U end_count)
+{
+    T_Int32U        i;
+    T_Glyph_Ptr     end, temp;
+
+    end = NULL;
+    for (i = 0; i < end_count; i++) {
+        temp = Find_Text(start, end_options[i], m_checkpoint, false, true);
+        if ((temp != NULL) && ((end == NULL) || (temp < end)))
+            end = temp;
+        }
+    if (x_Trap_Opt(end == NULL))
+        return(text);
+
+    *final = Copy_Span(pool, start, end);
+    return(end);
+}
+
+
+/* Extract the class of the first tag with the given name, e.g. "h1". Like
+    Extract_Text, the new position is just past the class value.
+*/
+T_Glyph_Ptr     C_HTML_Spans::Extract_Class(T_Glyph_Ptr * final, C_Pool * pool, T_Glyph_Ptr text,
+                                            T_Glyph_CPtr tag)
+{
+    T_Int32S        i;
+    T_HTML_Span *   span;
+
+    if (x_Trap_Opt((final == NULL) || (pool == NULL) || (text == NULL) || (tag == NULL)))
+        return(text);
+
+    i = Find_Tag(text, tag);
+    if (i < 0)
+        return(text);
+    span = &m_spans[i];
+    if (span->cls == NULL)
+        return(text);
+
+    *final = Copy_Span(pool, span->cls, span->cls + span->cls_length);
+    return(span->cls + span->cls_length);
+}
+
+
+/* Extract everything between the first tag with the given name (and class) and
+    the next matching end tag - e.g. the contents of <span class="level">.
+*/
+T_Glyph_Ptr     C_HTML_Spans::Extract_Tag_Text(T_Glyph_Ptr * final, C_Pool * pool, T_Glyph_Ptr text,
+                                            T_Glyph_CPtr tag, T_Glyph_CPtr cls)
+{
+    T_Int32S        i, j, count;
+    T_Int32U        length;
+    T_HTML_Span *   span;
+
+    if (x_Trap_Opt((final == NULL) || (pool == NULL) || (text == NULL) || (tag == NULL)))
+        return(text);
+
+    i = Find_Tag(text, tag, cls);
+    if (i < 0)
+        return(text);
+
+    /* Find the end tag that matches our tag
+    */
+    length = strlen(tag);
+    for (j = i + 1, count = m_spans.size(); j < count; j++) {
+        span = &m_spans[j];
+        if ((span->tag_length == length + 1) && (span->tag[0] == '/') &&
+            (strncmp(span->tag + 1, tag, length) == 0))
+            break;
+        }
+    if (x_Trap_Opt(j >= count))
+        return(text);
+
+    *final = Copy_Span(pool, m_spans[i].text, m_spans[j].start);
+    return(m_spans[j].start);
+}
+
+
+T_Glyph_Ptr     C_HTML_Spans::Extract_Label(T_Glyph_Ptr * final, C_Pool * pool, T_Glyph_Ptr text,
+                                            T_Glyph_CPtr label, T_Glyph_Ptr find_end)
+{
+    T_Glyph_CPtr    label_array[] = { label };
+    T_Glyph_Ptr     end_array[] = { find_end };
+
+    return(Extract_Label(final, pool, text, label_array, 1, end_array, 1));
+}
+
+
+/* Find the first of the given labels that appears after the text position,
+    and extract its value up to the earliest of the end options. Labels are
+    tried in order, just as Extract_Text tries its find sequence.
+*/
+T_Glyph_Ptr     C_HTML_Spans::Extract_Label(T_Glyph_Ptr * final, C_Pool * pool, T_Glyph_Ptr text,
+                                            T_Glyph_CPtr labels[], T_Int32U label_count,
+                                            T_Glyph_Ptr end_options[], T_Int32U end_count)
+{
+    T_Int32U        i;
+    T_Int32S        index;
+    T_Glyph_Ptr     start;
+
+    if (x_Trap_Opt((final == NULL) || (pool == NULL) || (text == NULL) ||
+         (labels == NULL) || (label_count == 0) ||
+         (end_options == NULL) || (end_count == 0)))
+         return(text);
+
+    index = -1;
+    for (i = 0; i < label_count; i++) {
+        index = Find_Label(text, labels[i]);
+        if (index >= 0)
+            break;
+        }
+    if (index < 0)
+        return(text);
+
+    /* The value starts after the closing bold tag, skipping any colon that
+        follows it
+    */
+    start = m_spans[index].text;
+    if (*start == ':')
+        start++;
+    return(Extract_Until(final, pool, text, start, end_options, end_count));
+}
@@ -0,0 +1,233 @@
+/*  FILE:   JOURNAL.CPP
+
+    Copyright (c) 2012 by Lone Wolf Development, Inc.  All rights reserved.
+
+    This code is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation; either version 2 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place, Suite 330, Boston, MA 02111-1307 USA
+
+    You can find more information about this project here:
+
+    http://code.google.com/p/ddidownloader/
+
+    This file includes:
+
+    A journal of the download in progress, kept in the temporary folder next
+    to the files being downloaded. Every index page and entry page that's
+    downloaded is noted in it as we go, so if the downloader is closed or
+    crashes part way through, the next run can pick up where it left off
+    instead of downloading everything again.
+*/
+
+
+#include "private.h"
+
+
+/* The journal is a text file that's only ever appended to. Each line is a
+    record type, then the rest of the record:
+
+        I <hash> <filename>     index page downloaded, with a hash of the file
+        D <filename>            entry page downloaded
+        F <filename>            entry page couldn't be downloaded
+
+    A later record for the same file replaces an earlier one. Anything after
+    the last complete line was being written when we stopped, so it's ignored.
+*/
+#define JOURNAL_FILENAME    "journal.ignore"
+
+
+/* Records are flushed to disk in batches, since a few pages downloaded twice
+    is much cheaper than waiting for the disk after every page
+*/
+#define JOURNAL_BATCH       25
+
+
+typedef map<string,T_Int64U>    T_Journal_Index;
+
+
+static  FILE *              l_journal = NULL;
+static  string              l_filename;
+static  T_Int32U            l_pending = 0;
+static  T_Journal_Index     l_index;
+static  set<string>         l_downloaded;
+
+
+/* Hash of a file's contents, or 0 if it can't be read - this is the same
+    64-bit FNV-1a hash the XML library uses for documents
+*/
+static T_Int64U Hash_File(T_Glyph_CPtr filename)
+{
+    size_t          length;
+    FILE *          file;
+    T_Int64U        hash;
+    T_Int8U         buffer[16384];
+
+    file = fopen(filename, "rb");
+    if (file == NULL)
+        return(0);
+    hash = XML_HASH_BASIS;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        hash = XML_Hash_Bytes(buffer, length, hash);
+    fclose(file);
+    return(hash);
+}
+
+
+/* Read in any journal left in the folder by a previous run
+*/
+static bool     Read_Journal(void)
+{
+    T_Int64U        hash;
+    T_Glyph_Ptr     text, ptr, end;
+    bool            is_found = false;
+
+    text = Quick_Read_Text((T_Glyph_Ptr) l_filename.c_str());
+    if (text == NULL)
+        return(false);
+
+    for (ptr = text; *ptr != '\0'; ptr = end) {
+        end = strchr(ptr, '\n');
+        if (end == NULL)
+            break;
+        *end++ = '\0';
+        if ((ptr[0] == '\0') || (ptr[1] != ' ') || (ptr[2] == '\0'))
+            continue;
+        is_found = true;
+        switch (ptr[0]) {
+            case 'I' :
+                hash = Parse_Hash(ptr + 2, &ptr);
+                if ((*ptr == ' ') && (ptr[1] != '\0'))
+                    l_index[ptr + 1] = hash;
+                break;
+            case 'D' :
+                l_downloaded.insert(ptr + 2);
+                break;
+            case 'F' :
+                l_downloaded.erase(ptr + 2);
+                break;
+            }
+        }
+    delete [] text;
+    return(is_found);
+}
+
+
+/* Add a record to the journal, flushing it out to disk if enough have built
+    up
+*/
+static void     Append_Record(T_Glyph type, T_Glyph_CPtr text)
+{
+    if (l_filename.empty())
+        return;
+    if (l_journal == NULL) {
+        l_journal = fopen(l_filename.c_str(), "a");
+        if (x_Trap_Opt(l_journal == NULL))
+            return;
+        }
+    fprintf(l_journal, "%c %s\n", type, text);
+    if (++l_pending >= JOURNAL_BATCH)
+        Journal_Flush();
+}
+
+
+/* Start keeping a journal in the given folder, returning whether there was
+    one there already from a download that didn't finish. The file isn't
+    opened until there's something to write to it, so the folder can still
+    be emptied if we're not resuming.
+*/
+bool            Journal_Open(T_Glyph_CPtr folder)
+{
+    Journal_Close(false);
+    l_filename = folder;
+    l_filename += JOURNAL_FILENAME;
+    l_pending = 0;
+    return(Read_Journal());
+}
+
+
+/* Write out any records that haven't made it to disk yet
+*/
+void            Journal_Flush(void)
+{
+    if ((l_journal == NULL) || (l_pending == 0))
+        return;
+    l_pending = 0;
+    if (x_Trap_Opt(fflush(l_journal) != 0))
+        return;
+    FileSys_Sync_File(l_filename.c_str());
+}
+
+
+/* Close the journal - if the download it's keeping track of is finished, we
+    don't need it any more
+*/
+void            Journal_Close(bool is_finished)
+{
+    if (l_journal != NULL) {
+        Journal_Flush();
+        fclose(l_journal);
+        l_journal = NULL;
+        }
+    if (is_finished && !l_filename.empty())
+        FileSys_Delete_File(l_filename.c_str(), FALSE);
+    l_filename.erase();
+    l_index.clear();
+    l_downloaded.clear();
+}
+
+
+/* Is the index page we'd download to the given file already there from
+    earlier in this download?
+*/
+bool            Journal_Is_Index_Current(T_Glyph_CPtr filename)
+{
+    T_Journal_Index::iterator   it;
+
+    it = l_index.find(filename);
+    if (it == l_index.end())
+        return(false);
+    return(it->second == Hash_File(filename));
+}
+
+
+void            Journal_Record_Index(T_Glyph_CPtr filename)
+{
+    T_Int64U        hash;
+    T_Glyph         buffer[MAX_FILE_NAME+40];
+
+    hash = Hash_File(filename);
+    l_index[filename] = hash;
+    sprintf(buffer, "%016llx %s", (unsigned long long) hash, filename);
+    Append_Record('I', buffer);
+}
+
+
+/* Has the entry page we'd download to the given file already been
+    downloaded?
+*/
+bool            Journal_Is_Downloaded(T_Glyph_CPtr filename)
+{
+    if (l_downloaded.count(filename) == 0)
+        return(false);
+    return(FileSys_Does_File_Exist((T_Glyph_Ptr) filename));
+}
+
+
+void            Journal_Record_Download(T_Glyph_CPtr filename, bool is_ok)
+{
+    if (is_ok)
+        l_downloaded.insert(filename);
+    else
+        l_downloaded.erase(filename);
+    Append_Record(is_ok ? 'D' : 'F', filename);
+}
@@ -0,0 +1,293 @@
+/*  FILE:   LOG.CPP
+
+    Copyright (c) 2012 by Lone Wolf Development, Inc.  All rights reserved.
+
+    This code is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation; either version 2 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place, Suite 330, Boston, MA 02111-1307 USA
+
+    You can find more information about this project here:
+
+    http://code.google.com/p/ddidownloader/
+
+    This file includes:
+
+    The log. Messages go into a ring buffer, and a thread of their own writes
+    them out to the log file and flushes it every so often, so the main thread
+    doesn't have to wait for the disk every time something is logged. Console
+    messages are printed straight away, but only flushed by the log thread.
+*/
+
+
+#include "private.h"
+
+#include <fstream>
+
+
+/* The ring holds messages that haven't been written out yet. Only the log
+    thread takes from it, so the two counts are all the coordination it needs
+    with whoever is adding to it. Messages are normally logged from the main
+    thread, but any thread that isn't capturing its messages may log too, so
+    writers take the write lock while they add a message. The size must be a
+    power of two.
+    The counts (and the flush counts below) are shared between the threads, so
+    they're always read through Thread_Atomic_Add.
+*/
+#define LOG_RING_SIZE       (256 * 1024)
+
+struct T_Log_Ring {
+    T_Glyph             buffer[LOG_RING_SIZE];
+    volatile T_Int32S   written;        // total bytes added by writers
+    volatile T_Int32S   drained;        // total bytes written out by the log thread
+};
+
+
+/* The log thread checks for new messages this often, and flushes the files
+    this often while messages keep arriving (both in milliseconds)
+*/
+#define LOG_POLL_INTERVAL   20
+#define LOG_FLUSH_INTERVAL  250
+
+
+static  ofstream *          l_log = NULL;
+static  T_Log_Ring *        l_ring = NULL;
+static  T_Void_Ptr          l_thread = NULL;
+static  E_Log_Level         l_level = e_log_detail;
+static  volatile T_Int32S   l_is_stopping = 0;
+static  volatile T_Int32S   l_flush_requests = 0;
+static  volatile T_Int32S   l_flushes_done = 0;
+static  volatile T_Int32S   l_write_lock = 0;
+
+
+/* Copy a message into the ring, waiting for the log thread to make room if
+    it's full
+*/
+static void     Ring_Write(T_Glyph_CPtr text, T_Int32U length)
+{
+    T_Int32U        written, offset, count, space;
+
+    while (length > 0) {
+        written = (T_Int32U) Thread_Atomic_Add(&l_ring->written, 0);
+        space = LOG_RING_SIZE - (written - (T_Int32U) Thread_Atomic_Add(&l_ring->drained, 0));
+        if (space == 0) {
+            Pause_Execution(1);
+            continue;
+            }
+
+        /* Copy as much as fits before the end of the buffer, then make it
+            available to the log thread
+        */
+        count = (length < space) ? length : space;
+        offset = written % LOG_RING_SIZE;
+        if (count > LOG_RING_SIZE - offset)
+            count = LOG_RING_SIZE - offset;
+        memcpy(l_ring->buffer + offset, text, count);
+        Thread_Atomic_Add(&l_ring->written, count);
+        text += count;
+        length -= count;
+        }
+}
+
+
+/* Write everything in the ring out to the log file, returning whether there
+    was anything there
+*/
+static bool     Ring_Drain(void)
+{
+    T_Int32U        written, drained, offset, count;
+
+    written = (T_Int32U) Thread_Atomic_Add(&l_ring->written, 0);
+    drained = (T_Int32U) Thread_Atomic_Add(&l_ring->drained, 0);
+    if (written == drained)
+        return(false);
+
+    while (drained != written) {
+        offset = drained % LOG_RING_SIZE;
+        count = written - drained;
+        if (count > LOG_RING_SIZE - offset)
+            count = LOG_RING_SIZE - offset;
+        l_log->write(l_ring->buffer + offset, count);
+        drained += count;
+        Thread_Atomic_Add(&l_ring->drained, count);
+        }
+    return(true);
+}
+
+
+static void     Log_Thread(T_Void_Ptr context)
+{
+    T_Int32S        requests, done;
+    T_Int32U        last_flush;
+    bool            is_stopping, is_dirty = false;
+
+    last_flush = Get_Milliseconds();
+    while (true) {
+
+        /* Note whether we've been asked to flush or stop before draining the
+            ring, so everything logged before the request is included
+        */
+        requests = Thread_Atomic_Add(&l_flush_requests, 0);
+        done = Thread_Atomic_Add(&l_flushes_done, 0);
+        is_stopping = (Thread_Atomic_Add(&l_is_stopping, 0) != 0);
+        if ((l_log != NULL) && Ring_Drain())
+            is_dirty = true;
+
+        if (is_stopping || (requests != done) ||
+            (Get_Milliseconds() - last_flush >= LOG_FLUSH_INTERVAL)) {
+            fflush(stdout);
+            if (is_dirty)
+                l_log->flush();
+            is_dirty = false;
+            last_flush = Get_Milliseconds();
+            Thread_Atomic_Add(&l_flushes_done, requests - done);
+            }
+
+        if (is_stopping)
+            break;
+        Pause_Execution(LOG_POLL_INTERVAL);
+        }
+}
+
+
+void        Log_Open(ofstream * stream)
+{
+    x_Trap_Opt(l_log != NULL);
+    l_log = stream;
+
+    /* If we can't start the log thread, everything is just written out
+        straight away instead
+    */
+    l_ring = new T_Log_Ring;
+    l_ring->written = 0;
+    l_ring->drained = 0;
+    l_is_stopping = 0;
+    l_thread = Thread_Start(Log_Thread, NULL);
+    if (x_Trap_Opt(l_thread == NULL)) {
+        delete l_ring;
+        l_ring = NULL;
+        }
+}
+
+
+void        Log_Close(void)
+{
+    if (l_thread != NULL) {
+        Thread_Atomic_Increment(&l_is_stopping);
+        Thread_Wait(l_thread);
+        l_thread = NULL;
+        }
+    if (l_ring != NULL) {
+        delete l_ring;
+        l_ring = NULL;
+        }
+    l_log = NULL;
+}
+
+
+void        Log_Set_Level(E_Log_Level level)
+{
+    l_level = level;
+}
+
+
+/* Make sure everything logged so far has reached the console and the log
+    file - e.g. before waiting for the user to press a key
+*/
+void        Log_Flush(void)
+{
+    T_Int32S        request;
+
+    if (l_thread == NULL) {
+        fflush(stdout);
+        if (l_log != NULL)
+            l_log->flush();
+        return;
+        }
+
+    request = Thread_Atomic_Increment(&l_flush_requests);
+    while (Thread_Atomic_Add(&l_flushes_done, 0) - request < 0)
+        Pause_Execution(1);
+}
+
+
+void        Log_Message(T_Glyph_Ptr message, bool is_console, E_Log_Level level)
+{
+    T_Log_Entry     entry;
+    T_Log_Capture * capture;
+
+    /* If this thread's messages are being captured, hold on to the message
+        until the capture is replayed
+    */
+    capture = (T_Log_Capture *) Thread_Get_Local(e_local_log_capture);
+    if (capture != NULL) {
+        entry.text = message;
+        entry.is_console = is_console;
+        entry.level = level;
+        capture->push_back(entry);
+        return;
+        }
+
+    /* Output the message to the console if requested, and to our log file
+        unless it's less important than we care about. The log thread takes
+        care of flushing both, unless there isn't one. The lock keeps messages
+        from different threads whole, and in the order they were logged.
+    */
+    if (is_console) {
+        fputs(message, stdout);
+        if (l_thread == NULL)
+            fflush(stdout);
+        }
+    if ((l_log != NULL) && (level >= l_level)) {
+        Thread_Lock(&l_write_lock);
+        if (l_thread != NULL)
+            Ring_Write(message, strlen(message));
+        else {
+            (*l_log) << message;
+            l_log->flush();
+            }
+        Thread_Unlock(&l_write_lock);
+        }
+
+    /* If something has gone badly wrong, we might not be around much longer,
+        so make sure this gets out right away
+    */
+    if (level == e_log_fatal)
+        Log_Flush();
+}
+
+
+/* Worker threads can't write to the log directly, so they capture their
+    messages instead, and the main thread replays them in a sensible order once
+    the work is done
+*/
+void        Log_Begin_Capture(T_Log_Capture * capture)
+{
+    x_Trap_Opt(Thread_Get_Local(e_local_log_capture) != NULL);
+    Thread_Set_Local(e_local_log_capture, capture);
+}
+
+
+void        Log_End_Capture(void)
+{
+    Thread_Set_Local(e_local_log_capture, NULL);
+}
+
+
+void        Log_Replay(T_Log_Capture * capture)
+{
+    T_Log_Capture::iterator     it;
+
+    for (it = capture->begin(); it != capture->end(); ++it)
+        Log_Message((T_Glyph_Ptr) it->text.c_str(), it->is_console, it->level);
+    capture->clear();
+}
@@ -35,6 +35,7 @@ template <class T> C_DDI_Output<T>::C_DDI_Output(T_Glyph_Ptr term, T_Glyph_Ptr f
     m_term = term;
     m_pool = pool;
     m_output_document = NULL;
+    m_loaded_document = NULL;
     memset(m_docs, 0, sizeof(m_docs));
     sprintf(m_docs[0].filename, "ddi_%s.dat", first_filename);
 }
@@ -49,7 +50,10 @@ template <class T> C_DDI_Output<T>::~C_DDI_Output()
     for (i = 0; i < MAX_XML_CONTAINERS; i++)
         if (m_docs[i].document != NULL)
             XML_Destroy_Document(m_docs[i].document);
+    if (m_loaded_document != NULL)
+        XML_Destroy_Document(m_loaded_document);
     m_output_document = NULL;
+    m_loaded_document = NULL;
     memset(m_docs, 0, sizeof(m_docs));
 }
 
@@ -178,9 +182,11 @@ template <class T> T_Status C_DDI_Output<T>::Output(void)
         }
 
     /* Set our output document to the 'main' document to let people retrieve
-        stuff from it.
+        stuff from it - unless we loaded our output from last time, in which
+        case that's what people should be looking at.
     */
-    m_output_document = m_docs[0].document;
+    if (m_loaded_document == NULL)
+        m_output_document = m_docs[0].document;
 
     /* Resolve whether any potential entries should be on the list
     */
@@ -211,7 +217,8 @@ template <class T> T_Status C_DDI_Output<T>::Output(void)
 
         /* Call our output function on this entry
         */
-        status = Output_Entry(root, info);
+        x_Profile_Trace(m_term, "Output_Entry", info->name,
+                        status = Output_Entry(root, info));
         if (status == LWD_ERROR_NOT_IMPLEMENTED)
             continue;
         if (!x_Is_Success(status)) {
@@ -242,6 +249,8 @@ template <class T> T_Status C_DDI_Output<T>::Process(void)
     T_Int32U        i, j, count;
     T *             info;
 
+    x_Profile_Timer(m_term, "process", m_pool);
+
     /* Make sure all output files are set up
     */
     count = m_list.size();
@@ -293,16 +302,16 @@ template <class T> T_Status C_DDI_Output<T>::Process(void)
 /* NOTE: We assume that all crawlers have been Processed before this function
     is called on any of them.
 */
-template <class T> T_Status C_DDI_Output<T>::Post_Process(T_Filename temp_folder)
+template <class T> T_Status C_DDI_Output<T>::Post_Process(void)
 {
     T_Status        status = LWD_ERROR;
-    T_Int32U        i, j, count;
-    long            result;
+    T_Int32U        i, count;
     bool            is_partial;
-    T_XML_Node      root, node;
+    T_XML_Node      root;
     T *             info;
-    vector <T_XML_Node> nodes;
-    T_Glyph         buffer[500], temp[500];
+    T_Glyph         buffer[500];
+
+    x_Profile_Timer(m_term, "post_process", m_pool);
 
     /* Iterate through our list, post-processing each power
     */
@@ -325,52 +334,96 @@ template <class T> T_Status C_DDI_Output<T>::Post_Process(T_Filename temp_folder
 
         /* Call our output function on this entry
         */
-        status = Post_Process_Entry(root, info);
+        x_Profile_Trace(m_term, "Post_Process_Entry", info->name,
+                        status = Post_Process_Entry(root, info));
         if (!x_Is_Success(status)) {
             sprintf(buffer, ">>> Error post-processing %s %s\n", m_term, info->name);
             Log_Message(buffer);
             }
         }
 
-    /* Go through our XML documents and write them out to a temporary file -
-        they still need to have extensions appended to them
+    /* Hand our XML documents over to have extensions appended to them - we
+        still own them, but they mustn't be touched again until they've been
+        written out. If we have partial nodes, the extensions need to know
+        about it.
     */
     for (i = 0; i < MAX_XML_CONTAINERS; i++) {
         if (m_docs[i].document == NULL)
             break;
+        Extension_Queue(m_docs[i].document, m_docs[i].filename, is_partial);
+        }
 
-        /* Check to make sure that all nodes in the document are valid - delete
-            any invalid ones. This may cause problems loading stuff into HL (if
-            the nodes are bootstrapped by others, for example), but if we don't,
-            it will CERTAINLY cause problems loading stuff into HL.
-        */
-        nodes.empty();
-        result = XML_Get_First_Child(m_docs[i].root, &node);
-        while (result == 0) {
-            result = XML_Validate_Node(node);
-            if (x_Trap_Opt(result != 0)) {
-                XML_Get_Name(node, temp);
-                sprintf(buffer, ">>> %s node removed from document %s!\n", temp, m_docs[i].filename);
-                Log_Message(buffer);
-                }
-            result = XML_Get_Next_Child(m_docs[i].root, &node);
-            }
-        for (j = 0; j < nodes.size(); i++)
-            XML_Delete_Node(nodes[j]);
+    x_Status_Return_Success();
+}
 
-        /* If we have partial nodes, set a flag in the document to indicate
-            that, so we know about it when we read things back in
-        */
-        if (is_partial)
-            XML_Write_Boolean_Attribute(m_docs[i].root, "ispartial", true);
 
-        /* Write out the document to a temporary folder
-        */
-        sprintf(buffer, "%s" DIR "%s", temp_folder, m_docs[i].filename);
-        result = XML_Write_Document(m_docs[i].document, buffer, false, true);
-        if (x_Trap_Opt(result != 0))
-            Log_Message("Could not write XML document.");
+/* Instead of crawling our entries, load the main document we generated last
+    time, so other classes can look things up in it. Our list gets a
+    placeholder for each entry, marked as a duplicate so it's never output
+    again; anything other classes add to the list is still output, but the
+    documents are never written out. Each thing and its tags go into the
+    symbol table, just as if we'd created them, since that's how everyone else
+    finds them.
+*/
+template <class T> T_Status C_DDI_Output<T>::Load_Output(T_Filename folder)
+{
+    long            result, tag_result;
+    T_Glyph_CPtr    ptr, compset, group, tag;
+    T_XML_Node      root, node, child;
+    T_XML_Cursor    cursor;
+    T               info;
+    T_Filename      filename;
+    T_Glyph         buffer[MAX_FILE_NAME+500];
+
+    sprintf(buffer, "Loading existing %s entries... ", m_term);
+    Log_Message(buffer, true);
+
+    sprintf(filename, "%s" DIR "%s", folder, m_docs[0].filename);
+    if (!FileSys_Does_File_Exist(filename)) {
+        sprintf(buffer, "\n%s not found - all data needs to be downloaded before it can be rebuilt a piece at a time.\n", m_docs[0].filename);
+        Log_Message(buffer, true);
+        x_Status_Return(LWD_ERROR);
+        }
+    result = XML_Read_Document(&m_loaded_document, DTD_Get_Data(), filename);
+    if (x_Trap_Opt(result != 0)) {
+        sprintf(buffer, "\nCould not read XML document %s.\n", m_docs[0].filename);
+        Log_Message(buffer, true);
+        x_Status_Return(LWD_ERROR);
         }
+    result = XML_Get_Document_Node(m_loaded_document, &root);
+    if (x_Trap_Opt(result != 0)) {
+        Log_Message("\nCould not get XML document root.\n", true);
+        x_Status_Return(LWD_ERROR);
+        }
+    m_output_document = m_loaded_document;
+
+    result = XML_Get_First_Named_Child(root, "thing", &node);
+    while (result == 0) {
+        memset(&info, 0, sizeof(info));
+        info.node = node;
+        ptr = XML_Get_Attribute_Pointer(node, "name");
+        info.name = m_pool->Acquire((ptr == NULL) ? "" : ptr);
+        ptr = XML_Get_Attribute_Pointer(node, "id");
+        info.id = m_pool->Acquire((ptr == NULL) ? "" : ptr);
+        info.is_duplicate = true;
+
+        compset = XML_Get_Attribute_Pointer(node, "compset");
+        Symbol_Add_Thing(root, node, info.id, (compset == NULL) ? "" : compset, info.name);
+        tag_result = XML_Cursor_First(&cursor, node, &child, "tag");
+        while (tag_result == 0) {
+            group = XML_Get_Attribute_Pointer(child, "group");
+            tag = XML_Get_Attribute_Pointer(child, "tag");
+            if ((group != NULL) && (tag != NULL))
+                Symbol_Add_Tag(node, group, tag);
+            tag_result = XML_Cursor_Next(&cursor, &child);
+            }
+
+        Load_Entry(&info);
+        m_list.push_back(info);
+        result = XML_Get_Next_Named_Child(root, &node);
+        }
+
+    Log_Message("done.\n", true);
 
     x_Status_Return_Success();
 }
@@ -401,6 +454,15 @@ template <class T> T_Status C_DDI_Single<T>::Download(T_Filename folder, T_WWW i
     sprintf(message, "Downloading %ss... ", Get_Term());
     Log_Message(message, true);
 
+    /* If we already got the file before we were interrupted last time, we can
+        use that
+    */
+    sprintf(filename, "%s" DIR "%s", folder, m_filename);
+    if (Journal_Is_Index_Current(filename)) {
+        Log_Message("done (already downloaded).\n", true);
+        x_Status_Return_Success();
+        }
+
     /* Download the file from the internet
     */
     status = WWW_Retrieve_URL(internet, m_url, &contents, NULL);
@@ -412,13 +474,13 @@ template <class T> T_Status C_DDI_Single<T>::Download(T_Filename folder, T_WWW i
 
     /* Write it out to a file we can read in later
     */
-    sprintf(filename, "%s" DIR "%s", folder, m_filename);
     status = Text_Encode_To_File(filename, contents);
     if (x_Trap_Opt(!x_Is_Success(status))) {
         sprintf(message, "Couldn't write individual %s download.\n", Get_Term());
         Log_Message(message);
         x_Status_Return(LWD_ERROR);
         }
+    Journal_Record_Index(filename);
 
     Log_Message("done.\n", true);
 
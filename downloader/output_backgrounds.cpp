@@ -41,7 +41,7 @@ static T_Glyph_Ptr      Get_Earliest(T_Glyph_Ptr pos1, T_Glyph_Ptr pos2)
 }
 
 
-static void Output_Options(T_Background_Info * info, bool is_skill, T_List_Ids * id_list, C_Pool * pool)
+static void Output_Options(T_Background_Info * info, bool is_skill, T_List_Ids * id_list)
 {
     T_Glyph         backup;
     T_Glyph_Ptr     text, temp, end, table, search;
@@ -85,7 +85,7 @@ static void Output_Options(T_Background_Info * info, bool is_skill, T_List_Ids *
         if (!is_skill) {
             is_skip = (Mapping_Find("bglangskip", text, false, false) != NULL);
             if (!is_skip)
-                Output_Language(info->node, text, info, id_list, pool, "User", "BackLang");
+                Output_Language(info->node, text, info, id_list, "User", "BackLang");
             }
         else {
             temp = Mapping_Find(table, text, false, true);
@@ -146,8 +146,8 @@ T_Status    C_DDI_Backgrounds::Output_Entry(T_XML_Node root, T_Background_Info *
     if ((info->campaign != NULL) && (info->campaign[0] != '\0'))
         Output_Tag(info->node, "BackCamp", info->campaign, info, "backcamp", NULL, true, true);
 
-    Output_Options(info, true, &m_id_list, m_pool);
-    Output_Options(info, false, &m_id_list, m_pool);
+    Output_Options(info, true, &m_id_list);
+    Output_Options(info, false, &m_id_list);
 
     /* Add this path to our internal list of backgrounds
     */
@@ -205,7 +205,7 @@ static T_Glyph_Ptr  First_Word_After(T_Glyph_Ptr buffer, T_Glyph_Ptr start)
 }
 
 
-static void Generate_Mechanics(T_Background_Info * info, T_List_Ids * id_list, C_Pool * pool)
+static void Generate_Mechanics(T_Background_Info * info, T_List_Ids * id_list)
 {
     T_Glyph_Ptr         ptr, temp, temp2, script;
     bool                is_hidden = true;
@@ -239,7 +239,7 @@ static void Generate_Mechanics(T_Background_Info * info, T_List_Ids * id_list, C
         if (strcmp(buffer, "Speech") == 0)
             strcpy(buffer, "Deep Speech");
         if (buffer[0] != '\0')
-            Output_Language(info->node, buffer, info, id_list, pool);
+            Output_Language(info->node, buffer, info, id_list);
         }
 
     /* Initial health
@@ -417,7 +417,7 @@ T_Status    C_DDI_Backgrounds::Post_Process_Entry(T_XML_Node root, T_Background_
 
     /* Generate scripts / tags / fields / etc for everything
     */
-    Generate_Mechanics(info, &m_id_list, m_pool);
+    Generate_Mechanics(info, &m_id_list);
 
     x_Status_Return_Success();
 }
\ No newline at end of file
@@ -482,12 +482,11 @@ static void Find_Feature_Powers(T_XML_Node classnode, T_Glyph_Ptr class_id,
                                 vector<T_XML_Node> * list, T_Class_Info * info)
 {
     T_Int32S            result;
-    T_Glyph_CPtr        cptr;
     T_XML_Document      document;
-    T_XML_Node          root, node, child;
+    T_XML_Node          root;
 
-    /* Get the XML document for the powers list, and iterate through the powers
-        in it.
+    /* Get the XML document for the powers list, and look up all the powers in
+        it that are features for this class
     */
     document = C_DDI_Powers::Get_Output_Document();
     result = XML_Get_Document_Node(document, &root);
@@ -495,34 +494,7 @@ static void Find_Feature_Powers(T_XML_Node classnode, T_Glyph_Ptr class_id,
         Log_Message("Could not get XML document root.");
         return;
         }
-    result = XML_Get_First_Named_Child(root, "thing", &node);
-    while (result == 0) {
-
-        /* If this power isn't a feature, skip it.
-        */
-        result = XML_Get_First_Named_Child_With_Attr(node, "tag", "group", "PowerType", &child);
-        if (result != 0)
-            goto next_power;
-        cptr = XML_Get_Attribute_Pointer(child, "tag");
-        if (strcmp(cptr, "Feature") != 0)
-            goto next_power;
-
-        /* if this power isn't for the right class, skip it.
-        */
-        result = XML_Get_First_Named_Child_With_Attr(node, "tag", "group", "PowerClass", &child);
-        if (result != 0)
-            goto next_power;
-        cptr = XML_Get_Attribute_Pointer(child, "tag");
-        if (strcmp(cptr, class_id) != 0)
-            goto next_power;
-
-        /* Otherwise, add the node to our list
-        */
-        list->push_back(node);
-
-next_power:
-        result = XML_Get_Next_Named_Child(root, &node);
-        }
+    Symbol_Find_Tagged(root, "PowerClass", class_id, list, "PowerType", "Feature");
 }
 
 
@@ -101,16 +101,13 @@ static T_Glyph_Ptr Add_Property(T_Glyph_Ptr property_name)
     /* Search for a property with this name in our weapon properties group - if
         there's one already, we just need to get the id from it
     */
-    result = XML_Get_First_Named_Child_With_Attr(Get_WepProp_Root(), "extgroup", "name",
-                                                    property_name, &node);
-    if (result == 0) {
-        ptr = (T_Glyph_Ptr) XML_Get_Attribute_Pointer(node, "tag");
+    ptr = (T_Glyph_Ptr) Get_WepProp_Registry()->Find_Id_For_Name(property_name);
+    if (ptr != NULL)
         return(ptr);
-        }
 
     /* Otherwise, generate the unique id for this property's name
     */
-    if (!Generate_Tag_Id(property_id, property_name, Get_WepProp_Root())) {
+    if (!Generate_Tag_Id(property_id, property_name, Get_WepProp_Registry())) {
         sprintf(message, "No unique id could be generated for property '%s'\n", property_name);
         Log_Message(message);
         return(NULL);
@@ -126,6 +123,7 @@ static T_Glyph_Ptr Add_Property(T_Glyph_Ptr property_name)
     XML_Write_Text_Attribute(node, "group", "WepProp");
     XML_Write_Text_Attribute(node, "tag", property_id);
     XML_Write_Text_Attribute(node, "name", property_name);
+    Get_WepProp_Registry()->Add(node);
     ptr = (T_Glyph_Ptr) XML_Get_Attribute_Pointer(node, "tag");
     return(ptr);
 }
@@ -444,7 +442,7 @@ static void         Output_Weapon_Groups(T_Item_Info * info, T_XML_Node target =
         */
         if ((strcmp(ptr, "Bow") == 0) || (strcmp(ptr, "Crossbow") == 0) ||
             (strcmp(ptr, "Sling") == 0))
-            XML_Write_Text_Attribute(target, "compset", "Ranged");
+            Symbol_Set_Compset(target, "Ranged");
 
         /* Go on to the next property
         */
@@ -458,22 +456,14 @@ next_property:
 
 static T_XML_Node   Find_Weapon(T_XML_Node root, T_Glyph_Ptr name)
 {
-    T_Int32S            result;
-    T_Glyph_CPtr        cptr;
     T_XML_Node          node;
     T_Glyph             buffer[500];
 
-    /* Get the XML document for the powers list, and iterate through the powers
-        in it.
+    /* Look up the melee weapon with this name in our symbol table
     */
-    result = XML_Get_First_Named_Child_With_Attr(root, "thing", "compset", "Melee", &node);
-    while (result == 0) {
-        cptr = XML_Get_Attribute_Pointer(node, "name");
-        if (stricmp(name, cptr) == 0)
-            return(node);
-
-        result = XML_Get_Next_Named_Child_With_Attr(root, &node);
-        }
+    node = Symbol_Find_Name(root, "Melee", name);
+    if (node != NULL)
+        return(node);
     sprintf(buffer, "Error finding primary weapon for %s\n", name);
     Log_Message(buffer);
     return(NULL);
@@ -670,7 +660,7 @@ T_Status    C_DDI_Items::Output_Armor(T_XML_Node root, T_Item_Info * info)
     */
     if ((info->armortype != NULL) && ((stricmp(info->armortype, "Heavy Shields") == 0) ||
         (stricmp(info->armortype, "Light Shields") == 0)))
-        XML_Write_Text_Attribute(info->node, "compset", "Shield");
+        Symbol_Set_Compset(info->node, "Shield");
 
     /* If we can confirm we're light armor by our name, add our light tag
     */
@@ -1551,7 +1541,6 @@ T_Status    C_DDI_Items::Output_Entry(T_XML_Node root, T_Item_Info * info)
 static void Find_Armor_Type(T_XML_Node root, T_Glyph_Ptr name, T_Glyph_Ptr * type_id,
                             T_Glyph_Ptr * type_name)
 {
-    long            result;
     T_Glyph_Ptr     ptr;
     T_XML_Node      node;
     T_Glyph         findtype[1000];
@@ -1568,8 +1557,8 @@ static void Find_Armor_Type(T_XML_Node root, T_Glyph_Ptr name, T_Glyph_Ptr * typ
         }
 
     strcpy(findtype, name);
-    result = XML_Get_First_Named_Child_With_Attr(root, "thing", "name", findtype, &node);
-    if (result == 0)
+    node = Symbol_Find_Name(root, NULL, findtype);
+    if (node != NULL)
         goto cleanup_exit;
 
     /* We didn't find it, so try taking 'Armor' off the name if it has it
@@ -1579,8 +1568,8 @@ static void Find_Armor_Type(T_XML_Node root, T_Glyph_Ptr name, T_Glyph_Ptr * typ
         while (ptr[-1] == ' ')
             ptr--;
         *ptr = '\0';
-        result = XML_Get_First_Named_Child_With_Attr(root, "thing", "name", findtype, &node);
-        if (result == 0)
+        node = Symbol_Find_Name(root, NULL, findtype);
+        if (node != NULL)
             goto cleanup_exit;
         }
 
@@ -1588,8 +1577,8 @@ static void Find_Armor_Type(T_XML_Node root, T_Glyph_Ptr name, T_Glyph_Ptr * typ
     */
     else {
         strcat(findtype, " Armor");
-        result = XML_Get_First_Named_Child_With_Attr(root, "thing", "name", findtype, &node);
-        if (result == 0)
+        node = Symbol_Find_Name(root, NULL, findtype);
+        if (node != NULL)
             goto cleanup_exit;
         }
 
@@ -1601,13 +1590,13 @@ static void Find_Armor_Type(T_XML_Node root, T_Glyph_Ptr name, T_Glyph_Ptr * typ
         while (ptr[-1] == ' ')
             ptr--;
         *ptr = '\0';
-        result = XML_Get_First_Named_Child_With_Attr(root, "thing", "name", findtype, &node);
-        if (result == 0)
+        node = Symbol_Find_Name(root, NULL, findtype);
+        if (node != NULL)
             goto cleanup_exit;
         }
 
 cleanup_exit:
-    if (result == 0) {
+    if (node != NULL) {
         *type_id = (T_Glyph_Ptr) XML_Get_Attribute_Pointer(node, "id");
         *type_name = (T_Glyph_Ptr) XML_Get_Attribute_Pointer(node, "name");
         }
@@ -905,4 +905,32 @@ cleanup_exit:
 T_Status    C_DDI_Powers::Post_Process_Entry(T_XML_Node root, T_Power_Info * info)
 {
     x_Status_Return_Success();
+}
+
+
+/* Work out the class of a power loaded from a previous run - other classes
+    compare it with their own names, so turn the class tag we output back
+    into a name
+*/
+void        C_DDI_Powers::Load_Entry(T_Power_Info * info)
+{
+    T_Int32U        i;
+    T_Int32S        result;
+    T_XML_Node      tag;
+    T_Glyph_CPtr    id;
+    T_Tuple *       tuple = NULL;
+    T_Glyph_Ptr     groups[] = { "PowerClass", "PowerClass", "PowerPath", "PowerDest" };
+    T_Glyph_Ptr     mappings[] = { "class", "fakeclass", "path", "destiny" };
+
+    info->forclass = "";
+    for (i = 0; (i < x_Array_Size(groups)) && (tuple == NULL); i++) {
+        result = XML_Get_First_Named_Child_With_Attr(info->node, "tag", "group", groups[i], &tag);
+        if (result != 0)
+            continue;
+        id = XML_Get_Attribute_Pointer(tag, "tag");
+        if (id != NULL)
+            tuple = Mapping_Find_Id(mappings[i], id);
+        }
+    if (tuple != NULL)
+        info->forclass = tuple->a;
 }
\ No newline at end of file
@@ -145,7 +145,7 @@ error:
 }
 
 
-static void Output_Languages(T_Race_Info * info, T_List_Ids * id_list, C_Pool * pool)
+static void Output_Languages(T_Race_Info * info, T_List_Ids * id_list)
 {
     T_Int32U            i, chunk_count, extra_langs;
     T_Glyph_Ptr         chunks[1000];
@@ -172,7 +172,7 @@ static void Output_Languages(T_Race_Info * info, T_List_Ids * id_list, C_Pool *
 
         /* Otherwise, add the specific language
         */
-        Output_Language(info->node, chunks[i], info, id_list, pool);
+        Output_Language(info->node, chunks[i], info, id_list);
         }
 
     /* If we have a non-zero number of extra languages, output a field for that
@@ -278,7 +278,7 @@ T_Status    C_DDI_Races::Output_Entry(T_XML_Node root, T_Race_Info * info)
 
     Output_Field(info->node, "racSpeed", As_Int(atoi(info->speed)), info);
 
-    Output_Languages(info, &m_id_list, m_pool);
+    Output_Languages(info, &m_id_list);
 
     if (stricmp(info->vision, "Normal") != 0)
         Output_Tag(info->node, "Vision", info->vision, info, "vision");
@@ -0,0 +1,584 @@
+/*  FILE:   OVERLAY.CPP
+
+    Copyright (c) 2012 by Lone Wolf Development, Inc.  All rights reserved.
+
+    This code is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation; either version 2 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place, Suite 330, Boston, MA 02111-1307 USA
+
+    You can find more information about this project here:
+
+    http://code.google.com/p/ddidownloader/
+
+    This file includes:
+
+    Precompiled copies of the XML files in the ddidownloader folder. The first
+    time we see an extension file, we parse and validate it as normal, then
+    save a binary image of the document in our cache folder. As long as the
+    extension file doesn't change, later runs build the document straight from
+    the image, without parsing or validating the XML again. The mapping file
+    gets the same treatment, except that its image holds the finished mappings
+    rather than a document.
+*/
+
+
+#include "private.h"
+
+
+/* An image starts with a header, followed by the root node. Each node holds
+    its name, the attributes that are set on it, its PCDATA and its children,
+    in document order. Strings are stored with their length and a terminating
+    null, so they can be used straight out of the image.
+
+    NOTE: The image holds whatever the data DTD accepted when it was compiled,
+        so OVERLAY_VERSION must be bumped whenever the DTD or the image layout
+        changes.
+*/
+#define OVERLAY_MAGIC       0x4C564F44
+#define OVERLAY_VERSION     4
+#define OVERLAY_EXTENSION   ".ovl"
+
+
+/* A mapping image holds all the strings used by the tuples, then the number
+    of mappings, then each mapping's id and tuples. Tuples are stored as three
+    offsets into the strings, with MAPPING_NONE for a string that isn't set.
+    Last come the messages logged while the mapping file was parsed, so they
+    can be logged again each time the image is used.
+*/
+#define MAPPING_MAGIC       0x504D4444
+#define MAPPING_NONE        0xFFFFFFFF
+
+struct T_Overlay_Header {
+    T_Int32U        magic;
+    T_Int32U        version;
+    T_Int64U        hash;           // hash of the extension file's text
+    T_Int32U        length;         // length of the extension file's text
+    T_Int32U        size;           // size of the image after the header
+    T_Int64U        check;          // hash of the image after the header
+};
+
+
+/* Where we are while reading an image
+*/
+struct T_Overlay_Reader {
+    T_Glyph_CPtr    ptr;
+    T_Glyph_CPtr    end;
+};
+
+
+static  string      l_folder;
+
+
+void            Overlay_Initialize(T_Glyph_CPtr cache_folder)
+{
+    l_folder = (cache_folder == NULL) ? "" : cache_folder;
+}
+
+
+/* Hash of the text - used both to spot changes to the extension file, and to
+    make sure the image wasn't damaged since we wrote it
+*/
+static T_Int64U Hash_Text(T_Glyph_CPtr text, T_Int32U length)
+{
+    return(XML_Hash_Bytes(text, length));
+}
+
+
+/* Read the whole of the file in text mode, the same way the XML library does,
+    so that we hash exactly the text it would parse
+*/
+static bool     Read_Text(T_Glyph_CPtr filename, string * text)
+{
+    FILE *          file;
+    size_t          count;
+    T_Glyph         buffer[16384];
+
+    file = fopen(filename, "r");
+    if (file == NULL)
+        return(false);
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text->append(buffer, count);
+    fclose(file);
+    return(true);
+}
+
+
+static void     Get_Image_Name(T_Glyph_Ptr image, T_Glyph_CPtr filename)
+{
+    T_Glyph_CPtr    base;
+
+    base = strrchr(filename, DIR[0]);
+    base = (base == NULL) ? filename : base + 1;
+    sprintf(image, "%s%s%s", l_folder.c_str(), base, OVERLAY_EXTENSION);
+}
+
+
+static void     Append_Int(string * image, T_Int32U value)
+{
+    image->append((T_Glyph_CPtr) &value, sizeof(value));
+}
+
+
+static void     Append_String(string * image, T_Glyph_CPtr text)
+{
+    T_Int32U        length;
+
+    if (text == NULL)
+        text = "";
+    length = strlen(text);
+    Append_Int(image, length);
+    image->append(text, length + 1);
+}
+
+
+/* Add the node and everything beneath it to the image. Only the attributes
+    that are set on the node are stored - including ones that are set to an
+    empty string, since those don't read back the same as an attribute that
+    isn't set when it has a default (e.g. index="1" or phase="*").
+*/
+static void     Compile_Node(string * image, T_XML_Node node)
+{
+    T_Int32S        result;
+    T_Int32U        count;
+    T_Int32U        count_offset;
+    T_Glyph_CPtr    value;
+    T_XML_Node      child;
+    T_XML_Cursor    cursor;
+    T_Glyph         name[100];
+
+    XML_Get_Name(node, name);
+    Append_String(image, name);
+
+    count_offset = image->size();
+    Append_Int(image, 0);
+    count = 0;
+    result = XML_Get_First_Attribute(node, name);
+    while (result == 0) {
+        if (XML_Is_Attribute_Set(node, name)) {
+            value = XML_Get_Attribute_Pointer(node, name, false);
+            Append_String(image, name);
+            Append_String(image, value);
+            count++;
+            }
+        result = XML_Get_Next_Attribute(node, name);
+        }
+    memcpy(&(*image)[count_offset], &count, sizeof(count));
+
+    Append_String(image, XML_Get_PCDATA_Pointer(node));
+
+    count_offset = image->size();
+    Append_Int(image, 0);
+    count = 0;
+    result = XML_Cursor_First(&cursor, node, &child);
+    while (result == 0) {
+        Compile_Node(image, child);
+        count++;
+        result = XML_Cursor_Next(&cursor, &child);
+        }
+    memcpy(&(*image)[count_offset], &count, sizeof(count));
+}
+
+
+/* Save the image of a file in our cache folder. If we can't, it doesn't
+    matter - we'll just parse the file again next time. The cache folder may be
+    shared with other runs, so the image is written to a file of our own and
+    then renamed into place, so nobody ever sees half of it.
+*/
+static void     Write_Image(T_Glyph_CPtr filename, T_Int32U magic, string * text,
+                            string * image)
+{
+    FILE *              file;
+    T_Overlay_Header    header;
+    T_Filename          image_name;
+    string              temp_name;
+    T_Glyph             buffer[50];
+
+    if (l_folder.empty())
+        return;
+
+    header.magic = magic;
+    header.version = OVERLAY_VERSION;
+    header.hash = Hash_Text(text->c_str(), text->size());
+    header.length = text->size();
+    header.size = image->size();
+    header.check = Hash_Text(image->data(), image->size());
+
+    Get_Image_Name(image_name, filename);
+    sprintf(buffer, ".%lx%llx", Thread_Get_Id(), (unsigned long long) Get_Microseconds());
+    temp_name = image_name;
+    temp_name += buffer;
+    temp_name += WRITING_EXTENSION;
+    file = fopen(temp_name.c_str(), "wb");
+    if (file == NULL)
+        return;
+    if ((fwrite(&header, sizeof(header), 1, file) != 1) ||
+        (fwrite(image->data(), 1, image->size(), file) != image->size())) {
+        fclose(file);
+        remove(temp_name.c_str());
+        return;
+        }
+    if ((fclose(file) != 0) || !x_Is_Success(FileSys_Rename_File(image_name, temp_name.c_str())))
+        remove(temp_name.c_str());
+}
+
+
+/* Read the whole image of a file in one go, once we know it's for this
+    version of the file and it hasn't been damaged. The caller owns the
+    returned buffer.
+*/
+static T_Glyph_Ptr  Read_Image(T_Glyph_CPtr filename, T_Int32U magic, string * text,
+                                T_Overlay_Reader * reader)
+{
+    FILE *              file;
+    long                position, length;
+    T_Glyph_Ptr         image;
+    T_Overlay_Header    header;
+    T_Filename          image_name;
+
+    if (l_folder.empty())
+        return(NULL);
+
+    Get_Image_Name(image_name, filename);
+    file = fopen(image_name, "rb");
+    if (file == NULL)
+        return(NULL);
+    if ((fread(&header, sizeof(header), 1, file) != 1) ||
+        (header.magic != magic) || (header.version != OVERLAY_VERSION) ||
+        (header.length != text->size()) ||
+        (header.hash != Hash_Text(text->c_str(), text->size()))) {
+        fclose(file);
+        return(NULL);
+        }
+
+    /* Make sure the rest of the file is exactly the size the header says,
+        before we trust it enough to allocate that much
+    */
+    position = ftell(file);
+    if ((position < 0) || (fseek(file, 0, SEEK_END) != 0) ||
+        ((length = ftell(file)) < 0) || (fseek(file, position, SEEK_SET) != 0) ||
+        ((T_Int32U) (length - position) != header.size)) {
+        fclose(file);
+        return(NULL);
+        }
+    image = new T_Glyph[header.size + 1];
+    if ((fread(image, 1, header.size, file) != header.size) ||
+        (Hash_Text(image, header.size) != header.check)) {
+        fclose(file);
+        delete [] image;
+        return(NULL);
+        }
+    fclose(file);
+
+    reader->ptr = image;
+    reader->end = image + header.size;
+    return(image);
+}
+
+
+static bool     Read_Int(T_Overlay_Reader * reader, T_Int32U * value)
+{
+    if (reader->end - reader->ptr < (long) sizeof(*value))
+        return(false);
+    memcpy(value, reader->ptr, sizeof(*value));
+    reader->ptr += sizeof(*value);
+    return(true);
+}
+
+
+static bool     Read_String(T_Overlay_Reader * reader, T_Glyph_CPtr * text)
+{
+    T_Int32U        length;
+
+    if (!Read_Int(reader, &length))
+        return(false);
+    if ((T_Int32U) (reader->end - reader->ptr) <= length)
+        return(false);
+    if (reader->ptr[length] != '\0')
+        return(false);
+    *text = reader->ptr;
+    reader->ptr += length + 1;
+    return(true);
+}
+
+
+/* Fill in the node from the image - its name has already been read
+*/
+static bool     Load_Node(T_Overlay_Reader * reader, T_XML_Node node)
+{
+    T_Int32U        i, count;
+    T_Glyph_CPtr    name, value;
+    T_XML_Node      child;
+
+    if (!Read_Int(reader, &count))
+        return(false);
+    for (i = 0; i < count; i++) {
+        if (!Read_String(reader, &name) || !Read_String(reader, &value))
+            return(false);
+        if (XML_Set_Attribute(node, name, value) != 0)
+            return(false);
+        }
+
+    if (!Read_String(reader, &value))
+        return(false);
+    if ((value[0] != '\0') && (XML_Set_PCDATA(node, value) != 0))
+        return(false);
+
+    if (!Read_Int(reader, &count))
+        return(false);
+    for (i = 0; i < count; i++) {
+        if (!Read_String(reader, &name))
+            return(false);
+        if (XML_Create_Child(node, name, &child) != 0)
+            return(false);
+        if (!Load_Node(reader, child))
+            return(false);
+        }
+    return(true);
+}
+
+
+/* Build the document from a saved image, if there's one that matches the
+    text of the extension file
+*/
+static bool     Load_Image(T_XML_Document * document, T_Glyph_CPtr filename, string * text)
+{
+    bool                is_ok;
+    T_Glyph_Ptr         image;
+    T_Glyph_CPtr        name;
+    T_XML_Node          root;
+    T_Overlay_Reader    reader;
+    T_Glyph             root_name[100];
+
+    image = Read_Image(filename, OVERLAY_MAGIC, text, &reader);
+    if (image == NULL)
+        return(false);
+
+    /* Build the document - if anything doesn't match up, throw it away and
+        parse the extension file instead
+    */
+    *document = NULL;
+    is_ok = (XML_Create_Document(document, DTD_Get_Data()) == 0);
+    if (is_ok)
+        is_ok = (XML_Get_Document_Node(*document, &root) == 0);
+    if (is_ok) {
+        XML_Get_Name(root, root_name);
+        is_ok = Read_String(&reader, &name) && (strcmp(name, root_name) == 0) &&
+                Load_Node(&reader, root) && (reader.ptr == reader.end);
+        }
+    delete [] image;
+
+    if (!is_ok && (*document != NULL)) {
+        XML_Destroy_Document(*document);
+        *document = NULL;
+        }
+    return(is_ok);
+}
+
+
+/* Load the extension document from the file, using a saved image of it if
+    we have one. Returns 0 if successful; otherwise the result and error are
+    the same as for XML_Read_Document.
+*/
+long            Overlay_Load(T_XML_Document * document, T_Glyph_CPtr filename)
+{
+    long            result;
+    T_XML_Node      root;
+    string          image, text;
+
+    if (!Read_Text(filename, &text))
+        return(XML_Read_Document(document, DTD_Get_Data(), filename));
+
+    if (Load_Image(document, filename, &text))
+        return(0);
+
+    result = XML_Extract_Document(document, DTD_Get_Data(), text.c_str());
+    if ((result == 0) && (XML_Get_Document_Node(*document, &root) == 0)) {
+        Compile_Node(&image, root);
+        Write_Image(filename, OVERLAY_MAGIC, &text, &image);
+        }
+    return(result);
+}
+
+
+static void     Append_Offset(string * image, string * strings, T_Glyph_CPtr text)
+{
+    if (text == NULL) {
+        Append_Int(image, MAPPING_NONE);
+        return;
+        }
+    Append_Int(image, strings->size());
+    strings->append(text, strlen(text) + 1);
+}
+
+
+static bool     Read_Offset(T_Overlay_Reader * reader, T_Glyph_Ptr strings,
+                            T_Int32U size, T_Glyph_Ptr * text)
+{
+    T_Int32U        offset;
+
+    if (!Read_Int(reader, &offset))
+        return(false);
+    if (offset == MAPPING_NONE)
+        *text = NULL;
+    else if (offset < size)
+        *text = strings + offset;
+    else
+        return(false);
+    return(true);
+}
+
+
+/* Save an image of the mappings loaded from the mapping file, along with the
+    messages logged while parsing it, then point all their tuples at a copy of
+    the strings we own, so the caller can throw away the document they came
+    from. The returned strings must be deleted once the mappings are finished
+    with.
+*/
+T_Glyph_Ptr     Overlay_Save_Mappings(T_Glyph_CPtr filename, vector<T_Mapping *> * mappings,
+                                        T_Log_Capture * log)
+{
+    T_Int32U        i, j, offset;
+    T_Glyph_Ptr     buffer;
+    T_Tuple *       tuple;
+    string          image, list, strings, text;
+
+    Append_Int(&list, mappings->size());
+    for (i = 0; i < mappings->size(); i++) {
+        list.append((T_Glyph_CPtr) &(*mappings)[i]->id, sizeof((*mappings)[i]->id));
+        Append_Int(&list, (*mappings)[i]->list.size());
+        for (j = 0; j < (*mappings)[i]->list.size(); j++) {
+            tuple = &(*mappings)[i]->list[j];
+            Append_Offset(&list, &strings, tuple->a);
+            Append_Offset(&list, &strings, tuple->b);
+            Append_Offset(&list, &strings, tuple->c);
+            }
+        }
+    Append_Int(&list, log->size());
+    for (i = 0; i < log->size(); i++) {
+        Append_Int(&list, (*log)[i].is_console ? 1 : 0);
+        Append_Int(&list, (*log)[i].level);
+        Append_String(&list, (*log)[i].text.c_str());
+        }
+    Append_Int(&image, strings.size());
+    image += strings;
+    image += list;
+    if (Read_Text(filename, &text))
+        Write_Image(filename, MAPPING_MAGIC, &text, &image);
+
+    /* The strings were added in the same order we walk the tuples here
+    */
+    buffer = new T_Glyph[strings.size() + 1];
+    memcpy(buffer, strings.data(), strings.size());
+    for (i = 0, offset = 0; i < mappings->size(); i++)
+        for (j = 0; j < (*mappings)[i]->list.size(); j++) {
+            tuple = &(*mappings)[i]->list[j];
+            if (tuple->a != NULL) {
+                tuple->a = buffer + offset;
+                offset += strlen(tuple->a) + 1;
+                }
+            if (tuple->b != NULL) {
+                tuple->b = buffer + offset;
+                offset += strlen(tuple->b) + 1;
+                }
+            if (tuple->c != NULL) {
+                tuple->c = buffer + offset;
+                offset += strlen(tuple->c) + 1;
+                }
+            }
+    return(buffer);
+}
+
+
+/* Load the mappings from our image of the mapping file, if we have one that
+    matches it, along with the messages logged when the file was parsed. The
+    tuples point straight into the image, which is returned and must be
+    deleted once the mappings are finished with. Returns NULL if the mapping
+    file needs to be parsed instead.
+*/
+T_Glyph_Ptr     Overlay_Load_Mappings(T_Glyph_CPtr filename, vector<T_Mapping *> * mappings,
+                                        T_Log_Capture * log)
+{
+    T_Int32U            i, j, size, map_count, tuple_count, start, log_start;
+    T_Int32U            log_count, is_console, level;
+    T_Glyph_Ptr         image, strings;
+    T_Glyph_CPtr        message;
+    T_Mapping *         mapping;
+    T_Tuple             tuple;
+    T_Log_Entry         entry;
+    T_Overlay_Reader    reader;
+    string              text;
+
+    if (!Read_Text(filename, &text))
+        return(NULL);
+    image = Read_Image(filename, MAPPING_MAGIC, &text, &reader);
+    if (image == NULL)
+        return(NULL);
+
+    /* The strings come first - make sure the last one is terminated, so that
+        every offset into them is safe to use
+    */
+    start = mappings->size();
+    log_start = log->size();
+    if (!Read_Int(&reader, &size) || ((T_Int32U) (reader.end - reader.ptr) < size))
+        goto failed;
+    if ((size > 0) && (reader.ptr[size - 1] != '\0'))
+        goto failed;
+    strings = (T_Glyph_Ptr) reader.ptr;
+    reader.ptr += size;
+
+    if (!Read_Int(&reader, &map_count))
+        goto failed;
+    for (i = 0; i < map_count; i++) {
+        mapping = new T_Mapping;
+        mappings->push_back(mapping);
+        if ((reader.end - reader.ptr) < (long) sizeof(mapping->id))
+            goto failed;
+        memcpy(&mapping->id, reader.ptr, sizeof(mapping->id));
+        reader.ptr += sizeof(mapping->id);
+        if (!Read_Int(&reader, &tuple_count))
+            goto failed;
+        for (j = 0; j < tuple_count; j++) {
+            if (!Read_Offset(&reader, strings, size, &tuple.a) || (tuple.a == NULL) ||
+                !Read_Offset(&reader, strings, size, &tuple.b) ||
+                !Read_Offset(&reader, strings, size, &tuple.c))
+                goto failed;
+            mapping->list.push_back(tuple);
+            }
+        }
+
+    if (!Read_Int(&reader, &log_count))
+        goto failed;
+    for (i = 0; i < log_count; i++) {
+        if (!Read_Int(&reader, &is_console) || !Read_Int(&reader, &level) ||
+            !Read_String(&reader, &message))
+            goto failed;
+        entry.text = message;
+        entry.is_console = (is_console != 0);
+        entry.level = (E_Log_Level) level;
+        log->push_back(entry);
+        }
+    if (reader.ptr != reader.end)
+        goto failed;
+    return(image);
+
+    /* If anything doesn't match up, get rid of whatever we added
+    */
+failed:
+    while (mappings->size() > start) {
+        delete mappings->back();
+        mappings->pop_back();
+        }
+    log->resize(log_start);
+    delete [] image;
+    return(NULL);
+}
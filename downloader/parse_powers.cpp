@@ -268,17 +268,18 @@ T_Status        C_DDI_Powers::Parse_Entry_Details(T_Glyph_Ptr contents, T_Power_
     T_Status            status;
     T_Int32U            length, templength;
     T_Glyph_Ptr         end, saved, temp, index_action;
-    T_Glyph_Ptr         starts[] = { "???", "???", "???", };
+    T_Glyph_CPtr        labels[] = { "???", "???", "???", };
     T_Glyph_Ptr         ends[] = { "<br", "</p" };
+    C_HTML_Spans        spans(ptr, checkpoint);
 
     /* The class of the first h1 tag gives us the type of power it is.
     */
-    ptr = Extract_Text(&info->use, m_pool, ptr, checkpoint, "<h1 class=\"", "\"");
+    ptr = spans.Extract_Class(&info->use, m_pool, ptr, "h1");
 
     /* Move past the end of the h1 tag - next is a <span> tag. the PCDATA of
         this tag is something like "Wizard Attack 22" or "Fighter Utility 7".
     */
-    ptr = Extract_Text(&info->type, m_pool, ptr, checkpoint, "<span class=\"level\">", "</span>");
+    ptr = spans.Extract_Tag_Text(&info->type, m_pool, ptr, "span", "level");
 
     /* The flavor text is the PCDATA of the first <i> node after that - it
         might have <span class="flavor">[text]</span> after it, so strip those
@@ -386,29 +387,29 @@ T_Status        C_DDI_Powers::Parse_Entry_Details(T_Glyph_Ptr contents, T_Power_
         description.
     */
     saved = ptr;
-    starts[0] = "<b>Special</b>:";
-    ptr = Extract_Text(&info->special, m_pool, ptr, checkpoint, starts, 1,
-                        ends, x_Array_Size(ends));
+    labels[0] = "Special";
+    ptr = spans.Extract_Label(&info->special, m_pool, ptr, labels, 1,
+                                ends, x_Array_Size(ends));
     Strip_Bad_Characters(info->special);
     ptr = saved;
 
-    starts[0] = "<b>Requirement</b>:";
-    starts[1] = "<b>Requirements</b>:";
-    ptr = Extract_Text(&info->requirement, m_pool, ptr, checkpoint, starts, 2,
-                        ends, x_Array_Size(ends));
+    labels[0] = "Requirement";
+    labels[1] = "Requirements";
+    ptr = spans.Extract_Label(&info->requirement, m_pool, ptr, labels, 2,
+                                ends, x_Array_Size(ends));
     Strip_Bad_Characters(info->requirement);
 
-    starts[0] = "<b>Target</b>:";
-    starts[1] = "<b>Targets</b>:";
-    starts[2] = "<b>Primary Target</b>:";
-    ptr = Extract_Text(&info->target, m_pool, ptr, checkpoint, starts, 3,
-                        ends, x_Array_Size(ends));
+    labels[0] = "Target";
+    labels[1] = "Targets";
+    labels[2] = "Primary Target";
+    ptr = spans.Extract_Label(&info->target, m_pool, ptr, labels, 3,
+                                ends, x_Array_Size(ends));
     Strip_Bad_Characters(info->target);
 
-    starts[0] = "<b>Attack</b>:";
-    starts[1] = "<b>Primary Attack</b>:";
-    ptr = Extract_Text(&info->attack, m_pool, ptr, checkpoint, starts, 2,
-                        ends, x_Array_Size(ends));
+    labels[0] = "Attack";
+    labels[1] = "Primary Attack";
+    ptr = spans.Extract_Label(&info->attack, m_pool, ptr, labels, 2,
+                                ends, x_Array_Size(ends));
     Strip_Bad_Characters(info->attack);
 
     /* Now the description, cutting off the 'first published' details and any
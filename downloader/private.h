@@ -29,7 +29,7 @@
 #ifdef _WIN32
 #include "xml\tools.h"
 #include "xml\pubxml.h"
-#elif defined(_OSX)
+#elif defined(_OSX) || defined(_LINUX)
 #include "xml/tools.h"
 #include "xml/pubxml.h"
 #else
@@ -38,6 +38,9 @@
 
 #include    <ctype.h>
 #include    <vector>
+#include    <map>
+#include    <set>
+#include    <string>
 
 using namespace std;
 
@@ -74,7 +77,7 @@ typedef unsigned __int64    T_Int64U;
 
 #define DIR                 "\\"
 
-#elif defined(_OSX)
+#elif defined(_OSX) || defined(_LINUX)
 typedef long long           T_Int64S;
 typedef unsigned long long  T_Int64U;
 
@@ -336,7 +339,43 @@ struct T_XML_Container {
 
 typedef T_Int64U            T_Unique;
 
-typedef vector<T_Unique> T_List_Ids;
+typedef set<T_Unique>       T_List_Ids;
+
+
+/* Registry of the tags (or things) in one of our shared group documents, such
+    as the weapon properties, languages and sources. Existing entries are found
+    by name or id without walking the document, and new ids are generated
+    against the ids already in use.
+*/
+class C_Tag_Registry {
+public:
+                    C_Tag_Registry(void);
+
+    void            Initialize(T_XML_Node root, T_Glyph_CPtr element, T_Glyph_CPtr id_attr,
+                                bool is_any_case = false);
+    void            Reset(void);
+
+    T_XML_Node      Get_Root(void)              { return(m_root); }
+
+    T_XML_Node      Find_Name(T_Glyph_CPtr name);
+    T_XML_Node      Find_Id(T_Glyph_CPtr id);
+    T_Glyph_CPtr    Find_Id_For_Name(T_Glyph_CPtr name);
+
+    void            Add(T_XML_Node node);
+    bool            Generate_Id(T_Glyph_Ptr buffer, T_Glyph_Ptr init, T_Glyph_Ptr name,
+                                T_Int32U second_length = 3);
+
+private:
+    string          Name_Key(T_Glyph_CPtr name);
+
+    T_XML_Node      m_root;
+    string          m_element;
+    string          m_id_attr;
+    bool            m_is_any_case;
+    T_List_Ids      m_ids;
+    map<string, T_XML_Node> m_names;
+    map<string, T_XML_Node> m_id_nodes;
+};
 
 
 /*  define uniqueness options
@@ -386,6 +425,16 @@ struct T_Failed {
 extern vector<T_Failed>   l_failed_downloads;
 
 
+/* Counts of what happened during the crawl, for the summary at the end of a
+    batch run - declared here, defined in ddicrawler.cpp
+*/
+struct T_Crawl_Stats {
+    T_Int32U        fetched;
+    T_Int32U        parsed;
+};
+extern T_Crawl_Stats    l_crawl_stats;
+
+
 /*  define the set of file attributes
  */
 typedef enum {
@@ -403,6 +452,65 @@ typedef enum {
 typedef T_Status        (* T_Fn_File_Enum)(T_Glyph_Ptr filename,
                                            T_File_Attribute attributes,
                                            T_Void_Ptr context);
+typedef void            (* T_Fn_Worker)(T_Void_Ptr context);
+
+
+/* Structure that holds a single tag from a block of HTML, along with the
+    plain text that follows it up to the next tag. None of the text is copied
+    - everything points into the original buffer, which must outlive us.
+*/
+struct T_HTML_Span {
+    T_Glyph_Ptr     start; // the '<' that opens the tag
+    T_Glyph_Ptr     tag; // tag name, e.g. "b" or "/span"
+    T_Int32U        tag_length;
+    T_Glyph_Ptr     cls; // value of the class attribute, or NULL
+    T_Int32U        cls_length;
+    T_Glyph_Ptr     text; // text after the closing '>'
+    T_Glyph_Ptr     text_end; // next '<' (or the end of the block)
+};
+
+
+/* Class that tokenizes a block of HTML (normally the "detail" div of a
+    compendium page) in a single pass, so that parsers can look up bold labels
+    like "<b>Level</b>:" or tags like "<span class="level">" without re-scanning
+    the page for each field. The Extract_* methods behave just like the
+    Extract_Text functions in text.cpp - they return the new text position, or
+    the original position if nothing was found - so parsers can switch over to
+    them one field at a time.
+*/
+class C_HTML_Spans {
+public:
+    C_HTML_Spans(T_Glyph_Ptr text, T_Glyph_Ptr checkpoint);
+
+    inline T_Int32U         Get_Count(void)
+                                { return(m_spans.size()); }
+    inline T_HTML_Span *    Get_Span(T_Int32U index)
+                                { return(&m_spans[index]); }
+
+    T_Int32S        Find_Tag(T_Glyph_Ptr text, T_Glyph_CPtr tag, T_Glyph_CPtr cls = NULL);
+    T_Int32S        Find_Label(T_Glyph_Ptr text, T_Glyph_CPtr label);
+
+    T_Glyph_Ptr     Extract_Class(T_Glyph_Ptr * final, C_Pool * pool, T_Glyph_Ptr text,
+                                    T_Glyph_CPtr tag);
+    T_Glyph_Ptr     Extract_Tag_Text(T_Glyph_Ptr * final, C_Pool * pool, T_Glyph_Ptr text,
+                                    T_Glyph_CPtr tag, T_Glyph_CPtr cls = NULL);
+    T_Glyph_Ptr     Extract_Label(T_Glyph_Ptr * final, C_Pool * pool, T_Glyph_Ptr text,
+                                    T_Glyph_CPtr label, T_Glyph_Ptr find_end);
+    T_Glyph_Ptr     Extract_Label(T_Glyph_Ptr * final, C_Pool * pool, T_Glyph_Ptr text,
+                                    T_Glyph_CPtr labels[], T_Int32U label_count,
+                                    T_Glyph_Ptr end_options[], T_Int32U end_count);
+
+private:
+    T_Int32S        Find_Span(T_Glyph_Ptr text);
+    T_Glyph_Ptr     Extract_Until(T_Glyph_Ptr * final, C_Pool * pool, T_Glyph_Ptr text,
+                                    T_Glyph_Ptr start, T_Glyph_Ptr end_options[],
+                                    T_Int32U end_count);
+
+    T_Glyph_Ptr     m_checkpoint;
+
+    vector<T_HTML_Span>                 m_spans;
+    map<string, vector<T_Int32U> >      m_labels;
+};
 
 
 /* Define a class that lets us generalise output mechanisms for DDI stuff
@@ -416,7 +524,8 @@ public:
                                 { return(m_list.size()); }
 
     T_Status        Process(void);
-    T_Status        Post_Process(T_Filename temp_folder);
+    T_Status        Post_Process(void);
+    T_Status        Load_Output(T_Filename folder);
 
     T_Int32U        Append_Item(T * info);
     void            Append_Potential_Item(T * info);
@@ -433,6 +542,12 @@ protected:
 
     virtual bool        Is_Potential_Match(T * info, T * potential);
 
+    /* Fill in anything else other classes need to know about an entry loaded
+        from a previous run - the node, name and id are already done
+    */
+    virtual void        Load_Entry(T * info)
+                            { }
+
     C_Pool *        m_pool;
 
     T_Glyph_Ptr     m_term;
@@ -441,6 +556,7 @@ protected:
     vector<T>       m_potentials;
 
     T_XML_Document  m_output_document;
+    T_XML_Document  m_loaded_document;
     T_List_Ids      m_id_list;
 
     T_XML_Container m_docs[MAX_XML_CONTAINERS];
@@ -468,7 +584,10 @@ public:
     virtual T_Status    Download_Content(T_Filename folder, T_WWW internet) = 0;
     virtual T_Status    Read_Content(T_Filename folder) = 0;
     virtual T_Status    Process(void) = 0;
-    virtual T_Status    Post_Process(T_Filename output_folder) = 0;
+    virtual T_Status    Post_Process(void) = 0;
+    virtual T_Status    Load_Output(T_Filename folder) = 0;
+
+    virtual T_Glyph_CPtr    Get_Category(void) = 0;
 };
 
 
@@ -491,8 +610,13 @@ public:
     */
     virtual inline T_Status Process(void)
                                 { return(C_DDI_Output<T>::Process()); }
-    virtual inline T_Status Post_Process(T_Filename output_folder)
-                                { return(C_DDI_Output<T>::Post_Process(output_folder)); }
+    virtual inline T_Status Post_Process(void)
+                                { return(C_DDI_Output<T>::Post_Process()); }
+    virtual inline T_Status Load_Output(T_Filename folder)
+                                { return(C_DDI_Output<T>::Load_Output(folder)); }
+
+    virtual inline T_Glyph_CPtr Get_Category(void)
+                                { return(m_tab_name); }
 
     T_Status    Download_Index(T_Filename folder, T_WWW internet);
     T_Status    Read_Index(T_Filename folder);
@@ -736,6 +860,7 @@ private:
                                             vector<T_Power_Info> * extras);
     virtual T_Status    Output_Entry(T_XML_Node root, T_Power_Info * info);
     virtual T_Status    Post_Process_Entry(T_XML_Node root, T_Power_Info * info);
+    virtual void        Load_Entry(T_Power_Info * info);
 
     virtual T_Int32U    Get_URL_Count(void);
     virtual void        Get_URL(T_Int32U index, T_Glyph_Ptr url, T_Glyph_Ptr names[],
@@ -773,7 +898,7 @@ public:
     virtual T_Status    Download(T_Filename folder, T_WWW internet) = 0;
     virtual T_Status    Read(T_Filename folder) = 0;
     virtual T_Status    Process(void) = 0;
-    virtual T_Status    Post_Process(T_Filename output_folder) = 0;
+    virtual T_Status    Post_Process(void) = 0;
 };
 
 
@@ -790,8 +915,8 @@ public:
     */
     virtual inline T_Status Process(void)
                                 { return(C_DDI_Output<T>::Process()); }
-    virtual inline T_Status Post_Process(T_Filename output_folder)
-                                { return(C_DDI_Output<T>::Post_Process(output_folder)); }
+    virtual inline T_Status Post_Process(void)
+                                { return(C_DDI_Output<T>::Post_Process()); }
 
     T_Status    Download(T_Filename folder, T_WWW internet);
     T_Status    Read(T_Filename folder);
@@ -829,24 +954,83 @@ bool        Is_Password(void);
 /* Get the root XML nodes for interesting data files
 */
 T_XML_Node  Get_Language_Root(void);
+C_Tag_Registry *    Get_Language_Registry(void);
 
 /* Get the root XML nodes for interesting augmentation files
 */
 T_XML_Node  Get_WepProp_Root(void);
 T_XML_Node  Get_Source_Root(void);
+C_Tag_Registry *    Get_WepProp_Registry(void);
+C_Tag_Registry *    Get_Source_Registry(void);
 
 /* Find a mapping entry in our master list
 */
 T_Glyph_Ptr     Mapping_Find(T_Glyph_Ptr mapping, T_Glyph_Ptr search, bool is_partial_mapping = false, bool is_partial_search = false);
 T_Tuple *       Mapping_Find_Tuple(T_Glyph_Ptr mapping, T_Glyph_Ptr search, bool is_partial_mapping = false, bool is_partial_search = false);
+T_Tuple *       Mapping_Find_Id(T_Glyph_Ptr mapping, T_Glyph_CPtr id);
 void            Mapping_Add(T_Glyph_Ptr mapping, T_Glyph_Ptr a, T_Glyph_Ptr b, T_Glyph_Ptr c = NULL);
+T_Int32U        Mapping_Get_Generation(void);
+
+/* Hand a finished document over to have its extensions appended
+*/
+void            Extension_Queue(T_XML_Document document, T_Glyph_CPtr filename, bool is_partial);
+
+
+/* Logging functions - found in log.cpp. Detail messages (e.g. every page
+    downloaded) can be left out of the log file, and fatal messages are
+    written out immediately rather than by the log thread.
+*/
+enum E_Log_Level {
+    e_log_detail,
+    e_log_normal,
+    e_log_fatal,
+};
+
+struct T_Log_Entry {
+    string          text;
+    bool            is_console;
+    E_Log_Level     level;
+};
+
+typedef vector<T_Log_Entry>     T_Log_Capture;
+
+void        Log_Open(ofstream * stream);
+void        Log_Close(void);
+void        Log_Set_Level(E_Log_Level level);
+void        Log_Flush(void);
+void        Log_Message(T_Glyph_Ptr message, bool is_console = false,
+                        E_Log_Level level = e_log_normal);
+void        Log_Begin_Capture(T_Log_Capture * capture);
+void        Log_End_Capture(void);
+void        Log_Replay(T_Log_Capture * capture);
+
+
+/* Scratch memory - found in scratch.cpp. A C_Scratch hands out temporary
+    buffers from the calling thread's arena, and gives them all back when it
+    goes out of scope, so it must not be shared between threads.
+*/
+struct T_Scratch_Arena;
+
+class C_Scratch {
+public:
+    C_Scratch();
+    ~C_Scratch();
+
+    T_Glyph_Ptr     Acquire(T_Int32U size);
+
+private:
+    T_Scratch_Arena *   m_arena;
+    T_Int32U            m_current;
+    T_Int32U            m_position;
+};
+
+void        Scratch_Shutdown_Thread(void);
 
 
 /* Helper functions - found in helper.cpp
 */
 void        Initialize_Helper(ofstream * stream);
 void        Shutdown_Helper(void);
-void        Log_Message(T_Glyph_Ptr message, bool is_console = false);
 
 T_Status    Mem_Acquire(T_Int32U size, T_Void_Ptr * ptr);
 T_Status    Mem_Resize(T_Void_Ptr current, T_Int32U requested, T_Void_Ptr * ptr);
@@ -855,11 +1039,13 @@ void        Mem_Release(T_Void_Ptr ptr);
 T_XML_Element * DTD_Get_Data(void);
 T_XML_Element * DTD_Get_Augmentation(void);
 
+T_Int64U    Parse_Hash(T_Glyph_Ptr text, T_Glyph_Ptr * end);
+
 bool        Check_Duplicate_Ids(T_Glyph_Ptr text, T_List_Ids * id_list);
 bool        Generate_Thing_Id(T_Glyph_Ptr buffer, T_Glyph_Ptr init, T_Glyph_Ptr thing_name,
                                 T_List_Ids * id_list, T_Int32U second_length = 3,
                                 T_Glyph_Ptr suffix = NULL, bool is_try_again = true);
-bool        Generate_Tag_Id(T_Glyph_Ptr buffer, T_Glyph_Ptr tag_name, T_XML_Node root);
+bool        Generate_Tag_Id(T_Glyph_Ptr buffer, T_Glyph_Ptr tag_name, C_Tag_Registry * registry);
 T_Int32S    Create_Thing_Node(T_XML_Node parent, T_Glyph_Ptr term, T_Glyph_Ptr compset,
                                 T_Glyph_Ptr name, T_Glyph_Ptr id, T_Glyph_Ptr description,
                                 T_Int32U uniqueness, T_Glyph_Ptr source, T_XML_Node * node,
@@ -903,13 +1089,14 @@ T_Int32S    Output_Eval_Rule(T_XML_Node node, T_Glyph_CPtr script, T_Glyph_Ptr p
                                 T_Glyph_Ptr before = NULL, T_Glyph_Ptr after = NULL);
 
 T_Int32S    Output_Language(T_XML_Node node, T_Glyph_Ptr name, T_Base_Info * info,
-                            T_List_Ids * id_list, C_Pool * pool, T_Glyph_Ptr boot_group = NULL,
+                            T_List_Ids * id_list, T_Glyph_Ptr boot_group = NULL,
                                 T_Glyph_Ptr boot_tag = NULL);
 
 void        Output_Prereqs(T_Base_Info * info, T_List_Ids * id_list);
 
 void        Append_Extensions(T_XML_Document document, T_Glyph_Ptr output_folder,
-                                T_Glyph_Ptr filename, bool is_partial);
+                                T_Glyph_Ptr filename, bool is_partial,
+                                bool is_merged = false);
 
 bool        Download_Page(T_WWW www, T_Base_Info * info, T_Glyph_Ptr url, T_Glyph_Ptr filename);
 
@@ -936,6 +1123,9 @@ T_Boolean   FileSys_Is_Wildcard_Match(T_Glyph_Ptr filename,T_Glyph_Ptr wildspec)
 T_Status    FileSys_Get_File_Attributes(T_Glyph_CPtr filename,
                                         T_File_Attribute * attribute);
 bool        FileSys_Does_Folder_Exist(T_Glyph_CPtr filename);
+T_Status    FileSys_Rename_File(T_Glyph_CPtr new_name,T_Glyph_CPtr old_name);
+T_Status    FileSys_Link_File(T_Glyph_CPtr new_name,T_Glyph_CPtr old_name);
+T_Status    FileSys_Sync_File(T_Glyph_CPtr filename);
 
 
 /* Unique id functions, in uniqueid.cpp
@@ -947,6 +1137,109 @@ T_Boolean       UniqueId_Is_Valid(const T_Glyph * text);
 T_Boolean       UniqueId_Is_Valid_Char(T_Glyph ch);
 
 
+/* Write stage for finished XML documents, in writer.cpp. Documents are queued
+    as they're finished, then validated and written out together on a pool of
+    threads. A document must not be touched by anything else until the queue
+    has been flushed. Documents written to the manifest folder are left alone
+    if they haven't changed since the last time.
+*/
+#define BACKUP_EXTENSION    ".saved"
+#define WRITING_EXTENSION   ".writing"
+#define MANIFEST_FILENAME   "ddi_manifest.ignore"
+
+void            Writer_Queue(T_XML_Document document, T_Glyph_CPtr filename,
+                                bool is_backup, bool is_owned, bool is_reported = false);
+T_Status        Writer_Flush(void);
+void            Writer_Open_Manifest(T_Glyph_CPtr folder);
+void            Writer_Discard_Manifest(void);
+void            Writer_Check_Nodes(T_XML_Document document, T_Glyph_CPtr filename);
+
+
+/* Precompiled extension and mapping files, in overlay.cpp. Each file is
+    parsed and validated once, and a binary image of it is kept in the cache
+    folder until the file changes.
+*/
+void            Overlay_Initialize(T_Glyph_CPtr cache_folder);
+long            Overlay_Load(T_XML_Document * document, T_Glyph_CPtr filename);
+T_Glyph_Ptr     Overlay_Load_Mappings(T_Glyph_CPtr filename, vector<T_Mapping *> * mappings,
+                                T_Log_Capture * log);
+T_Glyph_Ptr     Overlay_Save_Mappings(T_Glyph_CPtr filename, vector<T_Mapping *> * mappings,
+                                T_Log_Capture * log);
+
+
+/* Journal of the download in progress, in journal.cpp. Index and entry pages
+    that are noted in it don't need to be downloaded again if we're restarted.
+*/
+bool            Journal_Open(T_Glyph_CPtr folder);
+void            Journal_Flush(void);
+void            Journal_Close(bool is_finished);
+bool            Journal_Is_Index_Current(T_Glyph_CPtr filename);
+void            Journal_Record_Index(T_Glyph_CPtr filename);
+bool            Journal_Is_Downloaded(T_Glyph_CPtr filename);
+void            Journal_Record_Download(T_Glyph_CPtr filename, bool is_ok);
+
+
+/* Instrumentation, in profile.cpp. This is only built if _PROFILE is defined -
+    otherwise the macros below compile to nothing. Timers add up how long each
+    category spends in each phase (and how much of the pool it uses), and can
+    only be used on the main thread. Counters can be bumped on any thread.
+    Once a trace is enabled, each statement wrapped in x_Profile_Trace is
+    recorded as an event for the Chrome trace viewer, from any thread.
+*/
+enum E_Profile_Counter {
+    e_counter_mapping_lookups,
+    e_counter_xml_lookups,
+    e_counter_thing_ids,
+    e_counter_thing_id_attempts,
+    e_counter_count,
+};
+
+#ifdef _PROFILE
+class C_Profile_Timer {
+public:
+    C_Profile_Timer(T_Glyph_CPtr category, T_Glyph_CPtr phase, C_Pool * pool = NULL);
+    ~C_Profile_Timer();
+
+private:
+    T_Glyph_CPtr    m_category;
+    T_Glyph_CPtr    m_phase;
+    C_Pool *        m_pool;
+    T_Int32U        m_pool_start;
+    T_Int32U        m_start;
+};
+
+class C_Profile_Trace {
+public:
+    C_Profile_Trace(T_Glyph_CPtr category, T_Glyph_CPtr stage, T_Glyph_CPtr name);
+    ~C_Profile_Trace();
+
+private:
+    T_Glyph_CPtr    m_category;
+    T_Glyph_CPtr    m_stage;
+    T_Glyph_CPtr    m_name;
+    T_Int64U        m_start;
+};
+
+void            Profile_Initialize(void);
+void            Profile_Enable_Trace(T_Glyph_CPtr filename);
+void            Profile_Count(E_Profile_Counter counter);
+void            Profile_Report(void);
+
+#define x_Profile_Timer(category,phase,pool)    C_Profile_Timer _profile_timer(category,phase,pool)
+#define x_Profile_Count(counter)                Profile_Count(counter)
+#define x_Profile_Initialize()                  Profile_Initialize()
+#define x_Profile_Report()                      Profile_Report()
+#define x_Profile_Trace(category,stage,name,statement) \
+            { C_Profile_Trace _profile_trace(category,stage,name); statement; }
+#else
+#define x_Profile_Timer(category,phase,pool)
+#define x_Profile_Count(counter)
+#define x_Profile_Initialize()
+#define x_Profile_Report()
+#define x_Profile_Trace(category,stage,name,statement)  statement
+#endif
+
+
 /* Encoding functions, in encode.cpp
 */
 void            Text_Encode(T_Byte_Ptr data,T_Int32U in_len,T_Glyph_Ptr encode);
@@ -970,6 +1263,22 @@ T_Status        WWW_HTTP_Post(T_WWW internet,T_Glyph_Ptr url,
 T_Status        WWW_Close_Server(T_WWW internet);
 
 
+/* Symbol table of all output things, in symbols.cpp
+*/
+void        Symbol_Add_Thing(T_XML_Node root, T_XML_Node node, T_Glyph_CPtr id,
+                                T_Glyph_CPtr compset, T_Glyph_CPtr name);
+void        Symbol_Set_Compset(T_XML_Node node, T_Glyph_CPtr compset);
+void        Symbol_Add_Tag(T_XML_Node node, T_Glyph_CPtr group, T_Glyph_CPtr tag);
+T_XML_Node  Symbol_Find_Id(T_XML_Node root, T_Glyph_CPtr id);
+T_XML_Node  Symbol_Find_Name(T_XML_Node root, T_Glyph_CPtr compset, T_Glyph_CPtr name);
+void        Symbol_Find_Tagged(T_XML_Node root, T_Glyph_CPtr group, T_Glyph_CPtr tag,
+                                vector<T_XML_Node> * list,
+                                T_Glyph_CPtr group2 = NULL, T_Glyph_CPtr tag2 = NULL);
+bool        Symbol_Has_Tag(T_XML_Node node, T_Glyph_CPtr group, T_Glyph_CPtr tag);
+T_Int32U    Symbol_Get_Count(void);
+void        Symbol_Shutdown(void);
+
+
 /* Text-processing functions - found in text*.cpp
 */
 void        Strip_Bad_Characters(T_Glyph_Ptr buffer);
@@ -991,15 +1300,16 @@ T_Int32U    Text_Find_Replace(T_Glyph_Ptr dest,T_Glyph_Ptr src,T_Glyph_Ptr find,
 void        Text_Find_Replace(T_Glyph_Ptr dest,T_Glyph_Ptr src,T_Int32U length,
                                 T_Int32U count,T_Glyph_Ptr * find,T_Glyph_Ptr * replace);
 
-/* define some functions that are standard on windows but not OS X
+/* define some functions that are standard on windows but not OS X or Linux
 */
-#ifdef _OSX
+#if defined(_OSX) || defined(_LINUX)
 char* strlwr(char*);
 char* strupr(char*);
 #endif
 
 
-/* Regex stuff - found in regex*.cpp
+/* Regex stuff - found in regexp*.cpp. Compiled patterns are cached for the
+    life of the process, so constant patterns can be passed freely.
 */
 bool        Is_Regex_Match(T_Glyph_Ptr regexp, T_Glyph_Ptr text,
                             T_Glyph_Ptr capture1 = NULL, T_Glyph_Ptr capture2 = NULL);
@@ -1007,11 +1317,52 @@ T_Void_Ptr  Regex_Create(T_Glyph_Ptr pattern);
 string      Regex_Find_Match_Captures(T_Void_Ptr rx, T_Glyph_Ptr search_string, const vector<int> & captures);
 string      Regex_Next_Match_Capture(T_Void_Ptr rx);
 void        Regex_Destroy(T_Void_Ptr rx);
+T_Void_Ptr  Regex_Get_Compiled(T_Glyph_CPtr pattern);
+void        Regex_Shutdown(void);
+
+/* Platform regex engine, used by the cache in regexp.cpp
+*/
+T_Void_Ptr  Regex_Compile(T_Glyph_CPtr pattern);
+void        Regex_Free(T_Void_Ptr compiled);
+bool        Regex_Execute(T_Void_Ptr compiled, T_Glyph_Ptr text,
+                            T_Glyph_Ptr capture1, T_Glyph_Ptr capture2);
 
 
 /* Misc functions
  */
 void            Pause_Execution(T_Int32U milliseconds);
+T_Int32U        Get_Milliseconds(void);
+T_Int64U        Get_Microseconds(void);
 T_Glyph         Get_Character(void);
 T_Power_Info *  Get_Power(T_Int32U index);
 bool            Is_Log(void);
+
+/* Threading functions, in helper_*.cpp. Thread_Run_Workers calls the function
+    on each of the given number of threads and waits for them all to finish.
+    Thread_Start runs the function on a thread of its own, which keeps going
+    until it returns - Thread_Wait waits for that, then cleans up.
+    Each thread also has a few local pointers - the log uses one to capture
+    messages from workers, and scratch memory keeps each thread's arena in
+    another.
+*/
+#define WORKER_STACK_SIZE   (4 * 1024 * 1024)
+
+enum E_Thread_Local {
+    e_local_log_capture,
+    e_local_scratch,
+    e_local_count,
+};
+
+T_Int32U        Thread_Get_Processor_Count(void);
+T_Int32U        Thread_Get_Worker_Count(void);
+T_Int32U        Thread_Get_Id(void);
+void            Thread_Set_Worker_Count(T_Int32U count);
+void            Thread_Lock(volatile T_Int32S * lock);
+void            Thread_Unlock(volatile T_Int32S * lock);
+T_Int32S        Thread_Atomic_Increment(volatile T_Int32S * value);
+T_Int32S        Thread_Atomic_Add(volatile T_Int32S * value, T_Int32S amount);
+void            Thread_Run_Workers(T_Int32U count, T_Fn_Worker function, T_Void_Ptr context);
+T_Void_Ptr      Thread_Start(T_Fn_Worker function, T_Void_Ptr context);
+void            Thread_Wait(T_Void_Ptr thread);
+T_Void_Ptr      Thread_Get_Local(E_Thread_Local slot);
+void            Thread_Set_Local(E_Thread_Local slot, T_Void_Ptr value);
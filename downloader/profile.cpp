@@ -0,0 +1,307 @@
+/*  FILE:   PROFILE.CPP
+
+    Copyright (c) 2012 by Lone Wolf Development, Inc.  All rights reserved.
+
+    This code is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation; either version 2 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place, Suite 330, Boston, MA 02111-1307 USA
+
+    You can find more information about this project here:
+
+    http://code.google.com/p/ddidownloader/
+
+    This file includes:
+
+    Instrumentation for finding out where the time goes. Each crawler's phases
+    are timed, along with how much of the pool they use, and counts are kept of
+    the lookups that tend to be expensive. A report is written to the log at
+    the end of the run. Individual entries can also be traced, giving a
+    timeline that can be loaded into Chrome's about:tracing or Perfetto. None
+    of this is built unless _PROFILE is defined.
+*/
+
+
+#include "private.h"
+
+
+#ifdef _PROFILE
+
+
+/* Time spent by one category in one phase, added up over every call
+*/
+struct T_Profile_Timing {
+    string          category;
+    string          phase;
+    T_Int32U        calls;
+    T_Int32U        milliseconds;
+    T_Int32U        pool_bytes;
+};
+
+
+/* One traced statement - the strings are copied, since the entries they come
+    from are long gone by the time the trace is written out. Events are kept in
+    blocks that are only allocated once something is traced into them, so a
+    short run doesn't pay for the longest trace we can hold.
+*/
+#define TRACE_NAME_LENGTH   64
+#define TRACE_BLOCK_EVENTS  4096
+#define TRACE_MAX_BLOCKS    61
+#define TRACE_MAX_EVENTS    (TRACE_BLOCK_EVENTS * TRACE_MAX_BLOCKS)
+
+struct T_Trace_Event {
+    T_Glyph         category[TRACE_NAME_LENGTH];
+    T_Glyph_CPtr    stage;
+    T_Glyph         name[TRACE_NAME_LENGTH];
+    T_Int32U        thread;
+    T_Int64U        start;
+    T_Int64U        duration;
+};
+
+
+static  vector<T_Profile_Timing>    l_timings;
+static  volatile T_Int32S           l_counters[e_counter_count];
+
+static  string                      l_trace_filename;
+static  bool                        l_is_tracing = false;
+static  T_Trace_Event * volatile    l_trace_blocks[TRACE_MAX_BLOCKS];
+static  volatile T_Int32S           l_trace_claimed = -1;
+static  volatile T_Int32S           l_trace_lock = 0;
+static  T_Int64U                    l_trace_start;
+
+static  T_Glyph_Ptr                 l_counter_names[e_counter_count] = {
+    "mapping lookups",
+    "XML named-child searches",
+    "thing ids generated",
+    "unique id candidates checked",
+};
+
+
+/* The XML engine doesn't know about our counters, so it calls this whenever
+    it searches for a named child
+*/
+static void     Count_XML_Lookup(void)
+{
+    Profile_Count(e_counter_xml_lookups);
+}
+
+
+void            Profile_Initialize(void)
+{
+    XML_Set_Lookup_Hook(Count_XML_Lookup);
+}
+
+
+/* Start recording a trace, to be written to the given file at the end of the
+    run. This must be done before any worker threads are started.
+*/
+void            Profile_Enable_Trace(T_Glyph_CPtr filename)
+{
+    l_is_tracing = true;
+    l_trace_filename = filename;
+    l_trace_start = Get_Microseconds();
+}
+
+
+void            Profile_Count(E_Profile_Counter counter)
+{
+    Thread_Atomic_Increment(&l_counters[counter]);
+}
+
+
+/* Timers are only used on the main thread, so the list of timings doesn't
+    need any protection
+*/
+C_Profile_Timer::C_Profile_Timer(T_Glyph_CPtr category, T_Glyph_CPtr phase, C_Pool * pool)
+{
+    m_category = category;
+    m_phase = phase;
+    m_pool = pool;
+    m_pool_start = (pool == NULL) ? 0 : pool->Consumed_Size();
+    m_start = Get_Milliseconds();
+}
+
+
+C_Profile_Timer::~C_Profile_Timer()
+{
+    T_Int32U            i, count, size;
+    T_Profile_Timing    timing;
+
+    for (i = 0, count = l_timings.size(); i < count; i++)
+        if ((l_timings[i].category == m_category) && (l_timings[i].phase == m_phase))
+            break;
+    if (i >= count) {
+        timing.category = m_category;
+        timing.phase = m_phase;
+        timing.calls = 0;
+        timing.milliseconds = 0;
+        timing.pool_bytes = 0;
+        l_timings.push_back(timing);
+        }
+
+    l_timings[i].calls++;
+    l_timings[i].milliseconds += Get_Milliseconds() - m_start;
+    if (m_pool != NULL) {
+        size = m_pool->Consumed_Size();
+        if (size > m_pool_start)
+            l_timings[i].pool_bytes += size - m_pool_start;
+        }
+}
+
+
+/* Each thread claims the next free event for itself, so no locking is
+    needed except to allocate a new block - if we run out of events, the rest
+    just aren't recorded
+*/
+C_Profile_Trace::C_Profile_Trace(T_Glyph_CPtr category, T_Glyph_CPtr stage, T_Glyph_CPtr name)
+{
+    m_category = category;
+    m_stage = stage;
+    m_name = name;
+    m_start = l_is_tracing ? Get_Microseconds() : 0;
+}
+
+
+C_Profile_Trace::~C_Profile_Trace()
+{
+    T_Int32S            index, block;
+    T_Trace_Event *     event;
+
+    if (!l_is_tracing)
+        return;
+    index = Thread_Atomic_Increment(&l_trace_claimed);
+    if (index >= TRACE_MAX_EVENTS)
+        return;
+
+    /* If nobody has used the block this event is in yet, allocate it - the
+        lock makes sure only one thread does
+    */
+    block = index / TRACE_BLOCK_EVENTS;
+    if (l_trace_blocks[block] == NULL) {
+        Thread_Lock(&l_trace_lock);
+        if (l_trace_blocks[block] == NULL)
+            l_trace_blocks[block] = new T_Trace_Event[TRACE_BLOCK_EVENTS];
+        Thread_Unlock(&l_trace_lock);
+        }
+
+    event = &l_trace_blocks[block][index % TRACE_BLOCK_EVENTS];
+    strncpy(event->category, (m_category == NULL) ? "" : m_category, TRACE_NAME_LENGTH - 1);
+    event->category[TRACE_NAME_LENGTH - 1] = '\0';
+    strncpy(event->name, (m_name == NULL) ? "" : m_name, TRACE_NAME_LENGTH - 1);
+    event->name[TRACE_NAME_LENGTH - 1] = '\0';
+    event->stage = m_stage;
+    event->thread = Thread_Get_Id();
+    event->start = m_start - l_trace_start;
+    event->duration = Get_Microseconds() - m_start;
+}
+
+
+/* Write a string into a JSON file, escaping anything that needs it. Our text
+    is Latin-1, so anything outside ASCII is written as the code point it
+    stands for, which keeps the file valid UTF-8.
+*/
+static void     Write_JSON_String(FILE * file, T_Glyph_CPtr text)
+{
+    fputc('"', file);
+    for ( ; *text != '\0'; text++) {
+        if ((*text == '"') || (*text == '\\'))
+            fprintf(file, "\\%c", *text);
+        else if (((T_Int8U) *text < ' ') || ((T_Int8U) *text >= 0x80))
+            fprintf(file, "\\u%04x", (T_Int8U) *text);
+        else
+            fputc(*text, file);
+        }
+    fputc('"', file);
+}
+
+
+/* Write out the trace in the Chrome trace event format, with each traced
+    statement as a complete ("X") event
+*/
+static void     Write_Trace(void)
+{
+    T_Int32U            i, count;
+    FILE *              file;
+    T_Trace_Event *     event;
+    T_Glyph             buffer[MAX_FILE_NAME+100];
+
+    count = l_trace_claimed + 1;
+    if (count > TRACE_MAX_EVENTS) {
+        sprintf(buffer, "Trace was full - %lu events were not recorded.\n", count - TRACE_MAX_EVENTS);
+        Log_Message(buffer, true);
+        count = TRACE_MAX_EVENTS;
+        }
+
+    file = fopen(l_trace_filename.c_str(), "w");
+    if (x_Trap_Opt(file == NULL)) {
+        sprintf(buffer, "Couldn't write trace file %s.\n", l_trace_filename.c_str());
+        Log_Message(buffer, true);
+        return;
+        }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (i = 0; i < count; i++) {
+        event = &l_trace_blocks[i / TRACE_BLOCK_EVENTS][i % TRACE_BLOCK_EVENTS];
+        fprintf(file, "{\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%llu,\"dur\":%llu,\"name\":",
+                event->thread, (unsigned long long) event->start,
+                (unsigned long long) event->duration);
+        Write_JSON_String(file, event->name);
+        fprintf(file, ",\"cat\":");
+        Write_JSON_String(file, event->category);
+        fprintf(file, ",\"args\":{\"stage\":");
+        Write_JSON_String(file, event->stage);
+        fprintf(file, "}}%s\n", (i + 1 < count) ? "," : "");
+        }
+    fprintf(file, "]}\n");
+    fclose(file);
+
+    sprintf(buffer, "Trace of %lu events written to %s.\n", count, l_trace_filename.c_str());
+    Log_Message(buffer, true);
+}
+
+
+void            Profile_Report(void)
+{
+    T_Int32U        i, count, total = 0;
+    T_Glyph         buffer[500];
+
+    Log_Message("\nProfile report:\n\n");
+    sprintf(buffer, "    %-20s %-20s %8s %10s %12s\n", "category", "phase", "calls",
+                "ms", "pool bytes");
+    Log_Message(buffer);
+    for (i = 0, count = l_timings.size(); i < count; i++) {
+        sprintf(buffer, "    %-20s %-20s %8lu %10lu %12lu\n", l_timings[i].category.c_str(),
+                    l_timings[i].phase.c_str(), l_timings[i].calls,
+                    l_timings[i].milliseconds, l_timings[i].pool_bytes);
+        Log_Message(buffer);
+        total += l_timings[i].milliseconds;
+        }
+    sprintf(buffer, "    %-20s %-20s %8s %10lu\n\n", "total", "", "", total);
+    Log_Message(buffer);
+
+    for (i = 0; i < e_counter_count; i++) {
+        sprintf(buffer, "    %-42s %10ld\n", l_counter_names[i], l_counters[i]);
+        Log_Message(buffer);
+        }
+    Log_Message("\n");
+
+    if (l_is_tracing) {
+        Write_Trace();
+        for (i = 0; i < TRACE_MAX_BLOCKS; i++) {
+            delete [] l_trace_blocks[i];
+            l_trace_blocks[i] = NULL;
+            }
+        l_is_tracing = false;
+        }
+}
+
+
+#endif  // _PROFILE
@@ -0,0 +1,743 @@
+/*  FILE:   REGEXP.CPP
+
+ Copyright (c) 2012 by Lone Wolf Development, Inc.  All rights reserved.
+
+ This code is free software; you can redistribute it and/or modify it under
+ the terms of the GNU General Public License as published by the Free
+ Software Foundation; either version 2 of the License, or (at your option)
+ any later version.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ more details.
+
+ You should have received a copy of the GNU General Public License along with
+ this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ Place, Suite 330, Boston, MA 02111-1307 USA
+
+ You can find more information about this project here:
+
+ http://code.google.com/p/ddidownloader/
+
+ This file includes:
+
+ Platform-independent regular expression handling - a cache of compiled
+ patterns, and a simple linear-time matcher that's used in preference to the
+ platform regex engine for the patterns it understands.
+
+ NOTE: The linear-time matcher uses leftmost-first (Perl / ECMAScript) rules,
+ like the std::regex engine on Windows - of the matches starting at the
+ leftmost position, the one found by preferring the first alternative and the
+ greediest repeat wins. The POSIX engine used on OS X picks the longest match
+ instead, so a pattern like "(a|ab)(c|bcd)" can capture different groups
+ there. Only the patterns the linear matcher understands are affected, and
+ they now match the same way on every platform. Debug builds check every
+ linear match against the platform engine and log any difference.
+*/
+
+
+#include <string>
+
+#include "private.h"
+
+
+/*  Set this flag to false to always use the platform regex engine (see the
+    regexp_*.cpp files). Otherwise, any pattern that the linear-time matcher
+    below understands is matched with it instead, which avoids the worst cases
+    of backtracking engines.
+*/
+static      bool    l_is_linear = true;
+
+
+/*  Opcodes for our compiled linear-time programs
+*/
+enum E_Regex_Op {
+    e_op_char,
+    e_op_any,
+    e_op_class,
+    e_op_bol,
+    e_op_eol,
+    e_op_save,
+    e_op_split,
+    e_op_jump,
+    e_op_match,
+};
+
+struct T_Regex_Inst {
+    E_Regex_Op      op;
+    T_Int8U         ch; // character for e_op_char
+    T_Int32S        x; // class, save slot, or jump target
+    T_Int32S        y; // second split target (lower priority)
+};
+
+
+/*  Types of node in the parse tree we build before generating code
+*/
+enum E_Regex_Node {
+    e_node_char,
+    e_node_any,
+    e_node_class,
+    e_node_bol,
+    e_node_eol,
+    e_node_group,
+    e_node_concat,
+    e_node_alternate,
+    e_node_star,
+    e_node_plus,
+    e_node_quest,
+    e_node_empty,
+};
+
+struct T_Regex_Node {
+    E_Regex_Node    type;
+    T_Int8U         ch;
+    T_Int32S        value; // class index or group number
+    T_Int32S        left;
+    T_Int32S        right;
+};
+
+
+/*  A compiled linear-time program - the classes are 256-entry membership
+    tables
+*/
+struct T_Linear_Regex {
+    vector<T_Regex_Inst>    program;
+    vector<string>          classes;
+    T_Int32U                group_count;
+};
+
+
+/*  Each cached pattern holds its platform-compiled form and, if the pattern
+    was simple enough, a linear-time program too. Entries are never removed -
+    the set of patterns we use is small and fixed.
+*/
+struct T_Regex_Entry {
+    T_Void_Ptr          compiled;
+    T_Linear_Regex *    linear;
+};
+
+typedef map<string, T_Regex_Entry>     T_Regex_Cache;
+
+/*  Patterns are looked up from worker threads as well, so the cache is locked
+    while it's searched or added to. Entries don't move once they're in the map,
+    so they can be used without the lock.
+*/
+static  T_Regex_Cache       l_cache;
+static  volatile T_Int32S   l_cache_lock = 0;
+
+
+/*  Parser that turns a pattern into a tree of nodes. It understands literals,
+    '.', bracket classes, groups, alternation, the *, + and ? operators and the
+    ^ and $ anchors - anything else makes it give up, and we fall back to the
+    platform engine.
+*/
+class C_Regex_Parser {
+public:
+    C_Regex_Parser(T_Glyph_CPtr pattern, T_Linear_Regex * linear)
+                        { m_ptr = pattern; m_linear = linear; m_is_error = false; }
+
+    T_Int32S        Parse(void);
+    void            Generate(T_Int32S index);
+
+private:
+    T_Int32S        Parse_Alternate(void);
+    T_Int32S        Parse_Concat(void);
+    T_Int32S        Parse_Repeat(void);
+    T_Int32S        Parse_Atom(void);
+    T_Int32S        Parse_Class(void);
+    T_Int32S        Add_Node(E_Regex_Node type, T_Int32S left = -1, T_Int32S right = -1);
+    T_Int32S        Emit(E_Regex_Op op, T_Int32S x = 0, T_Int32S y = 0);
+
+    T_Glyph_CPtr        m_ptr;
+    T_Linear_Regex *    m_linear;
+    bool                m_is_error;
+    vector<T_Regex_Node>    m_nodes;
+};
+
+
+T_Int32S        C_Regex_Parser::Add_Node(E_Regex_Node type, T_Int32S left, T_Int32S right)
+{
+    T_Regex_Node    node;
+
+    node.type = type;
+    node.ch = 0;
+    node.value = 0;
+    node.left = left;
+    node.right = right;
+    m_nodes.push_back(node);
+    return(m_nodes.size() - 1);
+}
+
+
+T_Int32S        C_Regex_Parser::Parse(void)
+{
+    T_Int32S        index;
+
+    m_linear->group_count = 0;
+    index = Parse_Alternate();
+    if (m_is_error || (*m_ptr != '\0'))
+        return(-1);
+    return(index);
+}
+
+
+T_Int32S        C_Regex_Parser::Parse_Alternate(void)
+{
+    T_Int32S        left;
+
+    left = Parse_Concat();
+    while (!m_is_error && (*m_ptr == '|')) {
+        m_ptr++;
+        left = Add_Node(e_node_alternate, left, Parse_Concat());
+        }
+    return(left);
+}
+
+
+T_Int32S        C_Regex_Parser::Parse_Concat(void)
+{
+    T_Int32S        left;
+
+    left = Add_Node(e_node_empty);
+    while (!m_is_error && (*m_ptr != '\0') && (*m_ptr != '|') && (*m_ptr != ')'))
+        left = Add_Node(e_node_concat, left, Parse_Repeat());
+    return(left);
+}
+
+
+T_Int32S        C_Regex_Parser::Parse_Repeat(void)
+{
+    T_Int32S        atom;
+
+    atom = Parse_Atom();
+    for (;;) {
+        if (*m_ptr == '*')
+            atom = Add_Node(e_node_star, atom);
+        else if (*m_ptr == '+')
+            atom = Add_Node(e_node_plus, atom);
+        else if (*m_ptr == '?')
+            atom = Add_Node(e_node_quest, atom);
+        else
+            break;
+        m_ptr++;
+
+        /* We don't handle lazy or possessive operators, or counted repeats
+        */
+        if ((*m_ptr == '?') || (*m_ptr == '+') || (*m_ptr == '{'))
+            m_is_error = true;
+        }
+    if (*m_ptr == '{')
+        m_is_error = true;
+    return(atom);
+}
+
+
+T_Int32S        C_Regex_Parser::Parse_Atom(void)
+{
+    T_Int32S        index, group;
+    T_Glyph         ch;
+
+    ch = *m_ptr++;
+    switch (ch) {
+        case '(' :
+            if (*m_ptr == '?') {
+                m_is_error = true;
+                return(-1);
+                }
+            group = ++m_linear->group_count;
+            index = Add_Node(e_node_group, Parse_Alternate());
+            m_nodes[index].value = group;
+            if (*m_ptr != ')') {
+                m_is_error = true;
+                return(-1);
+                }
+            m_ptr++;
+            return(index);
+        case '[' :
+            return(Parse_Class());
+        case '.' :
+            return(Add_Node(e_node_any));
+        case '^' :
+            return(Add_Node(e_node_bol));
+        case '$' :
+            return(Add_Node(e_node_eol));
+        case '*' :
+        case '+' :
+        case '?' :
+        case '{' :
+        case ')' :
+            m_is_error = true;
+            return(-1);
+        case '\\' :
+
+            /* Only escaped punctuation is a plain literal - things like \d or
+                \1 mean something else
+            */
+            ch = *m_ptr++;
+            if ((ch == '\0') || x_Is_Alnum(ch)) {
+                m_is_error = true;
+                return(-1);
+                }
+            break;
+        }
+
+    index = Add_Node(e_node_char);
+    m_nodes[index].ch = (T_Int8U) ch;
+    return(index);
+}
+
+
+T_Int32S        C_Regex_Parser::Parse_Class(void)
+{
+    T_Int32S        index;
+    T_Int32U        i, first, last;
+    bool            is_negate;
+    string          members(256, '\0');
+
+    is_negate = (*m_ptr == '^');
+    if (is_negate)
+        m_ptr++;
+
+    /* A ']' right at the start is a literal member of the class
+    */
+    if (*m_ptr == ']') {
+        members[']'] = 1;
+        m_ptr++;
+        }
+    while (*m_ptr != ']') {
+        if ((*m_ptr == '\0') || (*m_ptr == '\\') || ((m_ptr[0] == '[') && (m_ptr[1] == ':'))) {
+            m_is_error = true;
+            return(-1);
+            }
+        first = (T_Int8U) *m_ptr++;
+        last = first;
+        if ((m_ptr[0] == '-') && (m_ptr[1] != ']') && (m_ptr[1] != '\0')) {
+            last = (T_Int8U) m_ptr[1];
+            m_ptr += 2;
+            }
+        for (i = first; i <= last; i++)
+            members[i] = 1;
+        }
+    m_ptr++;
+
+    if (is_negate)
+        for (i = 0; i < 256; i++)
+            members[i] = !members[i];
+    members[0] = 0;
+
+    index = Add_Node(e_node_class);
+    m_nodes[index].value = m_linear->classes.size();
+    m_linear->classes.push_back(members);
+    return(index);
+}
+
+
+T_Int32S        C_Regex_Parser::Emit(E_Regex_Op op, T_Int32S x, T_Int32S y)
+{
+    T_Regex_Inst    inst;
+
+    inst.op = op;
+    inst.ch = 0;
+    inst.x = x;
+    inst.y = y;
+    m_linear->program.push_back(inst);
+    return(m_linear->program.size() - 1);
+}
+
+
+void            C_Regex_Parser::Generate(T_Int32S index)
+{
+    T_Int32S        split, jump;
+    T_Regex_Node *  node = &m_nodes[index];
+    vector<T_Regex_Inst> &  program = m_linear->program;
+
+    switch (node->type) {
+        case e_node_char :
+            program[Emit(e_op_char)].ch = node->ch;
+            break;
+        case e_node_any :
+            Emit(e_op_any);
+            break;
+        case e_node_class :
+            Emit(e_op_class, node->value);
+            break;
+        case e_node_bol :
+            Emit(e_op_bol);
+            break;
+        case e_node_eol :
+            Emit(e_op_eol);
+            break;
+        case e_node_empty :
+            break;
+        case e_node_group :
+            Emit(e_op_save, node->value * 2);
+            Generate(node->left);
+            Emit(e_op_save, node->value * 2 + 1);
+            break;
+        case e_node_concat :
+            Generate(node->left);
+            Generate(m_nodes[index].right);
+            break;
+
+        /* split L1, L2; L1: left; jump L3; L2: right; L3:
+        */
+        case e_node_alternate :
+            split = Emit(e_op_split);
+            program[split].x = program.size();
+            Generate(node->left);
+            jump = Emit(e_op_jump);
+            program[split].y = program.size();
+            Generate(m_nodes[index].right);
+            program[jump].x = program.size();
+            break;
+
+        /* L1: split L2, L3; L2: atom; jump L1; L3:
+        */
+        case e_node_star :
+            split = Emit(e_op_split);
+            program[split].x = program.size();
+            Generate(node->left);
+            Emit(e_op_jump, split);
+            program[split].y = program.size();
+            break;
+
+        /* L1: atom; split L1, L3; L3:
+        */
+        case e_node_plus :
+            jump = program.size();
+            Generate(node->left);
+            split = Emit(e_op_split, jump);
+            program[split].y = program.size();
+            break;
+
+        /* split L1, L2; L1: atom; L2:
+        */
+        case e_node_quest :
+            split = Emit(e_op_split);
+            program[split].x = program.size();
+            Generate(node->left);
+            program[split].y = program.size();
+            break;
+        }
+}
+
+
+/*  Compile a pattern into a linear-time program, or return NULL if the pattern
+    uses something we don't understand
+*/
+static T_Linear_Regex *     Linear_Compile(T_Glyph_CPtr pattern)
+{
+    T_Int32S            index;
+    T_Linear_Regex *    linear;
+
+    linear = new T_Linear_Regex;
+    if (x_Trap_Opt(linear == NULL))
+        return(NULL);
+
+    C_Regex_Parser  parser(pattern, linear);
+    index = parser.Parse();
+    if (index < 0) {
+        delete linear;
+        return(NULL);
+        }
+
+    /* The entire match is saved as group 0
+    */
+    linear->program.push_back(T_Regex_Inst());
+    linear->program.back().op = e_op_save;
+    linear->program.back().x = 0;
+    parser.Generate(index);
+    linear->program.push_back(T_Regex_Inst());
+    linear->program.back().op = e_op_save;
+    linear->program.back().x = 1;
+    linear->program.push_back(T_Regex_Inst());
+    linear->program.back().op = e_op_match;
+    return(linear);
+}
+
+
+/*  A list of threads for the matcher - each thread is a program counter plus
+    its capture positions, stored in a flat array
+*/
+struct T_Thread_List {
+    vector<T_Int32S>        pcs;
+    vector<T_Glyph_CPtr>    captures;
+    vector<T_Int32U>        marks;
+    T_Int32U                generation;
+    T_Int32U                count;
+};
+
+
+static void     Reset_List(T_Thread_List * list)
+{
+    list->generation++;
+    list->count = 0;
+}
+
+
+static void     Add_Thread(T_Linear_Regex * linear, T_Thread_List * list, T_Int32S pc,
+                            T_Glyph_CPtr * captures, T_Int32U slots,
+                            T_Glyph_CPtr text, T_Glyph_CPtr sp)
+{
+    T_Regex_Inst *  inst;
+    T_Glyph_CPtr    old;
+
+    if (list->marks[pc] == list->generation)
+        return;
+    list->marks[pc] = list->generation;
+
+    inst = &linear->program[pc];
+    switch (inst->op) {
+        case e_op_jump :
+            Add_Thread(linear, list, inst->x, captures, slots, text, sp);
+            break;
+        case e_op_split :
+            Add_Thread(linear, list, inst->x, captures, slots, text, sp);
+            Add_Thread(linear, list, inst->y, captures, slots, text, sp);
+            break;
+        case e_op_save :
+            old = captures[inst->x];
+            captures[inst->x] = sp;
+            Add_Thread(linear, list, pc + 1, captures, slots, text, sp);
+            captures[inst->x] = old;
+            break;
+        case e_op_bol :
+            if (sp == text)
+                Add_Thread(linear, list, pc + 1, captures, slots, text, sp);
+            break;
+        case e_op_eol :
+            if (*sp == '\0')
+                Add_Thread(linear, list, pc + 1, captures, slots, text, sp);
+            break;
+        default :
+            list->pcs[list->count] = pc;
+            memcpy(&list->captures[list->count * slots], captures, slots * sizeof(T_Glyph_CPtr));
+            list->count++;
+            break;
+        }
+}
+
+
+/*  Run a linear-time program over the text (a Pike VM), giving the same
+    leftmost, greedy-first results a backtracking engine would. Returns true
+    if there was a match, filling in the start / end of each group.
+*/
+static bool     Linear_Match(T_Linear_Regex * linear, T_Glyph_CPtr text,
+                                vector<T_Glyph_CPtr> & result)
+{
+    T_Int32U        i, slots, size;
+    T_Int32S        pc;
+    T_Regex_Inst *  inst;
+    T_Glyph_CPtr    sp;
+    T_Glyph_CPtr *  captures;
+    bool            is_match, is_step;
+    T_Thread_List   lists[2], * current, * next, * swap;
+    vector<T_Glyph_CPtr>    start;
+
+    slots = (linear->group_count + 1) * 2;
+    size = linear->program.size();
+    for (i = 0; i < 2; i++) {
+        lists[i].pcs.resize(size);
+        lists[i].captures.resize(size * slots);
+        lists[i].marks.assign(size, 0);
+        lists[i].generation = 0;
+        lists[i].count = 0;
+        }
+    current = &lists[0];
+    next = &lists[1];
+    Reset_List(current);
+    start.assign(slots, NULL);
+    result.assign(slots, NULL);
+    is_match = false;
+
+    for (sp = text; ; sp++) {
+
+        /* Until we have a match, start a new (lowest priority) thread at each
+            position in the text, up to and including the terminating null (so
+            that patterns like "$" can match there). Once we have a match, we
+            only need to keep going while higher priority threads might still
+            find a better one.
+        */
+        if (!is_match)
+            Add_Thread(linear, current, 0, &start[0], slots, text, sp);
+        else if (current->count == 0)
+            break;
+
+        Reset_List(next);
+        for (i = 0; i < current->count; i++) {
+            pc = current->pcs[i];
+            captures = &current->captures[i * slots];
+            inst = &linear->program[pc];
+            is_step = false;
+            switch (inst->op) {
+                case e_op_char :
+                    is_step = ((T_Int8U) *sp == inst->ch) && (*sp != '\0');
+                    break;
+                case e_op_any :
+                    is_step = (*sp != '\0') && (*sp != '\n');
+                    break;
+                case e_op_class :
+                    is_step = (linear->classes[inst->x][(T_Int8U) *sp] != 0);
+                    break;
+
+                /* A match cuts off all the lower priority threads
+                */
+                case e_op_match :
+                    is_match = true;
+                    memcpy(&result[0], captures, slots * sizeof(T_Glyph_CPtr));
+                    i = current->count;
+                    continue;
+                default :
+                    break;
+                }
+            if (is_step)
+                Add_Thread(linear, next, pc + 1, captures, slots, text, sp + 1);
+            }
+
+        if (*sp == '\0')
+            break;
+        swap = current;
+        current = next;
+        next = swap;
+        }
+
+    return(is_match);
+}
+
+
+static void     Copy_Capture(T_Glyph_Ptr buffer, T_Glyph_CPtr start, T_Glyph_CPtr end)
+{
+    T_Int32U        length;
+
+    if ((start == NULL) || (end == NULL) || (end < start)) {
+        buffer[0] = '\0';
+        return;
+        }
+    length = end - start;
+    strncpy(buffer, start, length);
+    buffer[length] = '\0';
+}
+
+
+/*  Find a pattern in our cache, compiling it (and adding it) if this is the
+    first time we've seen it
+*/
+static T_Regex_Entry *      Regex_Find_Entry(T_Glyph_CPtr pattern)
+{
+    T_Regex_Entry           entry;
+    T_Regex_Entry *         result;
+    T_Regex_Cache::iterator it;
+
+    Thread_Lock(&l_cache_lock);
+    it = l_cache.find(pattern);
+    if (it != l_cache.end()) {
+        result = &it->second;
+        goto cleanup_exit;
+        }
+
+    result = NULL;
+    entry.compiled = Regex_Compile(pattern);
+    if (entry.compiled == NULL)
+        goto cleanup_exit;
+    entry.linear = l_is_linear ? Linear_Compile(pattern) : NULL;
+    result = &(l_cache[pattern] = entry);
+
+cleanup_exit:
+    Thread_Unlock(&l_cache_lock);
+    return(result);
+}
+
+
+#ifdef  _DEBUG
+/*  Check a linear match against what the platform engine makes of the same
+    text, so any pattern where the two disagree (see the note at the top of
+    the file) shows up in the log
+*/
+static void     Check_Linear_Match(T_Glyph_Ptr regexp, T_Regex_Entry * entry, T_Glyph_Ptr text,
+                                    bool is_match, T_Glyph_CPtr capture1, T_Glyph_CPtr capture2)
+{
+    bool            is_platform;
+    string          platform1, platform2, message;
+
+    platform1.assign(strlen(text) + 1, '\0');
+    platform2.assign(strlen(text) + 1, '\0');
+    is_platform = Regex_Execute(entry->compiled, text, &platform1[0], &platform2[0]);
+    if ((is_platform == is_match) &&
+        (!is_match ||
+            (((capture1 == NULL) || (strcmp(platform1.c_str(), capture1) == 0)) &&
+             ((capture2 == NULL) || (strcmp(platform2.c_str(), capture2) == 0)))))
+        return;
+
+    message = "Regular expression engines disagree on '";
+    message += regexp;
+    message += "' against '";
+    message += text;
+    message += "'\n";
+    Log_Message((T_Glyph_Ptr) message.c_str());
+}
+#endif
+
+
+T_Void_Ptr      Regex_Get_Compiled(T_Glyph_CPtr pattern)
+{
+    T_Regex_Entry *     entry;
+
+    entry = Regex_Find_Entry(pattern);
+    if (entry == NULL)
+        return(NULL);
+    return(entry->compiled);
+}
+
+
+bool     Is_Regex_Match(T_Glyph_Ptr regexp, T_Glyph_Ptr text, T_Glyph_Ptr capture1, T_Glyph_Ptr capture2)
+{
+    bool                    is_match;
+    T_Regex_Entry *         entry;
+    vector<T_Glyph_CPtr>    groups;
+
+    if (capture1 != NULL)
+        capture1[0] = '\0';
+    if (capture2 != NULL)
+        capture2[0] = '\0';
+
+    if (text[0] == '\0')
+        return(false);
+
+    entry = Regex_Find_Entry(regexp);
+    if (x_Trap_Opt(entry == NULL))
+        return(false);
+
+    /* If we don't have a linear-time program for the pattern, let the platform
+        engine do the work
+    */
+    if (entry->linear == NULL)
+        return(Regex_Execute(entry->compiled, text, capture1, capture2));
+
+    is_match = Linear_Match(entry->linear, text, groups);
+    if (is_match) {
+        if ((capture1 != NULL) && (entry->linear->group_count >= 1))
+            Copy_Capture(capture1, groups[2], groups[3]);
+        if ((capture2 != NULL) && (entry->linear->group_count >= 2))
+            Copy_Capture(capture2, groups[4], groups[5]);
+        }
+#ifdef  _DEBUG
+    Check_Linear_Match(regexp, entry, text, is_match, capture1, capture2);
+#endif
+    return(is_match);
+}
+
+
+/*  Release everything in our cache - call this at shutdown
+*/
+void            Regex_Shutdown(void)
+{
+    T_Regex_Cache::iterator it;
+
+    for (it = l_cache.begin(); it != l_cache.end(); ++it) {
+        Regex_Free(it->second.compiled);
+        if (it->second.linear != NULL)
+            delete it->second.linear;
+        }
+    l_cache.clear();
+}
@@ -1,4 +1,4 @@
-/*  FILE:   REGEXP_OSX.CPP
+/*  FILE:   REGEXP_POSIX.CPP
  
  Copyright (c) 2012 by Lone Wolf Development, Inc.  All rights reserved.
  
@@ -19,6 +19,10 @@
  You can find more information about this project here:
  
  http://code.google.com/p/ddidownloader/
+
+ This file includes:
+
+ POSIX regular expression engine, used on OS X and Linux.
  */
 
 
@@ -37,7 +41,7 @@
 
 struct T_Regexp {
 
-    regex_t             rx;
+    regex_t *           rx;
     T_Glyph_CPtr        search_base;
     T_Glyph_CPtr        search_string;
     T_Int32U            next_capture;
@@ -56,37 +60,51 @@ static void Copy_Capture(T_Glyph_Ptr buffer, T_Glyph_CPtr text, regmatch_t * mat
 }
 
 
-bool     Is_Regex_Match(T_Glyph_Ptr regexp, T_Glyph_Ptr text, T_Glyph_Ptr capture1, T_Glyph_Ptr capture2)
+T_Void_Ptr      Regex_Compile(T_Glyph_CPtr pattern)
+{
+    regex_t *   rx;
+    int         result;
+    T_Glyph     message[500];
+
+    rx = new regex_t;
+    if (x_Trap_Opt(rx == NULL))
+        return(NULL);
+
+    result = regcomp(rx, pattern, REG_EXTENDED);
+    if (x_Trap_Opt(result != 0)) {
+        sprintf(message, "Couldn't create regular expression: error %d\n", result);
+        Log_Message(message, TRUE);
+        delete rx;
+        return(NULL);
+        }
+    return(rx);
+}
+
+
+void            Regex_Free(T_Void_Ptr compiled)
+{
+    regex_t *   rx = (regex_t *) compiled;
+
+    regfree(rx);
+    delete rx;
+}
+
+
+bool            Regex_Execute(T_Void_Ptr compiled, T_Glyph_Ptr text, T_Glyph_Ptr capture1, T_Glyph_Ptr capture2)
 {
     int         result, size;
-    bool        is_match = false;
-    regex_t     rx;
     regmatch_t  matches[3]; // entire string + 2 return parameters
     
-    if (capture1 != NULL)
-        capture1[0] = '\0';
-    if (capture2 != NULL)
-        capture2[0] = '\0';
-        
-    if (text[0] == '\0')
-        return(false);
-
-    result = regcomp(&rx, regexp, REG_EXTENDED);
-    if (x_Trap_Opt(result != 0))
-        return(false);
-      
     /* If we didn't match, there are no capture groups to return. If the caller
         doesn't want us to capture anything, we can just pass 0 for the size.
     */
     size = ((capture1 == NULL) && (capture2 == NULL)) ? 0 : x_Array_Size(matches);
-    result = regexec(&rx, text, size, matches, 0);
+    result = regexec((regex_t *) compiled, text, size, matches, 0);
     if (result == REG_NOMATCH)
-        goto cleanup_exit;
+        return(false);
     if (x_Trap_Opt(result != 0))
-        goto cleanup_exit;
+        return(false);
         
-    is_match = true;
-    
     /* Copy our captures into the parameters, if provided.
         NOTE: matches[0] holds the entire matched string, so we only
             care about what's in matches[1] and following, which are
@@ -96,27 +114,23 @@ bool     Is_Regex_Match(T_Glyph_Ptr regexp, T_Glyph_Ptr text, T_Glyph_Ptr captur
         Copy_Capture(capture1, text, &matches[1]);
     if (capture2 != NULL)
         Copy_Capture(capture2, text, &matches[2]);
-        
-cleanup_exit:
-    regfree(&rx);
-    return(is_match);
+    return(true);
 }
 
 
+/* The compiled expression comes from the shared cache in regexp.cpp, so all
+    we need to allocate is the search state.
+*/
 T_Void_Ptr      Regex_Create(T_Glyph_Ptr pattern)
 {
     T_Regexp *  rx;
-    int         result;
-    T_Glyph     message[500];
     
     rx = new T_Regexp;
     if (x_Trap_Opt(rx == NULL))
         return(NULL);
 
-    result = regcomp(&rx->rx, pattern, REG_EXTENDED);
-    if (x_Trap_Opt(result != 0)) {
-        sprintf(message, "Couldn't create regular expression: error %d\n", result);
-        Log_Message(message, TRUE);
+    rx->rx = (regex_t *) Regex_Get_Compiled(pattern);
+    if (x_Trap_Opt(rx->rx == NULL)) {
         delete rx;
         return(NULL);
         }
@@ -151,7 +165,7 @@ static string   Next_Match_Internal(T_Regexp * rx)
         if (rx->search_string[0] == '\0')
             return("");
 
-        result = regexec(&rx->rx, rx->search_string, MAX_CAPTURES, rx->matches, 0);
+        result = regexec(rx->rx, rx->search_string, MAX_CAPTURES, rx->matches, 0);
         if (result == REG_NOMATCH)
             return("");
         if (x_Trap_Opt(result != 0))
@@ -203,6 +217,5 @@ void            Regex_Destroy(T_Void_Ptr rx_ptr)
 {
     T_Regexp *  rx = (T_Regexp *) rx_ptr;
     
-    regfree(&rx->rx);
     delete rx;
 }
@@ -31,26 +31,35 @@
 
 struct T_Regexp {
 
-    T_Regexp(T_Glyph_Ptr pattern) : rx(pattern) { }
-
-    regex                       rx;
+    regex *                     rx;
     string                      search_string;
     sregex_token_iterator       iter;
     const sregex_token_iterator end;
 };
 
 
-bool     Is_Regex_Match(T_Glyph_Ptr regexp, T_Glyph_Ptr text, T_Glyph_Ptr capture1, T_Glyph_Ptr capture2)
+T_Void_Ptr      Regex_Compile(T_Glyph_CPtr pattern)
 {
-    regex       rx(regexp);
-    cmatch      match;
+    regex *     rx;
 
-    if (capture1 != NULL)
-        capture1[0] = '\0';
-    if (capture2 != NULL)
-        capture2[0] = '\0';
+    rx = new regex(pattern);
+    if (x_Trap_Opt(rx == NULL))
+        return(NULL);
+    return(rx);
+}
 
-    if (!regex_search(text, match, rx))
+
+void            Regex_Free(T_Void_Ptr compiled)
+{
+    delete (regex *) compiled;
+}
+
+
+bool            Regex_Execute(T_Void_Ptr compiled, T_Glyph_Ptr text, T_Glyph_Ptr capture1, T_Glyph_Ptr capture2)
+{
+    cmatch      match;
+
+    if (!regex_search(text, match, *(regex *) compiled))
         return(false);
 
     if (capture1 != NULL)
@@ -61,13 +70,22 @@ bool     Is_Regex_Match(T_Glyph_Ptr regexp, T_Glyph_Ptr text, T_Glyph_Ptr captur
 }
 
 
+/* The compiled expression comes from the shared cache in regexp.cpp, so all
+    we need to allocate is the search state.
+*/
 T_Void_Ptr      Regex_Create(T_Glyph_Ptr pattern)
 {
     T_Regexp *  rx;
 
-    rx = new T_Regexp(pattern);
+    rx = new T_Regexp;
     if (x_Trap_Opt(rx == NULL))
         return(NULL);
+
+    rx->rx = (regex *) Regex_Get_Compiled(pattern);
+    if (x_Trap_Opt(rx->rx == NULL)) {
+        delete rx;
+        return(NULL);
+        }
     return(rx);
 }
 
@@ -80,7 +98,7 @@ string          Regex_Find_Match_Captures(T_Void_Ptr rx_ptr, T_Glyph_Ptr search_
         out of scope when we return and causes problems
     */
     rx->search_string = search_string;
-    rx->iter = sregex_token_iterator(rx->search_string.cbegin(), rx->search_string.cend(), rx->rx, captures);
+    rx->iter = sregex_token_iterator(rx->search_string.cbegin(), rx->search_string.cend(), *rx->rx, captures);
     if (rx->iter == rx->end)
         return("");
     return(rx->iter->str());
@@ -0,0 +1,160 @@
+/*  FILE:   SCRATCH.CPP
+
+    Copyright (c) 2012 by Lone Wolf Development, Inc.  All rights reserved.
+
+    This code is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation; either version 2 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place, Suite 330, Boston, MA 02111-1307 USA
+
+    You can find more information about this project here:
+
+    http://code.google.com/p/ddidownloader/
+
+    This file includes:
+
+    Scratch memory for temporary buffers. Each thread has an arena of its own,
+    so there's no locking, and buffers are sized to what's actually needed
+    instead of being huge arrays on the stack. Memory is handed out from the
+    end of the arena and given back in one go when the C_Scratch that
+    acquired it goes out of scope, so it's about as cheap as the stack.
+*/
+
+
+#include "private.h"
+
+
+/* Blocks are never smaller than this, so most threads only ever need one
+*/
+#define SCRATCH_BLOCK_SIZE  (256 * 1024)
+
+
+struct T_Scratch_Block {
+    T_Glyph_Ptr     buffer;
+    T_Int32U        size;
+};
+
+
+/* Blocks before the current one are full, and blocks after it are free -
+    they're kept for reuse rather than released
+*/
+struct T_Scratch_Arena {
+    vector<T_Scratch_Block> blocks;
+    T_Int32U                current;
+    T_Int32U                position;
+};
+
+
+static T_Scratch_Arena *    Get_Arena(void)
+{
+    T_Scratch_Arena *   arena;
+
+    arena = (T_Scratch_Arena *) Thread_Get_Local(e_local_scratch);
+    if (arena == NULL) {
+        arena = new T_Scratch_Arena;
+        arena->current = 0;
+        arena->position = 0;
+        Thread_Set_Local(e_local_scratch, arena);
+        }
+    return(arena);
+}
+
+
+/* Move on to the next block, making sure it's big enough for the given size
+*/
+static bool     Next_Block(T_Scratch_Arena * arena, T_Int32U size)
+{
+    T_Int32U            previous, position;
+    T_Scratch_Block     block;
+
+    previous = arena->current;
+    position = arena->position;
+    if (!arena->blocks.empty())
+        arena->current++;
+    arena->position = 0;
+    if ((arena->current < arena->blocks.size()) &&
+        (arena->blocks[arena->current].size >= size))
+        return(true);
+
+    /* We need a new block - if there's one here already that's too small,
+        replace it
+    */
+    block.size = (size > SCRATCH_BLOCK_SIZE) ? size : SCRATCH_BLOCK_SIZE;
+    block.buffer = new T_Glyph[block.size];
+    if (x_Trap_Opt(block.buffer == NULL)) {
+        arena->current = previous;
+        arena->position = position;
+        return(false);
+        }
+    if (arena->current < arena->blocks.size()) {
+        delete [] arena->blocks[arena->current].buffer;
+        arena->blocks[arena->current] = block;
+        }
+    else
+        arena->blocks.push_back(block);
+    return(true);
+}
+
+
+C_Scratch::C_Scratch()
+{
+    m_arena = Get_Arena();
+    m_current = m_arena->current;
+    m_position = m_arena->position;
+}
+
+
+/* Give back everything acquired since we were created - anything acquired
+    through a C_Scratch created after us has already been given back
+*/
+C_Scratch::~C_Scratch()
+{
+    m_arena->current = m_current;
+    m_arena->position = m_position;
+}
+
+
+T_Glyph_Ptr     C_Scratch::Acquire(T_Int32U size)
+{
+    T_Glyph_Ptr     ptr;
+
+    /* Keep everything aligned, in case we're asked for something other than
+        text
+    */
+    size = (size + 7) & ~7UL;
+    if (m_arena->blocks.empty() ||
+        (m_arena->blocks[m_arena->current].size - m_arena->position < size))
+        if (!Next_Block(m_arena, size))
+            return(NULL);
+
+    ptr = m_arena->blocks[m_arena->current].buffer + m_arena->position;
+    m_arena->position += size;
+    return(ptr);
+}
+
+
+/* Release the calling thread's arena - this is done when a thread finishes,
+    and must not be done while any C_Scratch is still in scope
+*/
+void            Scratch_Shutdown_Thread(void)
+{
+    T_Int32U            i;
+    T_Scratch_Arena *   arena;
+
+    arena = (T_Scratch_Arena *) Thread_Get_Local(e_local_scratch);
+    if (arena == NULL)
+        return;
+    for (i = 0; i < arena->blocks.size(); i++)
+        delete [] arena->blocks[i].buffer;
+    delete arena;
+    Thread_Set_Local(e_local_scratch, NULL);
+}
@@ -0,0 +1,261 @@
+/*  FILE:   SYMBOLS.CPP
+
+    Copyright (c) 2008-2012 by Lone Wolf Development, Inc.  All rights reserved.
+
+    This code is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation; either version 2 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place, Suite 330, Boston, MA 02111-1307 USA
+
+    You can find more information about this project here:
+
+    http://code.google.com/p/ddidownloader/
+
+    This file includes:
+
+    Symbol table of every thing node output by the crawlers, so that post-
+    processing can find things by id, name or tag without walking the XML
+    documents of other crawlers.
+*/
+
+
+#include "private.h"
+
+#include    <set>
+
+
+/* Each thing we know about, along with the root node it was created under
+*/
+struct T_Symbol {
+    T_XML_Node      root;
+    T_XML_Node      node;
+    string          compset;
+};
+
+typedef map<string, vector<T_Int32U> >  T_Symbol_Index;
+
+
+/* Things that have a particular tag, in the order the tags were added
+*/
+struct T_Symbol_Tagged {
+    vector<T_XML_Node>  nodes;
+    set<T_XML_Node>     members;
+};
+
+typedef map<string, T_Symbol_Tagged>    T_Symbol_Tags;
+
+
+static  vector<T_Symbol>    l_symbols;
+static  map<T_XML_Node, T_Int32U>   l_nodes;
+static  T_Symbol_Index      l_ids;
+static  T_Symbol_Index      l_names;
+static  T_Symbol_Index      l_any_names;
+static  T_Symbol_Tags       l_tags;
+
+
+/* Names are matched case-insensitively, so fold them to lower case. Names are
+    keyed along with their compset.
+*/
+static string   Name_Key(T_Glyph_CPtr compset, T_Glyph_CPtr name)
+{
+    string          key;
+
+    key = compset;
+    key += '|';
+    for ( ; *name != '\0'; name++)
+        key += (T_Glyph) tolower(*name);
+    return(key);
+}
+
+
+static string   Tag_Key(T_Glyph_CPtr group, T_Glyph_CPtr tag)
+{
+    string          key;
+
+    key = group;
+    key += '|';
+    key += tag;
+    return(key);
+}
+
+
+void            Symbol_Add_Thing(T_XML_Node root, T_XML_Node node, T_Glyph_CPtr id,
+                                    T_Glyph_CPtr compset, T_Glyph_CPtr name)
+{
+    T_Int32U        index;
+    T_Symbol        symbol;
+
+    if (x_Trap_Opt((node == NULL) || (id == NULL) || (compset == NULL) || (name == NULL)))
+        return;
+
+    symbol.root = root;
+    symbol.node = node;
+    symbol.compset = compset;
+    index = l_symbols.size();
+    l_symbols.push_back(symbol);
+    l_nodes[node] = index;
+    l_ids[id].push_back(index);
+    l_names[Name_Key(compset, name)].push_back(index);
+    l_any_names[Name_Key("", name)].push_back(index);
+}
+
+
+/* If a thing changes its compset after it was created (e.g. a weapon that
+    turns out to be ranged), re-index it so it can be found under the new one
+*/
+void            Symbol_Set_Compset(T_XML_Node node, T_Glyph_CPtr compset)
+{
+    T_Int32U                    index;
+    T_Symbol *                  symbol;
+    vector<T_Int32U> *          list;
+    vector<T_Int32U>::iterator  it;
+    map<T_XML_Node, T_Int32U>::iterator node_it;
+
+    XML_Write_Text_Attribute(node, "compset", compset);
+
+    node_it = l_nodes.find(node);
+    if (node_it == l_nodes.end())
+        return;
+    index = node_it->second;
+    symbol = &l_symbols[index];
+    if (symbol->compset == compset)
+        return;
+
+    list = &l_names[Name_Key(symbol->compset.c_str(), XML_Get_Attribute_Pointer(node, "name"))];
+    for (it = list->begin(); it != list->end(); ++it)
+        if (*it == index) {
+            list->erase(it);
+            break;
+            }
+    symbol->compset = compset;
+    l_names[Name_Key(compset, XML_Get_Attribute_Pointer(node, "name"))].push_back(index);
+}
+
+
+void            Symbol_Add_Tag(T_XML_Node node, T_Glyph_CPtr group, T_Glyph_CPtr tag)
+{
+    T_Symbol_Tagged *   tagged;
+
+    if (x_Trap_Opt((node == NULL) || (group == NULL) || (tag == NULL)))
+        return;
+
+    tagged = &l_tags[Tag_Key(group, tag)];
+    if (tagged->members.insert(node).second)
+        tagged->nodes.push_back(node);
+}
+
+
+/* Find the thing with the given id that was created beneath the given root;
+    pass a NULL root to search all documents
+*/
+T_XML_Node      Symbol_Find_Id(T_XML_Node root, T_Glyph_CPtr id)
+{
+    T_Int32U                    i, count;
+    T_Symbol_Index::iterator    it;
+
+    it = l_ids.find(id);
+    if (it == l_ids.end())
+        return(NULL);
+    for (i = 0, count = it->second.size(); i < count; i++)
+        if ((root == NULL) || (l_symbols[it->second[i]].root == root))
+            return(l_symbols[it->second[i]].node);
+    return(NULL);
+}
+
+
+/* Find a thing by name (case-insensitively) beneath the given root. If no
+    compset is given, things with any compset will match.
+*/
+T_XML_Node      Symbol_Find_Name(T_XML_Node root, T_Glyph_CPtr compset, T_Glyph_CPtr name)
+{
+    T_Int32U                    i, count, index;
+    T_Symbol_Index *            names;
+    T_Symbol_Index::iterator    it;
+
+    names = (compset != NULL) ? &l_names : &l_any_names;
+    it = names->find(Name_Key((compset != NULL) ? compset : "", name));
+    if (it == names->end())
+        return(NULL);
+    for (i = 0, count = it->second.size(); i < count; i++) {
+        index = it->second[i];
+        if ((root == NULL) || (l_symbols[index].root == root))
+            return(l_symbols[index].node);
+        }
+    return(NULL);
+}
+
+
+/* Build a list of all things beneath the root with the given tag, in the order
+    they were tagged. If a second group and tag are given, things must have
+    both tags.
+*/
+void            Symbol_Find_Tagged(T_XML_Node root, T_Glyph_CPtr group, T_Glyph_CPtr tag,
+                                    vector<T_XML_Node> * list,
+                                    T_Glyph_CPtr group2, T_Glyph_CPtr tag2)
+{
+    T_Int32U                i, count;
+    T_XML_Node              node;
+    T_Symbol_Tags::iterator it, it2;
+    map<T_XML_Node, T_Int32U>::iterator node_it;
+
+    it = l_tags.find(Tag_Key(group, tag));
+    if (it == l_tags.end())
+        return;
+    if (group2 != NULL) {
+        it2 = l_tags.find(Tag_Key(group2, tag2));
+        if (it2 == l_tags.end())
+            return;
+        }
+
+    for (i = 0, count = it->second.nodes.size(); i < count; i++) {
+        node = it->second.nodes[i];
+        if ((group2 != NULL) && (it2->second.members.count(node) == 0))
+            continue;
+        if (root != NULL) {
+            node_it = l_nodes.find(node);
+            if ((node_it == l_nodes.end()) || (l_symbols[node_it->second].root != root))
+                continue;
+            }
+        list->push_back(node);
+        }
+}
+
+
+bool            Symbol_Has_Tag(T_XML_Node node, T_Glyph_CPtr group, T_Glyph_CPtr tag)
+{
+    T_Symbol_Tags::iterator it;
+
+    it = l_tags.find(Tag_Key(group, tag));
+    if (it == l_tags.end())
+        return(false);
+    return(it->second.members.count(node) != 0);
+}
+
+
+/* The number of things in the table - this only ever grows, so callers can use
+    it to tell whether anything has been added since they last looked
+*/
+T_Int32U        Symbol_Get_Count(void)
+{
+    return(l_symbols.size());
+}
+
+
+void            Symbol_Shutdown(void)
+{
+    l_symbols.clear();
+    l_nodes.clear();
+    l_ids.clear();
+    l_names.clear();
+    l_any_names.clear();
+    l_tags.clear();
+}
@@ -39,7 +39,9 @@ void        Strip_Bad_Characters(T_Glyph_Ptr buffer)
     T_Glyph             endquote[10], uaccent[10], caccent[10], bullet[10], wtf[10];
     T_Glyph_Ptr         search[] = { "—", "–", "’", "“", endquote, uaccent, caccent, bullet, wtf, "<br/>", "<td>", "</td>", "\t", "&nbsp;", };
     T_Glyph_Ptr         replace[] = { " - ", "-", "\'", "\"", "\"", "u", "c", "*", " ", "{br}", "", "", "", "", };
-    T_Glyph             temp[200000];
+    T_Int32U            length;
+    T_Glyph_Ptr         temp;
+    C_Scratch           scratch;
 
     if (buffer == NULL)
         return;
@@ -78,7 +80,14 @@ void        Strip_Bad_Characters(T_Glyph_Ptr buffer)
     wtf[2] = (T_Glyph) 160;
     wtf[3] = '\0';
 
-    Text_Find_Replace(temp, buffer, strlen(buffer), x_Array_Size(search), search, replace);
+    /* None of the replacements are longer than what they replace, so the
+        result always fits in a buffer the size of the original
+    */
+    length = strlen(buffer);
+    temp = scratch.Acquire(length + 1);
+    if (x_Trap_Opt(temp == NULL))
+        return;
+    Text_Find_Replace(temp, buffer, length, x_Array_Size(search), search, replace);
     strcpy(buffer, temp);
 }
 
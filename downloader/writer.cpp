@@ -0,0 +1,408 @@
+/*  FILE:   WRITER.CPP
+
+    Copyright (c) 2012 by Lone Wolf Development, Inc.  All rights reserved.
+
+    This code is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation; either version 2 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place, Suite 330, Boston, MA 02111-1307 USA
+
+    You can find more information about this project here:
+
+    http://code.google.com/p/ddidownloader/
+
+    This file includes:
+
+    Write stage for finished XML documents. Once post-processing is done, the
+    documents don't depend on each other any more, so they're validated and
+    written out concurrently on a pool of worker threads. Each document is
+    written to a temporary file alongside its final name, and only renamed
+    into place once it's safely on disk, so a run that dies part way through
+    never leaves a half-written file behind.
+
+    A hash of every file written to the output folder is kept in a manifest
+    there. If a document comes out the same as last time, the existing file
+    (and its backup) are left exactly as they are.
+*/
+
+
+#include "private.h"
+
+
+/* A document waiting to be written. Anything logged while writing it is
+    captured in the job, and replayed in queue order once everyone is finished.
+*/
+struct T_Write_Job {
+    T_XML_Document  document;
+    string          filename;
+    string          temp_filename;
+    string          manifest_name;  // name in the manifest, or empty if none
+    T_Int64U        hash;
+    T_Int64U        old_hash;
+    bool            is_known;       // old_hash is that of the existing file
+    bool            is_changed;
+    bool            is_backup;
+    bool            is_owned;
+    bool            is_reported;
+    bool            is_failed;
+    T_Log_Capture   log;
+};
+
+
+/* The jobs being worked on, along with the index of the last one claimed
+*/
+struct T_Write_Queue {
+    vector<T_Write_Job>     jobs;
+    volatile T_Int32S       claimed;
+};
+
+
+typedef map<string,T_Int64U>    T_Manifest;
+
+
+static  vector<T_Write_Job> l_jobs;
+
+static  string              l_manifest_folder;
+static  T_Manifest          l_manifest;
+
+
+void            Writer_Queue(T_XML_Document document, T_Glyph_CPtr filename,
+                                bool is_backup, bool is_owned, bool is_reported)
+{
+    T_Write_Job     job;
+
+    if (x_Trap_Opt((document == NULL) || (filename == NULL)))
+        return;
+
+    job.document = document;
+    job.filename = filename;
+    job.temp_filename = job.filename + WRITING_EXTENSION;
+    job.hash = 0;
+    job.old_hash = 0;
+    job.is_known = false;
+    job.is_changed = true;
+    job.is_backup = is_backup;
+    job.is_owned = is_owned;
+    job.is_reported = is_reported;
+    job.is_failed = false;
+
+    /* Files written straight into the manifest folder are tracked by their
+        name within it
+    */
+    if (!l_manifest_folder.empty() &&
+        (job.filename.compare(0, l_manifest_folder.size(), l_manifest_folder) == 0) &&
+        (job.filename.find(DIR[0], l_manifest_folder.size()) == string::npos))
+        job.manifest_name = job.filename.substr(l_manifest_folder.size());
+
+    l_jobs.push_back(job);
+}
+
+
+/* Load the manifest from the given folder, so documents written there can be
+    compared with what's already present. A missing or garbled manifest just
+    means everything gets written.
+*/
+void            Writer_Open_Manifest(T_Glyph_CPtr folder)
+{
+    T_Int64U        hash;
+    T_Glyph_Ptr     text, ptr, end;
+    string          filename;
+
+    l_manifest.clear();
+    l_manifest_folder = folder;
+    l_manifest_folder += DIR;
+    filename = l_manifest_folder + MANIFEST_FILENAME;
+    text = Quick_Read_Text((T_Glyph_Ptr) filename.c_str());
+    if (text == NULL)
+        return;
+
+    /* Each line is the hash in hex, a space, then the name of the file
+    */
+    for (ptr = text; *ptr != '\0'; ptr = end) {
+        end = strchr(ptr, '\n');
+        if (end == NULL)
+            break;
+        *end++ = '\0';
+        hash = Parse_Hash(ptr, &ptr);
+        if ((*ptr != ' ') || (ptr[1] == '\0'))
+            continue;
+        l_manifest[ptr + 1] = hash;
+        }
+    delete [] text;
+}
+
+
+/* Forget everything in the manifest - the files in the folder have been
+    changed behind our back
+*/
+void            Writer_Discard_Manifest(void)
+{
+    string          filename;
+
+    l_manifest.clear();
+    if (l_manifest_folder.empty())
+        return;
+    filename = l_manifest_folder + MANIFEST_FILENAME;
+    FileSys_Delete_File(filename.c_str(), FALSE);
+}
+
+
+/* Write the manifest out, putting it in place the same way as our documents
+*/
+static void     Save_Manifest(void)
+{
+    T_Status            status;
+    string              text, filename, temp_filename;
+    T_Manifest::iterator    iter;
+    T_Glyph             buffer[40];
+
+    for (iter = l_manifest.begin(); iter != l_manifest.end(); iter++) {
+        sprintf(buffer, "%016llx ", (unsigned long long) iter->second);
+        text += buffer;
+        text += iter->first;
+        text += "\n";
+        }
+
+    filename = l_manifest_folder + MANIFEST_FILENAME;
+    temp_filename = filename + WRITING_EXTENSION;
+    status = Quick_Write_Text((T_Glyph_Ptr) temp_filename.c_str(), (T_Glyph_Ptr) text.c_str());
+    if (x_Is_Success(status))
+        status = FileSys_Rename_File(filename.c_str(), temp_filename.c_str());
+    if (x_Trap_Opt(!x_Is_Success(status))) {
+        FileSys_Delete_File(temp_filename.c_str(), FALSE);
+        Log_Message("Couldn't save the output file manifest.\n");
+        }
+}
+
+
+/* Check that all nodes in the document are valid. This may cause problems
+    loading stuff into HL (if the nodes are bootstrapped by others, for
+    example), but if we don't, it will CERTAINLY cause problems loading stuff
+    into HL. Only the document is touched, so this is safe to call from a
+    worker thread.
+*/
+void            Writer_Check_Nodes(T_XML_Document document, T_Glyph_CPtr filename)
+{
+    long            result;
+    T_XML_Node      root, node;
+    T_Glyph         buffer[500], temp[500];
+
+    if (x_Trap_Opt(XML_Get_Document_Node(document, &root) != 0))
+        return;
+    result = XML_Get_First_Child(root, &node);
+    while (result == 0) {
+        result = XML_Validate_Node(node);
+        if (x_Trap_Opt(result != 0)) {
+            XML_Get_Name(node, temp);
+            sprintf(buffer, ">>> %s node removed from document %s!\n", temp, filename);
+            Log_Message(buffer);
+            }
+        result = XML_Get_Next_Child(root, &node);
+        }
+}
+
+
+static void     Write_Job(T_Write_Job * job)
+{
+    long                result = 0;
+    T_XML_Memory_Report report;
+    T_Glyph             buffer[MAX_FILE_NAME+500];
+
+    Log_Begin_Capture(&job->log);
+
+    /* If we know what the existing file hashes to, validate and render the
+        document without writing anything, to see whether it's changed. If
+        it's the same, there's nothing more to do.
+    */
+    if (job->is_known) {
+        result = XML_Write_Document(job->document, NULL, false, true, &job->hash);
+        if (result == 0)
+            job->is_changed = (job->hash != job->old_hash);
+        }
+
+    /* Otherwise, write the document out to the temporary file, and make sure
+        it's reached the disk before anyone renames it into place
+    */
+    if ((result == 0) && job->is_changed) {
+        result = XML_Write_Document(job->document, (T_Glyph_Ptr) job->temp_filename.c_str(),
+                                    false, true, &job->hash);
+        if ((result == 0) && !x_Is_Success(FileSys_Sync_File(job->temp_filename.c_str())))
+            result = -1;
+        }
+    if (x_Trap_Opt(result != 0)) {
+        sprintf(buffer, "Could not write XML document %s.\n", job->filename.c_str());
+        Log_Message(buffer);
+        job->is_failed = true;
+        }
+
+    /* Note how much memory the document's attributes needed, compared with
+        what a slot for every possible attribute would have taken
+    */
+    if (job->is_reported && (XML_Get_Memory_Report(job->document, &report) == 0)) {
+        sprintf(buffer, "Attributes for %s: %ld nodes, %ld values, %ld bytes (dense storage: %ld bytes)\n",
+                job->filename.c_str(), report.node_count, report.attrib_count,
+                report.attrib_bytes, report.dense_bytes);
+        Log_Message(buffer);
+        }
+
+    if (job->is_owned)
+        XML_Destroy_Document(job->document);
+    Log_End_Capture();
+}
+
+
+/* Keep claiming jobs until there are none left
+*/
+static void     Write_Worker(T_Void_Ptr context)
+{
+    T_Int32S            index;
+    T_Write_Queue *     queue = (T_Write_Queue *) context;
+
+    while (true) {
+        index = Thread_Atomic_Increment(&queue->claimed);
+        if (index >= (T_Int32S) queue->jobs.size())
+            break;
+        Write_Job(&queue->jobs[index]);
+        }
+}
+
+
+/* Put a written document in place of the old version of the file - if the
+    old version is to be backed up, the backup is made a hard link to it, so
+    nothing is copied unless the file system can't link. The new version then
+    replaces the old one in a single rename, so there's never a point where
+    the file isn't there.
+*/
+static void     Publish_Job(T_Write_Job * job)
+{
+    T_Status        status;
+    string          backup;
+    T_Glyph         buffer[MAX_FILE_NAME+500];
+
+    if (job->is_failed) {
+        FileSys_Delete_File(job->temp_filename.c_str(), FALSE);
+        return;
+        }
+    if (!job->is_changed) {
+        sprintf(buffer, "%s is unchanged.\n", job->filename.c_str());
+        Log_Message(buffer);
+        return;
+        }
+
+    if (job->is_backup && FileSys_Does_File_Exist((T_Glyph_Ptr) job->filename.c_str())) {
+        backup = job->filename + BACKUP_EXTENSION;
+        FileSys_Delete_File(backup.c_str(), TRUE);
+        status = FileSys_Link_File(backup.c_str(), job->filename.c_str());
+        if (!x_Is_Success(status))
+            status = FileSys_Copy_File((T_Glyph_Ptr) backup.c_str(), (T_Glyph_Ptr) job->filename.c_str(), TRUE);
+        if (x_Trap_Opt(!x_Is_Success(status))) {
+            sprintf(buffer, "Couldn't make a backup of %s!\n", job->filename.c_str());
+            Log_Message(buffer);
+            }
+        }
+
+    status = FileSys_Rename_File(job->filename.c_str(), job->temp_filename.c_str());
+    if (x_Trap_Opt(!x_Is_Success(status))) {
+        sprintf(buffer, "Could not write XML document %s.\n", job->filename.c_str());
+        Log_Message(buffer);
+        job->is_failed = true;
+        return;
+        }
+    if (!job->manifest_name.empty()) {
+        l_manifest[job->manifest_name] = job->hash;
+        sprintf(buffer, "%s was updated.\n", job->filename.c_str());
+        Log_Message(buffer);
+        }
+}
+
+
+/* Write out everything that's been queued, returning an error if any of the
+    documents couldn't be written
+*/
+T_Status        Writer_Flush(void)
+{
+    T_Int32U        i, count, tracked, unchanged;
+    T_Status        status = SUCCESS;
+    T_Write_Queue   queue;
+    T_Write_Job *   job;
+    T_Manifest::iterator    iter;
+    string          filename;
+    T_Glyph         buffer[100];
+
+    if (l_jobs.empty())
+        x_Status_Return_Success();
+
+    x_Profile_Timer("all", "write", NULL);
+
+    /* Take the jobs off the queue before we start, so the queue can be used
+        again straight away
+    */
+    queue.jobs.swap(l_jobs);
+    queue.claimed = -1;
+
+    /* Find out what was written to each tracked file last time, as long as the
+        file is still there
+    */
+    tracked = 0;
+    for (i = 0, count = queue.jobs.size(); i < count; i++) {
+        job = &queue.jobs[i];
+        if (job->manifest_name.empty())
+            continue;
+        tracked++;
+        iter = l_manifest.find(job->manifest_name);
+        if ((iter != l_manifest.end()) &&
+            FileSys_Does_File_Exist((T_Glyph_Ptr) job->filename.c_str())) {
+            job->old_hash = iter->second;
+            job->is_known = true;
+            }
+        }
+
+    /* Use a thread per processor, but don't bother starting threads that
+        won't have anything to do
+    */
+    count = Thread_Get_Worker_Count();
+    if (count > queue.jobs.size())
+        count = queue.jobs.size();
+    Thread_Run_Workers(count, Write_Worker, &queue);
+
+    /* If any tracked files are about to change, get rid of the manifest until
+        they're all in place - if we don't make it that far, it's better to
+        write everything next time than to trust an out of date manifest
+    */
+    unchanged = 0;
+    for (i = 0, count = queue.jobs.size(); i < count; i++)
+        if (!queue.jobs[i].manifest_name.empty() && !queue.jobs[i].is_changed)
+            unchanged++;
+    if (tracked > unchanged) {
+        filename = l_manifest_folder + MANIFEST_FILENAME;
+        FileSys_Delete_File(filename.c_str(), FALSE);
+        }
+
+    /* Now everyone's finished, log what happened and put each new file in
+        place. This is done here, rather than on the worker threads, since
+        most of the platform file functions aren't safe to call from them.
+    */
+    for (i = 0, count = queue.jobs.size(); i < count; i++) {
+        Log_Replay(&queue.jobs[i].log);
+        Publish_Job(&queue.jobs[i]);
+        if (queue.jobs[i].is_failed)
+            status = LWD_ERROR;
+        }
+
+    if (tracked > unchanged)
+        Save_Manifest();
+    if (unchanged > 0) {
+        sprintf(buffer, " (%lu of %lu files unchanged)", unchanged, tracked);
+        Log_Message(buffer, true);
+        }
+    x_Status_Return(status);
+}
@@ -41,6 +41,7 @@
 #include    <iostream>
 #include    <fstream>
 #include    <string>
+#include    <map>
 
 #ifdef  _LONEWOLF
 #include    <utilplus.h>
@@ -49,10 +50,10 @@
 #endif
 
 
-/*  OS X uses slightly different names for these functions, but they're
-    otherwise the same
+/*  OS X and Linux use slightly different names for these functions, but
+    they're otherwise the same
 */
-#if defined(_OSX)
+#if defined(_OSX) || defined(_LINUX)
 #define     stricmp     strcasecmp
 #define     strnicmp    strncasecmp
 #endif
@@ -65,6 +66,11 @@
 typedef std::string     C_String;
 
 
+/*  define a map used to find the index of a child or attribute by name
+*/
+typedef std::map<C_String,long>     T_XML_Name_Index;
+
+
 /*  define the set of internal string ids
 */
 #define STRING_OUT_OF_MEMORY            100
@@ -134,6 +140,48 @@ extern  T_Internal_String_Table g_xml_strings;
 #define CDATA_END                           "]]>"
 #define COMMENTS_START                      "!--"
 #define MAX_CHARACTER_ENCODING_LENGTH       100
+#define XML_INLINE_ATTRIBUTES               3
+#define XML_EXTRA_ATTRIBUTES                4
+
+
+/*  declare the context that tracks errors and the current line while a
+    document is parsed or validated. Each parse gets its own context, and each
+    thread has its own current context (plus a default one that catches errors
+    outside of a parse), so documents can be parsed on several threads at once.
+*/
+struct  T_XML_Context
+{
+    T_Glyph *           errors;     // buffer that errors are reported into
+    long                size;       // capacity of the errors buffer
+    long                line;       // current line number within the source
+    bool                is_ignore;  // whether unknown tags are being ignored
+                                    // for the current sub-tree
+};
+
+T_XML_Context *     XML_Get_Context(void);
+T_XML_Context *     XML_Set_Context(T_XML_Context * context);
+
+
+/*  store an error into the context, replacing whatever was there and
+    truncating it to fit the context's buffer
+*/
+inline  void        XML_Store_Error(T_XML_Context * context,const T_Glyph * msg)
+{
+    strncpy(context->errors,msg,context->size - 1);
+    context->errors[context->size - 1] = '\0';
+}
+
+
+/*  report an error into the current context; if an error has already been
+    posted, the old error is retained and the new one ignored
+*/
+inline  void        XML_Report_Error(const T_Glyph * msg)
+{
+    T_XML_Context *     context = XML_Get_Context();
+
+    if (*context->errors == '\0')
+        XML_Store_Error(context,msg);
+}
 
 
 /*  declare all classes in advance to enable circular references
@@ -144,6 +192,7 @@ class   C_XML_Parser;
 class   C_XML_Element;
 class   C_XML_Contents;
 class   C_XML_Root;
+class   C_XML_Writer;
 
 
 /*  declare a class for managing a dynamically sized string using pool storage
@@ -173,8 +222,23 @@ private:
 };
 
 
+/*  declare the value of a single attribute held by a node; edited values are
+    held in C_Dyna_Text style blocks (a size followed by the text), so they can
+    be re-used if the attribute is changed again
+*/
+struct  T_XML_Attrib_Value
+{
+    short               index;      // index of the attribute within the element
+    bool                is_edit;    // whether the text is in an edit block
+    T_Glyph *           text;       // text of the attribute
+};
+
+
 /*  declare a class for managing the recursively defined contents of an XML
     document
+    NOTE! Only the attributes that have actually been set are stored - the
+            first few within the node itself, and the rest in an overflow
+            list from the pool.
 */
 class   C_XML_Contents
 {
@@ -185,10 +249,12 @@ public:
     static  inline  void    Ignore_Unknowns(bool is_ignore)
                                 { s_is_ignore = is_ignore; }
     static  inline  bool    Is_Ignore(void)
-                                { return(s_is_ignore); }
+                                { return(s_is_ignore || XML_Get_Context()->is_ignore); }
 
-    static  inline  void    Set_Error_Buffer(T_Glyph * buffer)
-                                { s_errors = buffer; }
+    static  inline  bool    Get_Ignore_Override(void)
+                                { return(XML_Get_Context()->is_ignore); }
+    static  inline  void    Set_Ignore_Override(bool is_ignore)
+                                { XML_Get_Context()->is_ignore = is_ignore; }
 
     inline  C_XML_Contents* Get_Parent(void)
                                 { return(m_parent); }
@@ -204,6 +270,7 @@ public:
     C_XML_Contents *    Create_Child(const T_Glyph * name);
     long                Delete_Child(C_XML_Contents * child);
     long                Destroy_Named_Children(const T_Glyph * name);
+    long                Destroy_Children(C_XML_Contents ** children,long count);
     long                Destroy_Named_Children_With_Attr(const T_Glyph * name, const T_Glyph * attr_name,
                                                             const T_Glyph * attr_value);
 
@@ -224,6 +291,8 @@ public:
                                                 const T_Glyph * attr_name, const T_Glyph * attr_value);
     C_XML_Contents *    Get_Next_Named_Child_With_Attr(void);
 
+    C_XML_Contents *    Get_Cursor_Child(T_XML_Cursor * cursor);
+
     const T_Glyph *     Get_First_Attribute_Name(void);
     const T_Glyph *     Get_Next_Attribute_Name(void);
 
@@ -231,6 +300,7 @@ public:
                                         const T_Glyph * value,bool use_pool = false);
     long                Get_Attribute_Size(const T_Glyph * name,bool use_default = true);
     const T_Glyph *     Get_Attribute(const T_Glyph * name,bool use_default = true);
+    bool                Is_Attribute_Set(const T_Glyph * name);
 
     bool                Is_PCDATA(void);
     void                Set_PCDATA(const T_Glyph * pcdata,bool use_pool = false);
@@ -246,14 +316,20 @@ public:
     long                Duplicate_Contents(C_XML_Contents * source, bool is_overwrite = true);
 
     C_String            Synthesize_Output(bool is_detailed = false, bool is_blanks = false);
+    void                Render_Output(C_XML_Writer * writer, bool is_detailed = false,
+                                        bool is_blanks = false);
 
     long                Get_Hierarchy(T_Glyph_Ptr buffer, bool is_skip_top_level);
 
+    void                Report_Memory(T_XML_Memory_Report * report);
+
 protected:
     inline  void        Set_Error(T_Glyph * msg)
-                            { if (*s_errors == '\0') strcpy(s_errors,msg); }
+                            { XML_Report_Error(msg); }
 
     long                Delete_Child(long index);
+    void                Mark_Child(long index);
+    void                Sweep_Children(void);
 
     void                Constructor(C_XML_Contents * parent);
     void                Initialize(C_XML_Element * element);
@@ -267,23 +343,27 @@ private:
     const T_Glyph *     Get_Attribute(long index,bool use_default = true);
 
     bool                Is_Attribute_Present(long index);
+    bool                Is_Attribute_Set(long index);
+
+    T_XML_Attrib_Value *    Find_Attribute_Value(long index);
+    T_XML_Attrib_Value *    Add_Attribute_Value(long index);
+
+    void                Reset_Cursor(const T_Glyph * name, const T_Glyph * attr_name,
+                                        const T_Glyph * attr_value);
 
     static  bool            s_is_ignore;// whether to ignore unknown tags/attributes
-    static  T_Glyph *       s_errors;
 
     C_XML_Element *     m_reference;// element that the contents pertain to
     T_Glyph *           m_pcdata;   // any PCDATA for the instance
     C_Dyna_Text         m_pcdata_edit;// any edited PCDATA for the instance
     long                m_count;    // number of children
     C_XML_Contents **   m_contents; // list of child contents instances
-    T_Glyph **          m_attrib_text;// attribute text for instance
-    C_Dyna_Text *       m_attrib_text_edit;// any edited attribute text
-    bool *              m_is_attrib;// whether each attrib was defined
+    T_XML_Attrib_Value  m_attribs[XML_INLINE_ATTRIBUTES];// first attribute values set
+    T_XML_Attrib_Value *m_attrib_extra;// overflow list of attribute values
+    short               m_attrib_count;// number of attribute values held
+    short               m_attrib_slots;// number of slots in the overflow list
     long                m_slots;    // number of child slots allocated thus far
-    long                m_next;     // index of next thing to retrieve
-    C_Dyna_Text         m_child_name;// name of child elements to retrieve
-    C_Dyna_Text         m_attribute_name;// attribute name used when retrieving an element
-    C_Dyna_Text         m_attribute_value;// attribute value used when retrieving an element
+    T_XML_Cursor        m_cursor;   // cursor used by the Get_First/Next functions
     C_XML_Contents *    m_parent;   // parent node in the hierarchy
     long                m_line;
 
@@ -291,7 +371,7 @@ private:
     friend class    C_XML_Element;
 
     long                Validate_Node(void);
-    void                Output_Node(long depth);
+    void                Output_Node(C_XML_Writer * writer,long depth);
 };
 
 
@@ -316,9 +396,6 @@ public:
     inline  void *      Acquire_Storage(long size)
                             { return(m_storage->Acquire(size)); }
 
-    inline  long        Get_Max_Attributes(void)
-                            { return(m_max_attributes); }
-
     inline  bool        Is_Dynamic(void)
                             { return(m_is_dynamic); }
 
@@ -356,7 +433,6 @@ private:
     static T_Glyph      s_default_encoding[MAX_CHARACTER_ENCODING_LENGTH+1];
 
     bool                m_is_dynamic;   //whether to allocate contents with "new"
-    long                m_max_attributes;//max # of attributes in hierarchy
     C_Napkin *          m_output;   // stream to synthesize output
     C_Pool *            m_storage;  // pool for all initial memory allocations
     C_Pool *            m_children; // pool for all child contents
@@ -369,6 +445,45 @@ private:
 };
 
 
+/*  declare a class that renders XML output through a buffer, either straight
+    into a file or into a napkin, keeping a hash of the text as it goes; if
+    neither is opened, the text is only hashed
+*/
+class   C_XML_Writer
+{
+public:
+    C_XML_Writer(void);
+    ~C_XML_Writer();
+
+    bool                Open(const T_Glyph * filename);
+    void                Open(C_Napkin * napkin);
+    bool                Close(void);
+
+    inline  void        Append(T_Glyph ch)
+                            { if (m_ptr >= m_end) Flush(); *m_ptr++ = ch; }
+    inline  void        Append(const T_Glyph * text)
+                            { Append(text,strlen(text)); }
+    void                Append(const T_Glyph * text,long length);
+    void                Append_Indent(long depth);
+    void                Append_Escaped(const T_Glyph * text);
+    void                Append_PCDATA(const T_Glyph * text,bool is_preserve);
+
+    inline  T_XML_Hash  Get_Hash(void)
+                            { return(m_hash); }
+
+private:
+    void                Flush(void);
+
+    FILE *              m_file;
+    C_Napkin *          m_napkin;
+    T_Glyph *           m_buffer;
+    T_Glyph *           m_ptr;
+    T_Glyph *           m_end;
+    bool                m_is_error;
+    T_XML_Hash          m_hash;     // FNV-1a hash of everything flushed
+};
+
+
 /*  declare the class for parsing the contents of an XML document into a
     recursive contents hierarchy
 */
@@ -378,11 +493,8 @@ public:
     C_XML_Parser(void);
     ~C_XML_Parser();
 
-    static  inline  void    Set_Error_Buffer(T_Glyph * buffer)
-                                { s_errors = buffer; }
-
-    static  inline  long    Get_Line(void)
-                                { return(s_line); }
+    inline  long            Get_Line(void)
+                                { return(m_context->line); }
 
     inline  C_XML_Contents* Contents(void)
                                 { return(m_contents); }
@@ -440,7 +552,7 @@ public:
 
 private:
     inline  void        Set_Error(T_Glyph * msg)
-                            { if (*s_errors == '\0') strcpy(s_errors,msg); }
+                            { XML_Report_Error(msg); }
 
     void                Parse_Version(void);
     void                Parse_Stylesheet(void);
@@ -448,9 +560,7 @@ private:
     void                Grow_Raw_Text(void);
     void                Grow_Token(void);
 
-    static  T_Glyph *       s_errors;
-    static  long            s_line;
-
+    T_XML_Context *     m_context;
     C_String            m_text;
     T_Glyph *           m_raw_text;
     unsigned long       m_raw_pos;
@@ -469,7 +579,12 @@ private:
 
 
 /*  declare the class that describes an element in an XML DTD
+    NOTE! The element graph for a DTD is built once, the first time it is
+            needed, and is then shared by every document using that DTD - on
+            every thread. Nothing may change an element after it is built.
 */
+typedef std::map<T_XML_Element *,C_XML_Element *>   T_XML_Element_Map;
+
 class   C_XML_Element
 {
 public:
@@ -477,11 +592,9 @@ public:
                     T_Fn_XML_Validate valid_func,
                     long child_count,T_XML_Child * children,
                     long attrib_count,T_XML_Attribute * attribs);
-    C_XML_Element(T_XML_Element * info);
     ~C_XML_Element();
 
-    static  inline  void    Set_Error_Buffer(T_Glyph * buffer)
-                                { s_errors = buffer; }
+    static  C_XML_Element * Get_Graph(T_XML_Element * info);
 
     inline  T_Glyph_CPtr    Get_Name(void) const
                                 { return(x_String(m_name)); }
@@ -509,7 +622,10 @@ public:
     void                Parse_Children(C_XML_Parser * parser,
                                         C_XML_Contents * contents);
 
-    long                Get_Maximum_Attributes(long depth = 0);
+    inline  long            Get_Maximum_Attributes(void) const
+                                { return(m_max_attributes); }
+    long                Find_Child(const T_Glyph * name) const;
+    long                Find_Attribute(const T_Glyph * name) const;
 
 protected:
     C_String            m_name;
@@ -521,23 +637,26 @@ protected:
     long                m_attrib_count;
     T_XML_Attribute *   m_attrib_list;
     bool                m_is_omit;
+    long                m_max_attributes;
+    T_XML_Name_Index    m_child_index;
+    T_XML_Name_Index    m_attrib_index;
 
 private:
-    C_XML_Element(T_XML_Element * info,bool is_two_stage);
+    C_XML_Element(T_XML_Element * info);
 
     inline  void        Set_Error(T_Glyph * msg)
-                            { if (*s_errors == '\0') strcpy(s_errors,msg); }
+                            { XML_Report_Error(msg); }
 
     long        Construct(const T_Glyph * name,bool is_any,
                             E_XML_PCDATA pcdata_type,T_Fn_XML_Validate valid_func,
-                            long child_count,T_XML_Child * children,
+                            long child_count,
                             long attrib_count,T_XML_Attribute * attribs,
-                            bool is_two_stage,bool is_omit);
-    long        Initialize_Children(T_XML_Child * children);
+                            bool is_omit);
+    static  C_XML_Element * Build(T_XML_Element * info,T_XML_Element_Map * built);
+    void        Index_Names(void);
+    long        Count_Max_Attributes(void);
     void        Parse_Unknown_Children(C_XML_Parser * parser, T_Glyph_Ptr name);
     void        Parse_Unknown_Tag(C_XML_Parser * parser);
-
-    static  T_Glyph *       s_errors;
 };
 
 
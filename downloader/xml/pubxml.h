@@ -40,6 +40,7 @@
 /*  define other important constants
 */
 #define MAX_XML_BUFFER_SIZE   20000
+#define XML_ERROR_BUFFER_SIZE 1000          // default size of an error buffer
 
 
 /*  define types to encapsulate the size of a character; some platforms require
@@ -49,6 +50,31 @@ typedef char        T_Glyph;
 typedef T_Glyph *   T_Glyph_Ptr;
 
 
+/*  define the type of hash computed over written documents - it's 64-bit
+    FNV-1a, so that two different documents are very unlikely to match
+*/
+#ifdef _WIN32
+typedef unsigned __int64    T_XML_Hash;
+#else
+typedef unsigned long long  T_XML_Hash;
+#endif
+#define XML_HASH_BASIS      14695981039346656037ULL
+#define XML_HASH_PRIME      1099511628211ULL
+
+
+/*  add the given bytes to a 64-bit FNV-1a hash, returning the new hash
+*/
+inline  T_XML_Hash  XML_Hash_Bytes(const void * data,unsigned long length,
+                                    T_XML_Hash hash = XML_HASH_BASIS)
+{
+    const unsigned char *   ptr = (const unsigned char *) data;
+
+    while (length-- > 0)
+        hash = (hash ^ *ptr++) * XML_HASH_PRIME;
+    return(hash);
+}
+
+
 /*  declare a forward reference to a private class referenced below
 */
 class   C_XML_Element;
@@ -113,8 +139,7 @@ struct  T_XML_Child
     E_XML_Child         nature;     // repetition frequency for the element
     C_XML_Element *     element;    // element object used as the child
                                     // used at run-time only
-    C_XML_Element **    reset_ptr;  // pointer used for cleanup at destruction
-                                    // used at run-time only
+    C_XML_Element **    reset_ptr;  // no longer used
 };
 
 
@@ -157,6 +182,37 @@ typedef struct T_XML_Document_ *    T_XML_Document;
 typedef struct T_XML_Node_ *        T_XML_Node;
 
 
+/*  define a cursor for iterating through the children of a node, optionally
+    restricted to a given element name and attribute value. A cursor holds all
+    of its own state, so any number of cursors may iterate over the same node
+    at once, including from multiple threads if the document is not being
+    modified. The name and attribute strings are not copied, so they must stay
+    valid while the cursor is in use. Deleting children of the node invalidates
+    any cursors on it.
+*/
+struct  T_XML_Cursor
+{
+    T_XML_Node          parent;     // node whose children are being iterated
+    long                position;   // index of the current child
+    const T_Glyph *     name;       // element name to match (NULL = any)
+    const T_Glyph *     attr_name;  // attribute to match (NULL = none)
+    const T_Glyph *     attr_value; // value the attribute must have
+};
+
+
+/*  define a report on the memory used to hold the attributes of a document,
+    along with what the same nodes would need with a slot for every attribute
+    the DTD allows
+*/
+struct  T_XML_Memory_Report
+{
+    long                node_count; // number of nodes in the document
+    long                attrib_count;// number of attribute values held
+    long                attrib_bytes;// bytes used to hold attribute values
+    long                dense_bytes;// bytes one slot per DTD attribute needs
+};
+
+
 /*  declare the public API for managing XML documents
 */
 void        XML_Handle_Unknowns(bool is_ignore);
@@ -165,7 +221,8 @@ long        XML_Read_Document(T_XML_Document * document,T_XML_Element * root,
                                     const T_Glyph * filename,bool is_dynamic = false,
                                     bool is_warnings = false);
 long        XML_Write_Document(T_XML_Document document,const T_Glyph * filename,
-                                    bool is_detailed = false, bool is_blanks = false);
+                                    bool is_detailed = false, bool is_blanks = false,
+                                    T_XML_Hash * hash = 0);
 
 long        XML_Create_Document(T_XML_Document * document,T_XML_Element * root,
                                     bool is_dynamic = false);
@@ -190,6 +247,12 @@ long        XML_Get_First_Named_Child_With_Attr(T_XML_Node node,const T_Glyph *
                                         T_XML_Node * child);
 long        XML_Get_Next_Named_Child_With_Attr(T_XML_Node node,T_XML_Node * child);
 
+long        XML_Cursor_First(T_XML_Cursor * cursor,T_XML_Node node,T_XML_Node * child,
+                                        const T_Glyph * name = 0,
+                                        const T_Glyph * attr_name = 0,
+                                        const T_Glyph * attr_value = 0);
+long        XML_Cursor_Next(T_XML_Cursor * cursor,T_XML_Node * child);
+
 long        XML_Get_Name(T_XML_Node node,T_Glyph * name);
 
 bool        XML_Is_PCDATA(T_XML_Node node);
@@ -207,12 +270,14 @@ long        XML_Get_Attribute(T_XML_Node node,const T_Glyph * name,
 long        XML_Set_Attribute(T_XML_Node node,const T_Glyph * name,
                                         const T_Glyph * value,bool use_pool = false);
 const T_Glyph * XML_Get_Attribute_Pointer(T_XML_Node node,const T_Glyph * name,bool use_default = true);
+bool        XML_Is_Attribute_Set(T_XML_Node node,const T_Glyph * name);
 
 long        XML_Create_Child(T_XML_Node node,const T_Glyph * name,
                                         T_XML_Node * child);
 long        XML_Delete_Node(T_XML_Node node);
 long        XML_Duplicate_Node(T_XML_Node node, T_XML_Node * duplicate, bool is_overwrite = true);
 long        XML_Delete_Named_Children(T_XML_Node node, const T_Glyph * name);
+long        XML_Delete_Children(T_XML_Node node, T_XML_Node * children, long count);
 long        XML_Delete_Named_Children_With_Attr(T_XML_Node node, const T_Glyph * name,
                                                 const T_Glyph * attr_name, const T_Glyph * attr_value);
 
@@ -220,7 +285,8 @@ long        XML_Normalize(T_XML_Document document);
 long        XML_Validate(T_XML_Document document);
 long        XML_Validate_Node(T_XML_Node node);
 
-void        XML_Set_Error_Buffer(T_Glyph * buffer);
+void        XML_Set_Error_Buffer(T_Glyph * buffer,long size = XML_ERROR_BUFFER_SIZE);
+void        XML_Set_Lookup_Hook(void (* hook)(void));
 void        XML_Set_Error(T_Glyph * msg);
 const T_Glyph * XML_Get_Error(void);
 
@@ -231,6 +297,8 @@ long        XML_Get_Line(T_XML_Node node);
 
 long        XML_Get_Hierarchy(T_Glyph_Ptr buffer, T_XML_Node node, bool is_skip_top_level = true);
 
+long        XML_Get_Memory_Report(T_XML_Document document,T_XML_Memory_Report * report);
+
 T_Glyph *   XML_Read_Text_Attribute(T_XML_Node xml,T_Glyph * name,T_Glyph * buffer);
 bool        XML_Read_Boolean_Attribute(T_XML_Node xml,T_Glyph * name);
 long        XML_Read_Integer_Attribute(T_XML_Node xml,T_Glyph * name);
@@ -38,9 +38,6 @@
 #define VERSION_TAG         "<?xml version=\"1.0\" encoding=\"%s\"?>"
 #define STYLESHEET_TAG      "<?xml-stylesheet href=\"%s\" type=\"%s\"?>"
 
-#define BLANKS              "                                        "
-#define INDENT_PER_LEVEL    2
-
 #define DYNAMIC_TEXT_SIZE   30
 
 
@@ -57,10 +54,34 @@ static      bool    l_is_blanks = false;
 /*  declare static member variables
 */
 bool            C_XML_Contents::s_is_ignore = false;
-T_Glyph *       C_XML_Contents::s_errors = NULL;
 T_Glyph         C_XML_Root::s_default_encoding[] = { XML_ENCODING_UTF_8 };
 
 
+/*  Acquire storage for edited text of the given length, rounded up to whole
+    block units. The size of the block is saved just before the text.
+*/
+static  T_Glyph *   Acquire_Edit_Block(C_Pool * pool,long len)
+{
+    short *     size;
+
+    /* calculate the storage we need in a block units
+    */
+    len = ((len - 1) / DYNAMIC_TEXT_SIZE) + 1;
+    len *= DYNAMIC_TEXT_SIZE;
+
+    /* acquire the storage we need
+    */
+    size = (short *) pool->Acquire((len * sizeof(T_Glyph)) + sizeof(short));
+    if (size == NULL)
+        x_Exception(-1234);
+
+    /* save the size and apportion storage for our actual string contents
+    */
+    *size = (short) len;
+    return((T_Glyph *) (size + 1));
+}
+
+
 void        C_Dyna_Text::Set_Text(C_Pool * pool,const T_Glyph * contents)
 {
     long     len;
@@ -71,22 +92,8 @@ void        C_Dyna_Text::Set_Text(C_Pool * pool,const T_Glyph * contents)
     */
     len = strlen(contents) + 1;
     if ((m_size == NULL) || (len > *m_size)) {
-
-        /* calculate the storage we need in a block units
-        */
-        len = ((len - 1) / DYNAMIC_TEXT_SIZE) + 1;
-        len *= DYNAMIC_TEXT_SIZE;
-
-        /* acquire the storage we need
-        */
-        m_size = (short *) pool->Acquire((len * sizeof(T_Glyph)) + sizeof(short));
-        if (m_size == NULL)
-            x_Exception(-1234);
-
-        /* save the size and apportion storage for our actual string contents
-        */
-        *m_size = (short) len;
-        m_text = (T_Glyph *) (m_size + 1);
+        m_text = Acquire_Edit_Block(pool,len);
+        m_size = ((short *) m_text) - 1;
         }
 
     /* save the contents
@@ -115,10 +122,6 @@ C_XML_Root::C_XML_Root(C_XML_Element * root,bool is_dynamic) : C_XML_Contents()
     */
     m_is_dynamic = is_dynamic;
 
-    /* calculate our maximum number of attributes throughout the hierarchy
-    */
-    m_max_attributes = root->Get_Maximum_Attributes();
-
     /* override the root node to be this node
     */
     m_root = this;
@@ -309,8 +312,6 @@ C_XML_Contents::~C_XML_Contents()
 
 void    C_XML_Contents::Constructor(C_XML_Contents * parent)
 {
-    long        i;
-
     /* initialize the basic member variables appropriately
     */
     m_parent = parent;
@@ -321,42 +322,28 @@ void    C_XML_Contents::Constructor(C_XML_Contents * parent)
     m_count = 0;
     m_contents = NULL;
     m_slots = 0;
-    m_next = 0;
+    m_cursor.parent = (T_XML_Node) this;
+    m_cursor.position = 0;
+    m_cursor.name = NULL;
+    m_cursor.attr_name = NULL;
+    m_cursor.attr_value = NULL;
 
-    /* allocate sufficient storage for dynamic attributes
+    /* start out with no attribute values; storage for them is only acquired
+        as they are set
     */
-    i = sizeof(bool) * m_root->Get_Max_Attributes();
-    m_is_attrib = (bool *) m_root->Get_Storage()->Acquire(i);
-    i = sizeof(T_Glyph *) * m_root->Get_Max_Attributes();
-    m_attrib_text = (T_Glyph **) m_root->Get_Storage()->Acquire(i);
-    if (!m_root->Is_Dynamic())
-        m_attrib_text_edit = NULL;
-    else {
-        i = sizeof(C_Dyna_Text) * m_root->Get_Max_Attributes();
-        m_attrib_text_edit = (C_Dyna_Text *) m_root->Get_Storage()->Acquire(i);
-        }
+    m_attrib_extra = NULL;
+    m_attrib_count = 0;
+    m_attrib_slots = 0;
 
-    /* initialize all attribute values to empty
-        NOTE! We must do this AFTER we allocate the storage above.
+    /* initialize our dynamic text fields appropriately
     */
-    for (i = 0; i < m_root->Get_Max_Attributes(); i++)
-        m_attrib_text[i] = NULL;
-
-    /* initialize our various dynamic text fields appropriately
-    */
-    m_child_name.Constructor();
-    m_attribute_name.Constructor();
-    m_attribute_value.Constructor();
-    if (m_root->Is_Dynamic()) {
+    if (m_root->Is_Dynamic())
         m_pcdata_edit.Constructor();
-        for (i = 0; i < m_root->Get_Max_Attributes(); i++)
-            m_attrib_text_edit[i].Constructor();
-        }
 
     /* set the line number to be whatever the current line number is according
         to the parser
     */
-    m_line = C_XML_Parser::Get_Line();
+    m_line = XML_Get_Context()->line;
 }
 
 
@@ -364,24 +351,20 @@ void    C_XML_Contents::Destructor(void)
 {
     long        i;
 
-    /* if this node has any children, release them appropriately
+    /* if this node has any children, release them appropriately; the list
+        itself belongs to the document's pool
     */
-    if (m_contents != NULL) {
+    if (m_contents != NULL)
         for (i = 0; i < m_count; i++)
             m_contents[i]->Release();
-        free(m_contents);
-        }
 }
 
 
 void        C_XML_Contents::Initialize(C_XML_Element * element)
 {
-    long                i;
-
     /* reset all attributes to empty
     */
-    for (i = 0; i < m_root->Get_Max_Attributes(); i++)
-        m_is_attrib[i] = false;
+    m_attrib_count = 0;
 
     /* finish initializing the contents object
     */
@@ -399,32 +382,32 @@ void        C_XML_Contents::Release(void)
 
 C_XML_Contents* C_XML_Contents::Get_New_Child(void)
 {
+    long                slots;
+    C_XML_Contents **   contents;
     C_XML_Contents *    child;
 
-    /* if we don't have another child ready to hand out, secure more children
+    /* if we don't have another child ready to hand out, secure more children;
+        the list doubles in size each time, so that a node with thousands of
+        children isn't copied over and over as it grows
+        NOTE! Lists come from the document's pool, so an outgrown list isn't
+                released until the document is. Since the list doubles, the
+                total outgrown is never more than the list in use.
     */
     if (m_count >= m_slots) {
-
-        /* if we haven't allocated storage yet, do so now
-        */
-        if (m_contents == NULL) {
-            m_contents = (C_XML_Contents **) malloc(sizeof(C_XML_Contents *) * SIZE_INCREMENT);
-            m_slots = SIZE_INCREMENT;
-            }
-
-        /* otherwise, increase the size of the current storage
-        */
-        else {
-            m_slots += SIZE_INCREMENT;
-            m_contents = (C_XML_Contents **) realloc(m_contents,sizeof(C_XML_Contents *) * m_slots);
-            }
+        slots = (m_slots == 0) ? SIZE_INCREMENT : m_slots * 2;
+        contents = (C_XML_Contents **) m_root->Acquire_Storage(sizeof(C_XML_Contents *) * slots);
 
         /* if we couldn't get more memory, we're in deep doodoo
         */
-        if (x_Trap_Opt(m_contents == NULL)) {
+        if (x_Trap_Opt(contents == NULL)) {
             Set_Error(x_Internal_String(STRING_OUT_OF_MEMORY));
             x_Exception(-208);
             }
+
+        if (m_count > 0)
+            memcpy(contents,m_contents,sizeof(C_XML_Contents *) * m_count);
+        m_contents = contents;
+        m_slots = slots;
         }
 
     /* allocate a new contents object, save it in the next available slot, and
@@ -440,15 +423,13 @@ C_XML_Contents* C_XML_Contents::Create_Child(const T_Glyph * name)
 {
     C_XML_Contents* child;
     C_XML_Element * element;
-    long            i,count;
+    long            i;
 
-    /* get the element reference for the parent (this node) and cycle through
-        its children to find the child that references the given element info
+    /* get the element reference for the parent (this node) and find the child
+        that references the given element info
     */
-    for (i = 0, count = m_reference->Get_Child_Count(); i < count; i++)
-        if (strcmp(m_reference->Get_Child_Name(i),name) == 0)
-            break;
-    if (x_Trap_Opt(i >= count))
+    i = m_reference->Find_Child(name);
+    if (x_Trap_Opt(i < 0))
         return(NULL);
     element = m_reference->Get_Child_Element(i);
 
@@ -505,13 +486,13 @@ long            C_XML_Contents::Delete_Child(long index)
         memmove(dest, source, (m_count - index - 1) * sizeof(C_XML_Contents *));
         }
 
-    /* If the 'next' member of this object is set at or past the index of the
-        deleted node, decrement it. If we don't do this, then m_next ends up
-        being the index of one element further along, and we stand the chance
-        of missing elements in our search.
+    /* If our cursor is set at or past the index of the deleted node,
+        decrement it. If we don't do this, then the cursor ends up at the index
+        of one element further along, and we stand the chance of missing
+        elements in our search.
     */
-    if (m_next >= index)
-        m_next--;
+    if (m_cursor.position >= index)
+        m_cursor.position--;
 
     /* Reduce the contents count by one to reflect the deletion, and return
         success.
@@ -523,29 +504,19 @@ long            C_XML_Contents::Delete_Child(long index)
 
 long            C_XML_Contents::Destroy_Named_Children(const T_Glyph * name)
 {
-    long                i, result;
-    C_XML_Contents *    contents;
+    long                i;
 
     /* If there are no children to delete, just return success.
     */
     if (m_count == 0)
         return(0);
 
-    /* Iterate through the list of children, backwards. That way the number of
-        memory moves we have to do (when we delete a child node and move the
-        ones below it 'up') is minimized, especially in the case where all the
-        children of a node have the same name. It also means we don't have to
-        worry about correcting our index when we delete a node, because we've
-        already looked at all the nodes that will be affected by the change.
+    /* Mark every child with the name, then remove them all in a single pass
     */
-    for (i = (m_count - 1) ; i >= 0; i--)
-        if (strcmp(m_contents[i]->Get_Name(),name) == 0) {
-            contents = m_contents[i];
-            result = Delete_Child(i);
-            if (x_Trap_Opt(result != 0))
-                return(result);
-            contents->Release();
-            }
+    for (i = 0; i < m_count; i++)
+        if (strcmp(m_contents[i]->Get_Name(),name) == 0)
+            Mark_Child(i);
+    Sweep_Children();
     return(0);
 }
 
@@ -553,8 +524,7 @@ long            C_XML_Contents::Destroy_Named_Children(const T_Glyph * name)
 long            C_XML_Contents::Destroy_Named_Children_With_Attr(const T_Glyph * name, const T_Glyph * attr_name,
                                                                     const T_Glyph * attr_value)
 {
-    long                i, result;
-    C_XML_Contents *    contents;
+    long                i;
     const T_Glyph *     value;
 
     /* If there are no children to delete, just return success.
@@ -562,46 +532,147 @@ long            C_XML_Contents::Destroy_Named_Children_With_Attr(const T_Glyph *
     if (m_count == 0)
         return(0);
 
-    /* Iterate through the list of children, backwards. That way the number of
-        memory moves we have to do (when we delete a child node and move the
-        ones below it 'up') is minimized, especially in the case where all the
-        children of a node have the same name. It also means we don't have to
-        worry about correcting our index when we delete a node, because we've
-        already looked at all the nodes that will be affected by the change.
+    /* Mark every child with the name and attribute value, then remove them
+        all in a single pass
     */
-    for (i = (m_count - 1) ; i >= 0; i--)
+    for (i = 0; i < m_count; i++)
         if (strcmp(m_contents[i]->Get_Name(),name) == 0) {
-            contents = m_contents[i];
-            value = contents->Get_Attribute(attr_name);
-            if ((value != NULL) && (strcmp(value, attr_value) == 0)) {
-                result = Delete_Child(i);
-                if (x_Trap_Opt(result != 0))
-                    return(result);
-                contents->Release();
-                }
+            value = m_contents[i]->Get_Attribute(attr_name);
+            if ((value != NULL) && (strcmp(value, attr_value) == 0))
+                Mark_Child(i);
             }
+    Sweep_Children();
     return(0);
 }
 
 
+/*  Compare two child pointers, so a list of them can be sorted and searched
+*/
+static  int     Compare_Children(const void * first,const void * second)
+{
+    C_XML_Contents *    a = *(C_XML_Contents **) first;
+    C_XML_Contents *    b = *(C_XML_Contents **) second;
+
+    return((a < b) ? -1 : ((a > b) ? 1 : 0));
+}
+
+
+/*  Delete every child in the given list, in a single pass over our children.
+    The list is sorted so each child can be looked up quickly, which means the
+    caller's list is left alone and a copy sorted instead.
+*/
+long            C_XML_Contents::Destroy_Children(C_XML_Contents ** children,long count)
+{
+    long                i;
+    C_XML_Contents **   sorted;
+
+    if ((m_count == 0) || (count <= 0))
+        return(0);
+    sorted = new C_XML_Contents * [count];
+    if (x_Trap_Opt(sorted == NULL))
+        return(-1);
+    memcpy(sorted,children,count * sizeof(C_XML_Contents *));
+    qsort(sorted,count,sizeof(C_XML_Contents *),Compare_Children);
+
+    /* Mark every child in the list, then remove them all in a single pass
+    */
+    for (i = 0; i < m_count; i++)
+        if (bsearch(&m_contents[i],sorted,count,sizeof(C_XML_Contents *),Compare_Children) != NULL)
+            Mark_Child(i);
+    Sweep_Children();
+    delete [] sorted;
+    return(0);
+}
+
+
+/*  Mark the child at the given index for deletion, releasing its contents. The
+    child stays in the list (as NULL) until Sweep_Children is called, so that
+    any number of children can be removed in one pass.
+    NOTE! Nothing may look at the list of children between marking and sweeping.
+*/
+void            C_XML_Contents::Mark_Child(long index)
+{
+    if (x_Trap_Opt((index < 0) || (index >= m_count) || (m_contents[index] == NULL)))
+        return;
+    m_contents[index]->Release();
+    m_contents[index] = NULL;
+}
+
+
+/*  Remove every child marked by Mark_Child from the list, preserving the order
+    of the rest
+*/
+void            C_XML_Contents::Sweep_Children(void)
+{
+    long        i, count, position;
+
+    /* Move each remaining child down over the marked ones; if our cursor is at
+        or past a marked child, it moves back one, just as Delete_Child does
+    */
+    position = m_cursor.position;
+    for (i = 0, count = 0; i < m_count; i++)
+        if (m_contents[i] != NULL)
+            m_contents[count++] = m_contents[i];
+        else if (position >= i)
+            m_cursor.position--;
+    m_count = count;
+}
+
+
 T_Glyph_CPtr        C_XML_Contents::Get_Name(void)
 {
     return(m_reference->Get_Name());
 }
 
 
+/* Set up our cursor to retrieve children matching the given name and
+    attribute value from the start of the list
+*/
+void                C_XML_Contents::Reset_Cursor(const T_Glyph * name, const T_Glyph * attr_name,
+                                                    const T_Glyph * attr_value)
+{
+    m_cursor.position = -1;
+    m_cursor.name = name;
+    m_cursor.attr_name = attr_name;
+    m_cursor.attr_value = attr_value;
+}
+
+
+/* Advance the cursor to the next child that matches its name and attribute
+    value, if any. The cursor is the only state used, so this may be called
+    with different cursors for the same node at the same time.
+*/
+C_XML_Contents *    C_XML_Contents::Get_Cursor_Child(T_XML_Cursor * cursor)
+{
+    C_XML_Contents *    child;
+    const T_Glyph *     attr;
+
+    for (cursor->position++; cursor->position < m_count; cursor->position++) {
+        child = m_contents[cursor->position];
+        if ((cursor->name != NULL) && (strcmp(child->Get_Name(),cursor->name) != 0))
+            continue;
+        if (cursor->attr_name != NULL) {
+            attr = child->Get_Attribute(cursor->attr_name);
+            if (strcmp(((attr == NULL) ? "" : attr),cursor->attr_value) != 0)
+                continue;
+            }
+        return(child);
+        }
+    cursor->position = m_count;
+    return(NULL);
+}
+
+
 C_XML_Contents *    C_XML_Contents::Get_First_Child(void)
 {
-    m_next = -1;
+    Reset_Cursor(NULL, NULL, NULL);
     return(Get_Next_Child());
 }
 
 
 C_XML_Contents *    C_XML_Contents::Get_Next_Child(void)
 {
-    if (++m_next >= m_count)
-        return(NULL);
-    return(m_contents[m_next]);
+    return(Get_Cursor_Child(&m_cursor));
 }
 
 
@@ -618,18 +689,14 @@ long            C_XML_Contents::Get_Named_Child_Count(const T_Glyph * name)
 
 C_XML_Contents *    C_XML_Contents::Get_First_Named_Child(const T_Glyph * name)
 {
-    m_child_name.Set_Text(m_root->Get_Storage(),name);
-    m_next = -1;
+    Reset_Cursor(name, NULL, NULL);
     return(Get_Next_Named_Child());
 }
 
 
 C_XML_Contents *    C_XML_Contents::Get_Next_Named_Child(void)
 {
-    for (m_next++; m_next < m_count; m_next++)
-        if (strcmp(m_contents[m_next]->Get_Name(),m_child_name.Get_Text()) == 0)
-            return(m_contents[m_next]);
-    return(NULL);
+    return(Get_Cursor_Child(&m_cursor));
 }
 
 
@@ -653,40 +720,29 @@ long            C_XML_Contents::Get_Named_Child_With_Attr_Count(const T_Glyph *
 C_XML_Contents *    C_XML_Contents::Get_First_Named_Child_With_Attr(const T_Glyph * name,
                                                         const T_Glyph * attr_name, const T_Glyph * attr_value)
 {
-    m_child_name.Set_Text(m_root->Get_Storage(),name);
-    m_attribute_name.Set_Text(m_root->Get_Storage(),attr_name);
-    m_attribute_value.Set_Text(m_root->Get_Storage(),attr_value);
-    m_next = -1;
+    Reset_Cursor(name, attr_name, attr_value);
     return(Get_Next_Named_Child_With_Attr());
 }
 
 
 C_XML_Contents *    C_XML_Contents::Get_Next_Named_Child_With_Attr(void)
 {
-    const T_Glyph * attr;
-
-    for (m_next++; m_next < m_count; m_next++)
-        if (strcmp(m_contents[m_next]->Get_Name(),m_child_name.Get_Text()) == 0) {
-            attr = m_contents[m_next]->Get_Attribute(m_attribute_name.Get_Text());
-            if (strcmp(((attr == NULL) ? "" : attr),m_attribute_value.Get_Text()) == 0)
-                return(m_contents[m_next]);
-                }
-    return(NULL);
+    return(Get_Cursor_Child(&m_cursor));
 }
 
 
 const T_Glyph * C_XML_Contents::Get_First_Attribute_Name(void)
 {
-    m_next = -1;
+    m_cursor.position = -1;
     return(Get_Next_Attribute_Name());
 }
 
 
 const T_Glyph * C_XML_Contents::Get_Next_Attribute_Name(void)
 {
-    if (++m_next >= m_reference->Get_Attribute_Count())
+    if (++m_cursor.position >= m_reference->Get_Attribute_Count())
         return(NULL);
-    return(m_reference->Get_Attribute(m_next)->name);
+    return(m_reference->Get_Attribute(m_cursor.position)->name);
 }
 
 
@@ -694,10 +750,8 @@ long            C_XML_Contents::Get_Attribute_Size(const T_Glyph * name,bool use
 {
     long            i;
 
-    for (i = 0; i < m_reference->Get_Attribute_Count(); i++)
-        if (strcmp(name,m_reference->Get_Attribute(i)->name) == 0)
-            break;
-    if (x_Trap_Opt(i >= m_reference->Get_Attribute_Count()))
+    i = m_reference->Find_Attribute(name);
+    if (x_Trap_Opt(i < 0))
         return(NULL);
 
     return(Get_Attribute_Size(i,use_default));
@@ -708,10 +762,8 @@ const T_Glyph * C_XML_Contents::Get_Attribute(const T_Glyph * name,bool use_defa
 {
     long        i;
 
-    for (i = 0; i < m_reference->Get_Attribute_Count(); i++)
-        if (strcmp(name,m_reference->Get_Attribute(i)->name) == 0)
-            break;
-    if (x_Trap_Opt(i >= m_reference->Get_Attribute_Count()))
+    i = m_reference->Find_Attribute(name);
+    if (x_Trap_Opt(i < 0))
         return(NULL);
 
     return(Get_Attribute(i,use_default));
@@ -723,117 +775,175 @@ long            C_XML_Contents::Set_Attribute(const T_Glyph * name,
 {
     long        i;
 
-    for (i = 0; i < m_reference->Get_Attribute_Count(); i++)
-        if (strcmp(name,m_reference->Get_Attribute(i)->name) == 0)
-            break;
-    if (x_Trap_Opt(i >= m_reference->Get_Attribute_Count()))
+    i = m_reference->Find_Attribute(name);
+    if (x_Trap_Opt(i < 0))
         return(-1);
 
     return(Set_Attribute(i,value,use_pool));
 }
 
 
-long            C_XML_Contents::Get_Attribute_Size(long index,bool use_default)
+/*  Find the value held for the attribute with the given index, returning NULL
+    if the attribute has not been set
+*/
+T_XML_Attrib_Value *    C_XML_Contents::Find_Attribute_Value(long index)
 {
-    const T_Glyph *     ptr;
-    T_XML_Attribute *   attribute;
+    long                    i;
 
-    /* if the original allocation is valid, use its contents
-    */
-    if (m_attrib_text[index] != NULL)
-        return(strlen(m_attrib_text[index]));
+    for (i = 0; i < m_attrib_count; i++)
+        if (i < XML_INLINE_ATTRIBUTES) {
+            if (m_attribs[i].index == index)
+                return(&m_attribs[i]);
+            }
+        else if (m_attrib_extra[i - XML_INLINE_ATTRIBUTES].index == index)
+            return(&m_attrib_extra[i - XML_INLINE_ATTRIBUTES]);
+    return(NULL);
+}
 
-    /* if we're not dynamic, use the default value or an empty string
-    */
-    if (!m_root->Is_Dynamic()) {
-        attribute = m_reference->Get_Attribute(index);
-        if (use_default && (attribute->def_value != NULL))
-            return(strlen(attribute->def_value));
-        return(1);
-        }
 
-    /* if there is no edited data, then report any default value present
-    */
-    if (m_attrib_text_edit[index].Is_Empty()) {
-        attribute = m_reference->Get_Attribute(index);
-        if (use_default && (attribute->def_value != NULL))
-            return(strlen(attribute->def_value));
+/*  Add a new value for the attribute with the given index. Once the values
+    held within the node are used up, further values go into an overflow list
+    from the pool, which doubles in size each time it fills (but never grows
+    beyond the number of attributes the element has).
+*/
+T_XML_Attrib_Value *    C_XML_Contents::Add_Attribute_Value(long index)
+{
+    long                    slots;
+    T_XML_Attrib_Value *    extra;
+    T_XML_Attrib_Value *    attrib;
+
+    if (m_attrib_count < XML_INLINE_ATTRIBUTES)
+        attrib = &m_attribs[m_attrib_count];
+    else {
+        if (m_attrib_count - XML_INLINE_ATTRIBUTES >= m_attrib_slots) {
+            slots = (m_attrib_slots == 0) ? XML_EXTRA_ATTRIBUTES : m_attrib_slots * 2;
+            if (slots > m_reference->Get_Attribute_Count() - XML_INLINE_ATTRIBUTES)
+                slots = m_reference->Get_Attribute_Count() - XML_INLINE_ATTRIBUTES;
+            if (x_Trap_Opt(slots <= m_attrib_slots))
+                x_Exception(-1234);
+            extra = (T_XML_Attrib_Value *) m_root->Acquire_Storage(sizeof(T_XML_Attrib_Value) * slots);
+            if (extra == NULL)
+                x_Exception(-1234);
+            if (m_attrib_slots > 0)
+                memcpy(extra,m_attrib_extra,sizeof(T_XML_Attrib_Value) * m_attrib_slots);
+            m_attrib_extra = extra;
+            m_attrib_slots = (short) slots;
+            }
+        attrib = &m_attrib_extra[m_attrib_count - XML_INLINE_ATTRIBUTES];
         }
 
-    /* otherwise, use the contents of the edited data
-    */
-    ptr = m_attrib_text_edit[index].Get_Text();
-    return(strlen(ptr) + 1);
+    attrib->index = (short) index;
+    attrib->is_edit = false;
+    attrib->text = NULL;
+    m_attrib_count++;
+    return(attrib);
 }
 
 
-const T_Glyph * C_XML_Contents::Get_Attribute(long index,bool use_default)
+long            C_XML_Contents::Get_Attribute_Size(long index,bool use_default)
 {
     T_XML_Attribute *   attribute;
+    T_XML_Attrib_Value *attrib;
 
-    /* if the original allocation is valid, get its contents
+    /* if the attribute has been set, use its contents
+        NOTE! For backwards compatibility, the size of an edited value includes
+                the null terminator, while an original value doesn't.
     */
-    if (m_attrib_text[index] != NULL)
-        return(m_attrib_text[index]);
+    attrib = Find_Attribute_Value(index);
+    if (attrib != NULL)
+        return(strlen(attrib->text) + (attrib->is_edit ? 1 : 0));
 
-    /* if we're not dynamic, use the default value or an empty string
+    /* otherwise, use the default value or an empty string
     */
-    if (!m_root->Is_Dynamic()) {
-        attribute = m_reference->Get_Attribute(index);
-        if (use_default && (attribute->def_value != NULL))
-            return(attribute->def_value);
-        return("");
-        }
+    attribute = m_reference->Get_Attribute(index);
+    if (use_default && (attribute->def_value != NULL))
+        return(strlen(attribute->def_value));
+    return(1);
+}
 
-    /* if there is no edited data, then report any default value present
+
+const T_Glyph * C_XML_Contents::Get_Attribute(long index,bool use_default)
+{
+    T_XML_Attribute *   attribute;
+    T_XML_Attrib_Value *attrib;
+
+    /* if the attribute has been set, get its contents
     */
-    if (m_attrib_text_edit[index].Is_Empty()) {
-        attribute = m_reference->Get_Attribute(index);
-        if (use_default && (attribute->def_value != NULL))
-            return(attribute->def_value);
-        }
+    attrib = Find_Attribute_Value(index);
+    if (attrib != NULL)
+        return(attrib->text);
 
-    /* otherwise, get the contents of the edited data
+    /* otherwise, use the default value or an empty string
     */
-    return(m_attrib_text_edit[index].Get_Text());
+    attribute = m_reference->Get_Attribute(index);
+    if (use_default && (attribute->def_value != NULL))
+        return(attribute->def_value);
+    return("");
 }
 
 
 long            C_XML_Contents::Set_Attribute(long index,const T_Glyph * value,bool use_pool)
 {
-    /* if there is no value stored yet or we've been explicitly told to use the
-        pool, allocate it from the fast storage pool
+    long                len;
+    T_XML_Attrib_Value *attrib;
+
+    if (value == NULL)
+        value = "";
+    len = strlen(value) + 1;
+
+    /* find the attribute's value, adding one if it hasn't been set yet
     */
-    if (use_pool || (m_attrib_text[index] == NULL) || !m_root->Is_Dynamic()) {
-        if (value == NULL)
-            value = "";
-        m_attrib_text[index] = (T_Glyph *) m_root->Acquire_Storage(strlen(value) + 1);
-        strcpy(m_attrib_text[index],value);
+    attrib = Find_Attribute_Value(index);
+    if (attrib == NULL) {
+        attrib = Add_Attribute_Value(index);
+        use_pool = true;
         }
 
-    /* otherwise, save the new value in the edit buffer and clear the original
-        allocation to indicate that edited contents are now used
+    /* if this is the first value or we've been explicitly told to use the
+        pool, allocate it from the fast storage pool
     */
-    else {
-        x_Trap_Opt(m_attrib_text_edit == NULL);
-        m_attrib_text_edit[index].Set_Text(m_root->Get_Storage(),value);
-        m_attrib_text[index] = NULL;
+    if (use_pool || !m_root->Is_Dynamic()) {
+        attrib->text = (T_Glyph *) m_root->Acquire_Storage(len);
+        attrib->is_edit = false;
         }
 
-    /* set the flag to indicate that we've got bona fide contents for the attrib
+    /* otherwise, save the new value in an edit block, re-using the block we
+        already have if the new value fits within it
     */
-    m_is_attrib[index] = true;
+    else if (!attrib->is_edit || (len > ((short *) attrib->text)[-1])) {
+        attrib->text = Acquire_Edit_Block(m_root->Get_Storage(),len);
+        attrib->is_edit = true;
+        }
+    strcpy(attrib->text,value);
     return(0);
 }
 
 
+bool            C_XML_Contents::Is_Attribute_Set(long index)
+{
+    return(Find_Attribute_Value(index) != NULL);
+}
+
+
+bool            C_XML_Contents::Is_Attribute_Set(const T_Glyph * name)
+{
+    long        i;
+
+    i = m_reference->Find_Attribute(name);
+    if (x_Trap_Opt(i < 0))
+        return(false);
+
+    return(Is_Attribute_Set(i));
+}
+
+
 bool            C_XML_Contents::Is_Attribute_Present(long index)
 {
     T_XML_Attribute *   attribute;
 
     /* if the attribute is specified explicitly, it's present
     */
-    if (m_is_attrib[index])
+    if (Is_Attribute_Set(index))
         return(true);
 
     /* otherwise, check if there is a default value for the attribute
@@ -933,9 +1043,9 @@ long                C_XML_Contents::Normalize(void)
         the default and override in case of the special flag of both child and
         attribute counts being -1
     */
-    old_is_ignore = s_is_ignore;
+    old_is_ignore = Get_Ignore_Override();
     if ((m_reference->Get_Child_Count() == -1) && (m_reference->Get_Attribute_Count() == -1))
-        s_is_ignore = true;
+        Set_Ignore_Override(true);
 
     /* sort all of the children beneath the current node so that they are in the
         exact order specified within the DTD (i.e. the order given by the
@@ -970,7 +1080,7 @@ long                C_XML_Contents::Normalize(void)
     /* if we still have children left over, then something is very wrong (unless
         we are supposed to be ignoring unrecognized tags)
     */
-    if (!s_is_ignore)
+    if (!Is_Ignore())
         if (x_Trap_Opt(done < m_count)) {
             result = -300;
             goto finished;
@@ -991,7 +1101,7 @@ long                C_XML_Contents::Normalize(void)
     /* restore the previous "is_ignore" state and return the result
     */
 finished:
-    s_is_ignore = old_is_ignore;
+    Set_Ignore_Override(old_is_ignore);
     return(result);
 }
 
@@ -1013,9 +1123,9 @@ long                C_XML_Contents::Validate_Node(void)
         the default and override in case of the special flag of both child and
         attribute counts being -1
     */
-    old_is_ignore = s_is_ignore;
+    old_is_ignore = Get_Ignore_Override();
     if ((m_reference->Get_Child_Count() == -1) && (m_reference->Get_Attribute_Count() == -1))
-        s_is_ignore = true;
+        Set_Ignore_Override(true);
 
     /* iterate through all of the attributes for the node and confirm accuracy
     */
@@ -1121,7 +1231,7 @@ long                C_XML_Contents::Validate_Node(void)
     /* verify that we don't have any children left over (unless we are supposed
         to ignore unrecognized tags)
     */
-    if (!s_is_ignore)
+    if (!Is_Ignore())
         if (x_Trap_Opt(next < m_count)) {
             result = -206;
             goto finished;
@@ -1142,7 +1252,7 @@ long                C_XML_Contents::Validate_Node(void)
     /* restore the original ignore state and return our result
     */
 finished:
-    s_is_ignore = old_is_ignore;
+    Set_Ignore_Override(old_is_ignore);
     return(result);
 }
 
@@ -1161,13 +1271,10 @@ long                C_XML_Contents::Validate(void)
 }
 
 
-void                C_XML_Contents::Output_Node(long depth)
+void                C_XML_Contents::Output_Node(C_XML_Writer * writer,long depth)
 {
-    static  T_Glyph l_blanks[] = BLANKS;
-
     long            i,count;
-    T_Glyph         ch,buffer[MAX_XML_BUFFER_SIZE+1];
-    T_Glyph *       dest;
+    T_Glyph         ch;
     const T_Glyph * src;
     const T_Glyph * ptr;
     const T_Glyph * spec;
@@ -1181,16 +1288,13 @@ void                C_XML_Contents::Output_Node(long depth)
 
     /* indent to the proper depth
     */
-    if (l_is_blanks || m_root->Is_Blanks()) {
-        l_blanks[depth * INDENT_PER_LEVEL] = '\0';
-        m_root->Get_Output()->Append(l_blanks);
-        l_blanks[depth * INDENT_PER_LEVEL] = ' ';
-        }
+    if (l_is_blanks || m_root->Is_Blanks())
+        writer->Append_Indent(depth);
 
     /* start the tag with the node name
     */
-    m_root->Get_Output()->Append('<');
-    m_root->Get_Output()->Append(m_reference->Get_Name());
+    writer->Append('<');
+    writer->Append(m_reference->Get_Name());
 
     /* output all attributes for the tag
     */
@@ -1213,35 +1317,14 @@ void                C_XML_Contents::Output_Node(long depth)
                 (strcmp(src,attribute->def_value) == 0))
                 continue;
 
-            /* if the attribute value contains any special characters, we must
-                convert them
+            /* output the attribute value, converting any special characters
             */
-            for (dest = buffer; *src != '\0'; src++)
-                switch (*src) {
-                    case '<' :  strcpy(dest,"&lt;");    dest += 4;  break;
-                    case '>' :  strcpy(dest,"&gt;");    dest += 4;  break;
-                    case '&' :  strcpy(dest,"&amp;");   dest += 5;  break;
-                    case '\"' : strcpy(dest,"&quot;");  dest += 6;  break;
-                    case '\'' : strcpy(dest,"&apos;");  dest += 6;  break;
-                    default :
-                        if ((T_Int8U) *src <= 127)
-                            *dest++ = *src;
-                        else {
-                            sprintf(dest,"&#%d;",(T_Int8U) *src);
-                            dest += strlen(dest);
-                            }
-                        break;
-                    }
-            *dest = '\0';
-
-            /* output the mapped attribute value
-            */
-            m_root->Get_Output()->Append(' ');
-            m_root->Get_Output()->Append(m_reference->Get_Attribute(i)->name);
-            m_root->Get_Output()->Append('=');
-            m_root->Get_Output()->Append('\"');
-            m_root->Get_Output()->Append(buffer);
-            m_root->Get_Output()->Append('\"');
+            writer->Append(' ');
+            writer->Append(attribute->name);
+            writer->Append('=');
+            writer->Append('\"');
+            writer->Append_Escaped(src);
+            writer->Append('\"');
             }
 
     /* retrieve the PCDATA for the node
@@ -1252,14 +1335,14 @@ void                C_XML_Contents::Output_Node(long depth)
         tag immediately and we're done
     */
     if ((*ptr == '\0') && (m_reference->Get_Child_Count() == 0)) {
-        m_root->Get_Output()->Append("/>");
-        m_root->Get_Output()->Append('\n');
+        writer->Append("/>");
+        writer->Append('\n');
         return;
         }
 
     /* otherwise, close the tag normally and continue
     */
-    m_root->Get_Output()->Append('>');
+    writer->Append('>');
 
     /* output any PCDATA for the node
     */
@@ -1289,78 +1372,29 @@ void                C_XML_Contents::Output_Node(long depth)
             this is due to our hack with empty strings
             NOTE! Do this AFTER the tests above.
         */
-        if ((ptr[0] == ' ') && (ptr[1] == '\0')) {
-            buffer[0] = '\0';
-            ptr = buffer;
-            }
+        if ((ptr[0] == ' ') && (ptr[1] == '\0'))
+            ptr = "";
 
         /* if there are no special characters or high-byte codes, just output
         */
         if (!is_special && !is_high)
-            m_root->Get_Output()->Append(ptr);
+            writer->Append(ptr);
 
         /* if there are special characters embedded and no high-byte ASCII
             codes, wrap the entire thing within a CDATA literal block
         */
         else if (is_special && !is_high) {
-            m_root->Get_Output()->Append('<');
-            m_root->Get_Output()->Append(CDATA_START);
-            m_root->Get_Output()->Append(ptr);
-            m_root->Get_Output()->Append(CDATA_END);
+            writer->Append('<');
+            writer->Append(CDATA_START);
+            writer->Append(ptr);
+            writer->Append(CDATA_END);
             }
 
         /* if there are any high-byte ASCII codes, we have to synthesize our
-            output on a character basis to properly escape any codes; while
-            we're at it, make sure to put CDATA blocks around blocks of
-            whitespace
+            output on a character basis to properly escape any codes
         */
         else
-            for ( ; *ptr != '\0'; ) {
-
-                /* proper handle a block of preserved whitespace (if necessary)
-                */
-                ch = *ptr++;
-                if ((ch == '\n') || (ch == '\t') || ((ch == ' ') && (*ptr == ' '))) {
-                    if (is_preserve)
-                        m_root->Get_Output()->Append(ch);
-                    else {
-                        m_root->Get_Output()->Append('<');
-                        m_root->Get_Output()->Append(CDATA_START);
-                        m_root->Get_Output()->Append(ch);
-                        while (*ptr != '\0') {
-                            ch = *ptr++;
-                            if ((ch == '\n') || (ch == '\t') || ((ch == ' ') && (*ptr == ' ')))
-                                m_root->Get_Output()->Append(ch);
-                            else
-                                break;
-                            }
-                        m_root->Get_Output()->Append(CDATA_END);
-                        }
-                    continue;
-                    }
-
-                /* recognize appropriate special characters and output correctly
-                */
-                dest = buffer;
-                switch (ch) {
-                    case '<' :  strcpy(dest,"&lt;");    dest += 4;  break;
-                    case '>' :  strcpy(dest,"&gt;");    dest += 4;  break;
-                    case '&' :  strcpy(dest,"&amp;");   dest += 5;  break;
-                    case '\"' : strcpy(dest,"&quot;");  dest += 6;  break;
-                    case '\'' : strcpy(dest,"&apos;");  dest += 6;  break;
-                    default :
-                        if ((T_Int8U) ch <= 127) {
-                            m_root->Get_Output()->Append(ch);
-                            continue;
-                            }
-                        sprintf(dest,"&#%d;",(T_Int8U) ch);
-                        dest += strlen(dest);
-                        break;
-                    }
-                *dest = '\0';
-                m_root->Get_Output()->Append(buffer);
-                }
-
+            writer->Append_PCDATA(ptr,is_preserve);
         }
 
     /* if the node has any children, we need to format them specially
@@ -1374,46 +1408,70 @@ void                C_XML_Contents::Output_Node(long depth)
         /* output all children of the node
             NOTE! Be sure to skip any elements marked as omitted.
         */
-        m_root->Get_Output()->Append('\n');
+        writer->Append('\n');
         for (i = 0; i < m_count; i++)
             if (!m_reference->Is_Omit())
-                m_contents[i]->Output_Node(depth);
+                m_contents[i]->Output_Node(writer,depth);
         }
 
     /* indent properly if we had any children - otherwise the closing element
         will be misaligned
     */
-    if ((m_count > 0) && (l_is_blanks || m_root->Is_Blanks())) {
-        l_blanks[depth * INDENT_PER_LEVEL] = '\0';
-        m_root->Get_Output()->Append(l_blanks);
-        l_blanks[depth * INDENT_PER_LEVEL] = ' ';
-        }
+    if ((m_count > 0) && (l_is_blanks || m_root->Is_Blanks()))
+        writer->Append_Indent(depth);
 
     /* output the terminal tag for the node
     */
-    m_root->Get_Output()->Append("</");
-    m_root->Get_Output()->Append(m_reference->Get_Name());
-    m_root->Get_Output()->Append('>');
-    m_root->Get_Output()->Append('\n');
+    writer->Append("</");
+    writer->Append(m_reference->Get_Name());
+    writer->Append('>');
+    writer->Append('\n');
 }
 
 
-C_String            C_XML_Contents::Synthesize_Output(bool is_detailed, bool is_blanks)
+/*  Render the document through the writer
+    NOTE! The document must be validated first.
+*/
+void                C_XML_Contents::Render_Output(C_XML_Writer * writer, bool is_detailed, bool is_blanks)
 {
-    long        result;
     T_Glyph     buffer[1000];
 
+    /* configure the root with whether the output is detailed / has blanks or not
+    */
+    m_root->Set_Detailed(is_detailed);
+    m_root->Set_Blanks(is_blanks);
+
+    /* emit the version tag properly
+    */
+    sprintf(buffer,VERSION_TAG,m_root->Get_Encoding());
+    writer->Append(buffer);
+    writer->Append('\n');
+
+    /* if stylesheet information is present, emit the stylesheet tag properly
+    */
+    if ((m_root->Get_Stylesheet_Href() != NULL) && (m_root->Get_Stylesheet_Type() != NULL)) {
+        sprintf(buffer,STYLESHEET_TAG,m_root->Get_Stylesheet_Href(),m_root->Get_Stylesheet_Type());
+        writer->Append(buffer);
+        writer->Append('\n');
+        }
+
+    /* synthesize the XML output via recursive descent through the nodes
+    */
+    Output_Node(writer,0);
+}
+
+
+C_String            C_XML_Contents::Synthesize_Output(bool is_detailed, bool is_blanks)
+{
+    long            result;
+    C_XML_Writer    writer;
+
     /* validate the contents
     */
     result = Validate();
     if (result != 0)
         return(NULL);
 
-    /* configure the root with whether the output is detailed / has blanks or not
-    */
-    m_root->Set_Detailed(is_detailed);
-    m_root->Set_Blanks(is_blanks);
-
     /* allocate a napkin object to incrementally render into - for the ROOT
         node only; if a napkin already exists, just re-use it
     */
@@ -1425,23 +1483,11 @@ C_String            C_XML_Contents::Synthesize_Output(bool is_detailed, bool is_
             return(NULL);
         }
 
-    /* emit the version tag properly
-    */
-    sprintf(buffer,VERSION_TAG,m_root->Get_Encoding());
-    m_root->Get_Output()->Append(buffer);
-    m_root->Get_Output()->Append('\n');
-
-    /* if stylesheet information is present, emit the stylesheet tag properly
-    */
-    if ((m_root->Get_Stylesheet_Href() != NULL) && (m_root->Get_Stylesheet_Type() != NULL)) {
-        sprintf(buffer,STYLESHEET_TAG,m_root->Get_Stylesheet_Href(),m_root->Get_Stylesheet_Type());
-        m_root->Get_Output()->Append(buffer);
-        m_root->Get_Output()->Append('\n');
-        }
-
-    /* synthesize the XML output via recursive descent through the nodes
+    /* render the document into the napkin
     */
-    Output_Node(0);
+    writer.Open(m_root->Get_Output());
+    Render_Output(&writer, is_detailed, is_blanks);
+    writer.Close();
 
     /* return the output we synthesized
     */
@@ -1451,7 +1497,7 @@ C_String            C_XML_Contents::Synthesize_Output(bool is_detailed, bool is_
 
 long            C_XML_Contents::Duplicate_Contents(C_XML_Contents * source, bool is_overwrite)
 {
-    long            result;
+    long            i, result;
     T_Glyph_CPtr    name;
     C_XML_Contents* child;
     C_XML_Contents* node;
@@ -1487,18 +1533,9 @@ long            C_XML_Contents::Duplicate_Contents(C_XML_Contents * source, bool
         duplicating, if we have to overwrite the old node.
     */
     if (is_overwrite) {
-        child = Get_First_Child();
-        while (child != NULL) {
-            result = Delete_Child(child);
-            if (x_Trap_Opt(result != 0))
-                return(result);
-            child->Release();
-
-            /* Since we just deleted our first child, we can get the first child
-                again!
-            */
-            child = Get_First_Child();
-            }
+        for (i = 0; i < m_count; i++)
+            Mark_Child(i);
+        Sweep_Children();
         }
 
     /* Iterate through the children of our source
@@ -1554,3 +1591,20 @@ long            C_XML_Contents::Get_Hierarchy(T_Glyph_Ptr buffer, bool is_skip_t
         strcpy(ptr, Get_Name());
     return(0);
 }
+
+
+/*  Add up the memory used to hold the attributes of this node and all of its
+    children
+*/
+void            C_XML_Contents::Report_Memory(T_XML_Memory_Report * report)
+{
+    long        i;
+
+    report->node_count++;
+    report->attrib_count += m_attrib_count;
+    report->attrib_bytes += sizeof(m_attribs) + sizeof(m_attrib_extra) +
+                            sizeof(m_attrib_count) + sizeof(m_attrib_slots) +
+                            (m_attrib_slots * sizeof(T_XML_Attrib_Value));
+    for (i = 0; i < m_count; i++)
+        m_contents[i]->Report_Memory(report);
+}
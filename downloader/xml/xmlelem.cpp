@@ -28,17 +28,58 @@
 
 #include    "private.h"
 
+#include    <set>
+#include    <vector>
+
+#ifdef  _WIN32
+#include    <windows.h>
+#else
+#include    <pthread.h>
+#endif
+
 
 /*  define constants used below
 */
 #define BLANKS              "                                        "
 
 
-/*  declare static member variables used below
+/*  declare static variables used below
 */
-T_Glyph *       C_XML_Element::s_errors = NULL;
 bool            l_is_unknown_trace = true;
 
+static  T_XML_Element_Map   l_graphs;
+
+
+/*  Guard the table of element graphs, since documents may be created on more
+    than one thread at once
+*/
+#ifdef  _WIN32
+static  volatile LONG       l_graph_lock = 0;
+
+static  void    Lock_Graphs(void)
+{
+    while (InterlockedExchange(&l_graph_lock,1) != 0)
+        Sleep(0);
+}
+
+static  void    Unlock_Graphs(void)
+{
+    InterlockedExchange(&l_graph_lock,0);
+}
+#else
+static  pthread_mutex_t     l_graph_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static  void    Lock_Graphs(void)
+{
+    pthread_mutex_lock(&l_graph_lock);
+}
+
+static  void    Unlock_Graphs(void)
+{
+    pthread_mutex_unlock(&l_graph_lock);
+}
+#endif
+
 
 /*
     name        --> name of the element (must be matched)
@@ -52,19 +93,16 @@ bool            l_is_unknown_trace = true;
     pcdata_type --> whether the element can be PCDATA
     valid_func  --> callback function to perform additional validation with
     child_count --> number of child elements (0=Empty)
-    children    --> list of child elements
     attrib_count--> number of attributes
     attribs     --> list of attributes
 */
 long        C_XML_Element::Construct(const T_Glyph * name,bool is_any,
                                     E_XML_PCDATA pcdata_type,
                                     T_Fn_XML_Validate valid_func,
-                                    long child_count,T_XML_Child * children,
+                                    long child_count,
                                     long attrib_count,T_XML_Attribute * attribs,
-                                    bool is_two_stage,bool is_omit)
+                                    bool is_omit)
 {
-    long        result;
-
     /* save the various fields
     */
     m_name = name;
@@ -76,121 +114,183 @@ long        C_XML_Element::Construct(const T_Glyph * name,bool is_any,
     m_attrib_count = attrib_count;
     m_attrib_list = attribs;
     m_is_omit = is_omit;
+    m_max_attributes = attrib_count;
 
-    /* allocate storage for the list of child elements (if any)
+    /* allocate storage for the list of child elements (if any); the caller
+        fills it in
     */
     if (m_child_count > 0) {
         m_children = new T_XML_Child[m_child_count];
         if (x_Trap_Opt(m_children == NULL))
             return(-900);
         }
+    return(0);
+}
 
-    /* if we are not specifically operating in a two-stage process, initialize
-        the children properly
-    */
-    if (!is_two_stage) {
-        result = Initialize_Children(children);
-        if (x_Trap_Opt(result != 0))
-            return(-901);
+
+/*  Build the element object for the given definition, along with all of its
+    children. Since a DTD can be recursively defined, we track every element
+    we've created during the build and re-use it whenever the same definition
+    turns up again - otherwise we would continue infinitely. The element is
+    recorded BEFORE its children are built, so that a child referring back to
+    it finds it.
+*/
+C_XML_Element * C_XML_Element::Build(T_XML_Element * info,T_XML_Element_Map * built)
+{
+    long                        i;
+    C_XML_Element *             element;
+    T_XML_Element_Map::iterator it;
+
+    it = built->find(info);
+    if (it != built->end())
+        return(it->second);
+
+    element = new C_XML_Element(info);
+    if (x_Trap_Opt(element == NULL))
+        return(NULL);
+    (*built)[info] = element;
+
+    for (i = 0; i < element->m_child_count; i++) {
+        element->m_children[i].elem_info = info->child_set[i].elem_info;
+        element->m_children[i].nature = info->child_set[i].nature;
+        element->m_children[i].element = Build(info->child_set[i].elem_info,built);
+        element->m_children[i].reset_ptr = NULL;
         }
-    return(0);
+    element->Index_Names();
+    return(element);
 }
 
 
-long        C_XML_Element::Initialize_Children(T_XML_Child * children)
+/*  Build the lookup tables that find a child or attribute by name; if a name
+    appears more than once, the first one wins, just as a linear search would
+*/
+void        C_XML_Element::Index_Names(void)
 {
-    long        i;
+    long            i;
+    const T_Glyph * name;
 
-    /* create each of the children appropriately; this process is a bit
-        convoluted, since we have to handle the situation where the DTD is
-        recursively defined; if we have recursive, we'll continue infinitely
-        unless we recognize when we've already processed a child structure; we
-        accomplish this by creating the element object within the actual
-        structure providing the definition, as this structure only exists once;
-        all we need to do is copy the pointer to the created object into our
-        local object and we're set; the remaining problem is cleanup, since more
-        than one object will point to the same child and all will attempt to
-        delete the object; in addition, we need to cleanup the created object
-        within the original structure, else we won't be able to be called more
-        than once; to accomplish this, we save a pointer to where the newly
-        created element object is stored in the original structure; during our
-        destructor, this "reset_ptr" can be used to indicate whether we should
-        delete the element and reset the original structure back properly
-        NOTE!! This method precludes creating more than one instance of the same
-            C_XML_Element hierarchy at any one time.
-        NOTE!! The creation process MUST be done in TWO stages. In order for
-            recursion to be handled properly, the child object must be created
-            first and THEN have its children initialized. If it is done with one
-            pass, the children will get processed BEFORE the current object is
-            saved into the original structure, which undermines our entire
-            effort to properly handle recursively defined DTDs.
-    */
     for (i = 0; i < m_child_count; i++) {
-        m_children[i].nature = children[i].nature;
-        m_children[i].elem_info = children[i].elem_info;
-        if (children[i].element == NULL) {
-            children[i].element = new C_XML_Element(children[i].elem_info,true);
-            children[i].element->Initialize_Children(children[i].elem_info->child_set);
-            m_children[i].reset_ptr = &children[i].element;
-            }
-        else
-            m_children[i].reset_ptr = NULL;
-        m_children[i].element = children[i].element;
+        name = m_children[i].elem_info->name;
+        if ((name != NULL) && (*name != '\0'))
+            m_child_index.insert(T_XML_Name_Index::value_type(name,i));
         }
-    return(0);
+    for (i = 0; i < m_attrib_count; i++)
+        m_attrib_index.insert(T_XML_Name_Index::value_type(m_attrib_list[i].name,i));
+}
+
+
+/*  Determine the largest number of attributes held by this element or anything
+    beneath it
+*/
+long        C_XML_Element::Count_Max_Attributes(void)
+{
+    long                    i,count;
+    C_XML_Element *         element;
+    std::vector<C_XML_Element *>    pending;
+    std::set<C_XML_Element *>       visited;
+
+    count = 0;
+    pending.push_back(this);
+    visited.insert(this);
+    while (!pending.empty()) {
+        element = pending.back();
+        pending.pop_back();
+        if (element->m_attrib_count > count)
+            count = element->m_attrib_count;
+        for (i = 0; i < element->m_child_count; i++)
+            if (visited.insert(element->m_children[i].element).second)
+                pending.push_back(element->m_children[i].element);
+        }
+    return(count);
+}
+
+
+/*  Retrieve the shared element graph for the DTD that starts at the given
+    definition, building it the first time it's asked for. The graph lives
+    until the program exits.
+*/
+C_XML_Element * C_XML_Element::Get_Graph(T_XML_Element * info)
+{
+    C_XML_Element *             element;
+    T_XML_Element_Map           built;
+    T_XML_Element_Map::iterator it;
+
+    Lock_Graphs();
+    it = l_graphs.find(info);
+    if (it != l_graphs.end()) {
+        element = it->second;
+        Unlock_Graphs();
+        return(element);
+        }
+
+    element = Build(info,&built);
+    if (element != NULL) {
+        for (it = built.begin(); it != built.end(); ++it)
+            it->second->m_max_attributes = it->second->Count_Max_Attributes();
+        l_graphs[info] = element;
+        }
+    Unlock_Graphs();
+    return(element);
 }
 
 
+/*  Create a free-standing element whose children come from the shared graphs
+    for their definitions
+*/
 C_XML_Element::C_XML_Element(const T_Glyph * name,bool is_any,
                                 E_XML_PCDATA pcdata_type,
                                 T_Fn_XML_Validate valid_func,
                                 long child_count,T_XML_Child * children,
                                 long attrib_count,T_XML_Attribute * attribs)
 {
+    long        i;
+
     Construct(name,is_any,pcdata_type,valid_func,
-                child_count,children,attrib_count,attribs,false,false);
+                child_count,attrib_count,attribs,false);
+    for (i = 0; i < m_child_count; i++) {
+        m_children[i].elem_info = children[i].elem_info;
+        m_children[i].nature = children[i].nature;
+        m_children[i].element = Get_Graph(children[i].elem_info);
+        m_children[i].reset_ptr = NULL;
+        }
+    Index_Names();
+    m_max_attributes = Count_Max_Attributes();
 }
 
 
 C_XML_Element::C_XML_Element(T_XML_Element * info)
 {
     Construct(info->name,info->is_any,info->pcdata_type,info->valid_func,
-                info->child_count,info->child_set,
-                info->attrib_count,info->attrib_list,false,info->is_omit);
+                info->child_count,
+                info->attrib_count,info->attrib_list,info->is_omit);
 }
 
 
-C_XML_Element::C_XML_Element(T_XML_Element * info,bool is_two_stage)
+/*  The children are owned by the graph they belong to, so we only dispose of
+    our own list
+*/
+C_XML_Element::~C_XML_Element()
 {
-    Construct(info->name,info->is_any,info->pcdata_type,info->valid_func,
-                info->child_count,info->child_set,
-                info->attrib_count,info->attrib_list,is_two_stage,info->is_omit);
+    if (m_child_count > 0)
+        delete [] m_children;
 }
 
 
-C_XML_Element::~C_XML_Element()
+long        C_XML_Element::Find_Child(const T_Glyph * name) const
 {
-    long        i;
+    T_XML_Name_Index::const_iterator    it;
 
-    /* cleanup all children appropriately; just because the child is non-NULL
-        does NOT mean that we should clean it up; since the hierarchy can be
-        recursive, it means that the same children can be re-used throughout; in
-        order to know whether WE need to delete a child, we need to check the
-        reset pointer, since it will be non-NULL only if it is our
-        responsibility to perform the cleanup (if NULL, then we are a duplicate
-        reference and some other object will perform the cleanup); when we
-        delete the child, we also must reset its contents within the original
-        definition structure, else we won't be able to be created again properly
-    */
-    for (i = 0; i < m_child_count; i++)
-        if ((m_children[i].element != NULL) &&
-            (m_children[i].reset_ptr != NULL) &&
-            (*m_children[i].reset_ptr != NULL)) {
-            delete m_children[i].element;
-            *m_children[i].reset_ptr = NULL;
-            }
-    if (m_child_count > 0)
-        delete [] m_children;
+    it = m_child_index.find(name);
+    return((it == m_child_index.end()) ? -1 : it->second);
+}
+
+
+long        C_XML_Element::Find_Attribute(const T_Glyph * name) const
+{
+    T_XML_Name_Index::const_iterator    it;
+
+    it = m_attrib_index.find(name);
+    return((it == m_attrib_index.end()) ? -1 : it->second);
 }
 
 
@@ -216,9 +316,9 @@ if (parser->Is_Debug()) Debug_Printf("%.*s%s\n",parser->Get_Depth()*2,BLANKS,x_S
         NOTE! This is a special case to allow arbitrary, non-verified sub-trees
                 in an otherwise strictly verified tree.
     */
-    old_is_ignore = contents->Is_Ignore();
+    old_is_ignore = contents->Get_Ignore_Override();
     if ((m_attrib_count == -1) && (m_child_count == -1))
-        contents->Ignore_Unknowns(true);
+        contents->Set_Ignore_Override(true);
 
     /* look for any attributes; if we get an attribute we don't expect, either
         bail out or ignore it, depending on our configuration
@@ -257,30 +357,29 @@ if (parser->Is_Debug()) Debug_Printf("%.*s%s\n",parser->Get_Depth()*2,BLANKS,x_S
             NOTE! If the attribute is marked as omitted, we just ignore it.
         */
         name = parser->Get_Token();
-        for (index = 0; index < m_attrib_count; index++)
-            if (!m_attrib_list[index].is_omit &&
-                (strcmp(name,m_attrib_list[index].name) == 0)) {
-
-                /* verify that the attribute is not duplicated and mark it found
-                */
-                if (x_Trap_Opt(contents->m_is_attrib[index])) {
-                    String_Printf(buffer,x_Internal_String(STRING_ATTRIBUTE_REPEATED),name,m_name.c_str());
-                    errval = -110;
-                    goto error_exit;
-                    }
-                contents->m_is_attrib[index] = true;
+        index = Find_Attribute(name);
+        if ((index >= 0) && m_attrib_list[index].is_omit)
+            index = -1;
+        if (index >= 0) {
 
-                /* extract the new value and save it
-                */
-                parser->Parse_Assignment();
-                contents->Set_Attribute(index,parser->Get_Token());
-                break;
+            /* verify that the attribute is not duplicated
+            */
+            if (x_Trap_Opt(contents->Is_Attribute_Set(index))) {
+                String_Printf(buffer,x_Internal_String(STRING_ATTRIBUTE_REPEATED),name,m_name.c_str());
+                errval = -110;
+                goto error_exit;
                 }
 
+            /* extract the new value and save it, which marks it found
+            */
+            parser->Parse_Assignment();
+            contents->Set_Attribute(index,parser->Get_Token());
+            }
+
         /* if we did not match anything, it's a problem (unless we are ignoring
             unrecognized tags and attributes)
         */
-        if (index >= m_attrib_count)
+        if (index < 0)
             if (C_XML_Contents::Is_Ignore()) {
                 strcpy(buffer,name);
                 parser->Parse_Assignment();
@@ -338,7 +437,7 @@ Debug_Printf("%.*s*%s = %s (UNKNOWN)\n",(parser->Get_Depth()+1)*2,BLANKS,buffer,
     ptr = temp;
     for (i = 0; i < m_attrib_count; i++)
         if (x_Trap_Opt(((m_attrib_list[i].nature == e_xml_required) || (m_attrib_list[i].nature == e_xml_fixed)) &&
-                       !contents->m_is_attrib[i])) {
+                       !contents->Is_Attribute_Set(i))) {
             sprintf(ptr, "%s'%s'", (is_valid ? "" : ", "), m_attrib_list[i].name);
             ptr += strlen(ptr);
             is_valid = false;
@@ -398,7 +497,7 @@ Debug_Printf("%.*s*%s = %s\n",(parser->Get_Depth()+1)*2,BLANKS,m_attrib_list[i].
     /* ascend a level of depth in the parse and we're done
     */
 finished:
-    contents->Ignore_Unknowns(old_is_ignore);
+    contents->Set_Ignore_Override(old_is_ignore);
 if (parser->Is_Debug()) Debug_Printf("%.*s/%s\n",parser->Get_Depth()*2,BLANKS,x_String(m_name));
     parser->Ascend();
     return;
@@ -406,7 +505,7 @@ if (parser->Is_Debug()) Debug_Printf("%.*s/%s\n",parser->Get_Depth()*2,BLANKS,x_
     /* trap an error, cleanup, and we're out of here
     */
 error_exit:
-    contents->Ignore_Unknowns(old_is_ignore);
+    contents->Set_Ignore_Override(old_is_ignore);
     Set_Error(buffer);
     x_Exception(errval);
 }
@@ -527,14 +626,13 @@ if (parser->Is_Debug()) Debug_Printf("%.*s PCDATA:%s\n",parser->Get_Depth()*2,BL
             /* this is the name of a tag, so look for a match among the children
                 NOTE! If the element is marked as omitted, we just ignore it.
             */
-            for (i = 0; i < m_child_count; i++)
-                if (!m_children[i].elem_info->is_omit &&
-                    (strcmp(parser->Get_Token(),m_children[i].element->Get_Name()) == 0))
-                    break;
+            i = Find_Child(parser->Get_Token());
+            if ((i >= 0) && m_children[i].elem_info->is_omit)
+                i = -1;
 
             /* if we failed to match anything, handle it appropriately
             */
-            if (i >= m_child_count) {
+            if (i < 0) {
                 if (C_XML_Contents::Is_Ignore())
                     Parse_Unknown_Tag(parser);
                 else {
@@ -822,28 +920,6 @@ if (parser->Is_Debug()) Debug_Printf("%.*s/%s\n",parser->Get_Depth()*2,BLANKS,x_
 }
 
 
-long        C_XML_Element::Get_Maximum_Attributes(long depth)
-{
-    long    i,count,child;
-
-    /* if we've exceeded our maximum depth, assume recursion and bail out
-    */
-    if (depth >= 25)
-        return(0);
-
-    /* determine the maximum number of attributes for this and all children
-    */
-    count = m_attrib_count;
-    for (i = 0; i < m_child_count; i++) {
-        child = Get_Child_Element(i)->Get_Maximum_Attributes(depth + 1);
-        if (child > count)
-            count = child;
-        }
-
-    return(count);
-}
-
-
 void        XML_Enable_Unknown_Trace(bool is_enable)
 {
     l_is_unknown_trace = is_enable;
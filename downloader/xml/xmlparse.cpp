@@ -38,13 +38,7 @@
 #define RAW_GROW            10000
 
 
-/*  declare static member variables used below
-*/
-T_Glyph *       C_XML_Parser::s_errors = NULL;
-long            C_XML_Parser::s_line = 0;
-
-
-/*  declare other static variables
+/*  declare static variables used below
 */
 T_Glyph *       l_encoding_types[] = { XML_ENCODING_ISO_8859_1 , XML_ENCODING_UTF_8 };
 
@@ -57,6 +51,7 @@ C_XML_Parser::C_XML_Parser(void)
 
     /* Initialize members
     */
+    m_context = XML_Get_Context();
     m_text = "";
     m_pos = 0;
     m_raw_text = (T_Glyph *) malloc(RAW_START);
@@ -249,7 +244,7 @@ T_Glyph C_XML_Parser::Next_Glyph(void)
     m_pos++;
 
     if (glyph == '\n')
-        s_line++;
+        m_context->line++;
     if (m_raw_pos >= m_raw_size)
         Grow_Raw_Text();
     m_raw_text[m_raw_pos++] = glyph;
@@ -266,7 +261,7 @@ T_Glyph C_XML_Parser::Peek_Glyph(void)
 void    C_XML_Parser::Unget_Glyph(const T_Glyph glyph)
 {
     if (glyph == '\n')
-        s_line--;
+        m_context->line--;
     m_pos--;
     m_raw_pos--;
 }
@@ -822,9 +817,9 @@ C_XML_Root *    C_XML_Parser::Parse_Document(C_XML_Element * document,
 if (is_debug) Debug_Printf("\nParsing Document:\n");
     /* reset our error message
     */
-    x_Assert_Opt(s_errors != NULL);
-    *s_errors = '\0';
-    s_line = 1;
+    m_context = XML_Get_Context();
+    *m_context->errors = '\0';
+    m_context->line = 1;
 
     /* initialize everything for the parse
     */
@@ -944,9 +939,9 @@ C_XML_Root *    C_XML_Parser::Parse_Element(C_XML_Element * document,
 
     /* reset our error message
     */
-    x_Assert_Opt(s_errors != NULL);
-    *s_errors = '\0';
-    s_line = 1;
+    m_context = XML_Get_Context();
+    *m_context->errors = '\0';
+    m_context->line = 1;
 
     /* initialize everything for the parse
     */
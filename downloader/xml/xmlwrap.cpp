@@ -33,6 +33,10 @@
 
 #include    "private.h"
 
+#ifndef _WIN32
+#include    <pthread.h>
+#endif
+
 
 /*  define the private structure of an XML document
 */
@@ -42,27 +46,146 @@ typedef struct T_XML_Document_ {
     }   T_XML_Document_Body, * T_XML_Document;
 
 
-/*  declare a buffer for reporting errors into
+/*  define the error state kept for each thread - the default context reports
+    into its own buffer (or the one given to XML_Set_Error_Buffer) and holds
+    the results of the last parse on the thread, while the current context is
+    whichever context is in use right now
+*/
+typedef struct T_XML_Thread_ {
+    T_XML_Context       shim;
+    T_XML_Context *     current;
+    T_Glyph             buffer[XML_ERROR_BUFFER_SIZE];
+    }   T_XML_Thread;
+
+
+/*  Retrieve the state for the calling thread, setting it up the first time the
+    thread uses the XML engine
+*/
+#ifdef  _WIN32
+static  __declspec(thread)  T_XML_Thread    l_thread;
+
+static  T_XML_Thread *  Get_Thread(void)
+{
+    if (l_thread.current == NULL) {
+        l_thread.shim.errors = l_thread.buffer;
+        l_thread.shim.size = XML_ERROR_BUFFER_SIZE;
+        l_thread.current = &l_thread.shim;
+        }
+    return(&l_thread);
+}
+#else
+static  pthread_key_t   l_thread_key;
+static  pthread_once_t  l_thread_once = PTHREAD_ONCE_INIT;
+
+static  void            Create_Thread_Key(void)
+{
+    pthread_key_create(&l_thread_key, free);
+}
+
+static  T_XML_Thread *  Get_Thread(void)
+{
+    T_XML_Thread *      thread;
+
+    pthread_once(&l_thread_once, Create_Thread_Key);
+    thread = (T_XML_Thread *) pthread_getspecific(l_thread_key);
+    if (thread == NULL) {
+        thread = (T_XML_Thread *) calloc(1, sizeof(T_XML_Thread));
+        if (thread == NULL)
+            x_Exception(-1234);
+        thread->shim.errors = thread->buffer;
+        thread->shim.size = XML_ERROR_BUFFER_SIZE;
+        thread->current = &thread->shim;
+        pthread_setspecific(l_thread_key, thread);
+        }
+    return(thread);
+}
+#endif
+
+
+/*  Retrieve the current context for the calling thread
+*/
+T_XML_Context *     XML_Get_Context(void)
+{
+    return(Get_Thread()->current);
+}
+
+
+/*  Make the given context current for the calling thread, returning the one
+    that was current before; NULL restores the thread's default context
+*/
+T_XML_Context *     XML_Set_Context(T_XML_Context * context)
+{
+    T_XML_Thread *      thread;
+    T_XML_Context *     previous;
+
+    thread = Get_Thread();
+    previous = thread->current;
+    thread->current = (context != NULL) ? context : &thread->shim;
+    return(previous);
+}
+
+
+/*  define the function to call whenever the children of a node are searched
+    by name - it's only called if the engine is built with _PROFILE defined
+*/
+static  void            (* l_lookup_hook)(void) = NULL;
+
+#ifdef  _PROFILE
+#define x_Count_Lookup()    { if (l_lookup_hook != NULL) l_lookup_hook(); }
+#else
+#define x_Count_Lookup()
+#endif
+
+
+/*  Reset the default context for the calling thread, ready for a new parse
 */
-static  T_Glyph     l_error_buffer[256];
-static  T_Glyph *   l_errors = l_error_buffer;
-static  long        l_line = 0;
+static  T_XML_Context * Reset_Errors(void)
+{
+    T_XML_Context *     shim;
+
+    shim = &Get_Thread()->shim;
+    *shim->errors = '\0';
+    shim->line = 0;
+    return(shim);
+}
+
+
+/*  Report a failure to read or write the named file into the current context
+*/
+static  void        Report_File_Error(long string_id,const T_Glyph * filename)
+{
+    T_Glyph_Ptr         format;
+    T_Glyph *           buffer;
+
+    format = x_Internal_String(string_id);
+    buffer = new T_Glyph[strlen(format) + strlen(filename) + 1];
+    String_Printf(buffer,format,filename);
+    XML_Store_Error(XML_Get_Context(),buffer);
+    delete [] buffer;
+}
 
 
-/*  read the contents of a text file into memory as one large string
+/*  read the contents of a text file into memory as one large string - the
+    string is sized to the file up front and read straight into, rather than
+    going through a buffer. Line endings may be translated as it's read, so
+    the string is trimmed to what we actually got.
 */
 static  C_String Read_File(const T_Glyph * filename)
 {
     C_String        contents;
     std::ifstream   input(filename);
-    T_Glyph         buffer[100000];
+    std::streamoff  size;
 
     if (!input.good())
         x_Exception(-999);
 
-    while (!input.eof()) {
-        input.read(buffer,sizeof(buffer));
-        contents.append(buffer,(T_Int32U) input.gcount());
+    input.seekg(0,std::ios::end);
+    size = input.tellg();
+    input.seekg(0,std::ios::beg);
+    if (size > 0) {
+        contents.resize((size_t) size);
+        input.read(&contents[0],size);
+        contents.resize((size_t) input.gcount());
         }
 
     return(contents);
@@ -72,7 +195,7 @@ static  C_String Read_File(const T_Glyph * filename)
 /*  Parse the XML data within "text" into the provided document, using the XML
     structure defined within "root".
 */
-static  long        Load_XML(T_XML_Document * document,T_XML_Element * root,
+static  long        Parse_XML(T_XML_Document * document,T_XML_Element * root,
                                 C_String& text,bool is_dynamic,bool is_warnings)
 {
     C_XML_Element * element;
@@ -84,15 +207,17 @@ static  long        Load_XML(T_XML_Document * document,T_XML_Element * root,
     */
     parser = new C_XML_Parser;
     if (x_Trap_Opt(parser == NULL)) {
-        strcpy(l_errors,x_Internal_String(STRING_UNEXPECTED_ERROR));
+        XML_Report_Error(x_Internal_String(STRING_UNEXPECTED_ERROR));
         return(-2);
         }
 
-    /* create the element hierarchy for the DTD, starting with the given root
+    /* retrieve the shared element hierarchy for the DTD, starting with the
+        given root
     */
-    element = new C_XML_Element(root);
+    element = C_XML_Element::Get_Graph(root);
     if (x_Trap_Opt(element == NULL)) {
-        strcpy(l_errors,x_Internal_String(STRING_UNEXPECTED_ERROR));
+        XML_Report_Error(x_Internal_String(STRING_UNEXPECTED_ERROR));
+        delete parser;
         return(-3);
         }
 
@@ -103,12 +228,9 @@ static  long        Load_XML(T_XML_Document * document,T_XML_Element * root,
         contents = parser->Parse_Document(element,text,is_dynamic,false);
         }
     catch (C_Exception& exception) {
-        if (*l_errors == '\0')
-            strcpy(l_errors,x_Internal_String(STRING_UNSPECIFIED_ERROR));
-        l_line = C_XML_Parser::Get_Line();
+        XML_Report_Error(x_Internal_String(STRING_UNSPECIFIED_ERROR));
         retval = exception.Get_Error();
         delete parser;
-        delete element;
         return(retval);
         }
 
@@ -117,7 +239,7 @@ static  long        Load_XML(T_XML_Document * document,T_XML_Element * root,
     */
     retval = 0;
     if (!contents->Is_Encoding_OK()) {
-        strcpy(l_errors, x_Internal_String(STRING_BAD_CHARACTER_ENCODING));
+        XML_Store_Error(XML_Get_Context(), x_Internal_String(STRING_BAD_CHARACTER_ENCODING));
         retval = 100;
         }
 
@@ -127,7 +249,6 @@ static  long        Load_XML(T_XML_Document * document,T_XML_Element * root,
     if (!is_warnings && (retval > 0)) {
         delete parser;
         delete contents;
-        delete element;
         return(retval);
         }
 
@@ -135,10 +256,9 @@ static  long        Load_XML(T_XML_Document * document,T_XML_Element * root,
     */
     *document = new T_XML_Document_Body;
     if (x_Trap_Opt(*document == NULL)) {
-        strcpy(l_errors,x_Internal_String(STRING_UNEXPECTED_ERROR));
+        XML_Report_Error(x_Internal_String(STRING_UNEXPECTED_ERROR));
         delete parser;
         delete contents;
-        delete element;
         return(-4);
         }
     (*document)->contents = contents;
@@ -151,6 +271,36 @@ static  long        Load_XML(T_XML_Document * document,T_XML_Element * root,
 }
 
 
+/*  Parse the XML data within "text" into the provided document, using the XML
+    structure defined within "root". The parse gets a context of its own, and
+    any error is copied back to the calling thread's default context afterwards
+    so that XML_Get_Error and XML_Get_Line report it.
+*/
+static  long        Load_XML(T_XML_Document * document,T_XML_Element * root,
+                                C_String& text,bool is_dynamic,bool is_warnings)
+{
+    T_XML_Context       context;
+    T_XML_Context *     previous;
+    T_Glyph             errors[XML_ERROR_BUFFER_SIZE];
+    long                retval;
+
+    errors[0] = '\0';
+    context.errors = errors;
+    context.size = XML_ERROR_BUFFER_SIZE;
+    context.line = 0;
+    context.is_ignore = false;
+    previous = XML_Set_Context(&context);
+    retval = Parse_XML(document,root,text,is_dynamic,is_warnings);
+    XML_Set_Context(previous);
+
+    if (errors[0] != '\0')
+        XML_Store_Error(previous,errors);
+    if (retval < 0)
+        previous->line = context.line;
+    return(retval);
+}
+
+
 /* Output everything at the start of an xml dtd
 */
 static long         Start_DTD(C_Napkin * output)
@@ -399,8 +549,7 @@ long        XML_Extract_Document(T_XML_Document * document,T_XML_Element * root,
 
     /* reset our error buffer to empty
     */
-    *l_errors = '\0';
-    l_line = 0;
+    Reset_Errors();
 
     /* convert the buffer into an STL string so we can parse it
     */
@@ -444,8 +593,7 @@ long        XML_Read_Document(T_XML_Document * document,T_XML_Element * root,
 
     /* reset our error buffer to empty
     */
-    *l_errors = '\0';
-    l_line = 0;
+    Reset_Errors();
 
     /* read the file into memory so we can parse it
     */
@@ -454,7 +602,7 @@ long        XML_Read_Document(T_XML_Document * document,T_XML_Element * root,
         }
     catch (...) {
         x_Break_Opt();
-        String_Printf(l_errors,x_Internal_String(STRING_FILE_READ_ERROR),filename);
+        Report_File_Error(STRING_FILE_READ_ERROR,filename);
         return(-1);
         }
 
@@ -474,39 +622,69 @@ long        XML_Read_Document(T_XML_Document * document,T_XML_Element * root,
     ensures that document object is complete and fully compliant with respect to
     the hierarchy definition specified when the document was created.
 
+    If no filename is given, nothing is written at all - the document is just
+    validated and rendered, so its hash can be compared with a previous one.
+    If the document can't be written out in full, the file is deleted rather
+    than being left half written, so callers that need to keep the previous
+    contents should write to a temporary file and rename it into place.
+
     document    --> XML document object to be written out to the file
-    filename    --> filename to create and write the XML contents out to
+    filename    --> filename to create and write the XML contents out to, or
+                    NULL to only compute the hash
     is_detailed --> whether to output attributes that match the default value
     is_blanks   --> whether to add appropriate blanks at the start of lines
+    hash        <-- (optional) 64-bit hash of the text written to the file
     return      <-- whether the document was written successfully (0 = Success)
 **************************************************************************** */
 
 long        XML_Write_Document(T_XML_Document document,const T_Glyph * filename,
-                                bool is_detailed, bool is_blanks)
+                                bool is_detailed, bool is_blanks,
+                                T_XML_Hash * hash)
 {
-    C_String            text;
+    long                result;
     C_XML_Contents *    contents;
+    C_XML_Writer        writer;
 
-    /* synthesize the complete text stream for the document
+    /* validate the document before we touch the file, so that an invalid
+        document leaves any existing file alone
     */
     contents = (C_XML_Contents *) document->contents;
     try {
-        text = contents->Synthesize_Output(is_detailed, is_blanks);
+        result = contents->Validate();
         }
     catch (...) {
+        result = -2;
+        }
+    if (result != 0) {
         x_Break_Opt();
         return(-2);
         }
 
-    /* try to write the stream out to the file specified
+    /* stream the document straight out to the file specified, rather than
+        building the whole thing in memory first
     */
+    if ((filename != NULL) && !writer.Open(filename)) {
+        x_Break_Opt();
+        return(-1);
+        }
     try {
-        Quick_Write_Text((T_Glyph_Ptr) filename,(T_Glyph_Ptr) text.c_str());
+        contents->Render_Output(&writer, is_detailed, is_blanks);
         }
     catch (...) {
         x_Break_Opt();
+        writer.Close();
+        if (filename != NULL)
+            remove(filename);
+        return(-2);
+        }
+    if (!writer.Close()) {
+        x_Break_Opt();
+        if (filename != NULL)
+            remove(filename);
         return(-1);
         }
+    if (hash != NULL)
+        *hash = writer.Get_Hash();
     return(0);
 }
 
@@ -535,9 +713,11 @@ long        XML_Create_Document(T_XML_Document * document,T_XML_Element * root,
     C_XML_Root *    contents;
     long            result;
 
-    /* create the element hierarchy for the DTD, starting with the given root
+    /* retrieve the shared element hierarchy for the DTD, starting with the
+        given root
     */
-    element = new C_XML_Element(root);
+    contents = NULL;
+    element = C_XML_Element::Get_Graph(root);
     if (x_Trap_Opt(element == NULL)) {
         result = -3;
         goto error_exit;
@@ -568,8 +748,6 @@ long        XML_Create_Document(T_XML_Document * document,T_XML_Element * root,
     /* cleanup after an error
     */
 error_exit:
-    if (element != NULL)
-        delete element;
     if (contents != NULL)
         delete contents;
     return(result);
@@ -589,12 +767,11 @@ error_exit:
 
 void        XML_Destroy_Document(T_XML_Document document)
 {
-    /* dispose of the document contents and root element objects
+    /* dispose of the document contents; the root element belongs to the
+        shared DTD graph, so we leave it alone
     */
-    if (document->contents != NULL) {
+    if (document->contents != NULL)
         delete document->contents;
-        delete document->root;
-        }
 
     /* dispose of the document itself
     */
@@ -728,7 +905,8 @@ long        XML_Get_Child_Count(T_XML_Node node)
     Note! Each node maintains a single "next" indicator. Any time that one of
     the "Get_First" functions is invoked, that "next" indicator is reset based
     on the function called and all subsequent calls will utilize the updated
-    "next" position.
+    "next" position. To run nested or concurrent iterations over the same node,
+    use XML_Cursor_First and XML_Cursor_Next instead.
 
     node        --> node to retrieve the first child of
     child       <-- first child node of the given parent
@@ -784,6 +962,7 @@ long        XML_Get_Named_Child_Count(T_XML_Node node,const T_Glyph * name)
 {
     C_XML_Contents *    contents;
 
+    x_Count_Lookup();
     contents = (C_XML_Contents *) node;
     return(contents->Get_Named_Child_Count(name));
 }
@@ -794,9 +973,10 @@ long        XML_Get_Named_Child_Count(T_XML_Node node,const T_Glyph * name)
 
     This function works the same as XML_Get_First_Child, except that the set of
     children retrieved is restricted to those possessing the specified name.
-    Once this function is called, the given name is cached internally, so it
-    does not need to be provided in subsequent calls to the function
-    XML_Get_Next_Named_Child.
+    Once this function is called, the given name is remembered internally, so
+    it does not need to be provided in subsequent calls to the function
+    XML_Get_Next_Named_Child. The name is not copied, so it must remain valid
+    until the iteration is finished.
 
     node        --> node to retrieve the first child of
     name        --> name to restrict the search to
@@ -809,6 +989,7 @@ long        XML_Get_First_Named_Child(T_XML_Node node,const T_Glyph * name,
 {
     C_XML_Contents *    contents;
 
+    x_Count_Lookup();
     contents = (C_XML_Contents *) node;
     *child = (T_XML_Node) contents->Get_First_Named_Child(name);
     return((*child == NULL) ? -1 : 0);
@@ -857,6 +1038,7 @@ long        XML_Get_Named_Child_With_Attr_Count(T_XML_Node node,const T_Glyph *
 {
     C_XML_Contents *    contents;
 
+    x_Count_Lookup();
     contents = (C_XML_Contents *) node;
     return(contents->Get_Named_Child_With_Attr_Count(name, attr_name, attr_value));
 }
@@ -868,8 +1050,9 @@ long        XML_Get_Named_Child_With_Attr_Count(T_XML_Node node,const T_Glyph *
     This function works the same as XML_Get_First_Named_Child, except that the
     set of children retrieved is restricted to those possessing a named attribute
     with the specified value. Once this function is called, the given attribute
-    and value are cached internally, so it does not need to be provided in
-    subsequent calls to the function XML_Get_Next_Named_Child_With_Attr.
+    and value are remembered internally, so they do not need to be provided in
+    subsequent calls to the function XML_Get_Next_Named_Child_With_Attr. As with
+    XML_Get_First_Named_Child, the strings are not copied.
 
     node        --> node to retrieve the first child of
     name        --> name of element to restrict the search to
@@ -885,6 +1068,7 @@ long        XML_Get_First_Named_Child_With_Attr(T_XML_Node node,const T_Glyph *
 {
     C_XML_Contents *    contents;
 
+    x_Count_Lookup();
     contents = (C_XML_Contents *) node;
     *child = (T_XML_Node) contents->Get_First_Named_Child_With_Attr(name, attr_name, attr_value);
     return((*child == NULL) ? -1 : 0);
@@ -915,6 +1099,63 @@ long        XML_Get_Next_Named_Child_With_Attr(T_XML_Node node,T_XML_Node * chil
 }
 
 
+/* ***************************************************************************
+    XML_Cursor_First
+
+    Set up a cursor to iterate through the children of a node and retrieve the
+    first matching child. If a name is given, only children with that name are
+    retrieved; if an attribute name is also given, only children whose value
+    for that attribute matches are retrieved. Unlike XML_Get_First_Child and
+    its relatives, no state is kept in the node, so iterations using separate
+    cursors can be nested or run concurrently on a document that is not being
+    modified.
+
+    cursor      <-- cursor to set up for subsequent XML_Cursor_Next calls
+    node        --> node to retrieve the first child of
+    child       <-- first matching child node of the given parent
+    name        --> name to restrict the search to (NULL = any)
+    attr_name   --> name of attribute to restrict the search to (NULL = any)
+    attr_value  --> value of attribute to restrict the search to
+    return      <-- whether the operation was successful (0 = Success)
+**************************************************************************** */
+
+long        XML_Cursor_First(T_XML_Cursor * cursor,T_XML_Node node,T_XML_Node * child,
+                                        const T_Glyph * name,const T_Glyph * attr_name,
+                                        const T_Glyph * attr_value)
+{
+    if (x_Trap_Opt((attr_name != NULL) && (attr_value == NULL)))
+        return(-1);
+
+    cursor->parent = node;
+    cursor->position = -1;
+    cursor->name = name;
+    cursor->attr_name = attr_name;
+    cursor->attr_value = attr_value;
+    return(XML_Cursor_Next(cursor,child));
+}
+
+
+/* ***************************************************************************
+    XML_Cursor_Next
+
+    Advance a cursor established by XML_Cursor_First to the next matching
+    child.
+
+    cursor      <-> cursor to advance
+    child       <-- next matching child node
+    return      <-- whether the operation was successful (0 = Success)
+**************************************************************************** */
+
+long        XML_Cursor_Next(T_XML_Cursor * cursor,T_XML_Node * child)
+{
+    C_XML_Contents *    contents;
+
+    contents = (C_XML_Contents *) cursor->parent;
+    *child = (T_XML_Node) contents->Get_Cursor_Child(cursor);
+    return((*child == NULL) ? -1 : 0);
+}
+
+
 /* ***************************************************************************
     XML_Get_Name
 
@@ -1165,6 +1406,26 @@ const T_Glyph * XML_Get_Attribute_Pointer(T_XML_Node node,const T_Glyph * name,b
 }
 
 
+/* ***************************************************************************
+    XML_Is_Attribute_Set
+
+    Determine whether the named attribute has been set explicitly within the
+    node, even if only to an empty string, rather than just taking its default.
+
+    node        --> node to check the attribute of
+    name        --> name of the attribute to check
+    return      <-- whether the attribute has been set within the node
+**************************************************************************** */
+
+bool        XML_Is_Attribute_Set(T_XML_Node node,const T_Glyph * name)
+{
+    C_XML_Contents *    contents;
+
+    contents = (C_XML_Contents *) node;
+    return(contents->Is_Attribute_Set(name));
+}
+
+
 /* ***************************************************************************
     XML_Set_Attribute
 
@@ -1318,6 +1579,32 @@ long        XML_Delete_Named_Children(T_XML_Node node, const T_Glyph * name)
 }
 
 
+/* ***************************************************************************
+    XML_Delete_Children
+
+    Deletes all of the given children of a node in a single pass over its
+    children, rather than searching for and removing each one in turn. This
+    makes it possible to pick out the children to delete while looking through
+    the node, then delete them all at the end. Any nodes in the list that aren't
+    children of the node are ignored.
+
+    node        --> node to look at
+    children    --> list of child nodes to delete
+    count       --> number of nodes in the list
+    return      <-- whether the operation was successful (0 = Success)
+**************************************************************************** */
+
+long        XML_Delete_Children(T_XML_Node node, T_XML_Node * children, long count)
+{
+    C_XML_Contents *    contents;
+    long                result;
+
+    contents = (C_XML_Contents *) node;
+    result = contents->Destroy_Children((C_XML_Contents **) children, count);
+    return(result);
+}
+
+
 /* ***************************************************************************
     XML_Delete_Named_Children_With_Attr
 
@@ -1378,18 +1665,45 @@ void        XML_Handle_Unknowns(bool is_ignore)
     XML_Set_Error_Buffer
 
     Configure the XML engine to use the specified buffer as the buffer in which
-    all error messages are written. The caller must ensure that the buffer is
-    large enough. If NULL is specified, an internal buffer is used instead.
+    all error messages for the calling thread are written. Messages longer than
+    the buffer are truncated. If NULL is specified, an internal buffer is used
+    instead.
 
     buffer      --> buffer to write all error messages into
+    size        --> size of the buffer, including room for the terminator
 **************************************************************************** */
 
-void        XML_Set_Error_Buffer(T_Glyph * buffer)
+void        XML_Set_Error_Buffer(T_Glyph * buffer,long size)
 {
-    l_errors = (buffer != NULL) ? buffer : l_error_buffer;
-    C_XML_Parser::Set_Error_Buffer(l_errors);
-    C_XML_Element::Set_Error_Buffer(l_errors);
-    C_XML_Contents::Set_Error_Buffer(l_errors);
+    T_XML_Thread *      thread;
+
+    thread = Get_Thread();
+    if ((buffer != NULL) && (size > 0)) {
+        thread->shim.errors = buffer;
+        thread->shim.size = size;
+        }
+    else {
+        thread->shim.errors = thread->buffer;
+        thread->shim.size = XML_ERROR_BUFFER_SIZE;
+        }
+}
+
+
+/* ***************************************************************************
+    XML_Set_Lookup_Hook
+
+    Specify a function to be called each time the children of a node are
+    searched by name, so the caller can count how many searches are made. The
+    function may be called on any thread. It's only called if the engine is
+    built with _PROFILE defined. This should be called before any other thread
+    uses the XML engine.
+
+    hook        --> function to call, or NULL for none
+**************************************************************************** */
+
+void        XML_Set_Lookup_Hook(void (* hook)(void))
+{
+    l_lookup_hook = hook;
 }
 
 
@@ -1404,36 +1718,37 @@ void        XML_Set_Error_Buffer(T_Glyph * buffer)
 
 void        XML_Set_Error(T_Glyph * msg)
 {
-    if (*l_errors == '\0')
-        strcpy(l_errors,msg);
+    XML_Report_Error(msg);
 }
 
 
 /* ***************************************************************************
     XML_Get_Error
 
-    Retrieve the last error message that was reported by the XML engine.
+    Retrieve the last error message that was reported by the XML engine on the
+    calling thread.
 
     return      --> latest error message
 **************************************************************************** */
 
 const T_Glyph * XML_Get_Error(void)
 {
-    return(l_errors);
+    return(XML_Get_Context()->errors);
 }
 
 
 /* ***************************************************************************
     XML_Get_Line
 
-    Retrieve the line number on which the last reported error occurred.
+    Retrieve the line number on which the last reported error on the calling
+    thread occurred.
 
     return      <-- line number on which latest error occurred
 **************************************************************************** */
 
 long        XML_Get_Line(void)
 {
-    return(l_line);
+    return(XML_Get_Context()->line);
 }
 
 
@@ -1527,7 +1842,7 @@ long        XML_Write_DTD(T_Glyph * filename, T_XML_Element * root, bool is_html
         }
     catch (...) {
         x_Break_Opt();
-        String_Printf(l_errors,x_Internal_String(STRING_FILE_WRITE_ERROR),filename);
+        Report_File_Error(STRING_FILE_WRITE_ERROR,filename);
         result = -32;
         }
     return(result);
@@ -1626,4 +1941,35 @@ long        XML_Get_Hierarchy(T_Glyph_Ptr buffer, T_XML_Node node, bool is_skip_
 
     contents = (C_XML_Contents *) node;
     return(contents->Get_Hierarchy(buffer, is_skip_top));
-}
\ No newline at end of file
+}
+
+
+/* ***************************************************************************
+    XML_Get_Memory_Report
+
+    Report on the memory used to hold the attributes of every node in the
+    document. For comparison, the report also gives the memory the same nodes
+    would use if each held a slot for every attribute in the DTD, as they did
+    before attribute storage became sparse.
+
+    document    --> XML document to report on
+    report      <-- memory used by the document's attributes
+    return      <-- whether the operation was successful (0 = Success)
+**************************************************************************** */
+
+long        XML_Get_Memory_Report(T_XML_Document document,T_XML_Memory_Report * report)
+{
+    long        slot;
+
+    if (x_Trap_Opt((document == NULL) || (report == NULL)))
+        return(-1);
+
+    memset(report,0,sizeof(T_XML_Memory_Report));
+    document->contents->Report_Memory(report);
+
+    slot = sizeof(bool) + sizeof(T_Glyph *);
+    if (document->contents->Is_Dynamic())
+        slot += sizeof(C_Dyna_Text);
+    report->dense_bytes = report->node_count * document->root->Get_Maximum_Attributes() * slot;
+    return(0);
+}
@@ -0,0 +1,275 @@
+/*  FILE:   XMLWRITE.CPP
+
+    Copyright (c) 2012 by Lone Wolf Development.  All rights reserved.
+
+    This code is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation; either version 2 of the License, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+    more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+    Place, Suite 330, Boston, MA 02111-1307 USA
+
+    You can find more information about this project here:
+
+    http://code.google.com/p/ddidownloader/
+
+    This file includes:
+
+    Implementation of the buffered writer used to render XML documents.
+*/
+
+
+#include    "private.h"
+
+
+/*  define constants used below
+*/
+#define WRITER_BUFFER_SIZE  65536
+#define BLANKS              "                                        "
+#define INDENT_PER_LEVEL    2
+
+
+/*  declare a table giving the entity that each character must be written as
+    within an attribute value, or NULL if it can be written as is; the table
+    is filled in when the program starts
+    NOTE! The null terminator has an entity of "", so that a scan for the next
+            character needing an entity always stops at the end of the text.
+*/
+class   C_XML_Escapes
+{
+public:
+    C_XML_Escapes(void);
+
+    inline  const T_Glyph * Get(T_Glyph ch) const
+                                { return(m_entity[(T_Int8U) ch]); }
+
+private:
+    const T_Glyph *     m_entity[256];
+    T_Glyph             m_high[128][7];
+};
+
+
+C_XML_Escapes::C_XML_Escapes(void)
+{
+    long        i;
+
+    for (i = 0; i < 128; i++)
+        m_entity[i] = NULL;
+    m_entity['\0'] = "";
+    m_entity['<'] = "&lt;";
+    m_entity['>'] = "&gt;";
+    m_entity['&'] = "&amp;";
+    m_entity['\"'] = "&quot;";
+    m_entity['\''] = "&apos;";
+    for (i = 128; i < 256; i++) {
+        sprintf(m_high[i - 128],"&#%ld;",i);
+        m_entity[i] = m_high[i - 128];
+        }
+}
+
+
+static  C_XML_Escapes   l_escapes;
+
+
+/*  Return whether the character starts a run of whitespace that must be
+    wrapped in a CDATA block within PCDATA
+*/
+static  inline  bool    Is_Whitespace_Run(T_Glyph ch,const T_Glyph * next)
+{
+    return((ch == '\n') || (ch == '\t') || ((ch == ' ') && (*next == ' ')));
+}
+
+
+C_XML_Writer::C_XML_Writer(void)
+{
+    m_file = NULL;
+    m_napkin = NULL;
+    m_is_error = false;
+    m_hash = XML_HASH_BASIS;
+    m_buffer = (T_Glyph *) malloc(WRITER_BUFFER_SIZE + 1);
+    if (m_buffer == NULL)
+        x_Exception(-1000);
+    m_ptr = m_buffer;
+    m_end = m_buffer + WRITER_BUFFER_SIZE;
+}
+
+
+C_XML_Writer::~C_XML_Writer()
+{
+    if (m_file != NULL)
+        fclose(m_file);
+    free(m_buffer);
+}
+
+
+/*  Write to the given file. The file is opened in text mode, so line endings
+    are translated just as they were when the whole document was written with
+    an ofstream.
+*/
+bool        C_XML_Writer::Open(const T_Glyph * filename)
+{
+    m_file = fopen(filename,"w");
+    return(m_file != NULL);
+}
+
+
+/*  Write into the given napkin instead of a file
+*/
+void        C_XML_Writer::Open(C_Napkin * napkin)
+{
+    m_napkin = napkin;
+}
+
+
+/*  Flush everything out and close the file, returning whether everything was
+    written successfully
+*/
+bool        C_XML_Writer::Close(void)
+{
+    Flush();
+    if (m_file != NULL) {
+        if (fclose(m_file) != 0)
+            m_is_error = true;
+        m_file = NULL;
+        }
+    return(!m_is_error);
+}
+
+
+/*  Write out everything in the buffer, adding it to our hash on the way
+*/
+void        C_XML_Writer::Flush(void)
+{
+    size_t      length;
+
+    length = m_ptr - m_buffer;
+    m_ptr = m_buffer;
+    if (length == 0)
+        return;
+    m_hash = XML_Hash_Bytes(m_buffer,length,m_hash);
+    if (m_file != NULL) {
+        if (fwrite(m_buffer,1,length,m_file) != length)
+            m_is_error = true;
+        }
+    else if (m_napkin != NULL) {
+        m_buffer[length] = '\0';
+        m_napkin->Append(m_buffer);
+        }
+}
+
+
+void        C_XML_Writer::Append(const T_Glyph * text,long length)
+{
+    long        space;
+
+    /* copy as much as fits into the buffer, flushing it as it fills
+    */
+    while (length > 0) {
+        space = m_end - m_ptr;
+        if (space == 0) {
+            Flush();
+            space = WRITER_BUFFER_SIZE;
+            }
+        if (space > length)
+            space = length;
+        memcpy(m_ptr,text,space);
+        m_ptr += space;
+        text += space;
+        length -= space;
+        }
+}
+
+
+/*  Write blanks to indent a line to the given depth
+*/
+void        C_XML_Writer::Append_Indent(long depth)
+{
+    static  const T_Glyph   l_blanks[] = BLANKS;
+    long                    length;
+
+    for (length = depth * INDENT_PER_LEVEL; length > 0; length -= sizeof(l_blanks) - 1)
+        Append(l_blanks,(length < (long) sizeof(l_blanks) - 1) ? length : sizeof(l_blanks) - 1);
+}
+
+
+/*  Write an attribute value, converting any special characters to entities;
+    runs of characters that need no conversion are copied in one go
+*/
+void        C_XML_Writer::Append_Escaped(const T_Glyph * text)
+{
+    const T_Glyph *     start;
+    const T_Glyph *     entity;
+
+    while (true) {
+        for (start = text; (entity = l_escapes.Get(*text)) == NULL; text++)
+            ;
+        Append(start,text - start);
+        if (*text == '\0')
+            break;
+        Append(entity);
+        text++;
+        }
+}
+
+
+/*  Write PCDATA that holds high-byte characters, which we have to escape; while
+    we're at it, make sure to put CDATA blocks around blocks of whitespace
+    NOTE! Within a CDATA block of whitespace, the character that ends the
+            block is dropped. This has always been the case, and documents rely
+            on being written out exactly the same, so don't change it.
+*/
+void        C_XML_Writer::Append_PCDATA(const T_Glyph * text,bool is_preserve)
+{
+    T_Glyph             ch;
+    const T_Glyph *     start;
+    const T_Glyph *     entity;
+
+    while (*text != '\0') {
+
+        /* copy any run of characters that need no special handling
+        */
+        for (start = text; (l_escapes.Get(*text) == NULL) &&
+                            (*text != '\n') && (*text != '\t') && (*text != ' '); text++)
+            ;
+        Append(start,text - start);
+        if (*text == '\0')
+            break;
+
+        /* proper handle a block of preserved whitespace (if necessary)
+        */
+        ch = *text++;
+        if (Is_Whitespace_Run(ch,text)) {
+            if (is_preserve)
+                Append(ch);
+            else {
+                Append('<');
+                Append(CDATA_START);
+                Append(ch);
+                while (*text != '\0') {
+                    ch = *text++;
+                    if (Is_Whitespace_Run(ch,text))
+                        Append(ch);
+                    else
+                        break;
+                    }
+                Append(CDATA_END);
+                }
+            continue;
+            }
+
+        /* recognize appropriate special characters and output correctly
+        */
+        entity = l_escapes.Get(ch);
+        if (entity == NULL)
+            Append(ch);
+        else
+            Append(entity);
+        }
+}